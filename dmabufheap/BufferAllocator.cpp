@@ -24,6 +24,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <mutex>
@@ -81,6 +85,9 @@ BufferAllocator::BufferAllocator() {
 }
 
 BufferAllocator::~BufferAllocator() {
+    /* Every mapping goes now, so the pool can close buffers that are still mapped */
+    UnmapAll();
+    ClosePool();
     CloseDmabufHeap();
 }
 
@@ -121,6 +128,78 @@ int BufferAllocator::Alloc(const std::string& heap_name, size_t len,
     return fd;
 }
 
+int BufferAllocator::ProbeHeaps() {
+    std::unordered_set<std::string> heap_list;
+    {
+        std::shared_lock<std::shared_mutex> slock(dmabuf_heap_fd_mutex_);
+        if (heaps_probed_) return heap_list_.size();
+    }
+    {
+        std::unique_lock<std::shared_mutex> ulock(dmabuf_heap_fd_mutex_);
+        if (heaps_probed_) return heap_list_.size();
+        heap_list_ = GetDmabufHeapList();
+        uncached_system_heap_ = heap_list_.count(kDmabufSystemUncachedHeapName);
+        heaps_probed_ = true;
+        heap_list = heap_list_;
+    }
+
+    for (auto& heap_name : heap_list) OpenDmabufHeap(heap_name);
+    return heap_list.size();
+}
+
+bool BufferAllocator::UncachedSystemHeapSupported() {
+    ProbeHeaps();
+    std::shared_lock<std::shared_mutex> slock(dmabuf_heap_fd_mutex_);
+    return uncached_system_heap_;
+}
+
+static unsigned long long NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int BufferAllocator::Warmup(const DmabufWarmupBuffer* buffers, size_t count,
+                            DmabufWarmupReport* report) {
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    DmabufWarmupReport done = {};
+    unsigned long long start = NowNs();
+    int ret = 0;
+
+    done.heaps = ProbeHeaps();
+    done.probe_ns = NowNs() - start;
+
+    for (size_t i = 0; i < count && !ret; i++) {
+        std::string heap_name = buffers[i].heap_name ? buffers[i].heap_name : kDmabufSystemHeapName;
+        PoolKey key(heap_name, PoolClassSize(buffers[i].len));
+        std::vector<int> fds;
+
+        start = NowNs();
+        ret = PoolReserve(heap_name, buffers[i].len, buffers[i].count);
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            fds = pool_classes_[key].free_fds;
+            done.buffers += fds.size() + pool_classes_[key].busy;
+            done.bytes += (fds.size() + pool_classes_[key].busy) * key.second;
+        }
+        done.alloc_ns += NowNs() - start;
+        if (ret || !buffers[i].cpu_access) continue;
+
+        /* The mappings stay in the cache, the first Map() of a frame is a lookup */
+        start = NowNs();
+        for (int fd : fds) {
+            volatile uint8_t* addr = static_cast<volatile uint8_t*>(Map(fd, key.second));
+            if (!addr) continue;
+            for (size_t offset = 0; offset < key.second; offset += page) (void)addr[offset];
+            Unmap(fd);
+        }
+        done.fault_ns += NowNs() - start;
+    }
+
+    if (report) *report = done;
+    return ret;
+}
+
 int BufferAllocator::AllocSystem(bool cpu_access_needed, size_t len, unsigned int heap_flags,
                                  size_t legacy_align) {
     if (!cpu_access_needed) {
@@ -128,12 +207,7 @@ int BufferAllocator::AllocSystem(bool cpu_access_needed, size_t len, unsigned in
          * CPU does not need to access allocated buffer so we try to allocate in
          * the 'system-uncached' heap after querying for its existence.
          */
-        static bool uncached_dmabuf_system_heap_support = [this]() -> bool {
-            auto dmabuf_heap_list = this->GetDmabufHeapList();
-            return (dmabuf_heap_list.find(kDmabufSystemUncachedHeapName) != dmabuf_heap_list.end());
-        }();
-
-        if (uncached_dmabuf_system_heap_support)
+        if (UncachedSystemHeapSupported())
             return DmabufAlloc(kDmabufSystemUncachedHeapName, len);
 
         cout << "AllocSystem. don't support system-uncached dma buf." << endl;
@@ -146,6 +220,252 @@ int BufferAllocator::AllocSystem(bool cpu_access_needed, size_t len, unsigned in
     return Alloc(kDmabufSystemHeapName, len, heap_flags, legacy_align);
 }
 
+/*
+ * Size classes are whole pages, exact up to 8 pages and in steps of a quarter
+ * of the power of two below above that, so a class wastes less than 25% and
+ * frame sized buffers of nearby resolutions share a class.
+ */
+size_t BufferAllocator::PoolClassSize(size_t len) {
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    size_t pages = (len + page - 1) / page;
+    size_t step = 1;
+
+    while ((step << 3) <= pages)
+        step <<= 1;
+    return (pages + step - 1) / step * step * page;
+}
+
+int BufferAllocator::PoolAlloc(const std::string& heap_name, size_t len) {
+    PoolKey key(heap_name, PoolClassSize(len));
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        PoolClass& pool_class = pool_classes_[key];
+        if (!pool_class.free_fds.empty()) {
+            int fd = pool_class.free_fds.back();
+            pool_class.free_fds.pop_back();
+            pool_class.busy++;
+            pool_busy_[fd] = key;
+            pool_stats_.hits++;
+            return fd;
+        }
+        pool_stats_.misses++;
+    }
+
+    int fd = Alloc(heap_name, key.second);
+    if (fd < 0) return fd;
+
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    pool_classes_[key].busy++;
+    pool_busy_[fd] = key;
+    return fd;
+}
+
+int BufferAllocator::PoolAllocSystem(bool cpu_access_needed, size_t len) {
+    if (!cpu_access_needed && UncachedSystemHeapSupported())
+        return PoolAlloc(kDmabufSystemUncachedHeapName, len);
+    return PoolAlloc(kDmabufSystemHeapName, len);
+}
+
+int BufferAllocator::PoolRelease(int dmabuf_fd) {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        auto it = pool_busy_.find(dmabuf_fd);
+        if (it == pool_busy_.end()) return -EINVAL;
+
+        PoolClass& pool_class = pool_classes_[it->second];
+        pool_busy_.erase(it);
+        pool_class.busy--;
+        pool_stats_.releases++;
+        /* A buffer still mapped stays, closing it would leave a mapping behind a dead fd number */
+        if (pool_class.free_fds.size() < std::max(kPoolFreePerClass, pool_class.reserve) ||
+            ForgetMapping(dmabuf_fd) == -EBUSY) {
+            pool_class.free_fds.push_back(dmabuf_fd);
+            return 0;
+        }
+        pool_stats_.evictions++;
+    }
+
+    /* Freeing the pages can take a while, keep it out of the lock */
+    close(dmabuf_fd);
+    return 0;
+}
+
+int BufferAllocator::PoolReserve(const std::string& heap_name, size_t len, size_t count) {
+    PoolKey key(heap_name, PoolClassSize(len));
+    size_t have;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        PoolClass& pool_class = pool_classes_[key];
+        pool_class.reserve = count;
+        have = pool_class.free_fds.size() + pool_class.busy;
+    }
+
+    for (; have < count; have++) {
+        int fd = Alloc(heap_name, key.second);
+        if (fd < 0) return fd;
+
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        pool_classes_[key].free_fds.push_back(fd);
+    }
+    return 0;
+}
+
+size_t BufferAllocator::PoolTrim(size_t keep_bytes) {
+    std::vector<std::pair<size_t, PoolClass*>> classes;
+    std::vector<int> fds;
+    size_t free_bytes = 0, trimmed = 0;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        for (auto& it : pool_classes_) {
+            free_bytes += it.second.free_fds.size() * it.first.second;
+            classes.push_back({it.first.second, &it.second});
+        }
+        std::sort(classes.begin(), classes.end(),
+                  [](const std::pair<size_t, PoolClass*>& a, const std::pair<size_t, PoolClass*>& b) {
+                      return a.first > b.first;
+                  });
+        for (auto& it : classes) {
+            std::vector<int> mapped;
+            while (free_bytes > keep_bytes && !it.second->free_fds.empty()) {
+                int fd = it.second->free_fds.back();
+                it.second->free_fds.pop_back();
+                if (ForgetMapping(fd) == -EBUSY) {
+                    mapped.push_back(fd);
+                    continue;
+                }
+                fds.push_back(fd);
+                free_bytes -= it.first;
+                trimmed += it.first;
+                pool_stats_.evictions++;
+            }
+            it.second->free_fds.insert(it.second->free_fds.end(), mapped.begin(), mapped.end());
+        }
+    }
+
+    for (int fd : fds) close(fd);
+    return trimmed;
+}
+
+void BufferAllocator::PoolGetStats(DmabufPoolStats* stats) {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    *stats = pool_stats_;
+    stats->free_buffers = stats->busy_buffers = 0;
+    stats->free_bytes = stats->busy_bytes = 0;
+    for (auto& it : pool_classes_) {
+        stats->free_buffers += it.second.free_fds.size();
+        stats->busy_buffers += it.second.busy;
+        stats->free_bytes += it.second.free_fds.size() * it.first.second;
+        stats->busy_bytes += it.second.busy * it.first.second;
+    }
+}
+
+void BufferAllocator::ClosePool() {
+    for (auto& it : pool_classes_) {
+        std::vector<int> mapped;
+        for (int fd : it.second.free_fds) {
+            if (ForgetMapping(fd) == -EBUSY)
+                mapped.push_back(fd);
+            else
+                close(fd);
+        }
+        it.second.free_fds.swap(mapped);
+    }
+}
+
+void* BufferAllocator::Map(unsigned int dmabuf_fd, size_t len) {
+    struct stat st;
+    if (fstat(dmabuf_fd, &st)) return nullptr;
+
+    std::lock_guard<std::mutex> lock(map_mutex_);
+    auto it = mappings_.find(dmabuf_fd);
+    if (it != mappings_.end()) {
+        Mapping& mapping = it->second;
+        bool same_buffer = mapping.dev == st.st_dev && mapping.ino == st.st_ino;
+        if (same_buffer && mapping.len >= len) {
+            mapping.refs++;
+            mapping.last_use = ++map_tick_;
+            return mapping.addr;
+        }
+        if (same_buffer && mapping.refs) {
+            cout << "Map() of " << len << "B while mapped with " << mapping.len << "B" << endl;
+            return nullptr;
+        }
+        /* The fd number was reused while its closed buffer is still mapped, the Unmap()
+         * of the old holder would count against this one */
+        if (mapping.refs) {
+            cout << "Map() of fd " << dmabuf_fd << " while still mapped for a closed buffer" << endl;
+            return nullptr;
+        }
+        munmap(mapping.addr, mapping.len);
+        mappings_.erase(it);
+    }
+
+    void* addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, dmabuf_fd, 0);
+    if (addr == MAP_FAILED) return nullptr;
+    mappings_[dmabuf_fd] = {addr, len, st.st_dev, st.st_ino, 1, ++map_tick_};
+    return addr;
+}
+
+int BufferAllocator::Unmap(unsigned int dmabuf_fd) {
+    std::lock_guard<std::mutex> lock(map_mutex_);
+    auto it = mappings_.find(dmabuf_fd);
+    if (it == mappings_.end() || !it->second.refs) return -EINVAL;
+
+    if (!--it->second.refs) TrimMappings();
+    return 0;
+}
+
+int BufferAllocator::ForgetMapping(unsigned int dmabuf_fd) {
+    std::lock_guard<std::mutex> lock(map_mutex_);
+    auto it = mappings_.find(dmabuf_fd);
+    if (it == mappings_.end()) return 0;
+    if (it->second.refs) return -EBUSY;
+
+    munmap(it->second.addr, it->second.len);
+    mappings_.erase(it);
+    return 0;
+}
+
+void* BufferAllocator::CpuAccessStart(unsigned int dmabuf_fd, size_t len, SyncType sync_type) {
+    void* addr = Map(dmabuf_fd, len);
+    if (!addr) return nullptr;
+
+    if (CpuSyncStart(dmabuf_fd, sync_type)) {
+        Unmap(dmabuf_fd);
+        return nullptr;
+    }
+    return addr;
+}
+
+int BufferAllocator::CpuAccessEnd(unsigned int dmabuf_fd, SyncType sync_type) {
+    int ret = CpuSyncEnd(dmabuf_fd, sync_type);
+    Unmap(dmabuf_fd);
+    return ret;
+}
+
+/* Called with map_mutex_ held, unmaps the least recently used unused mappings */
+void BufferAllocator::TrimMappings() {
+    size_t idle = 0;
+    for (auto& it : mappings_)
+        idle += !it.second.refs;
+
+    while (idle > kMapCacheIdle) {
+        auto lru = mappings_.end();
+        for (auto it = mappings_.begin(); it != mappings_.end(); ++it) {
+            if (!it->second.refs && (lru == mappings_.end() || it->second.last_use < lru->second.last_use))
+                lru = it;
+        }
+        munmap(lru->second.addr, lru->second.len);
+        mappings_.erase(lru);
+        idle--;
+    }
+}
+
+void BufferAllocator::UnmapAll() {
+    for (auto& it : mappings_) munmap(it.second.addr, it.second.len);
+    mappings_.clear();
+}
+
 int BufferAllocator::DoSync(unsigned int dmabuf_fd, bool start, SyncType sync_type) {
     struct dma_buf_sync sync = {
         .flags = (start ? DMA_BUF_SYNC_START : DMA_BUF_SYNC_END) |
@@ -155,19 +475,138 @@ int BufferAllocator::DoSync(unsigned int dmabuf_fd, bool start, SyncType sync_ty
 }
 
 int BufferAllocator::CpuSyncStart(unsigned int dmabuf_fd, SyncType sync_type) {
-    int ret = DoSync(dmabuf_fd, true /* start */, sync_type);
+    return CpuSyncStart(&dmabuf_fd, 1, sync_type);
+}
+
+int BufferAllocator::CpuSyncStart(const unsigned int* dmabuf_fds, size_t count, SyncType sync_type) {
+    std::vector<unsigned int> fds;
+    struct stat st;
+    int ret = 0;
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        for (size_t i = 0; i < count; i++) {
+            if (!sync_tracking_) {
+                fds.push_back(dmabuf_fds[i]);
+                continue;
+            }
+            if (fstat(dmabuf_fds[i], &st)) {
+                ret = ret ? ret : -errno;
+                continue;
+            }
+            /* Nothing can have changed under the CPU caches since it last owned the buffer */
+            if (LookupSync(dmabuf_fds[i], st).owner != kOwnerDevice) {
+                sync_stats_.elided++;
+                continue;
+            }
+            fds.push_back(dmabuf_fds[i]);
+        }
+    }
 
+    for (unsigned int fd : fds) {
+        int sync_ret = DoSync(fd, true /* start */, sync_type);
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        sync_stats_.issued++;
+        if (sync_ret) {
+            ret = ret ? ret : sync_ret;
+            continue;
+        }
+        auto it = sync_states_.find(fd);
+        if (sync_tracking_ && it != sync_states_.end()) it->second.owner = kOwnerCpu;
+    }
     if (ret) cout << "CpuSyncStart() failure" << endl;
     return ret;
 }
 
 int BufferAllocator::CpuSyncEnd(unsigned int dmabuf_fd, SyncType sync_type) {
+    struct stat st;
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        if (sync_tracking_ && !fstat(dmabuf_fd, &st)) {
+            /* The clean waits for the buffer to be handed to the device */
+            SyncState& state = LookupSync(dmabuf_fd, st);
+            state.owner = kOwnerCpu;
+            state.dirty |= (sync_type & kSyncWrite) != 0;
+            sync_stats_.elided++;
+            return 0;
+        }
+    }
+
     int ret = DoSync(dmabuf_fd, false /* start */, sync_type);
     if (ret) cout << "CpuSyncEnd() failure" << endl;
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    sync_stats_.issued++;
 
     return ret;
 }
 
+int BufferAllocator::SyncForDevice(const DmabufDeviceAccess* accesses, size_t count) {
+    std::vector<unsigned int> fds;
+    struct stat st;
+    int ret = 0;
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        if (!sync_tracking_) return 0;
+        for (size_t i = 0; i < count; i++) {
+            if (fstat(accesses[i].fd, &st)) {
+                ret = ret ? ret : -errno;
+                continue;
+            }
+            SyncState& state = LookupSync(accesses[i].fd, st);
+            if (state.dirty)
+                fds.push_back(accesses[i].fd);
+            else if (state.owner == kOwnerCpu)
+                sync_stats_.elided++;
+            /* A buffer the device only reads keeps what the CPU caches hold valid */
+            if (accesses[i].write || state.owner == kOwnerDevice)
+                state.owner = kOwnerDevice;
+            else
+                state.owner = kOwnerShared;
+            state.dirty = false;
+            sync_stats_.handoffs++;
+        }
+    }
+
+    for (unsigned int fd : fds) {
+        int sync_ret = DoSync(fd, false /* start */, kSyncReadWrite);
+        ret = ret ? ret : sync_ret;
+    }
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    sync_stats_.issued += fds.size();
+    return ret;
+}
+
+void BufferAllocator::SetSyncTracking(bool enable) {
+    std::vector<unsigned int> fds;
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        if (sync_tracking_ == enable) return;
+        sync_tracking_ = enable;
+        for (auto& it : sync_states_) {
+            if (it.second.dirty) fds.push_back(it.first);
+        }
+        sync_states_.clear();
+        sync_stats_.issued += fds.size();
+    }
+
+    for (unsigned int fd : fds) DoSync(fd, false /* start */, kSyncReadWrite);
+}
+
+void BufferAllocator::SyncGetStats(DmabufSyncStats* stats) {
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    *stats = sync_stats_;
+}
+
+/* Called with sync_mutex_ held, a buffer seen for the first time may have been written by the device */
+BufferAllocator::SyncState& BufferAllocator::LookupSync(unsigned int dmabuf_fd, const struct stat& st) {
+    auto it = sync_states_.find(dmabuf_fd);
+    if (it != sync_states_.end() && it->second.dev == st.st_dev && it->second.ino == st.st_ino)
+        return it->second;
+
+    SyncState& state = sync_states_[dmabuf_fd];
+    state = {st.st_dev, st.st_ino, kOwnerDevice, false};
+    return state;
+}
+
 std::unordered_set<std::string> BufferAllocator::GetDmabufHeapList() {
     std::unordered_set<std::string> heap_list;
     std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(kDmaHeapRoot), closedir);
@@ -21,13 +21,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <cstdint>
+#include <map>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 class BufferAllocator {
@@ -114,6 +118,138 @@ class BufferAllocator {
      */
     int CpuSyncEnd(unsigned int dmabuf_fd, SyncType sync_type = kSyncRead);
 
+    /**
+     * Returns a dmabuf fd from the recycling pool of @heap_name, and an error code
+     * otherwise. @len is rounded up to a size class, above 8 pages in steps of a
+     * quarter of a power of two, and a free buffer of that class is handed out when there
+     * is one; only a miss goes to the heap ioctl. The buffer keeps the contents
+     * it had when it was released and must be returned with PoolRelease().
+     */
+    int PoolAlloc(const std::string& heap_name, size_t len);
+
+    /**
+     * Pool counterpart of AllocSystem(), picks the heap the same way.
+     */
+    int PoolAllocSystem(bool cpu_access, size_t len);
+
+    /**
+     * Hands a buffer from PoolAlloc() back. It stays in the pool while its class
+     * holds fewer free buffers than were reserved for it, at least
+     * kPoolFreePerClass, and is closed otherwise, unless it is still mapped.
+     * Returns 0 on success and -EINVAL for an fd the pool did not hand out.
+     */
+    int PoolRelease(int dmabuf_fd);
+
+    /**
+     * Pre-warms the class of @len in @heap_name to @count buffers, free and busy
+     * together, and keeps up to @count free buffers of it from then on.
+     * Returns 0 on success and an error code when the heap ran out.
+     */
+    int PoolReserve(const std::string& heap_name, size_t len, size_t count);
+
+    /**
+     * Closes free buffers, largest classes first, until at most @keep_bytes are
+     * held free, e.g. under memory pressure. Buffers still mapped are kept.
+     * Reservations stay in place and refill on later releases. Returns the
+     * bytes given back.
+     */
+    size_t PoolTrim(size_t keep_bytes);
+
+    void PoolGetStats(DmabufPoolStats* stats);
+
+    /**
+     * Returns a read/write CPU mapping of the first @len bytes of @dmabuf_fd, and
+     * nullptr on failure. The mapping is cached per fd and reference counted,
+     * the first Map() of a buffer mmaps it and later ones are a lookup plus an
+     * fstat() that tells a reused fd number from the buffer it was mapped for.
+     * A larger @len than the cached mapping remaps an unused buffer. Fails for a
+     * mapping in use, of a smaller @len or of a closed buffer whose fd number
+     * was reused, until it is unmapped.
+     */
+    void* Map(unsigned int dmabuf_fd, size_t len);
+
+    /**
+     * Drops a reference taken by Map(). Teardown is lazy, the mapping stays for
+     * the next Map() and only the least recently used of more than
+     * kMapCacheIdle unused mappings are unmapped.
+     * Returns 0 on success and -EINVAL for an fd that is not mapped.
+     */
+    int Unmap(unsigned int dmabuf_fd);
+
+    /**
+     * Unmaps an unused buffer right away. A cached mapping keeps the buffer
+     * alive, so it is called before closing an fd that will not be mapped
+     * again; buffers the pool closes are forgotten by the pool.
+     * Returns 0 on success and -EBUSY while the buffer is mapped.
+     */
+    int ForgetMapping(unsigned int dmabuf_fd);
+
+    /**
+     * Map() followed by CpuSyncStart(), so a buffer accessed every frame is
+     * mapped once for its lifetime and every access is a lookup and a sync.
+     * Returns nullptr if either fails.
+     */
+    void* CpuAccessStart(unsigned int dmabuf_fd, size_t len, SyncType sync_type = kSyncRead);
+
+    /**
+     * CpuSyncEnd() followed by Unmap(), returns the result of the sync.
+     */
+    int CpuAccessEnd(unsigned int dmabuf_fd, SyncType sync_type = kSyncRead);
+
+    /**
+     * Turns ownership tracking of CpuSyncStart()/CpuSyncEnd() on or off. With
+     * tracking each buffer is owned by the CPU, shared after the device only
+     * read it, or owned by the device:
+     *  - CpuSyncStart() invalidates only buffers the device may have written
+     *    since the CPU last owned them.
+     *  - CpuSyncEnd() issues nothing, a CPU write only marks the buffer dirty.
+     *  - SyncForDevice() cleans the dirty buffers before the device accesses
+     *    them, so a buffer written by the CPU must reach the device through it.
+     * Turning tracking off cleans the buffers still dirty.
+     */
+    void SetSyncTracking(bool enable);
+
+    /**
+     * CpuSyncStart() of a set of buffers, e.g. the planes of a frame.
+     * Returns 0 on success and the first error otherwise.
+     */
+    int CpuSyncStart(const unsigned int* dmabuf_fds, size_t count, SyncType sync_type = kSyncRead);
+
+    /**
+     * Hands a set of buffers to the device, cleaning those the CPU wrote since
+     * they were last handed over. Without tracking it does nothing, the
+     * CpuSyncEnd() calls have already cleaned them.
+     * Returns 0 on success and the first error otherwise.
+     */
+    int SyncForDevice(const DmabufDeviceAccess* accesses, size_t count);
+
+    /* Snapshot of the sync counters. */
+    void SyncGetStats(DmabufSyncStats* stats);
+
+    /**
+     * Scans /dev/dma_heap and opens every heap once per allocator, later
+     * allocations and heap queries use what was found.
+     * Returns the number of heaps.
+     */
+    int ProbeHeaps();
+
+    /**
+     * Startup warm-up so the first frame does not pay for opening heaps,
+     * allocating or faulting in buffers: probes the heaps, reserves @count sets
+     * of pool buffers and, for sets with cpu_access, maps them through the
+     * mapping cache and touches every page. @report, if not null, gets what was
+     * done and the time spent in each step.
+     * Returns 0 on success and the error of the first failed allocation
+     * otherwise.
+     */
+    int Warmup(const DmabufWarmupBuffer* buffers, size_t count, DmabufWarmupReport* report);
+
+    /* Unused mappings the cache holds on to */
+    static constexpr size_t kMapCacheIdle = 32;
+
+    /* Free buffers a class keeps without a reservation */
+    static constexpr size_t kPoolFreePerClass = 4;
+
     /**
      * Query supported DMA-BUF heaps.
      *
@@ -129,6 +265,62 @@ class BufferAllocator {
     int DmabufAlloc(const std::string& heap_name, size_t len);
     int DoSync(unsigned int dmabuf_fd, bool start, SyncType sync_type);
     void CloseDmabufHeap();
+    bool UncachedSystemHeapSupported();
+    static size_t PoolClassSize(size_t len);
+    void ClosePool();
+    void TrimMappings();
+    void UnmapAll();
+    struct SyncState;
+    SyncState& LookupSync(unsigned int dmabuf_fd, const struct stat& st);
+
+    /* Buffers of one size class of one heap */
+    struct PoolClass {
+        std::vector<int> free_fds;
+        size_t busy = 0;
+        size_t reserve = 0;
+    };
+    typedef std::pair<std::string, size_t> PoolKey;
+
+    /* Size classes by heap name and class size */
+    std::map<PoolKey, PoolClass> pool_classes_;
+    /* Class of every buffer the pool handed out */
+    std::unordered_map<int, PoolKey> pool_busy_;
+    DmabufPoolStats pool_stats_ = {};
+    /* Protects the pool, never held across the heap ioctl */
+    std::mutex pool_mutex_;
+
+    /* A cached CPU mapping, dev/ino identify the buffer behind the fd */
+    struct Mapping {
+        void* addr;
+        size_t len;
+        dev_t dev;
+        ino_t ino;
+        unsigned int refs;
+        uint64_t last_use;
+    };
+    std::unordered_map<int, Mapping> mappings_;
+    uint64_t map_tick_ = 0;
+    /* Protects the mapping cache */
+    std::mutex map_mutex_;
+
+    /* Who may hold the latest data of a buffer, dev/ino identify the buffer behind the fd */
+    enum SyncOwner { kOwnerDevice, kOwnerShared, kOwnerCpu };
+    struct SyncState {
+        dev_t dev;
+        ino_t ino;
+        SyncOwner owner;
+        bool dirty;
+    };
+    std::unordered_map<int, SyncState> sync_states_;
+    DmabufSyncStats sync_stats_ = {};
+    bool sync_tracking_ = false;
+    /* Protects the sync states, never held across the sync ioctl */
+    std::mutex sync_mutex_;
+
+    /* Heaps found by ProbeHeaps(), under dmabuf_heap_fd_mutex_ */
+    bool heaps_probed_ = false;
+    bool uncached_system_heap_ = false;
+    std::unordered_set<std::string> heap_list_;
 
     /* Stores all open dmabuf_heap handles. */
     std::unordered_map<std::string, int> dmabuf_heap_fds_;
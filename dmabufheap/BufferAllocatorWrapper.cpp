@@ -55,4 +55,109 @@ int DmabufHeapCpuSyncEnd(BufferAllocator* buffer_allocator, unsigned int dmabuf_
         return -EINVAL;
     return buffer_allocator->CpuSyncEnd(dmabuf_fd, sync_type);
 }
+
+int DmabufHeapSetSyncTracking(BufferAllocator* buffer_allocator, bool enable) {
+    if (!buffer_allocator)
+        return -EINVAL;
+    buffer_allocator->SetSyncTracking(enable);
+    return 0;
+}
+
+int DmabufHeapCpuSyncStartMany(BufferAllocator* buffer_allocator, const unsigned int* dmabuf_fds,
+                               size_t count, SyncType sync_type) {
+    if (!buffer_allocator || (count && !dmabuf_fds))
+        return -EINVAL;
+    return buffer_allocator->CpuSyncStart(dmabuf_fds, count, sync_type);
+}
+
+int DmabufHeapSyncForDevice(BufferAllocator* buffer_allocator, const DmabufDeviceAccess* accesses,
+                            size_t count) {
+    if (!buffer_allocator || (count && !accesses))
+        return -EINVAL;
+    return buffer_allocator->SyncForDevice(accesses, count);
+}
+
+int DmabufHeapSyncGetStats(BufferAllocator* buffer_allocator, DmabufSyncStats* stats) {
+    if (!buffer_allocator || !stats)
+        return -EINVAL;
+    buffer_allocator->SyncGetStats(stats);
+    return 0;
+}
+
+int DmabufHeapPoolAlloc(BufferAllocator* buffer_allocator, const char* heap_name, size_t len) {
+    if (!buffer_allocator)
+        return -EINVAL;
+    return buffer_allocator->PoolAlloc(heap_name, len);
+}
+
+int DmabufHeapPoolAllocSystem(BufferAllocator* buffer_allocator, bool cpu_access, size_t len) {
+    if (!buffer_allocator)
+        return -EINVAL;
+    return buffer_allocator->PoolAllocSystem(cpu_access, len);
+}
+
+int DmabufHeapPoolRelease(BufferAllocator* buffer_allocator, int dmabuf_fd) {
+    if (!buffer_allocator)
+        return -EINVAL;
+    return buffer_allocator->PoolRelease(dmabuf_fd);
+}
+
+int DmabufHeapPoolReserve(BufferAllocator* buffer_allocator, const char* heap_name, size_t len,
+                          size_t count) {
+    if (!buffer_allocator)
+        return -EINVAL;
+    return buffer_allocator->PoolReserve(heap_name, len, count);
+}
+
+size_t DmabufHeapPoolTrim(BufferAllocator* buffer_allocator, size_t keep_bytes) {
+    if (!buffer_allocator)
+        return 0;
+    return buffer_allocator->PoolTrim(keep_bytes);
+}
+
+int DmabufHeapPoolGetStats(BufferAllocator* buffer_allocator, DmabufPoolStats* stats) {
+    if (!buffer_allocator || !stats)
+        return -EINVAL;
+    buffer_allocator->PoolGetStats(stats);
+    return 0;
+}
+
+void* DmabufHeapMap(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd, size_t len) {
+    if (!buffer_allocator)
+        return nullptr;
+    return buffer_allocator->Map(dmabuf_fd, len);
+}
+
+int DmabufHeapUnmap(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd) {
+    if (!buffer_allocator)
+        return -EINVAL;
+    return buffer_allocator->Unmap(dmabuf_fd);
+}
+
+int DmabufHeapForgetMapping(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd) {
+    if (!buffer_allocator)
+        return -EINVAL;
+    return buffer_allocator->ForgetMapping(dmabuf_fd);
+}
+
+void* DmabufHeapCpuAccessStart(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd, size_t len,
+                               SyncType sync_type) {
+    if (!buffer_allocator)
+        return nullptr;
+    return buffer_allocator->CpuAccessStart(dmabuf_fd, len, sync_type);
+}
+
+int DmabufHeapCpuAccessEnd(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd,
+                           SyncType sync_type) {
+    if (!buffer_allocator)
+        return -EINVAL;
+    return buffer_allocator->CpuAccessEnd(dmabuf_fd, sync_type);
+}
+
+int DmabufHeapWarmup(BufferAllocator* buffer_allocator, const DmabufWarmupBuffer* buffers,
+                     size_t count, DmabufWarmupReport* report) {
+    if (!buffer_allocator || (count && !buffers))
+        return -EINVAL;
+    return buffer_allocator->Warmup(buffers, count, report);
+}
 }
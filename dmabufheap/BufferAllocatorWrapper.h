@@ -44,6 +44,44 @@ int DmabufHeapCpuSyncStart(BufferAllocator* buffer_allocator, unsigned int dmabu
 int DmabufHeapCpuSyncEnd(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd,
                          SyncType sync_type);
 
+int DmabufHeapSetSyncTracking(BufferAllocator* buffer_allocator, bool enable);
+
+int DmabufHeapCpuSyncStartMany(BufferAllocator* buffer_allocator, const unsigned int* dmabuf_fds,
+                               size_t count, SyncType sync_type);
+
+int DmabufHeapSyncForDevice(BufferAllocator* buffer_allocator, const DmabufDeviceAccess* accesses,
+                            size_t count);
+
+int DmabufHeapSyncGetStats(BufferAllocator* buffer_allocator, DmabufSyncStats* stats);
+
+int DmabufHeapPoolAlloc(BufferAllocator* buffer_allocator, const char* heap_name, size_t len);
+
+int DmabufHeapPoolAllocSystem(BufferAllocator* buffer_allocator, bool cpu_access, size_t len);
+
+int DmabufHeapPoolRelease(BufferAllocator* buffer_allocator, int dmabuf_fd);
+
+int DmabufHeapPoolReserve(BufferAllocator* buffer_allocator, const char* heap_name, size_t len,
+                          size_t count);
+
+size_t DmabufHeapPoolTrim(BufferAllocator* buffer_allocator, size_t keep_bytes);
+
+int DmabufHeapPoolGetStats(BufferAllocator* buffer_allocator, DmabufPoolStats* stats);
+
+void* DmabufHeapMap(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd, size_t len);
+
+int DmabufHeapUnmap(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd);
+
+int DmabufHeapForgetMapping(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd);
+
+void* DmabufHeapCpuAccessStart(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd, size_t len,
+                               SyncType sync_type);
+
+int DmabufHeapCpuAccessEnd(BufferAllocator* buffer_allocator, unsigned int dmabuf_fd,
+                           SyncType sync_type);
+
+int DmabufHeapWarmup(BufferAllocator* buffer_allocator, const DmabufWarmupBuffer* buffers,
+                     size_t count, DmabufWarmupReport* report);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,6 +18,7 @@
 #define DMABUFHEAP_DEF_H_
 
 #include <linux/dma-buf.h>
+#include <stddef.h>
 
 static const char kDmabufSystemHeapName[] = "system";
 static const char kDmabufSystemUncachedHeapName[] = "system-uncached";
@@ -28,4 +29,47 @@ typedef enum {
     kSyncReadWrite = DMA_BUF_SYNC_RW,
 } SyncType;
 
+/* Counters of the recycling pool, see BufferAllocator::PoolGetStats(). */
+typedef struct {
+    unsigned long hits;          /* pool allocations served from a free buffer */
+    unsigned long misses;        /* pool allocations that went to the heap */
+    unsigned long releases;      /* buffers handed back */
+    unsigned long evictions;     /* free buffers closed by release or trim */
+    unsigned long free_buffers;
+    unsigned long busy_buffers;
+    size_t free_bytes;
+    size_t busy_bytes;
+} DmabufPoolStats;
+
+/* A buffer the device is about to access, see BufferAllocator::SyncForDevice(). */
+typedef struct {
+    int fd;
+    int write;                   /* the device writes the buffer, not only reads it */
+} DmabufDeviceAccess;
+
+/* Counters of the sync ownership tracking, see BufferAllocator::SyncGetStats(). */
+typedef struct {
+    unsigned long issued;        /* DMA_BUF_IOCTL_SYNC calls made */
+    unsigned long elided;        /* syncs that would have changed nothing */
+    unsigned long handoffs;      /* buffers handed to the device */
+} DmabufSyncStats;
+
+/* A set of pool buffers BufferAllocator::Warmup() puts in place. */
+typedef struct {
+    const char* heap_name;       /* NULL for the system heap */
+    size_t len;
+    size_t count;
+    int cpu_access;              /* map the buffers and fault in their pages */
+} DmabufWarmupBuffer;
+
+/* What BufferAllocator::Warmup() did and the time it took. */
+typedef struct {
+    unsigned long heaps;         /* heaps found and opened */
+    unsigned long buffers;       /* buffers in the pool for the warmup sets */
+    size_t bytes;
+    unsigned long long probe_ns;
+    unsigned long long alloc_ns;
+    unsigned long long fault_ns;
+} DmabufWarmupReport;
+
 #endif
@@ -0,0 +1,254 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#ifndef __V2D_HPP__
+#define __V2D_HPP__
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "v2d_api.h"
+
+/*
+ * C++17 front end of the job API. A Surface carries its colour format in its
+ * type, so the stride and plane sizes are worked out at compile time and a
+ * task whose formats need a colour space conversion it does not ask for, or
+ * one its CSC mode can not do, does not compile. Everything is inline and
+ * forwards to the V2D_Add*Task calls with the V2D_SURFACE_S the Surface
+ * holds, so a job built here records the same descriptors as the C path.
+ */
+namespace v2d {
+
+enum class ColorKind { kRgb, kYuv, kGrey, kAlpha };
+
+/* what a colour format stores, and its bytes per pixel in the first plane */
+template <V2D_COLOR_FORMAT_E F>
+struct FormatTraits {
+    static_assert(F >= V2D_COLOR_FORMAT_RGB888 && F < V2D_COLOR_FORMAT_BUTT, "not a v2d colour format");
+
+    static constexpr bool kYuv = F == V2D_COLOR_FORMAT_NV12 || F == V2D_COLOR_FORMAT_NV21;
+    static constexpr bool kPalette = (F >= V2D_COLOR_FORMAT_L8_RGBA8888 && F <= V2D_COLOR_FORMAT_L8_RGB565) ||
+                                     (F >= V2D_COLOR_FORMAT_L8_BGRA8888 && F <= V2D_COLOR_FORMAT_L8_BGR565);
+    static constexpr ColorKind kKind = kYuv                           ? ColorKind::kYuv
+                                       : F == V2D_COLOR_FORMAT_Y8     ? ColorKind::kGrey
+                                       : F == V2D_COLOR_FORMAT_A8     ? ColorKind::kAlpha
+                                                                      : ColorKind::kRgb;
+    static constexpr uint32_t kBpp =
+            (F == V2D_COLOR_FORMAT_RGBX8888 || F == V2D_COLOR_FORMAT_RGBA8888 || F == V2D_COLOR_FORMAT_ARGB8888 ||
+             F == V2D_COLOR_FORMAT_BGRX8888 || F == V2D_COLOR_FORMAT_BGRA8888 || F == V2D_COLOR_FORMAT_ABGR8888)
+                    ? 4
+            : (F == V2D_COLOR_FORMAT_RGB888 || F == V2D_COLOR_FORMAT_BGR888 || F == V2D_COLOR_FORMAT_RGBA5658 ||
+               F == V2D_COLOR_FORMAT_ARGB8565 || F == V2D_COLOR_FORMAT_BGRA5658 || F == V2D_COLOR_FORMAT_ABGR8565)
+                    ? 3
+            : (F == V2D_COLOR_FORMAT_RGB565 || F == V2D_COLOR_FORMAT_BGR565) ? 2
+                                                                             : 1;
+
+    /* NV12/NV21 carry a half height interleaved chroma plane right after the luma */
+    static constexpr uint32_t Stride(uint32_t w) { return w * kBpp; }
+    static constexpr size_t LumaSize(uint32_t stride, uint32_t h) { return (size_t)stride * h; }
+    static constexpr size_t ChromaSize(uint32_t stride, uint32_t h) { return kYuv ? (size_t)stride * ((h + 1) / 2) : 0; }
+    static constexpr size_t Size(uint32_t stride, uint32_t h) { return LumaSize(stride, h) + ChromaSize(stride, h); }
+};
+
+/*
+ * Whether a layer of format S can be drawn into a destination of format D
+ * with CSC mode M. Without a mode, a layer has to store the same kind of
+ * colour as the destination, alpha and grey layers go anywhere.
+ */
+template <V2D_CSC_MODE_E M, V2D_COLOR_FORMAT_E S, V2D_COLOR_FORMAT_E D>
+constexpr bool CscValid() {
+    constexpr ColorKind kSrc = FormatTraits<S>::kKind;
+    constexpr ColorKind kDst = FormatTraits<D>::kKind;
+    constexpr bool kRgbSrc = kSrc == ColorKind::kRgb;
+    constexpr bool kRgbDst = kDst == ColorKind::kRgb;
+
+    switch (M) {
+        case V2D_CSC_MODE_RGB_2_BT601WIDE:
+        case V2D_CSC_MODE_RGB_2_BT601NARROW:
+        case V2D_CSC_MODE_RGB_2_BT709WIDE:
+        case V2D_CSC_MODE_RGB_2_BT709NARROW:
+            return kRgbSrc && kDst == ColorKind::kYuv;
+        case V2D_CSC_MODE_BT601WIDE_2_RGB:
+        case V2D_CSC_MODE_BT601NARROW_2_RGB:
+        case V2D_CSC_MODE_BT709WIDE_2_RGB:
+        case V2D_CSC_MODE_BT709NARROW_2_RGB:
+            return kSrc == ColorKind::kYuv && kRgbDst;
+        case V2D_CSC_MODE_RGB_2_GREY:
+            return kRgbSrc && (kDst == ColorKind::kGrey || kDst == ColorKind::kYuv);
+        case V2D_CSC_MODE_RGB_2_RGB:
+            return kRgbSrc && kRgbDst;
+        case V2D_CSC_MODE_BUTT:
+            return kSrc == kDst || kSrc == ColorKind::kAlpha || kSrc == ColorKind::kGrey;
+        default:
+            /* the remaining modes convert between the yuv standards */
+            return M > V2D_CSC_MODE_BT709NARROW_2_RGB && M < V2D_CSC_MODE_RGB_2_GREY && kSrc == ColorKind::kYuv &&
+                   kDst == ColorKind::kYuv;
+    }
+}
+
+/*
+ * A dmabuf backed surface of format F. The surface owns its fd and closes
+ * it, so it is move-only, hand it a dup() to keep the fd. Stride and chroma
+ * offset default to the tightly packed layout.
+ */
+template <V2D_COLOR_FORMAT_E F>
+class Surface {
+  public:
+    using Traits = FormatTraits<F>;
+    static constexpr V2D_COLOR_FORMAT_E kFormat = F;
+
+    Surface() : surface_{} { surface_.fd = -1; surface_.format = F; }
+    Surface(int fd, uint16_t w, uint16_t h) : Surface(fd, w, h, Traits::Stride(w)) {}
+    Surface(int fd, uint16_t w, uint16_t h, uint16_t stride) : surface_{} {
+        surface_.fd = fd;
+        surface_.w = w;
+        surface_.h = h;
+        surface_.stride = stride;
+        surface_.format = F;
+        /* the cpu backend and the driver find the chroma plane at offset */
+        if (Traits::kYuv) surface_.offset = (int)Traits::LumaSize(stride, h);
+    }
+    ~Surface() {
+        if (surface_.fd >= 0) close(surface_.fd);
+    }
+
+    Surface(Surface&& other) noexcept : surface_(other.surface_) { other.surface_.fd = -1; }
+    Surface& operator=(Surface&& other) noexcept {
+        if (this != &other) {
+            if (surface_.fd >= 0) close(surface_.fd);
+            surface_ = other.surface_;
+            other.surface_.fd = -1;
+        }
+        return *this;
+    }
+    Surface(const Surface&) = delete;
+    Surface& operator=(const Surface&) = delete;
+
+    /** Gives up the fd, the surface is left empty. */
+    int Release() {
+        int fd = surface_.fd;
+        surface_.fd = -1;
+        return fd;
+    }
+
+    int fd() const { return surface_.fd; }
+    uint16_t width() const { return surface_.w; }
+    uint16_t height() const { return surface_.h; }
+    uint16_t stride() const { return surface_.stride; }
+    size_t size() const { return Traits::Size(surface_.stride, surface_.h); }
+    V2D_AREA_S rect() const { return V2D_AREA_S{0, 0, surface_.w, surface_.h}; }
+    /* the C view, for calls the wrapper does not cover */
+    V2D_SURFACE_S* get() const { return &surface_; }
+
+  private:
+    /* the C API takes non-const surfaces but does not write to them */
+    mutable V2D_SURFACE_S surface_;
+};
+
+/*
+ * A job being built, ended with End, EndAsync or Record. A job dropped
+ * without ending submits nothing. Task calls return the V2D_Add*Task result,
+ * a job whose Begin failed has no handle and fails every call.
+ */
+class Job {
+  public:
+    Job() : handle_(0) {}
+    explicit Job(V2D_HANDLE handle) : handle_(handle) {}
+    ~Job() {
+        if (handle_) {
+            V2D_ResetJob(handle_);
+            V2D_EndJob(handle_);
+        }
+    }
+
+    Job(Job&& other) noexcept : handle_(other.handle_) { other.handle_ = 0; }
+    Job& operator=(Job&& other) noexcept {
+        std::swap(handle_, other.handle_);
+        return *this;
+    }
+    Job(const Job&) = delete;
+    Job& operator=(const Job&) = delete;
+
+    /** Begins a job on a context, 0 is the default context of V2D_BeginJob. */
+    static Job Begin(V2D_CONTEXT_HANDLE context = 0) {
+        V2D_HANDLE handle = 0;
+        int32_t ret = context ? V2D_BeginContextJob(context, &handle) : V2D_BeginJob(&handle);
+        return Job(ret == SUCCESS ? handle : 0);
+    }
+
+    bool valid() const { return handle_ != 0; }
+    V2D_HANDLE get() const { return handle_; }
+
+    template <V2D_COLOR_FORMAT_E D>
+    int32_t Fill(const Surface<D>& dst, const V2D_AREA_S& rect, uint32_t color) {
+        V2D_FILLCOLOR_S fill_color = {color, D};
+        return V2D_AddFillTask(handle_, dst.get(), const_cast<V2D_AREA_S*>(&rect), &fill_color);
+    }
+
+    /** Copies, scales and rotates, a blit never converts colour, see Convert. */
+    template <V2D_COLOR_FORMAT_E D, V2D_COLOR_FORMAT_E S>
+    int32_t Blit(const Surface<D>& dst, const V2D_AREA_S& dst_rect, const Surface<S>& src,
+                 const V2D_AREA_S& src_rect) {
+        static_assert(CscValid<V2D_CSC_MODE_BUTT, S, D>(), "a blit does not convert colour, use Convert");
+        return V2D_AddBitblitTask(handle_, dst.get(), const_cast<V2D_AREA_S*>(&dst_rect), src.get(),
+                                  const_cast<V2D_AREA_S*>(&src_rect), V2D_CSC_MODE_BUTT);
+    }
+
+    /** A blit through mode M, run as a blend of the background layer alone. */
+    template <V2D_CSC_MODE_E M, V2D_COLOR_FORMAT_E D, V2D_COLOR_FORMAT_E S>
+    int32_t Convert(const Surface<D>& dst, const V2D_AREA_S& dst_rect, const Surface<S>& src,
+                    const V2D_AREA_S& src_rect, V2D_ROTATE_ANGLE_E rotate = V2D_ROT_0) {
+        static_assert(CscValid<M, S, D>(), "the CSC mode can not convert between these formats");
+        V2D_BLEND_CONF_S conf = {};
+        conf.blendlayer[0].blend_area = dst_rect;
+        return V2D_AddBlendTask(handle_, src.get(), const_cast<V2D_AREA_S*>(&src_rect), nullptr, nullptr, nullptr,
+                                nullptr, dst.get(), const_cast<V2D_AREA_S*>(&dst_rect), &conf, V2D_ROT_0, rotate,
+                                V2D_CSC_MODE_BUTT, M, nullptr, V2D_NO_DITHER);
+    }
+
+    /** A foreground blended over a background, each through its own CSC mode. */
+    template <V2D_CSC_MODE_E BackCsc = V2D_CSC_MODE_BUTT, V2D_CSC_MODE_E ForeCsc = V2D_CSC_MODE_BUTT,
+              V2D_COLOR_FORMAT_E D, V2D_COLOR_FORMAT_E B, V2D_COLOR_FORMAT_E F>
+    int32_t Blend(const Surface<D>& dst, const V2D_AREA_S& dst_rect, const Surface<B>& back,
+                  const V2D_AREA_S& back_rect, const Surface<F>& fore, const V2D_AREA_S& fore_rect,
+                  const V2D_BLEND_CONF_S& conf, V2D_ROTATE_ANGLE_E fore_rotate = V2D_ROT_0,
+                  V2D_ROTATE_ANGLE_E back_rotate = V2D_ROT_0, V2D_DITHER_E dither = V2D_NO_DITHER) {
+        static_assert(CscValid<BackCsc, B, D>(), "the background CSC mode can not convert between these formats");
+        static_assert(CscValid<ForeCsc, F, D>(), "the foreground CSC mode can not convert between these formats");
+        static_assert(!FormatTraits<B>::kPalette && !FormatTraits<F>::kPalette, "palette layers need a palette");
+        return V2D_AddBlendTask(handle_, back.get(), const_cast<V2D_AREA_S*>(&back_rect), fore.get(),
+                                const_cast<V2D_AREA_S*>(&fore_rect), nullptr, nullptr, dst.get(),
+                                const_cast<V2D_AREA_S*>(&dst_rect), const_cast<V2D_BLEND_CONF_S*>(&conf),
+                                fore_rotate, back_rotate, ForeCsc, BackCsc, nullptr, dither);
+    }
+
+    /** Gates the tasks added after it, the job takes over the fence. */
+    int32_t AddAcquireFence(int32_t fence) { return V2D_AddAcquireFence(handle_, fence); }
+
+    /** Submits and waits, the job is ended whatever the result. */
+    int32_t End() { return V2D_EndJob(Take()); }
+    /** Submits without waiting, fence is -1 or a sync_file the caller closes. */
+    int32_t EndAsync(int32_t* fence) { return V2D_EndJobAsync(Take(), fence); }
+    /** Ends the job into a template for V2D_ReplayTemplate. */
+    int32_t Record(V2D_TEMPLATE_HANDLE* tmpl) { return V2D_RecordTemplate(Take(), tmpl); }
+
+  private:
+    V2D_HANDLE Take() {
+        V2D_HANDLE handle = handle_;
+        handle_ = 0;
+        return handle;
+    }
+
+    V2D_HANDLE handle_;
+};
+
+}  // namespace v2d
+
+#endif
@@ -16,9 +16,78 @@ extern "C" {
 
 #include "v2d_type.h"
 
+/*****************************************************************************
+ Prototype    : V2D_Open
+ Description  : Open a v2d context on the backend named by the V2D_BACKEND environment
+                variable,"device" (the default),"cpu" or "auto". Jobs are bound to
+                a context with V2D_BeginContextJob. Any number of threads may begin,
+                build and end jobs on the same context at the same time, a single job
+                handle must only be used by one thread at a time.
+ Input        : None
+ Output       : V2D_CONTEXT_HANDLE *phContext
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_Open(V2D_CONTEXT_HANDLE *phContext);
+
+/*****************************************************************************
+ Prototype    : V2D_OpenBackend
+ Description  : Open a v2d context on the given backend. V2D_BACKEND_CPU runs the tasks
+                on the cpu reference implementation,V2D_BACKEND_AUTO uses the device
+                and falls back to the cpu when it cannot be opened. Tasks on the cpu
+                backend have completed when the job has been ended.
+ Input        : V2D_BACKEND_E enBackend
+ Output       : V2D_CONTEXT_HANDLE *phContext
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_OpenBackend(V2D_BACKEND_E enBackend, V2D_CONTEXT_HANDLE *phContext);
+
+/*****************************************************************************
+ Prototype    : V2D_Close
+ Description  : Close a v2d context,the backend is released once the jobs begun on
+                the context have ended.
+ Input        : V2D_CONTEXT_HANDLE hContext
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_Close(V2D_CONTEXT_HANDLE hContext);
+
+/*****************************************************************************
+ Prototype    : V2D_Init
+ Description  : Do the one-off work of the first job up front,open the backend of a
+                context,0 being the default context of V2D_BeginJob,build the host
+                colour conversion tables,start the callback thread of the context,open the
+                host backend drawing unaligned edges for the device and put a job
+                with its task array in the job cache of the calling thread,so the
+                first frame of that thread costs what later ones do.
+ Input        : V2D_CONTEXT_HANDLE hContext
+ Output       : uint64_t *pInitNs,time spent,may be NULL
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_Init(V2D_CONTEXT_HANDLE hContext, uint64_t *pInitNs);
+
+/*****************************************************************************
+ Prototype    : V2D_BeginContextJob
+ Description  : Begin a v2d job on a context opened with V2D_Open.
+ Input        : V2D_CONTEXT_HANDLE hContext
+ Output       : V2D_HANDLE *phHandle
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_BeginContextJob(V2D_CONTEXT_HANDLE hContext, V2D_HANDLE *phHandle);
+
 /*****************************************************************************
  Prototype    : V2D_BeginJob
  Description  : Begin a v2d job,then add task into the job,v2d will finish all the task in the job.
+                The job runs on the process wide default context.
  Input        : V2D_HANDLE *phHandle
  Output       : None
  Return Value :
@@ -27,6 +96,18 @@ extern "C" {
 *****************************************************************************/
 int32_t V2D_BeginJob(V2D_HANDLE *phHandle);
 
+/*****************************************************************************
+ Prototype    : V2D_ResetJob
+ Description  : Drop all tasks and pending fences of a job but keep the handle and its
+                task storage,so the same handle can be filled again from scratch.
+ Input        : V2D_HANDLE hHandle
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_ResetJob(V2D_HANDLE hHandle);
+
 /*****************************************************************************
  Prototype    : V2D_EndJob
  Description  : End a job,all tasks in the job will be submmitted to v2d
@@ -38,6 +119,174 @@ int32_t V2D_BeginJob(V2D_HANDLE *phHandle);
 *****************************************************************************/
 int32_t V2D_EndJob(V2D_HANDLE hHandle);
 
+/*****************************************************************************
+ Prototype    : V2D_EndJobAsync
+ Description  : End a job without waiting,all tasks in the job will be submmitted to v2d
+                and the call returns once they are queued. The caller owns the returned
+                sync_file fd, it signals when the whole job is done and must be closed.
+                -1 is returned when the device did not hand out a fence.
+                The tasks go down in chunks of 64 with at most two chunks queued,so a
+                job of more than 128 tasks blocks here until all but its last two
+                chunks are done.
+                Tasks whose dst_rect the device can not take as it is leave the edges
+                to the host,which draws them off a sw_sync timeline(debugfs). Without
+                it such a task fails here,V2D_EndJob still draws them after its wait.
+ Input        : V2D_HANDLE hHandle
+ Output       : int32_t *pCompleteFence
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_EndJobAsync(V2D_HANDLE hHandle, int32_t *pCompleteFence);
+
+/*****************************************************************************
+ Prototype    : V2D_EndJobCallback
+ Description  : End a job without waiting,pfnCallback is invoked from a library thread
+                with the job result once all tasks in the job are done. Every context
+                has its own thread,callbacks of a context fire in submission order.
+                Tasks left partly to the host need sw_sync as with V2D_EndJobAsync,
+                which also blocks the same way for jobs of more than 128 tasks.
+ Input        : V2D_HANDLE hHandle
+                V2D_JOB_CALLBACK pfnCallback
+                void *pUserData
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_EndJobCallback(V2D_HANDLE hHandle, V2D_JOB_CALLBACK pfnCallback, void *pUserData);
+
+/*****************************************************************************
+ Prototype    : V2D_RecordTemplate
+ Description  : End a job by recording its tasks into an immutable template instead
+                of submitting them,the job handle is released. A job with acquire
+                fences can not be recorded,those belong to one frame.
+ Input        : V2D_HANDLE hHandle
+ Output       : V2D_TEMPLATE_HANDLE *phTemplate
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_RecordTemplate(V2D_HANDLE hHandle, V2D_TEMPLATE_HANDLE *phTemplate);
+
+/*****************************************************************************
+ Prototype    : V2D_ReplayTemplate
+ Description  : Submit the tasks of a template on a context,0 being the default
+                context of V2D_BeginJob,with the buffers in pstBind swapped in. Only
+                fds and offsets are patched,a thread replaying the same template
+                frame after frame reuses the tasks it expanded the first time.
+                acquireFence,-1 for none,is taken over and gates the first task.
+                With pCompleteFence NULL the call waits like V2D_EndJob,otherwise
+                the fence is returned like V2D_EndJobAsync does.
+ Input        : V2D_CONTEXT_HANDLE hContext
+                V2D_TEMPLATE_HANDLE hTemplate
+                const V2D_TEMPLATE_BIND_S *pstBind
+                uint32_t bindCount
+                int32_t acquireFence
+ Output       : int32_t *pCompleteFence
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_ReplayTemplate(V2D_CONTEXT_HANDLE hContext, V2D_TEMPLATE_HANDLE hTemplate, const V2D_TEMPLATE_BIND_S *pstBind,
+                                uint32_t bindCount, int32_t acquireFence, int32_t *pCompleteFence);
+
+/*****************************************************************************
+ Prototype    : V2D_DestroyTemplate
+ Description  : Free a template,replays already submitted are not affected.
+ Input        : V2D_TEMPLATE_HANDLE hTemplate
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_DestroyTemplate(V2D_TEMPLATE_HANDLE hTemplate);
+
+/*****************************************************************************
+ Prototype    : V2D_GetStats
+ Description  : Read the counters and latency histograms of a context,0 reads the
+                default context of V2D_BeginJob. Fails when the library was built
+                without V2D_STATS.
+ Input        : V2D_CONTEXT_HANDLE hContext
+ Output       : V2D_STATS_S *pstStats
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_GetStats(V2D_CONTEXT_HANDLE hContext, V2D_STATS_S *pstStats);
+
+/*****************************************************************************
+ Prototype    : V2D_ResetStats
+ Description  : Clear the counters and latency histograms of a context,0 clears the
+                default context of V2D_BeginJob.
+ Input        : V2D_CONTEXT_HANDLE hContext
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_ResetStats(V2D_CONTEXT_HANDLE hContext);
+
+/*****************************************************************************
+ Prototype    : V2D_TraceEnable
+ Description  : Turn the job trace on or off,jobs begun while it is on are recorded
+                with their submission,fence wait and tasks in per-thread rings.
+                V2D_TRACE=file turns it on from the start and dumps at exit.
+ Input        : int32_t enable
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_TraceEnable(int32_t enable);
+
+/*****************************************************************************
+ Prototype    : V2D_TraceDump
+ Description  : Write the trace recorded since the last dump as Chrome trace event
+                json,for chrome://tracing or ui.perfetto.dev. Tasks of a thread
+                show up once their fence signaled and the thread ended a job or
+                dumped after that.
+ Input        : const char *pFileName
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_TraceDump(const char *pFileName);
+
+/*****************************************************************************
+ Prototype    : V2D_SetDeviceAccessHook
+ Description  : Have every job of a context report the buffers it is about to hand to
+                the backend,before it is submitted,e.g. so the buffer allocator can
+                track which buffers the device owns and clean only those the cpu
+                wrote. Each fd is reported once per call,a job may take several calls.
+                A hContext of 0 sets the hook of the default context of V2D_BeginJob.
+                Set it before jobs are ended,NULL turns it off.
+ Input        : V2D_CONTEXT_HANDLE hContext
+                V2D_DEVICE_ACCESS_HOOK pfnHook
+                void *pUserData
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_SetDeviceAccessHook(V2D_CONTEXT_HANDLE hContext, V2D_DEVICE_ACCESS_HOOK pfnHook, void *pUserData);
+
+/*****************************************************************************
+ Prototype    : V2D_AddAcquireFence
+ Description  : add an input fence,v2d waits for it before running the task added last.
+                Called before any task is added,it applies to the first task of the job.
+                May be called once per input surface,the fences are merged.
+                The library takes ownership of fenceFd and closes it.
+ Input        : V2D_HANDLE hHandle
+                int32_t fenceFd
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_AddAcquireFence(V2D_HANDLE hHandle, int32_t fenceFd);
+
 /*****************************************************************************
  Prototype    : V2D_AddFillTask
  Description  : add a Fill task into a job
@@ -87,6 +336,207 @@ int32_t V2D_AddBlendTask(V2D_HANDLE hHandle,
                              V2D_PALETTE_S *pstPalette,
                              V2D_DITHER_E dither);
 
+/*****************************************************************************
+ Prototype    : V2D_CreatePalette
+ Description  : upload a palette once,the handle can be referenced by many tasks and jobs
+                through V2D_SetTaskPalette instead of passing the palette by value.
+ Input        : V2D_PALETTE_S *pstPalette
+ Output       : V2D_PALETTE_HANDLE *phPalette
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_CreatePalette(V2D_PALETTE_S *pstPalette, V2D_PALETTE_HANDLE *phPalette);
+
+/*****************************************************************************
+ Prototype    : V2D_DestroyPalette
+ Description  : release a palette handle,tasks still referencing it keep it alive.
+ Input        : V2D_PALETTE_HANDLE hPalette
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_DestroyPalette(V2D_PALETTE_HANDLE hPalette);
+
+/*****************************************************************************
+ Prototype    : V2D_SetTaskPalette
+ Description  : use an uploaded palette for the task added last.
+ Input        : V2D_HANDLE hHandle
+                V2D_PALETTE_HANDLE hPalette
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_SetTaskPalette(V2D_HANDLE hHandle, V2D_PALETTE_HANDLE hPalette);
+
+/*****************************************************************************
+ Prototype    : V2D_CscImage
+ Description  : Convert an image in process memory on the cpu,with the colour space
+                conversion of enMode,or only the format for V2D_CSC_MODE_BUTT. Both
+                images have the same size,NV12/NV21 output takes its chroma from the
+                top left pixel of each 2x2 block. Uses the kernels of V2D_SetCpuIsa.
+                Every mode rounds its coefficients and bias the way the block does,
+                only V2D_CSC_MODE_BT601NARROW_2_RGB is checked bit exact against the
+                block's output,the others may differ from it by one level.
+ Input        : V2D_IMAGE_S *pstSrc
+                V2D_IMAGE_S *pstDst
+                V2D_CSC_MODE_E enMode
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_CscImage(V2D_IMAGE_S *pstSrc, V2D_IMAGE_S *pstDst, V2D_CSC_MODE_E enMode);
+
+/*****************************************************************************
+ Prototype    : V2D_SetCpuIsa
+ Description  : Pick the kernels of V2D_CscImage,V2D_RotateImage and the cpu backend,
+                "scalar" or "generic",e.g. to compare them. NULL goes back to
+                V2D_CPU_ISA,read once,or generic without it. Fails for other names.
+ Input        : const char *pIsa
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_SetCpuIsa(const char *pIsa);
+
+/*****************************************************************************
+ Prototype    : V2D_RotateImage
+ Description  : Rotate,mirror or flip an image in process memory on the cpu,like
+                the layer rotation of a blend task. pstDst has the same format,with
+                width and height swapped for V2D_ROT_90/V2D_ROT_270. Passing the same
+                image as pstSrc and pstDst rotates in place,which needs a square
+                image for V2D_ROT_90/V2D_ROT_270. Other overlaps are not allowed.
+ Input        : V2D_IMAGE_S *pstSrc
+                V2D_IMAGE_S *pstDst
+                V2D_ROTATE_ANGLE_E enRotate
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_RotateImage(V2D_IMAGE_S *pstSrc, V2D_IMAGE_S *pstDst, V2D_ROTATE_ANGLE_E enRotate);
+
+/*****************************************************************************
+ Prototype    : V2D_FbcDecode
+ Description  : Decode an FBC surface on the cpu,pBuf holds its header followed by
+                the payload like the buffer of fbcDecInfo.fd. pstDst has the size of
+                the picture and the format of enFbcdecFmt,only the pixels inside the
+                bbox are written,a superblock at a time.
+ Input        : FBC_DECODER_S *pstFbc
+                const void *pBuf
+                size_t size
+ Output       : V2D_IMAGE_S *pstDst
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_FbcDecode(FBC_DECODER_S *pstFbc, const void *pBuf, size_t size, V2D_IMAGE_S *pstDst);
+
+/*****************************************************************************
+ Prototype    : V2D_FbcBufferSize
+ Description  : Bytes of the buffer an FBC surface of w x h needs,the header and
+                a payload slot of raw size per 16x16 superblock starting at the
+                offset of pstFbc,or right behind the header when it is smaller.
+ Input        : FBC_ENCODER_S *pstFbc
+                uint16_t w
+                uint16_t h
+ Output       : None
+ Return Value : bytes,0 for an unknown format
+ Calls        :
+ Called By    :
+*****************************************************************************/
+size_t V2D_FbcBufferSize(FBC_ENCODER_S *pstFbc, uint16_t w, uint16_t h);
+
+/*****************************************************************************
+ Prototype    : V2D_FbcEncode
+ Description  : Encode an image in process memory into an FBC surface on the cpu,
+                in the header and payload layout of fbcEncInfo.fd that the block
+                and V2D_FbcDecode read. pstSrc has the format of enFbcencFmt,the
+                superblocks the bbox touches are written whole. pUsed returns the
+                header and payload bytes written,the bytes a read of the surface
+                fetches,and may be NULL.
+ Input        : FBC_ENCODER_S *pstFbc
+                V2D_IMAGE_S *pstSrc
+                void *pBuf
+                size_t size
+ Output       : size_t *pUsed
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_FbcEncode(FBC_ENCODER_S *pstFbc, V2D_IMAGE_S *pstSrc, void *pBuf, size_t size, size_t *pUsed);
+
+/*****************************************************************************
+ Prototype    : V2D_LoaderOpen
+ Description  : Open an image or a sequence of raw frames of frameSize bytes for
+                loading into buffer mappings,0 takes the whole file as one frame.
+                Regular files are mapped and copied from,other files or
+                V2D_LOADER=read use large preads straight into the destination.
+ Input        : const char *pFileName
+                size_t frameSize
+ Output       : V2D_LOADER_HANDLE *phLoader
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_LoaderOpen(const char *pFileName, size_t frameSize, V2D_LOADER_HANDLE *phLoader);
+
+/*****************************************************************************
+ Prototype    : V2D_LoaderFrames
+ Description  : Number of whole frames in the file of a loader.
+ Input        : V2D_LOADER_HANDLE hLoader
+ Output       : uint32_t *pFrames
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_LoaderFrames(V2D_LOADER_HANDLE hLoader, uint32_t *pFrames);
+
+/*****************************************************************************
+ Prototype    : V2D_LoaderRead
+ Description  : Copy a frame into pDst,failing when size is smaller than a frame,
+                and start prefetching the next frame,wrapping around at the end,
+                in the background.
+ Input        : V2D_LOADER_HANDLE hLoader
+                uint32_t frame
+                void *pDst
+                size_t size
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_LoaderRead(V2D_LOADER_HANDLE hLoader, uint32_t frame, void *pDst, size_t size);
+
+/*****************************************************************************
+ Prototype    : V2D_LoaderClose
+ Description  : Close a loader and stop its prefetching.
+ Input        : V2D_LOADER_HANDLE hLoader
+ Output       : None
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_LoaderClose(V2D_LOADER_HANDLE hLoader);
+
+/*****************************************************************************
+ Prototype    : V2D_LoadFile
+ Description  : Load a whole file into pDst,failing when it is larger than size.
+                pLoaded returns the bytes loaded and may be NULL.
+ Input        : const char *pFileName
+                void *pDst
+                size_t size
+ Output       : size_t *pLoaded
+ Return Value :
+ Calls        :
+ Called By    :
+*****************************************************************************/
+int32_t V2D_LoadFile(const char *pFileName, void *pDst, size_t size, size_t *pLoaded);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -32,7 +32,22 @@ typedef unsigned short uint16_t;
 typedef unsigned int uint32_t;
 typedef unsigned long uint64_t;
 typedef uint64_t V2D_HANDLE;
+typedef uint64_t V2D_PALETTE_HANDLE;
+typedef uint64_t V2D_CONTEXT_HANDLE;
+typedef uint64_t V2D_LOADER_HANDLE;
+typedef uint64_t V2D_TEMPLATE_HANDLE;
+#ifndef __cplusplus
 typedef int bool;
+#endif
+/* flags of the structs below, int sized in C and C++ alike */
+typedef int V2D_BOOL;
+
+typedef enum SPACEMIT_V2D_BACKEND_E {
+    V2D_BACKEND_DEVICE  =0,
+    V2D_BACKEND_CPU     =1,
+    V2D_BACKEND_AUTO    =2,
+    V2D_BACKEND_BUTT
+} V2D_BACKEND_E;
 
 typedef enum SPACEMIT_V2D_INPUT_LAYER_E {
     V2D_INPUT_LAYER0    =0,
@@ -202,12 +217,12 @@ typedef struct SPACEMIT_V2D_FILLCOLOR_S {
 
 typedef struct SPACEMIT_V2D_BACKGROUND_S {
     V2D_FILLCOLOR_S fillcolor;
-    bool enable;
+    V2D_BOOL enable;
 } V2D_BACKGROUND_S;
 
 typedef struct SPACEMIT_V2D_SOLIDCOLOR_S {
     V2D_FILLCOLOR_S fillcolor;
-    bool enable;
+    V2D_BOOL enable;
 } V2D_SOLIDCOLOR_S;
 
 typedef struct SPACEMIT_V2D_PALETTE_S {
@@ -223,8 +238,8 @@ typedef struct SPACEMIT_FBC_DECODER_S {
     uint16_t bboxRight;
     uint16_t bboxTop;
     uint16_t bboxBottom;
-    bool rgb_pack_en;
-    bool is_split;
+    V2D_BOOL rgb_pack_en;
+    V2D_BOOL is_split;
     FBC_DECODER_MODE_E   enFbcdecMode;
     FBC_DECODER_FORMAT_E enFbcdecFmt;
 } FBC_DECODER_S;
@@ -241,13 +256,23 @@ typedef struct SPACEMIT_FBC_ENCODER_S {
     uint16_t bboxRight;
     uint16_t bboxTop;
     uint16_t bboxBottom;
-    bool is_split;
+    V2D_BOOL is_split;
     FBC_ENCODER_FORMAT_E enFbcencFmt;
 } FBC_ENCODER_S;
 
+/* image in process memory, for the host side conversion helpers */
+typedef struct SPACEMIT_V2D_IMAGE_S {
+    void *pData;        /* first plane */
+    void *pUv;          /* interleaved chroma plane of NV12/NV21 */
+    uint32_t stride;    /* bytes per row, shared by both planes */
+    uint16_t w;
+    uint16_t h;
+    V2D_COLOR_FORMAT_E format;
+} V2D_IMAGE_S;
+
 typedef struct SPACEMIT_V2D_SURFACE_S {
     struct {
-        bool fbc_enable;
+        V2D_BOOL fbc_enable;
         int fd;
         int offset;
         uint32_t phyaddr_y_l;
@@ -315,6 +340,50 @@ typedef struct {
     V2D_PALETTE_S palette;
 } V2D_PARAM_S;
 
+typedef void (*V2D_JOB_CALLBACK)(int32_t result, void *pUserData);
+
+/* a buffer a job hands to the backend, write is set for the destination */
+typedef struct SPACEMIT_V2D_BUFFER_ACCESS_S {
+    int32_t fd;
+    int32_t write;
+} V2D_BUFFER_ACCESS_S;
+
+typedef void (*V2D_DEVICE_ACCESS_HOOK)(const V2D_BUFFER_ACCESS_S *pstAccess, uint32_t count, void *pUserData);
+
+/* a buffer a template was recorded with and the one a replay uses instead */
+typedef struct SPACEMIT_V2D_TEMPLATE_BIND_S {
+    int32_t fd;                 /* fd as recorded */
+    int32_t newFd;
+    int32_t offset;             /* added to the offsets recorded with fd */
+} V2D_TEMPLATE_BIND_S;
+
+/*
+ * Latencies are bucketed by powers of two in microseconds, bucket i counts
+ * samples in [2^i, 2^(i+1)) us, the first one everything below 2 us and the
+ * last one everything above.
+ */
+#define V2D_STATS_BUCKETS 24
+typedef struct SPACEMIT_V2D_LATENCY_S {
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint32_t buckets[V2D_STATS_BUCKETS];
+} V2D_LATENCY_S;
+
+typedef struct SPACEMIT_V2D_STATS_S {
+    uint64_t jobs;              /* jobs ended */
+    uint64_t tasks;             /* tasks handed to the backend */
+    uint64_t bytes;             /* pixel bytes the submitted tasks read and write */
+    uint64_t timeouts;          /* fence waits that timed out */
+    uint64_t failures;          /* jobs that failed to submit or complete */
+    uint64_t widened;           /* tasks moved onto the dst alignment of the backend */
+    uint64_t fixups;            /* tasks whose unaligned edges were drawn on the host */
+    uint64_t fixupPixels;       /* destination pixels the host drew for them */
+    V2D_LATENCY_S build;        /* first AddTask to submit */
+    V2D_LATENCY_S submit;       /* submit to the backend accepting the last chunk */
+    V2D_LATENCY_S complete;     /* accept to the job fence signaling, fenced jobs the library waits on */
+} V2D_STATS_S;
+
 typedef struct  {
     V2D_PARAM_S param;
     int32_t acquireFencefd;
@@ -8,272 +8,2143 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
 #include "pthread.h"
-#include "v2d_type.h"
+#include "v2d_backend.h"
+#include "v2d_cpu.h"
+#include "v2d_trace.h"
 #include <poll.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/sync_file.h>
 
-int gFd = -1;
+typedef enum SPACEMIT_V2D_TASK_TYPE_E
+{
+	TASK_NONE   = 0,
+	ROTATION   = 1,
+	CSC  = 2,
+	FILL = 3,
+	BLEND = 3,
+} V2D_TASK_TYPE_E;
+
+#define BACKEND_ENV "V2D_BACKEND"
+/* overrides the dst alignment of the backend, e.g. to run the device rules on the cpu */
+#define ALIGN_ENV "V2D_DST_ALIGN"
+/* 1 or 0 overrides whether the backend may widen unaligned tasks, see V2dAlignTask */
+#define WIDEN_ENV "V2D_DST_WIDEN"
+/* tasks handed to the backend per submission, longer jobs are split into chunks */
+#define MAX_TASK_LIST_LENGTH 64
+#define MAX_CHUNKS_IN_FLIGHT 2
+#define JOB_CACHE_DEPTH 2
+/* jobs that grew beyond this give their task storage back when they end */
+#define JOB_CACHE_MAX_TASKS (16 * MAX_TASK_LIST_LENGTH)
+
+/* sw_sync timeline signaling host fix-ups drawn by the waiter, optional as it needs debugfs */
+#define SW_SYNC_FILE "/sys/kernel/debug/sync/sw_sync"
+struct sw_sync_create_fence_data
+{
+	uint32_t value;
+	char name[32];
+	int32_t fence;
+};
+#define SW_SYNC_IOC_CREATE_FENCE _IOWR('W', 0, struct sw_sync_create_fence_data)
+#define SW_SYNC_IOC_INC          _IOW('W', 1, uint32_t)
+
+/*
+ * Completion callbacks are fired by a waiter thread per context. Jobs of a
+ * context finish in submission order, so it simply waits on the pending
+ * fences first in, first out, and neither a slow fence nor a blocking
+ * callback of one context holds up the callbacks of another. Spent records
+ * are kept on a free list, queuing a callback does not allocate once warm.
+ * The same queue draws the host fix-ups of jobs once their fence signals, a
+ * record carrying fix-ups has no callback and advances the fix-up timeline.
+ */
+typedef struct SPACEMIT_V2D_CALLBACK_S
+{
+	int fence;
+	uint64_t acceptNs;
+	V2D_JOB_CALLBACK pfnCallback;
+	void *pUserData;
+	/* swapped with the fix-up array of a job, so it stays with the record on the free list */
+	V2D_TASK_S *pstFixups;
+	uint32_t fixupCount;
+	uint32_t fixupCapacity;
+	struct SPACEMIT_V2D_CALLBACK_S *pNext;
+} V2D_CALLBACK_S;
+
+/*
+ * A context owns one open instance of a backend, the device or the CPU
+ * reference. Jobs hold a reference on the context they were begun on, so
+ * V2D_Close never pulls the backend from under a job that is still being
+ * built or submitted. V2D_BeginJob uses a process wide default context whose
+ * backend is picked from V2D_BACKEND and opened on first submission.
+ */
+typedef struct SPACEMIT_V2D_CONTEXT_S
+{
+	V2D_BACKEND_E enBackend;
+	const V2D_BACKEND_S *pBackend; /* set once the backend is open */
+	void *pPriv;
+	int refs;
+	pthread_mutex_t lock;
+	/* callback queue under lock, each queued record holds a reference on the context */
+	pthread_cond_t cbCond;
+	V2D_CALLBACK_S *pCbHead;
+	V2D_CALLBACK_S *pCbTail;
+	V2D_CALLBACK_S *pCbFree;
+	pthread_t cbTid;
+	int cbRunning;
+	int cbQuit;
+#ifdef V2D_STATS
+	V2D_STATS_S stStats; /* updated with relaxed atomics by every thread ending jobs */
+#endif
+	uint32_t dstAlign; /* set with pBackend */
+	uint32_t dstWiden;
+	void *pFixupPriv; /* cpu backend drawing unaligned edges, opened on first use */
+	/* under lock, the sw_sync timeline is -1 until first used and -2 without sw_sync */
+	int fixupTimeline;
+	uint32_t fixupPoint;
+	int hostFence; /* signals once the fix-ups queued last are drawn */
+	/* V2D_SetDeviceAccessHook, under lock */
+	V2D_DEVICE_ACCESS_HOOK pfnAccessHook;
+	void *pAccessUser;
+} V2D_CONTEXT_S;
+
+static V2D_CONTEXT_S gDefaultContext = {
+	.enBackend = V2D_BACKEND_BUTT,
+	.refs = 1,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cbCond = PTHREAD_COND_INITIALIZER,
+	.dstAlign = 0,
+	.fixupTimeline = -1,
+	.hostFence = -1,
+};
+
+typedef struct SPACEMIT_V2D_PALETTE_OBJ_S
+{
+	int refs;
+	V2D_PALETTE_S stPalette;
+} V2D_PALETTE_OBJ_S;
+
+/* optional sections of a task descriptor, one bit per V2D_PARAM_S surface plus the palette */
+#define DESC_LAYER0     (1 << 0)
+#define DESC_LAYER1     (1 << 1)
+#define DESC_MASK       (1 << 2)
+#define DESC_DST        (1 << 3)
+#define DESC_PALETTE    (1 << 4)
+#define DESC_SURFACE_NUM 4
+/* distinct buffers reported to the device access hook per call */
+#define ACCESS_BATCH 32
+
+/*
+ * Compact form of a task as recorded by the V2D_Add*Task calls. Surfaces
+ * live once per job in a table and are referenced by index, absent layers
+ * and the palette are simply not present. The descriptor is expanded into
+ * the V2D_SUBMIT_TASK_S the driver expects right before submission.
+ */
+typedef struct SPACEMIT_V2D_TASK_DESC_S
+{
+	uint8_t sections;
+	uint8_t l0_rt;
+	uint8_t l1_rt;
+	uint8_t l0_csc;
+	uint8_t l1_csc;
+	uint8_t dither;
+	uint8_t type; /* V2D_TRACE_TASK_E */
+	uint32_t surface[DESC_SURFACE_NUM];
+	V2D_AREA_S rect[DESC_SURFACE_NUM];
+	V2D_BLEND_CONF_S blendconf;
+	V2D_PALETTE_OBJ_S *pPalette;
+	int acquireFence;
+} V2D_TASK_DESC_S;
+
+/*
+ * A recorded job, its descriptors and surfaces frozen as they were added.
+ * A replay patches buffers into a copy of the small surface table and
+ * borrows the descriptors, they never carry acquire fences so nothing writes
+ * to them. Templates are told apart by id, a job whose staging slots still
+ * hold the tasks of a template expanded only patches fds and offsets.
+ */
+typedef struct SPACEMIT_V2D_TEMPLATE_S
+{
+	uint64_t id;
+	uint32_t count;
+	uint32_t surfaceCount;
+	V2D_TASK_DESC_S *pstDesc;
+	V2D_SURFACE_S *pstSurfaces;
+} V2D_TEMPLATE_S;
+
+static uint64_t gTemplateId = 0;
+
+typedef struct SPACEMIT_VGS_JOB_S
+{
+	uint32_t count;
+	V2D_TASK_TYPE_E  currentTaskState;
+	int pendingAcquireFence;
+	uint32_t capacity;
+	uint32_t surfaceCount;
+	uint32_t stagingCount;
+	/* monotonic timestamps of the first AddTask, the submission and the backend accepting it */
+	uint64_t addNs;
+	uint64_t submitNs;
+	uint64_t acceptNs;
+	uint32_t accepted; /* tasks the backend took */
+	/* id and V2D_BeginJob time of a job begun while tracing, the id is 0 otherwise */
+	uint64_t traceId;
+	uint64_t traceNs;
+	V2D_CONTEXT_S *pContext;
+	struct SPACEMIT_VGS_JOB_S *pNextFree;
+	/* descriptors and surfaces grow with the job, capacity tasks and 4x as many surfaces */
+	V2D_TASK_DESC_S *pstDesc;
+	V2D_SURFACE_S *pstSurfaces;
+	/* template a replay borrows pstDesc from, and the one the staging slots hold expanded under stagedAlign and stagedWiden */
+	const V2D_TEMPLATE_S *pTemplate;
+	uint64_t stagedTemplate;
+	uint32_t stagedAlign;
+	uint32_t stagedWiden;
+	/* host fix-ups of tasks already queued, drawn once they complete */
+	V2D_TASK_S *pstFixups;
+	uint32_t fixupCount;
+	uint32_t fixupCapacity;
+	/* one chunk of expanded tasks, kept with the job so unused sections stay zero across reuse */
+	uint8_t au8StagingSections[MAX_TASK_LIST_LENGTH];
+	V2D_TASK_S astTasks[MAX_TASK_LIST_LENGTH];
+} V2D_JOB_S;
+
+static V2D_PALETTE_OBJ_S *V2dNewPalette(V2D_PALETTE_S *pstPalette)
+{
+	V2D_PALETTE_OBJ_S *pPalette = (V2D_PALETTE_OBJ_S *)malloc(sizeof(V2D_PALETTE_OBJ_S));
+	if (!pPalette)
+		return NULL;
+	pPalette->refs = 1;
+	memcpy(&pPalette->stPalette, pstPalette, sizeof(V2D_PALETTE_S));
+	return pPalette;
+}
+
+static V2D_PALETTE_OBJ_S *V2dRefPalette(V2D_PALETTE_OBJ_S *pPalette)
+{
+	__atomic_add_fetch(&pPalette->refs, 1, __ATOMIC_RELAXED);
+	return pPalette;
+}
+
+static void V2dPutPalette(V2D_PALETTE_OBJ_S *pPalette)
+{
+	if (pPalette && __atomic_sub_fetch(&pPalette->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(pPalette);
+}
+
+static V2D_CONTEXT_S *V2dRefContext(V2D_CONTEXT_S *pstContext)
+{
+	__atomic_add_fetch(&pstContext->refs, 1, __ATOMIC_RELAXED);
+	return pstContext;
+}
+
+static void V2dDestroyContext(V2D_CONTEXT_S *pstContext)
+{
+	V2D_CALLBACK_S *pCb;
+
+	/* no callback is pending, the waiter is idle unless it dropped the last reference itself */
+	if (pstContext->cbRunning)
+	{
+		if (pthread_equal(pstContext->cbTid, pthread_self()))
+		{
+			pthread_detach(pstContext->cbTid);
+		}
+		else
+		{
+			pthread_mutex_lock(&pstContext->lock);
+			pstContext->cbQuit = 1;
+			pthread_cond_signal(&pstContext->cbCond);
+			pthread_mutex_unlock(&pstContext->lock);
+			pthread_join(pstContext->cbTid, NULL);
+		}
+	}
+	while ((pCb = pstContext->pCbFree))
+	{
+		pstContext->pCbFree = pCb->pNext;
+		free(pCb->pstFixups);
+		free(pCb);
+	}
+	if (pstContext->pBackend)
+		pstContext->pBackend->close(pstContext->pPriv);
+	if (pstContext->pFixupPriv)
+		gV2dCpuBackend.close(pstContext->pFixupPriv);
+	if (pstContext->fixupTimeline >= 0)
+		close(pstContext->fixupTimeline);
+	if (pstContext->hostFence >= 0)
+		close(pstContext->hostFence);
+	pthread_cond_destroy(&pstContext->cbCond);
+	pthread_mutex_destroy(&pstContext->lock);
+	free(pstContext);
+}
+
+/* returns 1 when this was the last reference and the context is gone */
+static int V2dPutContext(V2D_CONTEXT_S *pstContext)
+{
+	if (__atomic_sub_fetch(&pstContext->refs, 1, __ATOMIC_ACQ_REL))
+		return 0;
+	V2dDestroyContext(pstContext);
+	return 1;
+}
+
+#ifdef V2D_STATS
+static uint64_t V2dStatNow(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+static void V2dStatAdd(uint64_t *pCounter, uint64_t value)
+{
+	__atomic_add_fetch(pCounter, value, __ATOMIC_RELAXED);
+}
+
+/* the sample count is the sum of the buckets, V2D_GetStats fills it in */
+static void V2dStatLatency(V2D_LATENCY_S *pstLatency, uint64_t startNs, uint64_t endNs)
+{
+	uint64_t ns, us, max;
+	int bucket = 0;
+
+	if (!startNs || endNs < startNs)
+		return;
+	ns = endNs - startNs;
+	us = ns / 1000;
+	if (us > 1)
+		bucket = 63 - __builtin_clzl(us);
+	if (bucket >= V2D_STATS_BUCKETS)
+		bucket = V2D_STATS_BUCKETS - 1;
+	__atomic_add_fetch(&pstLatency->buckets[bucket], 1, __ATOMIC_RELAXED);
+	V2dStatAdd(&pstLatency->totalNs, ns);
+	max = __atomic_load_n(&pstLatency->maxNs, __ATOMIC_RELAXED);
+	while (ns > max && !__atomic_compare_exchange_n(&pstLatency->maxNs, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static uint64_t V2dStatSurfaceBytes(const V2D_SURFACE_S *pstSurface, const V2D_AREA_S *pRect)
+{
+	uint64_t pixels = (uint64_t)pRect->w * pRect->h;
+
+	if (pstSurface->solidcolor.enable)
+		return 0;
+	if (pstSurface->format == V2D_COLOR_FORMAT_NV12 || pstSurface->format == V2D_COLOR_FORMAT_NV21)
+		return pixels * 3 / 2;
+	return pixels * V2dCpuBpp(pstSurface->format);
+}
+
+/* accounts a queued job once, the counters of a context are shared by all threads */
+static void V2dStatJob(V2D_JOB_S *pstV2dJob, int ret)
+{
+	V2D_STATS_S *pstStats = &pstV2dJob->pContext->stStats;
+	V2D_TASK_DESC_S *pDesc = pstV2dJob->pstDesc;
+	uint64_t bytes = 0;
+	uint32_t i;
+	int layer;
+
+	for (i=0; i<pstV2dJob->accepted; i++, pDesc++)
+	{
+		for (layer=0; layer<DESC_SURFACE_NUM; layer++)
+		{
+			if (pDesc->sections & (1 << layer))
+				bytes += V2dStatSurfaceBytes(&pstV2dJob->pstSurfaces[pDesc->surface[layer]], &pDesc->rect[layer]);
+		}
+	}
+	V2dStatAdd(&pstStats->jobs, 1);
+	if (pstV2dJob->accepted)
+	{
+		V2dStatAdd(&pstStats->tasks, pstV2dJob->accepted);
+		V2dStatAdd(&pstStats->bytes, bytes);
+	}
+	if (ret)
+	{
+		V2dStatAdd(&pstStats->failures, 1);
+		return;
+	}
+	V2dStatLatency(&pstStats->build, pstV2dJob->addNs, pstV2dJob->submitNs);
+	V2dStatLatency(&pstStats->submit, pstV2dJob->submitNs, pstV2dJob->acceptNs);
+}
+
+static void V2dStatAlign(V2D_CONTEXT_S *pstContext, int widened, uint64_t fixupPixels)
+{
+	if (widened)
+		V2dStatAdd(&pstContext->stStats.widened, 1);
+	if (fixupPixels)
+	{
+		V2dStatAdd(&pstContext->stStats.fixups, 1);
+		V2dStatAdd(&pstContext->stStats.fixupPixels, fixupPixels);
+	}
+}
+
+/* ret is the result of waiting on a fence, -ETIME when it timed out */
+static void V2dStatWait(V2D_CONTEXT_S *pstContext, int ret)
+{
+	if (ret == -ETIME)
+		V2dStatAdd(&pstContext->stStats.timeouts, 1);
+}
+
+/*
+ * Takes the signaled fence before it is closed. A job without a fence had
+ * completed by the time the backend accepted it and leaves no sample. The
+ * sample ends when the fence signaled, not when its waiter woke up, so a
+ * late wakeup or a slow callback ahead in the queue is not counted.
+ */
+static void V2dStatComplete(V2D_CONTEXT_S *pstContext, uint64_t acceptNs, int fence, int ret)
+{
+	uint64_t signalNs = 0;
+
+	V2dStatWait(pstContext, ret);
+	if (ret)
+	{
+		V2dStatAdd(&pstContext->stStats.failures, 1);
+		return;
+	}
+	if (fence < 0)
+		return;
+	if (V2dFenceSignaled(fence, &signalNs) != 1 || !signalNs)
+		signalNs = V2dStatNow();
+	/* a fence can signal before submit() has returned */
+	if (signalNs < acceptNs)
+		signalNs = acceptNs;
+	V2dStatLatency(&pstContext->stStats.complete, acceptNs, signalNs);
+}
+#else
+static inline uint64_t V2dStatNow(void) { return 0; }
+static inline void V2dStatJob(V2D_JOB_S *pstV2dJob, int ret) {}
+static inline void V2dStatWait(V2D_CONTEXT_S *pstContext, int ret) {}
+static inline void V2dStatComplete(V2D_CONTEXT_S *pstContext, uint64_t acceptNs, int fence, int ret) {}
+static inline void V2dStatAlign(V2D_CONTEXT_S *pstContext, int widened, uint64_t fixupPixels) {}
+#endif
+
+static void V2dClearJob(V2D_JOB_S *pstV2dJob)
+{
+	uint32_t i;
+	for (i=0; i<pstV2dJob->count; i++)
+	{
+		if (pstV2dJob->pstDesc[i].acquireFence >= 0)
+			close(pstV2dJob->pstDesc[i].acquireFence);
+		V2dPutPalette(pstV2dJob->pstDesc[i].pPalette);
+	}
+	if (pstV2dJob->pendingAcquireFence >= 0)
+		close(pstV2dJob->pendingAcquireFence);
+	pstV2dJob->count = 0;
+	pstV2dJob->surfaceCount = 0;
+	pstV2dJob->currentTaskState = TASK_NONE;
+	pstV2dJob->pendingAcquireFence = -1;
+	pstV2dJob->addNs = 0;
+	pstV2dJob->submitNs = 0;
+	pstV2dJob->acceptNs = 0;
+	pstV2dJob->accepted = 0;
+}
+
+static int V2dReserveJob(V2D_JOB_S *pstV2dJob, uint32_t capacity)
+{
+	V2D_TASK_DESC_S *pstDesc;
+	V2D_SURFACE_S *pstSurfaces;
+
+	pstDesc = (V2D_TASK_DESC_S *)realloc(pstV2dJob->pstDesc, capacity * sizeof(V2D_TASK_DESC_S));
+	if (!pstDesc)
+		return FAILURE;
+	pstV2dJob->pstDesc = pstDesc;
+	pstSurfaces = (V2D_SURFACE_S *)realloc(pstV2dJob->pstSurfaces, capacity * DESC_SURFACE_NUM * sizeof(V2D_SURFACE_S));
+	if (!pstSurfaces)
+		return FAILURE;
+	pstV2dJob->pstSurfaces = pstSurfaces;
+	pstV2dJob->capacity = capacity;
+	return SUCCESS;
+}
+
+static void V2dFreeJob(V2D_JOB_S *pstV2dJob)
+{
+	free(pstV2dJob->pstDesc);
+	free(pstV2dJob->pstSurfaces);
+	free(pstV2dJob->pstFixups);
+	free(pstV2dJob);
+}
+
+/*
+ * Ended jobs are kept in a small per-thread cache together with their task
+ * array, so a BeginJob/AddTask/EndJob frame loop does not touch the heap
+ * once it has warmed up.
+ */
+static pthread_once_t gJobCacheOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gJobCacheKey;
+
+static void V2dJobCacheDestroy(void *pCache)
+{
+	V2D_JOB_S *pstV2dJob = (V2D_JOB_S *)pCache;
+	V2D_JOB_S *pNext;
+	while (pstV2dJob)
+	{
+		pNext = pstV2dJob->pNextFree;
+		V2dFreeJob(pstV2dJob);
+		pstV2dJob = pNext;
+	}
+}
+
+static void V2dJobCacheInit(void)
+{
+	pthread_key_create(&gJobCacheKey, V2dJobCacheDestroy);
+}
+
+static V2D_JOB_S *V2dGetJob(V2D_CONTEXT_S *pstContext)
+{
+	V2D_JOB_S *pstV2dJob;
+
+	pthread_once(&gJobCacheOnce, V2dJobCacheInit);
+	pstV2dJob = (V2D_JOB_S *)pthread_getspecific(gJobCacheKey);
+	if (pstV2dJob)
+	{
+		pthread_setspecific(gJobCacheKey, pstV2dJob->pNextFree);
+	}
+	else
+	{
+		pstV2dJob = (V2D_JOB_S*)calloc(1, sizeof(V2D_JOB_S));
+		if (!pstV2dJob)
+			return NULL;
+		if (V2dReserveJob(pstV2dJob, MAX_TASK_LIST_LENGTH))
+		{
+			V2dFreeJob(pstV2dJob);
+			return NULL;
+		}
+	}
+	pstV2dJob->count = 0;
+	pstV2dJob->surfaceCount = 0;
+	pstV2dJob->currentTaskState = TASK_NONE;
+	pstV2dJob->pendingAcquireFence = -1;
+	pstV2dJob->addNs = 0;
+	pstV2dJob->submitNs = 0;
+	pstV2dJob->acceptNs = 0;
+	pstV2dJob->accepted = 0;
+	pstV2dJob->fixupCount = 0;
+	pstV2dJob->pNextFree = NULL;
+	pstV2dJob->pContext = V2dRefContext(pstContext);
+	V2dTraceInit();
+	pstV2dJob->traceId = V2dTracing() ? V2dTraceJobId() : 0;
+	pstV2dJob->traceNs = pstV2dJob->traceId ? V2dTraceNow() : 0;
+	return pstV2dJob;
+}
+
+static void V2dPutJob(V2D_JOB_S *pstV2dJob)
+{
+	V2D_JOB_S *pCache;
+	int depth = 0;
+
+	V2dClearJob(pstV2dJob);
+	V2dPutContext(pstV2dJob->pContext);
+	pstV2dJob->pContext = NULL;
+	pthread_once(&gJobCacheOnce, V2dJobCacheInit);
+	pCache = (V2D_JOB_S *)pthread_getspecific(gJobCacheKey);
+	for (; pCache && depth < JOB_CACHE_DEPTH; pCache = pCache->pNextFree)
+		depth++;
+	if (depth >= JOB_CACHE_DEPTH ||
+		(pstV2dJob->capacity > JOB_CACHE_MAX_TASKS && V2dReserveJob(pstV2dJob, MAX_TASK_LIST_LENGTH)))
+	{
+		V2dFreeJob(pstV2dJob);
+		return;
+	}
+	pstV2dJob->pNextFree = (V2D_JOB_S *)pthread_getspecific(gJobCacheKey);
+	pthread_setspecific(gJobCacheKey, pstV2dJob);
+}
+
+static int sync_wait(int fd, int timeout)
+{
+	struct pollfd fds;
+	int ret = 0;
+	if (fd < 0) {
+		return -1;
+	}
+	fds.fd = fd;
+	fds.events = POLLIN;
+	do {
+		ret = poll(&fds, 1, timeout);
+		if (ret > 0) {
+			if (fds.revents & (POLLERR | POLLNVAL)) {
+				return -1;
+			}
+			return 0;
+		} else if (ret == 0) {
+			return -ETIME;
+		}
+	} while (ret == -1 );
+	return ret;
+}
+
+int V2dWaitFence(int fence, int timeout)
+{
+	return sync_wait(fence, timeout);
+}
+
+int V2dFenceSignaled(int fence, uint64_t *pNs)
+{
+	struct sync_file_info stInfo;
+	struct sync_fence_info stFence;
+
+	memset(&stInfo, 0, sizeof(stInfo));
+	memset(&stFence, 0, sizeof(stFence));
+	stInfo.num_fences = 1;
+	stInfo.sync_fence_info = (uint64_t)(&stFence);
+	if (ioctl(fence, SYNC_IOC_FILE_INFO, &stInfo) < 0 || stInfo.status < 0)
+		return -1;
+	if (stInfo.status == 0)
+		return 0;
+	*pNs = stFence.timestamp_ns;
+	return 1;
+}
+
+int v2d_lock_async(int fence_fd)
+{
+	int ret = 0;
+	if (fence_fd >= 0)
+	{
+		ret = sync_wait(fence_fd, 3000);
+		close(fence_fd);
+	}
+	return ret;
+}
+
+/*
+ * The driver takes a single acquire fence per task, so several input fences
+ * are merged into one. Both fds are consumed. Should the merge fail, the
+ * dependency is resolved on the CPU instead of being dropped.
+ */
+static int V2dMergeFence(int fence1, int fence2)
+{
+	struct sync_merge_data stMerge;
+
+	if (fence1 < 0)
+		return fence2;
+	if (fence2 < 0)
+		return fence1;
+	memset(&stMerge, 0, sizeof(stMerge));
+	strncpy(stMerge.name, "v2d_acquire", sizeof(stMerge.name) - 1);
+	stMerge.fd2 = fence2;
+	if (ioctl(fence1, SYNC_IOC_MERGE, &stMerge) < 0)
+	{
+		printf("Failed to merge acquire fences, waiting on cpu\n");
+		v2d_lock_async(fence2);
+		return fence1;
+	}
+	close(fence1);
+	close(fence2);
+	return stMerge.fence;
+}
+
+static void V2dExpandTask(V2D_JOB_S *pstV2dJob, uint32_t desc, uint32_t idx)
+{
+	V2D_TASK_DESC_S *pDesc = &pstV2dJob->pstDesc[desc];
+	V2D_TASK_S *pTask = &pstV2dJob->astTasks[idx];
+	V2D_PARAM_S *pstParam = &pTask->stV2dTask.param;
+	V2D_SURFACE_S *apSurface[DESC_SURFACE_NUM] = {&pstParam->layer0, &pstParam->layer1, &pstParam->mask, &pstParam->dst};
+	V2D_AREA_S *apRect[DESC_SURFACE_NUM] = {&pstParam->l0_rect, &pstParam->l1_rect, &pstParam->mask_rect, &pstParam->dst_rect};
+	uint8_t stale;
+	int i;
+
+	/* a staging slot is cleared once, afterwards only sections it last carried are cleared */
+	if (idx >= pstV2dJob->stagingCount)
+	{
+		memset(pTask, 0, sizeof(V2D_TASK_S));
+		pstV2dJob->au8StagingSections[idx] = 0;
+		pstV2dJob->stagingCount = idx + 1;
+	}
+	stale = pstV2dJob->au8StagingSections[idx] & ~pDesc->sections;
+
+	for (i=0; i<DESC_SURFACE_NUM; i++)
+	{
+		if (pDesc->sections & (1 << i))
+			memcpy(apSurface[i], &pstV2dJob->pstSurfaces[pDesc->surface[i]], sizeof(V2D_SURFACE_S));
+		else if (stale & (1 << i))
+			memset(apSurface[i], 0, sizeof(V2D_SURFACE_S));
+		*apRect[i] = pDesc->rect[i];
+	}
+	memcpy(&pstParam->blendconf, &pDesc->blendconf, sizeof(V2D_BLEND_CONF_S));
+	pstParam->l0_rt  = (V2D_ROTATE_ANGLE_E)pDesc->l0_rt;
+	pstParam->l1_rt  = (V2D_ROTATE_ANGLE_E)pDesc->l1_rt;
+	pstParam->l0_csc = (V2D_CSC_MODE_E)pDesc->l0_csc;
+	pstParam->l1_csc = (V2D_CSC_MODE_E)pDesc->l1_csc;
+	pstParam->dither = (V2D_DITHER_E)pDesc->dither;
+	if (pDesc->sections & DESC_PALETTE)
+		memcpy(&pstParam->palette, &pDesc->pPalette->stPalette, sizeof(V2D_PALETTE_S));
+	else if (stale & DESC_PALETTE)
+		memset(&pstParam->palette, 0, sizeof(V2D_PALETTE_S));
+	pTask->stV2dTask.acquireFencefd = pDesc->acquireFence;
+	pTask->stV2dTask.completeFencefd = -1;
+	pstV2dJob->au8StagingSections[idx] = pDesc->sections;
+}
+
+/* a replayed task already staged by an earlier replay of its template, only its buffers change */
+static void V2dPatchTask(V2D_JOB_S *pstV2dJob, uint32_t idx)
+{
+	V2D_TASK_DESC_S *pDesc = &pstV2dJob->pstDesc[idx];
+	V2D_TASK_S *pTask = &pstV2dJob->astTasks[idx];
+	V2D_PARAM_S *pstParam = &pTask->stV2dTask.param;
+	V2D_SURFACE_S *apSurface[DESC_SURFACE_NUM] = {&pstParam->layer0, &pstParam->layer1, &pstParam->mask, &pstParam->dst};
+	V2D_SURFACE_S *pstSurface;
+	int i;
+
+	for (i=0; i<DESC_SURFACE_NUM; i++)
+	{
+		if (!(pDesc->sections & (1 << i)))
+			continue;
+		pstSurface = &pstV2dJob->pstSurfaces[pDesc->surface[i]];
+		if (pstSurface->fbc_enable)
+		{
+			memcpy(apSurface[i], pstSurface, sizeof(V2D_SURFACE_S));
+			continue;
+		}
+		apSurface[i]->fd = pstSurface->fd;
+		apSurface[i]->offset = pstSurface->offset;
+	}
+	pTask->stV2dTask.acquireFencefd = pDesc->acquireFence;
+	pTask->stV2dTask.completeFencefd = -1;
+}
+
+/* a task as the trace shows it, its first source layer and the destination */
+static void V2dTraceDesc(V2D_JOB_S *pstV2dJob, uint32_t desc, int fence, uint64_t startNs, uint64_t endNs)
+{
+	V2D_TASK_DESC_S *pDesc = &pstV2dJob->pstDesc[desc];
+	V2D_SURFACE_S *pstSurface;
+	V2D_TRACE_TASK_S stTask;
+	int layer;
+
+	stTask.type = pDesc->type;
+	stTask.srcFormat = V2D_COLOR_FORMAT_BUTT;
+	stTask.dstFormat = V2D_COLOR_FORMAT_BUTT;
+	for (layer=0; layer<2; layer++)
+	{
+		pstSurface = &pstV2dJob->pstSurfaces[pDesc->surface[layer]];
+		if ((pDesc->sections & (1 << layer)) && !pstSurface->solidcolor.enable)
+		{
+			stTask.srcFormat = pstSurface->format;
+			break;
+		}
+	}
+	if (pDesc->sections & DESC_DST)
+		stTask.dstFormat = pstV2dJob->pstSurfaces[pDesc->surface[3]].format;
+	stTask.w = pDesc->rect[3].w;
+	stTask.h = pDesc->rect[3].h;
+	V2dTraceTask(pstV2dJob->traceId, desc, &stTask, fence, startNs, endNs);
+}
+
+/* how a task with an unaligned destination origin is run, see V2dAlignTask */
+#define ALIGN_NONE   0
+#define ALIGN_WIDEN  1 /* on the backend, from the aligned origin below it */
+#define ALIGN_FOLD   2 /* on the backend, from the aligned origin with the dst copied through below the layer */
+#define ALIGN_STRIPS 3 /* the aligned interior on the backend, the edge strips on the host */
+#define ALIGN_HOST   4 /* too small for an aligned interior, all of it on the host */
+
+/*
+ * A task with a single layer is run from the aligned origin with its layer
+ * moved to layer1, replacing what is below it, and the destination itself as
+ * layer0 over the whole widened rect. The pixels the task gains are read and
+ * written back unchanged, so this only goes for packed formats that unpack
+ * and pack losslessly and without dithering. Its blend area is clipped to
+ * dst_rect, for a scaled or rotated layer only when it needs no clipping.
+ */
+static int V2dFoldTask(V2D_JOB_S *pstV2dJob, uint32_t desc, uint32_t idx, uint32_t x0, uint32_t y0)
+{
+	V2D_TASK_DESC_S *pDesc = &pstV2dJob->pstDesc[desc];
+	V2D_PARAM_S *pstParam = &pstV2dJob->astTasks[idx].stV2dTask.param;
+	V2D_BLEND_CONF_S *pConf = &pstParam->blendconf;
+	V2D_BLEND_LAYER_CONF_S *pLayer = &pConf->blendlayer[1];
+	V2D_AREA_S *pRect = &pstParam->dst_rect;
+	V2D_AREA_S stArea = pConf->blendlayer[0].blend_area;
+	V2D_COLOR_FORMAT_E format = pstParam->dst.format;
+	uint32_t dx, dy;
+
+	if ((pDesc->sections & (DESC_LAYER0 | DESC_LAYER1 | DESC_MASK)) != DESC_LAYER0 || pConf->bgcolor.enable ||
+	    pstParam->dither != V2D_NO_DITHER || pstParam->layer0.fbc_enable || pstParam->dst.solidcolor.enable ||
+	    V2dCpuIsPalette(format) || format == V2D_COLOR_FORMAT_NV12 || format == V2D_COLOR_FORMAT_NV21 ||
+	    format == V2D_COLOR_FORMAT_RGBX8888 || format == V2D_COLOR_FORMAT_BGRX8888 || !stArea.w || !stArea.h)
+		return 0;
+	dx = (stArea.x < pRect->x) ? pRect->x - stArea.x : 0;
+	dy = (stArea.y < pRect->y) ? pRect->y - stArea.y : 0;
+	if (dx >= stArea.w || dy >= stArea.h)
+		return 0;
+	if ((dx || dy) && !pstParam->layer0.solidcolor.enable &&
+	    (pstParam->l0_rt != V2D_ROT_0 || pstParam->l0_rect.w != stArea.w || pstParam->l0_rect.h != stArea.h))
+		return 0;
+	stArea.x += dx;
+	stArea.y += dy;
+	stArea.w -= dx;
+	stArea.h -= dy;
+
+	pstParam->layer1 = pstParam->layer0;
+	pstParam->l1_rect = pstParam->l0_rect;
+	pstParam->l1_rect.x += dx;
+	pstParam->l1_rect.y += dy;
+	pstParam->l1_rect.w -= dx;
+	pstParam->l1_rect.h -= dy;
+	pstParam->l1_rt = pstParam->l0_rt;
+	pstParam->l1_csc = pstParam->l0_csc;
+	memset(pLayer, 0, sizeof(V2D_BLEND_LAYER_CONF_S));
+	pLayer->blend_area = stArea;
+	pLayer->stBlendFactor.srcColorFactor = V2D_BLEND_ONE;
+	pLayer->stBlendFactor.dstColorFactor = V2D_BLEND_ZERO;
+	pLayer->stBlendFactor.srcAlphaFactor = V2D_BLEND_ONE;
+	pLayer->stBlendFactor.dstAlphaFactor = V2D_BLEND_ZERO;
+	pConf->blend_cmd = V2D_BLENDCMD_ALPHA;
+	pConf->mask_cmd = V2D_MASKCMD_DISABLE;
+
+	pRect->w += pRect->x - x0;
+	pRect->h += pRect->y - y0;
+	pRect->x = x0;
+	pRect->y = y0;
+	pstParam->layer0 = pstParam->dst;
+	pstParam->l0_rect = *pRect;
+	pstParam->l0_rt = V2D_ROT_0;
+	pstParam->l0_csc = V2D_CSC_MODE_BUTT;
+	pConf->blendlayer[0].blend_area = *pRect;
+	/* the next expansion into this slot clears layer1 again */
+	pstV2dJob->au8StagingSections[idx] |= DESC_LAYER1;
+	return 1;
+}
+
+/*
+ * The device takes destination rects whose origin is a multiple of its
+ * alignment. A task draws its layers over their blend areas and dst_rect only
+ * clips them, so a task whose layers stay clear of the pixels left of and
+ * above dst_rect can be widened to the aligned origin below it, the pixels it
+ * gains are covered by no layer and left alone. Only backends that set
+ * dstWiden do so, the device does not until that is verified on the hardware.
+ * A single layer task is folded instead, see V2dFoldTask. Any other task is
+ * cut down to its aligned interior, the thin strips above and left of it are
+ * drawn by the cpu backend.
+ */
+static int V2dAlignTask(V2D_JOB_S *pstV2dJob, uint32_t desc, uint32_t idx, V2D_AREA_S *pOrig)
+{
+	V2D_TASK_DESC_S *pDesc = &pstV2dJob->pstDesc[desc];
+	V2D_PARAM_S *pstParam = &pstV2dJob->astTasks[idx].stV2dTask.param;
+	V2D_AREA_S *pRect = &pstParam->dst_rect;
+	V2D_AREA_S *pArea;
+	uint32_t align = pstV2dJob->pContext->dstAlign;
+	uint32_t x0, y0, right, bottom;
+	int layer, widen;
+
+	if (align <= 1 || !((pRect->x | pRect->y) & (align - 1)) || !pRect->w || !pRect->h || pstParam->dst.fbc_enable)
+		return ALIGN_NONE;
+	*pOrig = *pRect;
+	right = pRect->x + pRect->w;
+	bottom = pRect->y + pRect->h;
+	x0 = pRect->x & ~(align - 1);
+	y0 = pRect->y & ~(align - 1);
+	widen = pstV2dJob->pContext->dstWiden && !pstParam->blendconf.bgcolor.enable;
+	for (layer=0; layer<V2D_INPUT_LAYER_NUM && widen; layer++)
+	{
+		pArea = &pstParam->blendconf.blendlayer[layer].blend_area;
+		if (!(pDesc->sections & (1 << layer)) || !pArea->w || !pArea->h)
+			continue;
+		if ((pArea->x < pRect->x || pArea->y < pRect->y) && pArea->x + pArea->w > x0 && pArea->y + pArea->h > y0 &&
+			pArea->x < right && pArea->y < bottom)
+			widen = 0;
+	}
+	if (widen)
+	{
+		pRect->x = x0;
+		pRect->y = y0;
+		pRect->w = right - x0;
+		pRect->h = bottom - y0;
+		return ALIGN_WIDEN;
+	}
+	if (V2dFoldTask(pstV2dJob, desc, idx, x0, y0))
+		return ALIGN_FOLD;
+	x0 = (pRect->x + align - 1) & ~(align - 1);
+	y0 = (pRect->y + align - 1) & ~(align - 1);
+	if (x0 >= right || y0 >= bottom)
+		return ALIGN_HOST;
+	pRect->x = x0;
+	pRect->y = y0;
+	pRect->w = right - x0;
+	pRect->h = bottom - y0;
+	return ALIGN_STRIPS;
+}
+
+static void *V2dFixupBackend(V2D_CONTEXT_S *pstContext)
+{
+	void *pPriv = NULL;
+
+	if (pstContext->pBackend == &gV2dCpuBackend)
+		return pstContext->pPriv;
+	if (__atomic_load_n(&pstContext->pFixupPriv, __ATOMIC_ACQUIRE))
+		return pstContext->pFixupPriv;
+	pthread_mutex_lock(&pstContext->lock);
+	if (!pstContext->pFixupPriv && gV2dCpuBackend.open(&pPriv) == SUCCESS)
+		__atomic_store_n(&pstContext->pFixupPriv, pPriv, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&pstContext->lock);
+	return pstContext->pFixupPriv;
+}
+
+/* keeps what the backend leaves out of staged task idx for the host, it is drawn after the tasks queued before */
+static int V2dAddFixup(V2D_JOB_S *pstV2dJob, uint32_t idx, int align, const V2D_AREA_S *pOrig)
+{
+	V2D_TASK_S *pTask = &pstV2dJob->astTasks[idx];
+	V2D_AREA_S *pInner = &pTask->stV2dTask.param.dst_rect;
+	V2D_TASK_S *pstFixups, *pStrip;
+	uint64_t pixels = 0;
+	uint32_t capacity;
+	int acquire = pTask->stV2dTask.acquireFencefd;
+
+	if (pstV2dJob->fixupCount + 2 > pstV2dJob->fixupCapacity)
+	{
+		capacity = pstV2dJob->fixupCapacity ? 2 * pstV2dJob->fixupCapacity : 8;
+		pstFixups = (V2D_TASK_S *)realloc(pstV2dJob->pstFixups, capacity * sizeof(V2D_TASK_S));
+		if (!pstFixups)
+		{
+			printf("Failed to malloc v2d host fix-ups\n");
+			return FAILURE;
+		}
+		pstV2dJob->pstFixups = pstFixups;
+		pstV2dJob->fixupCapacity = capacity;
+	}
+	pStrip = &pstV2dJob->pstFixups[pstV2dJob->fixupCount];
+	if (align == ALIGN_HOST)
+	{
+		/* the backend never sees the task, the host waits on its acquire fence instead */
+		memcpy(pStrip, pTask, sizeof(V2D_TASK_S));
+		pStrip->stV2dTask.param.dst_rect = *pOrig;
+		pStrip->stV2dTask.acquireFencefd = (acquire >= 0) ? dup(acquire) : -1;
+		if (acquire >= 0 && pStrip->stV2dTask.acquireFencefd < 0)
+			return FAILURE;
+		pStrip++;
+	}
+	else
+	{
+		/* the interior has waited on the acquire fence by the time the strips are drawn */
+		if (pInner->y > pOrig->y)
+		{
+			memcpy(pStrip, pTask, sizeof(V2D_TASK_S));
+			pStrip->stV2dTask.param.dst_rect = *pOrig;
+			pStrip->stV2dTask.param.dst_rect.h = pInner->y - pOrig->y;
+			pStrip->stV2dTask.acquireFencefd = -1;
+			pStrip++;
+		}
+		if (pInner->x > pOrig->x)
+		{
+			memcpy(pStrip, pTask, sizeof(V2D_TASK_S));
+			pStrip->stV2dTask.param.dst_rect = *pInner;
+			pStrip->stV2dTask.param.dst_rect.x = pOrig->x;
+			pStrip->stV2dTask.param.dst_rect.w = pInner->x - pOrig->x;
+			pStrip->stV2dTask.acquireFencefd = -1;
+			pStrip++;
+		}
+	}
+	for (; pstV2dJob->fixupCount < (uint32_t)(pStrip - pstV2dJob->pstFixups); pstV2dJob->fixupCount++)
+	{
+		pInner = &pstV2dJob->pstFixups[pstV2dJob->fixupCount].stV2dTask.param.dst_rect;
+		pixels += (uint64_t)pInner->w * pInner->h;
+	}
+	V2dStatAlign(pstV2dJob->pContext, 0, pixels);
+	return SUCCESS;
+}
+
+/* closes the acquire fences fix-ups still hold */
+static void V2dDropFixups(V2D_TASK_S *pstFixups, uint32_t count)
+{
+	uint32_t i;
+
+	for (i=0; i<count; i++)
+	{
+		if (pstFixups[i].stV2dTask.acquireFencefd >= 0)
+			close(pstFixups[i].stV2dTask.acquireFencefd);
+	}
+}
+
+/* draws fix-ups on the cpu backend once the tasks queued ahead of them have completed */
+static int V2dDrawFixups(V2D_CONTEXT_S *pstContext, V2D_TASK_S *pstFixups, uint32_t count)
+{
+	void *pPriv = V2dFixupBackend(pstContext);
+	int ret = SUCCESS;
+
+	if (!pPriv || gV2dCpuBackend.submit(pPriv, pstFixups, count) != (int32_t)count)
+	{
+		printf("Failed to draw the unaligned edges of v2d tasks on the host\n");
+		ret = FAILURE;
+	}
+	V2dDropFixups(pstFixups, count);
+	return ret;
+}
+
+/* whether task desc reads or writes pixels a fix-up still pending in the job draws */
+static int V2dFixupConflict(V2D_JOB_S *pstV2dJob, uint32_t desc)
+{
+	V2D_TASK_DESC_S *pDesc = &pstV2dJob->pstDesc[desc];
+	V2D_SUBMIT_TASK_S *pstFixup;
+	V2D_AREA_S *pRect, *pStrip;
+	uint32_t i;
+	int layer;
+
+	for (i=0; i<pstV2dJob->fixupCount; i++)
+	{
+		pstFixup = &pstV2dJob->pstFixups[i].stV2dTask;
+		pStrip = &pstFixup->param.dst_rect;
+		for (layer=0; layer<DESC_SURFACE_NUM; layer++)
+		{
+			if (!(pDesc->sections & (1 << layer)) || pstV2dJob->pstSurfaces[pDesc->surface[layer]].fd != pstFixup->param.dst.fd)
+				continue;
+			pRect = &pDesc->rect[layer];
+			if (pRect->x < pStrip->x + pStrip->w && pStrip->x < pRect->x + pRect->w &&
+				pRect->y < pStrip->y + pStrip->h && pStrip->y < pRect->y + pRect->h)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+static void *V2dCallbackThread(void *arg)
+{
+	V2D_CONTEXT_S *pstContext = (V2D_CONTEXT_S *)arg;
+	V2D_CALLBACK_S *pCb;
+	uint32_t one = 1;
+	int ret;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&pstContext->lock);
+		while (!pstContext->pCbHead && !pstContext->cbQuit)
+			pthread_cond_wait(&pstContext->cbCond, &pstContext->lock);
+		pCb = pstContext->pCbHead;
+		if (!pCb)
+		{
+			pthread_mutex_unlock(&pstContext->lock);
+			break;
+		}
+		pstContext->pCbHead = pCb->pNext;
+		if (!pstContext->pCbHead)
+			pstContext->pCbTail = NULL;
+		pthread_mutex_unlock(&pstContext->lock);
+
+		/* the fence stays open until the statistics took its signal time */
+		ret = (pCb->fence >= 0) ? V2dWaitFence(pCb->fence, 3000) : 0;
+		if (pCb->fixupCount)
+		{
+			/* fix-ups behind a failed fence are dropped, their timeline moves on all the same */
+			if (ret)
+				V2dDropFixups(pCb->pstFixups, pCb->fixupCount);
+			else
+				V2dDrawFixups(pstContext, pCb->pstFixups, pCb->fixupCount);
+			pCb->fixupCount = 0;
+			ioctl(pstContext->fixupTimeline, SW_SYNC_IOC_INC, &one);
+			if (pCb->fence >= 0)
+				close(pCb->fence);
+		}
+		else
+		{
+			V2dStatComplete(pstContext, pCb->acceptNs, pCb->fence, ret);
+			if (pCb->fence >= 0)
+				close(pCb->fence);
+			pCb->pfnCallback(ret ? FAILURE : SUCCESS, pCb->pUserData);
+		}
+
+		pthread_mutex_lock(&pstContext->lock);
+		pCb->pNext = pstContext->pCbFree;
+		pstContext->pCbFree = pCb;
+		pthread_mutex_unlock(&pstContext->lock);
+		if (V2dPutContext(pstContext))
+			break;
+	}
+	return NULL;
+}
+
+/* called with the context lock held */
+static int V2dStartCallbackThread(V2D_CONTEXT_S *pstContext)
+{
+	if (pstContext->cbRunning)
+		return SUCCESS;
+	if (pthread_create(&pstContext->cbTid, NULL, V2dCallbackThread, pstContext))
+	{
+		printf("Failed to create v2d callback thread\n");
+		return FAILURE;
+	}
+	pstContext->cbRunning = 1;
+	return SUCCESS;
+}
+
+/* called with the context lock held, records only come from the heap until the free list is warm */
+static V2D_CALLBACK_S *V2dNewCallback(V2D_CONTEXT_S *pstContext)
+{
+	V2D_CALLBACK_S *pCb = pstContext->pCbFree;
+
+	if (pCb)
+	{
+		pstContext->pCbFree = pCb->pNext;
+		return pCb;
+	}
+	pCb = (V2D_CALLBACK_S *)calloc(1, sizeof(V2D_CALLBACK_S));
+	if (!pCb)
+		printf("Failed to malloc v2d callback\n");
+	return pCb;
+}
+
+/* called with the context lock held */
+static void V2dPushCallback(V2D_CONTEXT_S *pstContext, V2D_CALLBACK_S *pCb)
+{
+	pCb->pNext = NULL;
+	if (pstContext->pCbTail)
+		pstContext->pCbTail->pNext = pCb;
+	else
+		pstContext->pCbHead = pCb;
+	pstContext->pCbTail = pCb;
+	pthread_cond_signal(&pstContext->cbCond);
+}
+
+/* the callback takes over the context reference once queued */
+static int V2dQueueCallback(int fence, V2D_CONTEXT_S *pstContext, uint64_t acceptNs, V2D_JOB_CALLBACK pfnCallback, void *pUserData)
+{
+	V2D_CALLBACK_S *pCb;
+
+	pthread_mutex_lock(&pstContext->lock);
+	pCb = V2dStartCallbackThread(pstContext) ? NULL : V2dNewCallback(pstContext);
+	if (!pCb)
+	{
+		pthread_mutex_unlock(&pstContext->lock);
+		return FAILURE;
+	}
+	pCb->fence = fence;
+	pCb->acceptNs = acceptNs;
+	pCb->pfnCallback = pfnCallback;
+	pCb->pUserData = pUserData;
+	V2dPushCallback(pstContext, pCb);
+	pthread_mutex_unlock(&pstContext->lock);
+	return SUCCESS;
+}
+
+/* called with the context lock held, the fix-up timeline or -2 without sw_sync */
+static int V2dFixupTimeline(V2D_CONTEXT_S *pstContext)
+{
+	if (pstContext->fixupTimeline == -1)
+	{
+		pstContext->fixupTimeline = open(SW_SYNC_FILE, O_RDWR|O_CLOEXEC);
+		if (pstContext->fixupTimeline < 0)
+			pstContext->fixupTimeline = -2;
+	}
+	return pstContext->fixupTimeline;
+}
+
+/*
+ * Whether the host may draw what the backend leaves out of a task. Without
+ * sw_sync the fix-ups are drawn in the submitting thread after the tasks
+ * ahead of them completed, which only a caller that waits for the job anyway
+ * can afford. The cpu backend does its work inside the submit, so there is
+ * nothing to wait for.
+ */
+static int V2dHostAllowed(V2D_CONTEXT_S *pstContext, int wait)
+{
+	int timeline;
+
+	if (wait || pstContext->pBackend == &gV2dCpuBackend)
+		return 1;
+	pthread_mutex_lock(&pstContext->lock);
+	timeline = V2dFixupTimeline(pstContext);
+	pthread_mutex_unlock(&pstContext->lock);
+	return timeline >= 0;
+}
+
+/*
+ * Hands the pending fix-ups of a job to the waiter of its context, which
+ * draws them once fence signals and then signals *pHostFence off a sw_sync
+ * timeline, so neither the job nor the ones after it wait on the host in the
+ * submitting thread. Without sw_sync they are drawn here after one wait and
+ * *pHostFence is -1, see V2dHostAllowed. fence is not consumed.
+ */
+static int V2dFlushFixups(V2D_JOB_S *pstV2dJob, int fence, int *pHostFence)
+{
+	V2D_CONTEXT_S *pstContext = pstV2dJob->pContext;
+	struct sw_sync_create_fence_data stFence;
+	V2D_CALLBACK_S *pCb = NULL;
+	V2D_TASK_S *pstFixups;
+	uint32_t capacity;
+	int ret;
+
+	*pHostFence = -1;
+	if (!pstV2dJob->fixupCount)
+		return SUCCESS;
+	pthread_mutex_lock(&pstContext->lock);
+	if (V2dFixupTimeline(pstContext) >= 0 && V2dStartCallbackThread(pstContext) == SUCCESS)
+		pCb = V2dNewCallback(pstContext);
+	if (pCb)
+	{
+		memset(&stFence, 0, sizeof(stFence));
+		stFence.value = pstContext->fixupPoint + 1;
+		strncpy(stFence.name, "v2d_fixup", sizeof(stFence.name) - 1);
+		pCb->fence = (fence >= 0) ? dup(fence) : -1;
+		if ((fence < 0 || pCb->fence >= 0) && ioctl(pstContext->fixupTimeline, SW_SYNC_IOC_CREATE_FENCE, &stFence) == 0)
+		{
+			pstContext->fixupPoint++;
+			pstFixups = pCb->pstFixups;
+			capacity = pCb->fixupCapacity;
+			pCb->pstFixups = pstV2dJob->pstFixups;
+			pCb->fixupCapacity = pstV2dJob->fixupCapacity;
+			pCb->fixupCount = pstV2dJob->fixupCount;
+			pstV2dJob->pstFixups = pstFixups;
+			pstV2dJob->fixupCapacity = capacity;
+			pstV2dJob->fixupCount = 0;
+			pCb->acceptNs = 0;
+			pCb->pfnCallback = NULL;
+			pCb->pUserData = NULL;
+			V2dRefContext(pstContext);
+			V2dPushCallback(pstContext, pCb);
+			if (pstContext->hostFence >= 0)
+				close(pstContext->hostFence);
+			__atomic_store_n(&pstContext->hostFence, dup(stFence.fence), __ATOMIC_RELAXED);
+			pthread_mutex_unlock(&pstContext->lock);
+			*pHostFence = stFence.fence;
+			return SUCCESS;
+		}
+		if (pCb->fence >= 0)
+			close(pCb->fence);
+		pCb->pNext = pstContext->pCbFree;
+		pstContext->pCbFree = pCb;
+	}
+	pthread_mutex_unlock(&pstContext->lock);
+
+	ret = SUCCESS;
+	if (fence >= 0 && V2dWaitFence(fence, 3000))
+	{
+		printf("Failed to wait for v2d tasks ahead of a host fix-up\n");
+		V2dDropFixups(pstV2dJob->pstFixups, pstV2dJob->fixupCount);
+		ret = FAILURE;
+	}
+	else
+	{
+		ret = V2dDrawFixups(pstContext, pstV2dJob->pstFixups, pstV2dJob->fixupCount);
+	}
+	pstV2dJob->fixupCount = 0;
+	return ret;
+}
+
+/* a copy of the fence of the fix-ups an earlier job left to the waiter, -1 once they are drawn */
+static int V2dHostFence(V2D_CONTEXT_S *pstContext)
+{
+	int fence = -1;
+
+	if (__atomic_load_n(&pstContext->hostFence, __ATOMIC_RELAXED) < 0)
+		return -1;
+	pthread_mutex_lock(&pstContext->lock);
+	if (pstContext->hostFence >= 0 && V2dWaitFence(pstContext->hostFence, 0) == 0)
+	{
+		close(pstContext->hostFence);
+		__atomic_store_n(&pstContext->hostFence, -1, __ATOMIC_RELAXED);
+	}
+	if (pstContext->hostFence >= 0)
+		fence = dup(pstContext->hostFence);
+	pthread_mutex_unlock(&pstContext->lock);
+	return fence;
+}
+
+/*
+ * The job goes down in chunks of MAX_TASK_LIST_LENGTH tasks, each in a single
+ * backend submission which fills in the completeFencefd of every task. Tasks
+ * are executed in submission order, which also keeps tasks touching the same
+ * destination ordered across chunks, so the fence of the last accepted task
+ * signals the completion of the whole job and is handed back through pFence,
+ * the others are closed right away.
+ * A chunk is queued while the previous one still runs, at most
+ * MAX_CHUNKS_IN_FLIGHT chunks of a job are queued at any time.
+ * Host fix-ups of unaligned tasks are collected while the chunks go down and
+ * flushed after the whole job, or before a task that touches their pixels,
+ * which then waits for them on the fence V2dFlushFixups hands back. A job
+ * whose caller does not wait fails at the first task that needs the host
+ * when V2dHostAllowed says no.
+ */
+static int V2dQueueJob(V2D_JOB_S *pstV2dJob, int *pFence, int wait)
+{
+	int ret = SUCCESS;
+	int chunkWait, fence, hostFence, merged;
+	int trace = pstV2dJob->traceId != 0;
+	uint64_t traceSubmitNs = 0, chunkNs = 0, chunkAcceptNs = 0;
+	uint32_t first, i, n, hw, submitted, last;
+	int32_t accepted;
+	V2D_CONTEXT_S *pstContext = pstV2dJob->pContext;
+	int aChunkFence[MAX_CHUNKS_IN_FLIGHT];
+	V2D_TASK_S * curNode;
+	V2D_AREA_S stOrig;
+	int align, restage, hostLast, flush, hostAllowed = -1;
+
+	for (i=0; i<MAX_CHUNKS_IN_FLIGHT; i++)
+		aChunkFence[i] = -1;
+	/* fix-ups an earlier job left to the waiter go first */
+	hostFence = V2dHostFence(pstContext);
+
+	pstV2dJob->submitNs = V2dStatNow();
+	pstV2dJob->accepted = 0;
+	if (trace)
+		traceSubmitNs = V2dTraceNow();
+	for (first=0; first<pstV2dJob->count && ret == SUCCESS; first+=n)
+	{
+		n = pstV2dJob->count - first;
+		if (n > MAX_TASK_LIST_LENGTH)
+			n = MAX_TASK_LIST_LENGTH;
+		restage = hostLast = flush = 0;
+		if (pstV2dJob->pTemplate && pstV2dJob->stagedTemplate == pstV2dJob->pTemplate->id &&
+			pstV2dJob->stagedAlign == pstContext->dstAlign && pstV2dJob->stagedWiden == pstContext->dstWiden)
+		{
+			for (i=0; i<n; i++)
+				V2dPatchTask(pstV2dJob, i);
+			/* the descriptors of a replay are shared, its acquire fence is kept on the side */
+			pstV2dJob->astTasks[0].stV2dTask.acquireFencefd = pstV2dJob->pendingAcquireFence;
+		}
+		else
+		{
+			for (i=0; i<n; i++)
+			{
+				/* a task touching pixels of a pending fix-up waits for it, the chunk ends before it */
+				if (pstV2dJob->fixupCount && V2dFixupConflict(pstV2dJob, first + i))
+				{
+					n = i;
+					flush = 1;
+					break;
+				}
+				V2dExpandTask(pstV2dJob, first + i, i);
+				if (pstV2dJob->pTemplate && first + i == 0)
+					pstV2dJob->astTasks[0].stV2dTask.acquireFencefd = pstV2dJob->pendingAcquireFence;
+				align = V2dAlignTask(pstV2dJob, first + i, i, &stOrig);
+				/* neither split nor folded tasks can be patched in place by the next replay */
+				if (align >= ALIGN_FOLD)
+					restage = 1;
+				if (align == ALIGN_WIDEN || align == ALIGN_FOLD)
+					V2dStatAlign(pstContext, 1, 0);
+				if (align < ALIGN_STRIPS)
+					continue;
+				if (hostAllowed < 0)
+					hostAllowed = V2dHostAllowed(pstContext, wait);
+				if (!hostAllowed)
+					printf("Failed to queue v2d task %u, its unaligned edges need sw_sync to be drawn by the host "
+					       "without waiting for the job\n", first + i);
+				if (!hostAllowed || V2dAddFixup(pstV2dJob, i, align, &stOrig))
+				{
+					ret = FAILURE;
+					n = i;
+					break;
+				}
+				/* a task left to the host alone ends the chunk, without reaching the backend */
+				if (align == ALIGN_HOST)
+				{
+					n = i + 1;
+					hostLast = 1;
+					break;
+				}
+			}
+			/* a template that fits one chunk, without host parts or folds, stays staged for the next replay on this job */
+			pstV2dJob->stagedTemplate = (pstV2dJob->pTemplate && n == pstV2dJob->count && !restage) ?
+				pstV2dJob->pTemplate->id : 0;
+			pstV2dJob->stagedAlign = pstContext->dstAlign;
+			pstV2dJob->stagedWiden = pstContext->dstWiden;
+		}
+
+		if (trace)
+			chunkNs = V2dTraceNow();
+		hw = n - hostLast;
+		accepted = 0;
+		if (hw)
+		{
+			/* the oldest chunk in flight has to finish before another one is queued */
+			chunkWait = v2d_lock_async(aChunkFence[0]);
+			V2dStatWait(pstContext, chunkWait);
+			if (chunkWait)
+				ret = FAILURE;
+			memmove(aChunkFence, aChunkFence + 1, (MAX_CHUNKS_IN_FLIGHT - 1) * sizeof(int));
+			aChunkFence[MAX_CHUNKS_IN_FLIGHT - 1] = -1;
+
+			/* the first task the backend sees also waits for the fix-ups queued ahead of it */
+			merged = -1;
+			if (hostFence >= 0)
+			{
+				fence = pstV2dJob->astTasks[0].stV2dTask.acquireFencefd;
+				merged = V2dMergeFence((fence >= 0) ? dup(fence) : -1, hostFence);
+				pstV2dJob->astTasks[0].stV2dTask.acquireFencefd = merged;
+				hostFence = -1;
+			}
+			accepted = pstContext->pBackend->submit(pstContext->pPriv, pstV2dJob->astTasks, hw);
+			if (merged >= 0)
+				close(merged);
+		}
+		submitted = (accepted > 0) ? (uint32_t)accepted : 0;
+		if (submitted == hw && hostLast)
+			submitted = n;
+		if (trace)
+			chunkAcceptNs = V2dTraceNow();
+		pstV2dJob->accepted += submitted;
+		if (first + n == pstV2dJob->count)
+			pstV2dJob->acceptNs = V2dStatNow();
+		if (submitted != n)
+		{
+			printf("Failed to submit V2D task, %u of %u accepted!\n", first + submitted, pstV2dJob->count);
+			ret = FAILURE;
+		}
+
+		/* the backend holds its own reference on the acquire fences once submit returns */
+		last = (hostLast && submitted == n) ? hw : submitted;
+		for (i=0; i<n; i++)
+		{
+			curNode = &pstV2dJob->astTasks[i];
+			fence = curNode->stV2dTask.completeFencefd;
+			/* the trace takes over the task fences, a copy of the one that is handed on */
+			if (trace && i < submitted)
+				V2dTraceDesc(pstV2dJob, first + i, (i + 1 == last && fence >= 0) ? dup(fence) : fence, chunkNs, chunkAcceptNs);
+			if (i + 1 == last) {
+				aChunkFence[MAX_CHUNKS_IN_FLIGHT - 1] = fence;
+			} else if (i < last && fence >= 0 && !trace) {
+				close(fence);
+			}
+			if(pstV2dJob->pstDesc[first + i].acquireFence >= 0)
+			{
+				close(pstV2dJob->pstDesc[first + i].acquireFence);
+				pstV2dJob->pstDesc[first + i].acquireFence = -1;
+			}
+		}
+
+		if (flush && ret == SUCCESS)
+		{
+			for (i=MAX_CHUNKS_IN_FLIGHT, fence=-1; i>0 && fence<0; i--)
+				fence = aChunkFence[i - 1];
+			ret = V2dFlushFixups(pstV2dJob, fence, &merged);
+			hostFence = V2dMergeFence(hostFence, merged);
+		}
+	}
+	if (hostFence >= 0)
+		close(hostFence);
+
+	if (trace)
+		V2dTraceSpan(TRACE_SUBMIT, pstV2dJob->traceId, pstV2dJob->accepted, traceSubmitNs, V2dTraceNow());
+
+	/* the last chunk that made it to the backend covers all chunks before it */
+	*pFence = -1;
+	for (i=0; i<MAX_CHUNKS_IN_FLIGHT; i++)
+	{
+		if (*pFence >= 0 && aChunkFence[i] >= 0)
+		{
+			close(*pFence);
+			*pFence = -1;
+		}
+		if (aChunkFence[i] >= 0)
+			*pFence = aChunkFence[i];
+	}
+
+	/* the fix-ups still pending go after the whole job, their fence stands for it */
+	if (ret != SUCCESS)
+	{
+		V2dDropFixups(pstV2dJob->pstFixups, pstV2dJob->fixupCount);
+		pstV2dJob->fixupCount = 0;
+	}
+	else if (V2dFlushFixups(pstV2dJob, *pFence, &fence))
+	{
+		ret = FAILURE;
+	}
+	else if (fence >= 0)
+	{
+		if (*pFence >= 0)
+			close(*pFence);
+		*pFence = fence;
+	}
+	return ret;
+}
+
+static V2D_BACKEND_E V2dEnvBackend(void)
+{
+	const char *pName = getenv(BACKEND_ENV);
+	if (!pName || !pName[0] || !strcmp(pName, "device"))
+		return V2D_BACKEND_DEVICE;
+	if (!strcmp(pName, "cpu"))
+		return V2D_BACKEND_CPU;
+	if (!strcmp(pName, "auto"))
+		return V2D_BACKEND_AUTO;
+	printf("Unknown %s=%s, using the device\n", BACKEND_ENV, pName);
+	return V2D_BACKEND_DEVICE;
+}
+
+static uint32_t V2dEnvAlign(uint32_t align)
+{
+	const char *pAlign = getenv(ALIGN_ENV);
+	uint32_t value;
+
+	if (!pAlign || !pAlign[0])
+		return align;
+	value = (uint32_t)strtoul(pAlign, NULL, 0);
+	if (!value || (value & (value - 1)))
+	{
+		printf("%s=%s is not a power of two, using %u\n", ALIGN_ENV, pAlign, align);
+		return align;
+	}
+	return value;
+}
+
+static uint32_t V2dEnvWiden(uint32_t widen)
+{
+	const char *pWiden = getenv(WIDEN_ENV);
+
+	if (!pWiden || !pWiden[0])
+		return widen;
+	return strcmp(pWiden, "0") != 0;
+}
+
+static int V2dOpenContext(V2D_CONTEXT_S *pstContext)
+{
+	const V2D_BACKEND_S *pBackend;
+	void *pPriv = NULL;
+	int ret;
+
+	if (__atomic_load_n(&pstContext->pBackend, __ATOMIC_ACQUIRE))
+		return SUCCESS;
+	/* first submission on this context, threads may race to get here */
+	pthread_mutex_lock(&pstContext->lock);
+	if (!pstContext->pBackend)
+	{
+		if (pstContext->enBackend == V2D_BACKEND_BUTT)
+			pstContext->enBackend = V2dEnvBackend();
+		pBackend = (pstContext->enBackend == V2D_BACKEND_CPU) ? &gV2dCpuBackend : &gV2dDeviceBackend;
+		ret = pBackend->open(&pPriv);
+		if (ret && pstContext->enBackend == V2D_BACKEND_AUTO)
+		{
+			printf("Falling back to the v2d cpu backend\n");
+			pBackend = &gV2dCpuBackend;
+			ret = pBackend->open(&pPriv);
+		}
+		if (ret)
+		{
+			pthread_mutex_unlock(&pstContext->lock);
+			return FAILURE;
+		}
+		pstContext->pPriv = pPriv;
+		pstContext->dstAlign = V2dEnvAlign(pBackend->dstAlign);
+		pstContext->dstWiden = V2dEnvWiden(pBackend->dstWiden);
+		__atomic_store_n(&pstContext->pBackend, pBackend, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&pstContext->lock);
+	return SUCCESS;
+}
 
-typedef enum SPACEMIT_V2D_TASK_TYPE_E
+int32_t V2D_OpenBackend(V2D_BACKEND_E enBackend, V2D_CONTEXT_HANDLE *phContext)
 {
-	TASK_NONE   = 0,
-	ROTATION   = 1,
-	CSC  = 2,
-	FILL = 3,
-	BLEND = 3,
-} V2D_TASK_TYPE_E;
+	V2D_CONTEXT_S *pstContext;
+	if (!phContext || enBackend >= V2D_BACKEND_BUTT)
+		return FAILURE;
+	pstContext = (V2D_CONTEXT_S *)calloc(1, sizeof(V2D_CONTEXT_S));
+	if (!pstContext)
+	{
+		printf("Failed to malloc v2d context\n");
+		return FAILURE;
+	}
+	pstContext->enBackend = enBackend;
+	pstContext->pBackend = NULL;
+	pstContext->pPriv = NULL;
+	pstContext->refs = 1;
+	pstContext->fixupTimeline = -1;
+	pstContext->hostFence = -1;
+	pthread_mutex_init(&pstContext->lock, NULL);
+	pthread_cond_init(&pstContext->cbCond, NULL);
+	if (V2dOpenContext(pstContext))
+	{
+		V2dPutContext(pstContext);
+		return FAILURE;
+	}
+	*phContext = (uint64_t)(pstContext);
+	return SUCCESS;
+}
 
-typedef struct SPACEMIT_V2D_TASK_S
+int32_t V2D_Open(V2D_CONTEXT_HANDLE *phContext)
 {
-	V2D_SUBMIT_TASK_S stV2dTask;
-	struct SPACEMIT_V2D_TASK_S *pNext;
-} V2D_TASK_S;
+	return V2D_OpenBackend(V2dEnvBackend(), phContext);
+}
 
-typedef struct SPACEMIT_VGS_JOB_S
+int32_t V2D_Close(V2D_CONTEXT_HANDLE hContext)
 {
-	uint32_t count;
-	V2D_TASK_TYPE_E  currentTaskState;
-	V2D_TASK_S *pHead;
-	V2D_TASK_S *pTail;
-} V2D_JOB_S;
+	if (hContext==0)
+		return FAILURE;
+	V2dPutContext((V2D_CONTEXT_S *)hContext);
+	return SUCCESS;
+}
 
-#define DEV_NAME "/dev/v2d_dev"
-#define MAX_TASK_LIST_LENGTH 64
+int32_t V2D_Init(V2D_CONTEXT_HANDLE hContext, uint64_t *pInitNs)
+{
+	V2D_CONTEXT_S *pstContext = hContext ? (V2D_CONTEXT_S *)hContext : &gDefaultContext;
+	V2D_JOB_S *pstV2dJob;
+	V2D_CALLBACK_S *pCb;
+	struct timespec stStart, stEnd;
+	int ret, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &stStart);
+	if (V2dOpenContext(pstContext))
+		return FAILURE;
+	V2dCpuIsa();
+	V2dCscMatrix(V2D_CSC_MODE_RGB_2_BT601WIDE);
+	/* the waiter thread and a few callback records, enough for a frame loop keeping jobs in flight */
+	pthread_mutex_lock(&pstContext->lock);
+	ret = SUCCESS;
+	for (i=0; !pstContext->cbRunning && i<JOB_CACHE_DEPTH; i++)
+	{
+		pCb = (V2D_CALLBACK_S *)calloc(1, sizeof(V2D_CALLBACK_S));
+		if (!pCb)
+			break;
+		pCb->pNext = pstContext->pCbFree;
+		pstContext->pCbFree = pCb;
+	}
+	ret = V2dStartCallbackThread(pstContext);
+	if (pstContext->dstAlign > 1)
+		V2dFixupTimeline(pstContext);
+	pthread_mutex_unlock(&pstContext->lock);
+	if (ret)
+		return FAILURE;
+	/* and the backend drawing the unaligned edges left to the host, with its workers and map cache */
+	if (pstContext->dstAlign > 1 && !V2dFixupBackend(pstContext))
+		return FAILURE;
+
+	/* fault in the task array now rather than while the first frame fills it */
+	pstV2dJob = V2dGetJob(pstContext);
+	if (!pstV2dJob)
+		return FAILURE;
+	memset(pstV2dJob->pstDesc, 0, pstV2dJob->capacity * sizeof(V2D_TASK_DESC_S));
+	memset(pstV2dJob->pstSurfaces, 0, pstV2dJob->capacity * DESC_SURFACE_NUM * sizeof(V2D_SURFACE_S));
+	V2dPutJob(pstV2dJob);
 
-void freeList(V2D_TASK_S * pHead)
+	clock_gettime(CLOCK_MONOTONIC, &stEnd);
+	if (pInitNs)
+		*pInitNs = (uint64_t)(stEnd.tv_sec - stStart.tv_sec) * 1000000000ull + stEnd.tv_nsec - stStart.tv_nsec;
+	return SUCCESS;
+}
+
+int32_t V2D_BeginContextJob(V2D_CONTEXT_HANDLE hContext, V2D_HANDLE *pHandle)
 {
-	V2D_TASK_S * p;
-	while(pHead != NULL)
+	V2D_JOB_S *pstV2dJob = NULL;
+	if (hContext==0 || !pHandle)
+		return FAILURE;
+	pstV2dJob = V2dGetJob((V2D_CONTEXT_S *)hContext);
+	if (!pstV2dJob)
 	{
-		p = pHead;
-		pHead = pHead->pNext;
-		free(p);
-		p = NULL;
+		printf("Failed to malloc v2d job\n");
+		return FAILURE;
 	}
+	*pHandle = (uint64_t)(pstV2dJob);
+	return SUCCESS;
 }
 
-static int sync_wait(int fd, int timeout)
+int32_t V2D_BeginJob(V2D_HANDLE *pHandle)
 {
-	struct pollfd fds;
-	int ret = 0;
-	if (fd < 0) {
-		return -1;
+	V2D_JOB_S *pstV2dJob = NULL;
+	pstV2dJob = V2dGetJob(&gDefaultContext);
+	if (!pstV2dJob)
+	{
+		printf("Failed to malloc v2d job\n");
+		return FAILURE;
 	}
-	fds.fd = fd;
-	fds.events = POLLIN;
-	do {
-		ret = poll(&fds, 1, timeout);
-		if (ret > 0) {
-			if (fds.revents & (POLLERR | POLLNVAL)) {
-				return -1;
+	*pHandle = (uint64_t)(pstV2dJob);
+	return SUCCESS;
+}
+
+int32_t V2D_ResetJob(V2D_HANDLE hHandle)
+{
+	if(hHandle==0)
+		return FAILURE;
+	V2dClearJob((V2D_JOB_S *)hHandle);
+	return SUCCESS;
+}
+
+int32_t V2D_SetDeviceAccessHook(V2D_CONTEXT_HANDLE hContext, V2D_DEVICE_ACCESS_HOOK pfnHook, void *pUserData)
+{
+	V2D_CONTEXT_S *pstContext = hContext ? (V2D_CONTEXT_S *)hContext : &gDefaultContext;
+
+	pthread_mutex_lock(&pstContext->lock);
+	pstContext->pfnAccessHook = pfnHook;
+	pstContext->pAccessUser = pUserData;
+	pthread_mutex_unlock(&pstContext->lock);
+	return SUCCESS;
+}
+
+static int V2dAddAccess(V2D_BUFFER_ACCESS_S *pstAccess, int count, int fd, int write)
+{
+	int i;
+
+	if (fd <= 0)
+		return count;
+	for (i=0; i<count; i++)
+	{
+		if (pstAccess[i].fd == fd)
+		{
+			pstAccess[i].write |= write;
+			return count;
+		}
+	}
+	pstAccess[count].fd = fd;
+	pstAccess[count].write = write;
+	return count + 1;
+}
+
+/* reports the buffers of a job to the hook of its context, in batches of distinct fds */
+static void V2dDeviceAccess(V2D_JOB_S *pstV2dJob)
+{
+	V2D_CONTEXT_S *pstContext = pstV2dJob->pContext;
+	V2D_DEVICE_ACCESS_HOOK pfnHook;
+	V2D_BUFFER_ACCESS_S astAccess[ACCESS_BATCH];
+	V2D_TASK_DESC_S *pDesc = pstV2dJob->pstDesc;
+	V2D_SURFACE_S *pstSurface;
+	void *pUserData;
+	int count = 0, layer;
+	uint32_t i;
+
+	/* the pair is taken together, a hook never sees the user data of another */
+	pthread_mutex_lock(&pstContext->lock);
+	pfnHook = pstContext->pfnAccessHook;
+	pUserData = pstContext->pAccessUser;
+	pthread_mutex_unlock(&pstContext->lock);
+	if (!pfnHook)
+		return;
+	for (i=0; i<pstV2dJob->count; i++, pDesc++)
+	{
+		for (layer=0; layer<DESC_SURFACE_NUM; layer++)
+		{
+			if (!(pDesc->sections & (1 << layer)))
+				continue;
+			/* an fbc surface may keep its header in a buffer of its own */
+			if (count > ACCESS_BATCH - 2)
+			{
+				pfnHook(astAccess, count, pUserData);
+				count = 0;
 			}
-			return 0;
-		} else if (ret == 0) {
-			return -1;
+			pstSurface = &pstV2dJob->pstSurfaces[pDesc->surface[layer]];
+			count = V2dAddAccess(astAccess, count, pstSurface->fd, (1 << layer) == DESC_DST);
+			if (pstSurface->fbc_enable)
+				count = V2dAddAccess(astAccess, count, pstSurface->fbcDecInfo.fd, (1 << layer) == DESC_DST);
 		}
-	} while (ret == -1 );
+	}
+	if (count)
+		pfnHook(astAccess, count, pUserData);
+}
+
+/* wait tells whether the caller waits for the job to complete, see V2dHostAllowed */
+static int V2dEndJob(V2D_JOB_S *pstV2dJob, int *pFence, int wait)
+{
+	int ret;
+
+	*pFence = -1;
+	ret = V2dOpenContext(pstV2dJob->pContext);
+	if (ret == SUCCESS)
+	{
+		V2dDeviceAccess(pstV2dJob);
+		ret = V2dQueueJob(pstV2dJob, pFence, wait);
+	}
+	V2dStatJob(pstV2dJob, ret);
 	return ret;
 }
 
-int v2d_lock_async(int fence_fd)
+static void V2dTraceEndJob(V2D_JOB_S *pstV2dJob)
+{
+	if (!pstV2dJob->traceId)
+		return;
+	V2dTraceSpan(TRACE_JOB, pstV2dJob->traceId, pstV2dJob->count, pstV2dJob->traceNs, V2dTraceNow());
+	V2dTraceResolve();
+}
+
+int32_t V2D_EndJobAsync(V2D_HANDLE hHandle, int32_t *pCompleteFence)
 {
 	int ret = 0;
-	if (fence_fd >= 0)
+	if(hHandle==0 || !pCompleteFence)
+		return FAILURE;
+	V2D_JOB_S *pstV2dJob=(V2D_JOB_S *)hHandle;
+
+	ret = V2dEndJob(pstV2dJob, pCompleteFence, 0);
+	V2dTraceEndJob(pstV2dJob);
+	V2dPutJob(pstV2dJob);
+	return ret;
+}
+
+int32_t V2D_EndJobCallback(V2D_HANDLE hHandle, V2D_JOB_CALLBACK pfnCallback, void *pUserData)
+{
+	int ret = 0;
+	int fence = -1;
+	V2D_CONTEXT_S *pstContext;
+	if(hHandle==0 || !pfnCallback)
+		return FAILURE;
+	V2D_JOB_S *pstV2dJob=(V2D_JOB_S *)hHandle;
+
+	ret = V2dEndJob(pstV2dJob, &fence, 0);
+	pstContext = V2dRefContext(pstV2dJob->pContext);
+	if (ret || V2dQueueCallback(fence, pstContext, pstV2dJob->acceptNs, pfnCallback, pUserData))
 	{
-		ret = sync_wait(fence_fd, 3000);
-		close(fence_fd);
+		v2d_lock_async(fence);
+		V2dPutContext(pstContext);
+		ret = FAILURE;
 	}
+	V2dTraceEndJob(pstV2dJob);
+	V2dPutJob(pstV2dJob);
 	return ret;
 }
 
-int V2dSubmitJob(V2D_JOB_S *pstV2dJob)
+/* the job goes back to the cache only after the wait, so its timestamps are still around */
+int32_t V2D_EndJob(V2D_HANDLE hHandle)
 {
-	int ret;
-	int i;
-	V2D_TASK_S * curNode = pstV2dJob->pHead;
+	int ret = 0;
+	int wait;
+	int fence = -1;
+	uint64_t waitNs;
+	if(hHandle==0)
+		return FAILURE;
+	V2D_JOB_S *pstV2dJob=(V2D_JOB_S *)hHandle;
+
+	ret = V2dEndJob(pstV2dJob, &fence, 1);
+	waitNs = (pstV2dJob->traceId && fence >= 0) ? V2dTraceNow() : 0;
+	wait = (fence >= 0) ? V2dWaitFence(fence, 3000) : 0;
+	if (waitNs)
+		V2dTraceSpan(TRACE_WAIT, pstV2dJob->traceId, pstV2dJob->count, waitNs, V2dTraceNow());
+	if (ret == SUCCESS)
+		V2dStatComplete(pstV2dJob->pContext, pstV2dJob->acceptNs, fence, wait);
+	if (fence >= 0)
+		close(fence);
+	if (wait)
+		ret = FAILURE;
+	V2dTraceEndJob(pstV2dJob);
+	V2dPutJob(pstV2dJob);
+	return ret;
+}
+
+int32_t V2D_RecordTemplate(V2D_HANDLE hHandle, V2D_TEMPLATE_HANDLE *phTemplate)
+{
+	V2D_JOB_S *pstV2dJob = (V2D_JOB_S *)hHandle;
+	V2D_TEMPLATE_S *pTemplate;
+	int fenced;
+	uint32_t i;
+
+	if (hHandle==0 || !phTemplate)
+		return FAILURE;
+	fenced = pstV2dJob->pendingAcquireFence >= 0;
 	for (i=0; i<pstV2dJob->count; i++)
+		fenced |= pstV2dJob->pstDesc[i].acquireFence >= 0;
+	if (fenced || !pstV2dJob->count)
+	{
+		printf("Failed to record v2d template, %s\n", fenced ? "acquire fences are per replay" : "the job has no tasks");
+		V2dPutJob(pstV2dJob);
+		return FAILURE;
+	}
+	pTemplate = (V2D_TEMPLATE_S *)calloc(1, sizeof(V2D_TEMPLATE_S));
+	if (pTemplate)
+	{
+		pTemplate->pstDesc = (V2D_TASK_DESC_S *)malloc(pstV2dJob->count * sizeof(V2D_TASK_DESC_S));
+		pTemplate->pstSurfaces = (V2D_SURFACE_S *)malloc(pstV2dJob->surfaceCount * sizeof(V2D_SURFACE_S));
+	}
+	if (!pTemplate || !pTemplate->pstDesc || (pstV2dJob->surfaceCount && !pTemplate->pstSurfaces))
 	{
-		curNode->stV2dTask.acquireFencefd = -1;
-		curNode->stV2dTask.completeFencefd = -1;
-		ret = write(gFd, curNode, sizeof(V2D_TASK_S));
-		if (ret != sizeof(V2D_TASK_S))
+		printf("Failed to malloc v2d template\n");
+		if (pTemplate)
 		{
-			printf("Failed to submit V2D task!\n");
-			return FAILURE;
+			free(pTemplate->pstDesc);
+			free(pTemplate->pstSurfaces);
+			free(pTemplate);
 		}
-		curNode = curNode->pNext;
+		V2dPutJob(pstV2dJob);
+		return FAILURE;
+	}
+	pTemplate->id = __atomic_add_fetch(&gTemplateId, 1, __ATOMIC_RELAXED);
+	pTemplate->count = pstV2dJob->count;
+	pTemplate->surfaceCount = pstV2dJob->surfaceCount;
+	memcpy(pTemplate->pstDesc, pstV2dJob->pstDesc, pTemplate->count * sizeof(V2D_TASK_DESC_S));
+	memcpy(pTemplate->pstSurfaces, pstV2dJob->pstSurfaces, pTemplate->surfaceCount * sizeof(V2D_SURFACE_S));
+	for (i=0; i<pTemplate->count; i++)
+	{
+		if (pTemplate->pstDesc[i].pPalette)
+			V2dRefPalette(pTemplate->pstDesc[i].pPalette);
 	}
+	V2dPutJob(pstV2dJob);
+	*phTemplate = (uint64_t)pTemplate;
+	return SUCCESS;
+}
 
-	curNode = pstV2dJob->pHead;
-	for (i=0; i<pstV2dJob->count; i++)
+/* the first bind of a recorded fd wins, so binds may swap buffers around */
+static void V2dBindSurfaces(V2D_SURFACE_S *pstSurfaces, uint32_t count, const V2D_TEMPLATE_BIND_S *pstBind, uint32_t bindCount)
+{
+	uint32_t i, j;
+	int fd, fbcFd;
+
+	for (i=0; i<count; i++)
 	{
-		ret = v2d_lock_async(curNode->stV2dTask.completeFencefd);
-		if(curNode->stV2dTask.acquireFencefd > 0)
-			close(curNode->stV2dTask.acquireFencefd);
-		curNode = curNode->pNext;
+		fd = pstSurfaces[i].fd;
+		fbcFd = pstSurfaces[i].fbc_enable ? pstSurfaces[i].fbcDecInfo.fd : -1;
+		for (j=0; j<bindCount; j++)
+		{
+			if (pstBind[j].fd <= 0)
+				continue;
+			if (fd == pstBind[j].fd)
+			{
+				pstSurfaces[i].fd = pstBind[j].newFd;
+				pstSurfaces[i].offset += pstBind[j].offset;
+				fd = -1;
+			}
+			if (fbcFd == pstBind[j].fd)
+			{
+				pstSurfaces[i].fbcDecInfo.fd = pstBind[j].newFd;
+				fbcFd = -1;
+			}
+		}
 	}
-	return ret;
 }
 
-int32_t V2D_BeginJob(V2D_HANDLE *pHandle)
+int32_t V2D_ReplayTemplate(V2D_CONTEXT_HANDLE hContext, V2D_TEMPLATE_HANDLE hTemplate, const V2D_TEMPLATE_BIND_S *pstBind,
+                                uint32_t bindCount, int32_t acquireFence, int32_t *pCompleteFence)
 {
+	V2D_CONTEXT_S *pstContext = hContext ? (V2D_CONTEXT_S *)hContext : &gDefaultContext;
+	V2D_TEMPLATE_S *pTemplate = (V2D_TEMPLATE_S *)hTemplate;
+	V2D_TASK_DESC_S *pstOwnDesc;
 	V2D_JOB_S *pstV2dJob = NULL;
-	pstV2dJob = (V2D_JOB_S*)malloc(sizeof(V2D_JOB_S));
+	int ret, wait;
+	int fence = -1;
+	uint64_t waitNs;
+
+	if (hTemplate != 0 && (pstBind || !bindCount))
+		pstV2dJob = V2dGetJob(pstContext);
 	if (!pstV2dJob)
 	{
-		printf("Failed to malloc v2d job\n");
+		if (acquireFence >= 0)
+			close(acquireFence);
 		return FAILURE;
 	}
-	memset(pstV2dJob,0,sizeof(V2D_JOB_S));
-	pstV2dJob->currentTaskState = TASK_NONE;
-	pstV2dJob->pHead = NULL;
-	pstV2dJob->pTail = NULL;
-	*pHandle = (uint64_t)(pstV2dJob);
+	pstV2dJob->pendingAcquireFence = acquireFence;
+	if (pTemplate->count > pstV2dJob->capacity && V2dReserveJob(pstV2dJob, pTemplate->count))
+	{
+		printf("Failed to grow v2d task list to %u tasks\n", pTemplate->count);
+		V2dPutJob(pstV2dJob);
+		return FAILURE;
+	}
+	pstV2dJob->addNs = V2dStatNow();
+	memcpy(pstV2dJob->pstSurfaces, pTemplate->pstSurfaces, pTemplate->surfaceCount * sizeof(V2D_SURFACE_S));
+	pstV2dJob->surfaceCount = pTemplate->surfaceCount;
+	V2dBindSurfaces(pstV2dJob->pstSurfaces, pstV2dJob->surfaceCount, pstBind, bindCount);
+	pstOwnDesc = pstV2dJob->pstDesc;
+	pstV2dJob->pstDesc = pTemplate->pstDesc;
+	pstV2dJob->count = pTemplate->count;
+	pstV2dJob->pTemplate = pTemplate;
+
+	ret = V2dEndJob(pstV2dJob, &fence, pCompleteFence == NULL);
+	if (pCompleteFence)
+	{
+		*pCompleteFence = fence;
+	}
+	else
+	{
+		waitNs = (pstV2dJob->traceId && fence >= 0) ? V2dTraceNow() : 0;
+		wait = (fence >= 0) ? V2dWaitFence(fence, 3000) : 0;
+		if (waitNs)
+			V2dTraceSpan(TRACE_WAIT, pstV2dJob->traceId, pstV2dJob->count, waitNs, V2dTraceNow());
+		if (ret == SUCCESS)
+			V2dStatComplete(pstV2dJob->pContext, pstV2dJob->acceptNs, fence, wait);
+		if (fence >= 0)
+			close(fence);
+		if (wait)
+			ret = FAILURE;
+	}
+	V2dTraceEndJob(pstV2dJob);
+	/* hand the job its own descriptors back before they are cleared */
+	pstV2dJob->pstDesc = pstOwnDesc;
+	pstV2dJob->count = 0;
+	pstV2dJob->pTemplate = NULL;
+	V2dPutJob(pstV2dJob);
+	return ret;
+}
+
+int32_t V2D_DestroyTemplate(V2D_TEMPLATE_HANDLE hTemplate)
+{
+	V2D_TEMPLATE_S *pTemplate = (V2D_TEMPLATE_S *)hTemplate;
+	uint32_t i;
+
+	if (hTemplate == 0)
+		return FAILURE;
+	for (i=0; i<pTemplate->count; i++)
+		V2dPutPalette(pTemplate->pstDesc[i].pPalette);
+	free(pTemplate->pstDesc);
+	free(pTemplate->pstSurfaces);
+	free(pTemplate);
 	return SUCCESS;
 }
 
-int32_t V2D_EndJob(V2D_HANDLE hHandle)
+int32_t V2D_GetStats(V2D_CONTEXT_HANDLE hContext, V2D_STATS_S *pstStats)
 {
-	int ret = 0;
-	if(hHandle==0)
+#ifdef V2D_STATS
+	V2D_CONTEXT_S *pstContext = hContext ? (V2D_CONTEXT_S *)hContext : &gDefaultContext;
+	V2D_LATENCY_S *pstLatency;
+	int i;
+	if (!pstStats)
 		return FAILURE;
-	V2D_JOB_S *pstV2dJob=(V2D_JOB_S *)hHandle;
+	/* a snapshot of the counters, jobs ending meanwhile may be partially in it */
+	memcpy(pstStats, &pstContext->stStats, sizeof(V2D_STATS_S));
+	for (pstLatency=&pstStats->build; pstLatency<=&pstStats->complete; pstLatency++)
+	{
+		pstLatency->count = 0;
+		for (i=0; i<V2D_STATS_BUCKETS; i++)
+			pstLatency->count += pstLatency->buckets[i];
+	}
+	return SUCCESS;
+#else
+	return FAILURE;
+#endif
+}
+
+int32_t V2D_ResetStats(V2D_CONTEXT_HANDLE hContext)
+{
+#ifdef V2D_STATS
+	V2D_CONTEXT_S *pstContext = hContext ? (V2D_CONTEXT_S *)hContext : &gDefaultContext;
+	memset(&pstContext->stStats, 0, sizeof(V2D_STATS_S));
+	return SUCCESS;
+#else
+	return FAILURE;
+#endif
+}
+static V2D_TASK_DESC_S *V2dNewDesc(V2D_JOB_S *pstV2dJob)
+{
+	V2D_TASK_DESC_S *pDesc;
 
-	if(gFd < 0)
+	if (pstV2dJob->count >= pstV2dJob->capacity && V2dReserveJob(pstV2dJob, pstV2dJob->capacity * 2))
 	{
-		gFd = open(DEV_NAME, O_RDWR|O_CLOEXEC|O_NONBLOCK);
-		if(gFd >= 0)
-		{
-			ret = V2dSubmitJob(pstV2dJob);
-		}else{
-			gFd = -1;
-			printf("Failed to open device file %s\n", DEV_NAME);
-			ret = FAILURE;
-		}
-	}else{
-		ret = V2dSubmitJob(pstV2dJob);
+		printf("Failed to grow v2d task list beyond %u tasks\n", pstV2dJob->capacity);
+		return NULL;
+	}
+	if (!pstV2dJob->count)
+		pstV2dJob->addNs = V2dStatNow();
+	pDesc = &pstV2dJob->pstDesc[pstV2dJob->count++];
+	memset(pDesc,0,sizeof(V2D_TASK_DESC_S));
+	pDesc->acquireFence = pstV2dJob->pendingAcquireFence;
+	pstV2dJob->pendingAcquireFence = -1;
+	return pDesc;
+}
+
+/* surfaces are usually shared between neighbouring tasks, e.g. one dst for all windows */
+static void V2dDescSurface(V2D_JOB_S *pstV2dJob, V2D_TASK_DESC_S *pDesc, int layer, V2D_SURFACE_S *pstSurface)
+{
+	uint32_t i, first;
+
+	first = (pstV2dJob->surfaceCount > DESC_SURFACE_NUM) ? pstV2dJob->surfaceCount - DESC_SURFACE_NUM : 0;
+	for (i=pstV2dJob->surfaceCount; i>first; i--)
+	{
+		if (!memcmp(&pstV2dJob->pstSurfaces[i-1], pstSurface, sizeof(V2D_SURFACE_S)))
+			break;
 	}
-	freeList(pstV2dJob->pHead);
-	pstV2dJob->pTail = NULL;
-	if(pstV2dJob)
+	if (i == first)
 	{
-		free(pstV2dJob);
-		pstV2dJob = NULL;
+		i = ++pstV2dJob->surfaceCount;
+		memcpy(&pstV2dJob->pstSurfaces[i-1], pstSurface, sizeof(V2D_SURFACE_S));
 	}
-	hHandle=-1;
-	return ret;
+	pDesc->surface[layer] = i - 1;
+	pDesc->sections |= (1 << layer);
+}
+
+static void V2dDescPalette(V2D_TASK_DESC_S *pDesc, V2D_PALETTE_OBJ_S *pPalette)
+{
+	V2dPutPalette(pDesc->pPalette);
+	pDesc->pPalette = pPalette;
+	pDesc->sections |= DESC_PALETTE;
+}
+
+int32_t V2D_AddAcquireFence(V2D_HANDLE hHandle, int32_t fenceFd)
+{
+	int *pFence;
+	if (hHandle==0 || fenceFd < 0)
+		return FAILURE;
+	V2D_JOB_S *pstV2dJob=(V2D_JOB_S *)hHandle;
+
+	if (pstV2dJob->count)
+		pFence = &pstV2dJob->pstDesc[pstV2dJob->count - 1].acquireFence;
+	else
+		pFence = &pstV2dJob->pendingAcquireFence;
+	*pFence = V2dMergeFence(*pFence, fenceFd);
+	return SUCCESS;
+}
+
+int32_t V2D_CreatePalette(V2D_PALETTE_S *pstPalette, V2D_PALETTE_HANDLE *phPalette)
+{
+	V2D_PALETTE_OBJ_S *pPalette;
+	if (!pstPalette || !phPalette)
+		return FAILURE;
+	pPalette = V2dNewPalette(pstPalette);
+	if (!pPalette)
+	{
+		printf("Failed to malloc v2d palette\n");
+		return FAILURE;
+	}
+	*phPalette = (uint64_t)(pPalette);
+	return SUCCESS;
+}
+
+int32_t V2D_DestroyPalette(V2D_PALETTE_HANDLE hPalette)
+{
+	if (hPalette==0)
+		return FAILURE;
+	V2dPutPalette((V2D_PALETTE_OBJ_S *)hPalette);
+	return SUCCESS;
+}
+
+int32_t V2D_SetTaskPalette(V2D_HANDLE hHandle, V2D_PALETTE_HANDLE hPalette)
+{
+	if (hHandle==0 || hPalette==0)
+		return FAILURE;
+	V2D_JOB_S *pstV2dJob=(V2D_JOB_S *)hHandle;
+	if (pstV2dJob->count == 0)
+		return FAILURE;
+	V2dDescPalette(&pstV2dJob->pstDesc[pstV2dJob->count - 1], V2dRefPalette((V2D_PALETTE_OBJ_S *)hPalette));
+	return SUCCESS;
 }
+
 int32_t V2D_AddFillTask(V2D_HANDLE hHandle, V2D_SURFACE_S *pstDst, V2D_AREA_S *pstDstRect,  V2D_FILLCOLOR_S *pstFillColor)
 {
-	V2D_PARAM_S *pstParam;
-	V2D_SURFACE_S *pstSrc, *pstOut;
-	V2D_BLEND_CONF_S *pstBlendConf;
+	V2D_TASK_DESC_S *pDesc;
+	V2D_SURFACE_S stSrc;
 	V2D_BLEND_LAYER_CONF_S *pstBlendLayerConf;
 
 	if (hHandle==0)
 		return FAILURE;
 
 	V2D_JOB_S *pstV2dJob=(V2D_JOB_S *)hHandle;
-	pstV2dJob->count++;
-	if (pstV2dJob->count>MAX_TASK_LIST_LENGTH)
-	{
-		printf("Faied to add fill task, the task list length exceeds %d\n", MAX_TASK_LIST_LENGTH);
-		pstV2dJob->count--;
-		return FAILURE;
-	}
 	pstV2dJob->currentTaskState = FILL;
-	V2D_TASK_S * pNew = (V2D_TASK_S *)malloc(sizeof(V2D_TASK_S));
-	if(pNew == NULL)
-	{
-		printf("The new node assignment failed and the program terminated!\n");
-		exit(-1);
-	}
-	memset(pNew,0,sizeof(V2D_TASK_S));
-	pstParam = &pNew->stV2dTask.param;
+	pDesc = V2dNewDesc(pstV2dJob);
+	if (!pDesc)
+		return FAILURE;
+	pDesc->type = TRACE_TASK_FILL;
 	//config layer0 input solid color
-	pstParam->l0_csc = V2D_CSC_MODE_BUTT;
-	pstSrc = &pstParam->layer0;
-	pstSrc->solidcolor.enable = 1;
-	memcpy(&pstSrc->solidcolor.fillcolor, pstFillColor, sizeof(V2D_FILLCOLOR_S));
+	pDesc->l0_csc = V2D_CSC_MODE_BUTT;
+	memset(&stSrc, 0, sizeof(V2D_SURFACE_S));
+	stSrc.solidcolor.enable = 1;
+	memcpy(&stSrc.solidcolor.fillcolor, pstFillColor, sizeof(V2D_FILLCOLOR_S));
+	V2dDescSurface(pstV2dJob, pDesc, 0, &stSrc);
 	//config output
 	if (pstDst) {
-		memcpy(&pstParam->dst, pstDst, sizeof(V2D_SURFACE_S));
+		V2dDescSurface(pstV2dJob, pDesc, 3, pstDst);
 	}
 	if (pstDstRect) {
-		memcpy(&pstParam->dst_rect, pstDstRect, sizeof(V2D_AREA_S));
+		pDesc->rect[3] = *pstDstRect;
 	}
 	//config blend
-	pstBlendConf = &pstParam->blendconf;
-	pstBlendConf->blend_cmd = V2D_BLENDCMD_ALPHA;
-	pstBlendConf->bgcolor.enable = 0;
-	pstBlendLayerConf = &pstBlendConf->blendlayer[0];
+	pDesc->blendconf.blend_cmd = V2D_BLENDCMD_ALPHA;
+	pDesc->blendconf.bgcolor.enable = 0;
+	pstBlendLayerConf = &pDesc->blendconf.blendlayer[0];
 	pstBlendLayerConf->blend_area.x = pstDstRect->x;
 	pstBlendLayerConf->blend_area.y = pstDstRect->y;
 	pstBlendLayerConf->blend_area.w = pstDstRect->w;
 	pstBlendLayerConf->blend_area.h = pstDstRect->h;
 
-	pNew->pNext=NULL;
-	if (!pstV2dJob->pHead) {
-		pstV2dJob->pHead = pNew;
-	} else {
-		pstV2dJob->pTail->pNext = pNew;
-	}
-	pstV2dJob->pTail = pNew;
-
 	return SUCCESS;
 }
 
 int32_t V2D_AddBitblitTask(V2D_HANDLE hHandle, V2D_SURFACE_S *pstDst, V2D_AREA_S *pstDstRect, V2D_SURFACE_S *pstSrc,
                                 V2D_AREA_S *pstSrcRect, V2D_CSC_MODE_E enCSCMode)
 {
-	V2D_PARAM_S *pstParam;
-	V2D_SURFACE_S *pstInput, *pstOutput;
-	V2D_BLEND_CONF_S *pstBlendConf;
+	V2D_TASK_DESC_S *pDesc;
 	V2D_BLEND_LAYER_CONF_S *pstBlendLayerConf;
 	if (hHandle==0)
 		return FAILURE;
 	V2D_JOB_S *pstV2dJob=(V2D_JOB_S *)hHandle;
-	pstV2dJob->count++;
-	if (pstV2dJob->count>MAX_TASK_LIST_LENGTH)
-	{
-		printf("Faied to add bitblit task, the task list length exceeds %d\n", MAX_TASK_LIST_LENGTH);
-		pstV2dJob->count--;
-		return FAILURE;
-	}
 	pstV2dJob->currentTaskState = TASK_NONE;
-	V2D_TASK_S * pNew = (V2D_TASK_S *)malloc(sizeof(V2D_TASK_S));
-	if(pNew == NULL)
-	{
-		printf("The new node assignment failed and the program terminated!\n");
-		exit(-1);
-	}
-	memset(pNew,0,sizeof(V2D_TASK_S));
-	pstParam = &pNew->stV2dTask.param;
+	pDesc = V2dNewDesc(pstV2dJob);
+	if (!pDesc)
+		return FAILURE;
+	pDesc->type = TRACE_TASK_BLIT;
 	//config input
-	pstParam->l0_csc = V2D_CSC_MODE_BUTT;
-	memcpy(&pstParam->layer0, pstSrc, sizeof(V2D_SURFACE_S));
-	memcpy(&pstParam->l0_rect, pstSrcRect, sizeof(V2D_AREA_S));
+	pDesc->l0_csc = V2D_CSC_MODE_BUTT;
+	V2dDescSurface(pstV2dJob, pDesc, 0, pstSrc);
+	pDesc->rect[0] = *pstSrcRect;
 	//config output
-	memcpy(&pstParam->dst, pstDst, sizeof(V2D_SURFACE_S));
-	memcpy(&pstParam->dst_rect, pstDstRect, sizeof(V2D_AREA_S));
+	V2dDescSurface(pstV2dJob, pDesc, 3, pstDst);
+	pDesc->rect[3] = *pstDstRect;
 	//config blend
-	pstBlendConf = &pstParam->blendconf;
-	pstBlendConf->bgcolor.enable = 0;
-	pstBlendLayerConf = &pstBlendConf->blendlayer[0];
+	pDesc->blendconf.bgcolor.enable = 0;
+	pstBlendLayerConf = &pDesc->blendconf.blendlayer[0];
 	pstBlendLayerConf->blend_area.x = pstDstRect->x;
 	pstBlendLayerConf->blend_area.y = pstDstRect->y;
 	pstBlendLayerConf->blend_area.w = pstDstRect->w;
 	pstBlendLayerConf->blend_area.h = pstDstRect->h;
 
-	pNew->pNext=NULL;
-	if (!pstV2dJob->pHead) {
-		pstV2dJob->pHead = pNew;
-	} else {
-		pstV2dJob->pTail->pNext = pNew;
-	}
-	pstV2dJob->pTail = pNew;
-
 	return SUCCESS;
 
 }
@@ -294,70 +2165,65 @@ int32_t V2D_AddBlendTask(V2D_HANDLE hHandle,
                              V2D_PALETTE_S *pstPalette,
                              V2D_DITHER_E dither)
 {
-	V2D_PARAM_S *pstParam;
+	V2D_TASK_DESC_S *pDesc, *pPrev;
+	V2D_PALETTE_OBJ_S *pPalette;
 
 	if (hHandle==0)
 		return FAILURE;
 	V2D_JOB_S *pstV2dJob=(V2D_JOB_S *)hHandle;
-	pstV2dJob->count++;
-	if (pstV2dJob->count>MAX_TASK_LIST_LENGTH)
-	{
-		printf("Faied to add blend task, the task list length exceeds %d\n", MAX_TASK_LIST_LENGTH);
-		pstV2dJob->count--;
-		return FAILURE;
-	}
 	pstV2dJob->currentTaskState = BLEND;
-	V2D_TASK_S * pNew = (V2D_TASK_S *)malloc(sizeof(V2D_TASK_S));
-	if(pNew == NULL)
-	{
-		printf("The new node assignment failed and the program terminated!\n");
-		exit(-1);
-	}
-	memset(pNew,0,sizeof(V2D_TASK_S));
-	pstParam = &pNew->stV2dTask.param;
-	pstParam->l0_csc = enBackCSCMode;
-	pstParam->l1_csc = enForeCSCMode;
-	pstParam->l0_rt  = enBackRotateAngle;
-	pstParam->l1_rt  = enForeRotateAngle;
-	pstParam->dither = dither;
+	pDesc = V2dNewDesc(pstV2dJob);
+	if (!pDesc)
+		return FAILURE;
+	pDesc->type = TRACE_TASK_BLEND;
+	pDesc->l0_csc = enBackCSCMode;
+	pDesc->l1_csc = enForeCSCMode;
+	pDesc->l0_rt  = enBackRotateAngle;
+	pDesc->l1_rt  = enForeRotateAngle;
+	pDesc->dither = dither;
 	if (pstBackGround) {
-		memcpy(&pstParam->layer0, pstBackGround, sizeof(V2D_SURFACE_S));
+		V2dDescSurface(pstV2dJob, pDesc, 0, pstBackGround);
 	}
 	if (pstBackGroundRect) {
-		memcpy(&pstParam->l0_rect, pstBackGroundRect, sizeof(V2D_AREA_S));
+		pDesc->rect[0] = *pstBackGroundRect;
 	}
 	if (pstForeGround) {
-		memcpy(&pstParam->layer1, pstForeGround, sizeof(V2D_SURFACE_S));
+		V2dDescSurface(pstV2dJob, pDesc, 1, pstForeGround);
 	}
 	if (pstForeGroundRect) {
-		memcpy(&pstParam->l1_rect, pstForeGroundRect, sizeof(V2D_AREA_S));
+		pDesc->rect[1] = *pstForeGroundRect;
 	}
 	if (pstMask) {
-		memcpy(&pstParam->mask, pstMask, sizeof(V2D_SURFACE_S));
+		V2dDescSurface(pstV2dJob, pDesc, 2, pstMask);
 	}
 	if (pstMaskRect) {
-		memcpy(&pstParam->mask_rect, pstMaskRect, sizeof(V2D_AREA_S));
+		pDesc->rect[2] = *pstMaskRect;
 	}
 	if (pstDst) {
-		memcpy(&pstParam->dst, pstDst, sizeof(V2D_SURFACE_S));
+		V2dDescSurface(pstV2dJob, pDesc, 3, pstDst);
 	}
 	if (pstDstRect) {
-		memcpy(&pstParam->dst_rect, pstDstRect, sizeof(V2D_AREA_S));
+		pDesc->rect[3] = *pstDstRect;
 	}
 	if (pstBlendConf) {
-		memcpy(&pstParam->blendconf, pstBlendConf, sizeof(V2D_BLEND_CONF_S));
+		memcpy(&pDesc->blendconf, pstBlendConf, sizeof(V2D_BLEND_CONF_S));
 	}
 	if (pstPalette) {
-		memcpy(&pstParam->palette, pstPalette, sizeof(V2D_PALETTE_S));
-	}
-	pNew->pNext=NULL;
-	if (!pstV2dJob->pHead) {
-		pstV2dJob->pHead = pNew;
-	} else {
-		pstV2dJob->pTail->pNext = pNew;
+		//palettes passed by value are shared with the previous task when unchanged
+		pPrev = (pstV2dJob->count > 1) ? pDesc - 1 : NULL;
+		if (pPrev && pPrev->pPalette && !memcmp(&pPrev->pPalette->stPalette, pstPalette, sizeof(V2D_PALETTE_S)))
+			pPalette = V2dRefPalette(pPrev->pPalette);
+		else
+			pPalette = V2dNewPalette(pstPalette);
+		if (!pPalette)
+		{
+			printf("Failed to malloc v2d palette\n");
+			pstV2dJob->pendingAcquireFence = pDesc->acquireFence;
+			pstV2dJob->count--;
+			return FAILURE;
+		}
+		V2dDescPalette(pDesc, pPalette);
 	}
-	pstV2dJob->pTail = pNew;
 
 	return SUCCESS;
 }
-
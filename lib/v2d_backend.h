@@ -0,0 +1,42 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#ifndef __V2D_BACKEND_H__
+#define __V2D_BACKEND_H__
+#include "v2d_type.h"
+
+typedef struct SPACEMIT_V2D_TASK_S
+{
+	V2D_SUBMIT_TASK_S stV2dTask;
+	void *pReserved; /* was the list link, keeps the per-task write size the driver expects */
+} V2D_TASK_S;
+
+/*
+ * A backend executes the expanded tasks of a job. open() is called once per
+ * context on its first submission, submit() may be called from several
+ * threads at once and returns how many of the tasks it accepted, in order.
+ * Accepted tasks carry their completion fence in completeFencefd, -1 when
+ * the task had already completed by the time submit() returned.
+ */
+typedef struct SPACEMIT_V2D_BACKEND_S
+{
+	const char *name;
+	int32_t (*open)(void **ppPriv);
+	void (*close)(void *pPriv);
+	int32_t (*submit)(void *pPriv, V2D_TASK_S *pstTasks, uint32_t count);
+	uint32_t dstAlign; /* dst_rect x and y have to be multiples of it */
+	uint32_t dstWiden; /* an unaligned task may grow to the aligned origin, see V2dAlignTask */
+} V2D_BACKEND_S;
+
+extern const V2D_BACKEND_S gV2dDeviceBackend;
+extern const V2D_BACKEND_S gV2dCpuBackend;
+
+/* waits on a fence without consuming it, 0 once signaled */
+int V2dWaitFence(int fence, int timeout);
+/* 1 with the time the kernel stamped on the fence once it signaled, 0 while it is pending, -1 on errors */
+int V2dFenceSignaled(int fence, uint64_t *pNs);
+
+#endif
@@ -0,0 +1,1478 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pthread.h"
+#include "v2d_backend.h"
+#include "v2d_cpu.h"
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/dma-buf.h>
+
+/*
+ * Reference implementation of the V2D pipeline on the cpu. Every task is run
+ * to completion inside submit(), so tasks never carry a completion fence.
+ * V2D_CPU_THREADS caps the worker threads, all online cores by default.
+ *
+ * For every destination pixel in dst_rect:
+ *  - layer0 is sampled where its blend_area covers the pixel and, with the
+ *    background colour enabled, blended over it with blendlayer[0],
+ *  - layer1 is sampled where its blend_area covers the pixel and blended or
+ *    ROP2'ed over that result with blendlayer[1], gated or scaled by the mask,
+ *  - the result is dithered and stored, pixels no layer covers are left alone.
+ * Layers are scaled from their rect to their blend_area by nearest sampling,
+ * rotation is applied clockwise. Surface offset is the byte offset of the
+ * chroma plane of NV12/NV21 surfaces, solid and fill colours are the little
+ * endian bytes of a pixel in their format. Fbc layers are decoded on the cpu
+ * before the task runs. A task with an fbc destination renders into a zeroed
+ * copy, whose superblocks under dst_rect are encoded once its batch ran.
+ *
+ * Buffers stay mapped across submits, looked up by device and inode so a
+ * reused fd number never hits the mapping of another buffer. A mapping keeps
+ * its buffer alive, so each submit first drops the cached mappings whose fd
+ * no longer refers to their buffer, and the idle ones are evicted least
+ * recently used first beyond CPU_MAP_CACHE_BYTES. A closed buffer is thus
+ * released by the next submit at the latest, or when the backend is closed.
+ * Each submit still brackets its access with dma-buf syncs.
+ */
+
+#define CPU_MAP_MAX 32
+#define CPU_MAP_CACHE 32
+#define CPU_MAP_CACHE_BYTES (64u << 20)
+#define CPU_TASK_MAPS 4
+/* a task touches at most four surfaces, two ranges each for NV12/NV21 */
+#define CPU_TASK_RANGES (2 * CPU_TASK_MAPS)
+#define CPU_BATCH_MAX 64
+#define CPU_TILE_BYTES (64 * 1024)
+#define CPU_THREADS_MAX 16
+#define CPU_THREADS_ENV "V2D_CPU_THREADS"
+#define CPU_FENCE_TIMEOUT 3000
+
+typedef struct SPACEMIT_V2D_CPU_CACHED_S
+{
+	dev_t dev;
+	ino_t ino;
+	int fd; /* the fd it was last mapped through */
+	uint8_t *pAddr; /* NULL for a free slot */
+	size_t size;
+	uint32_t users; /* submits working on it, it is only evicted at 0 */
+	uint64_t lastUse;
+} V2D_CPU_CACHED_S;
+
+typedef struct SPACEMIT_V2D_CPU_MAP_CACHE_S
+{
+	pthread_mutex_t lock;
+	uint64_t clock;
+	size_t bytes; /* mapped by all entries */
+	V2D_CPU_CACHED_S astEntry[CPU_MAP_CACHE];
+} V2D_CPU_MAP_CACHE_S;
+
+typedef struct SPACEMIT_V2D_CPU_MAP_S
+{
+	int fd;
+	uint8_t *pAddr;
+	size_t size;
+	V2D_CPU_CACHED_S *pCached; /* NULL for a mapping of this submit only */
+} V2D_CPU_MAP_S;
+
+/* the buffers of one submit */
+typedef struct SPACEMIT_V2D_CPU_MAPS_S
+{
+	V2D_CPU_MAP_CACHE_S *pCache;
+	V2D_CPU_MAP_S astMap[CPU_MAP_MAX];
+	int count;
+} V2D_CPU_MAPS_S;
+
+typedef struct SPACEMIT_V2D_CPU_LAYER_S
+{
+	int active;
+	int solid;
+	V2D_PIXEL_S stSolid;
+	const V2D_SURFACE_S *pSurface;
+	uint8_t *pBase;
+	uint8_t *pChroma;
+	uint32_t stride;
+	/* decoded copy of an fbc surface, owned by the layer */
+	uint8_t *pFbc;
+	/* buffer of an fbc destination, pFbc is encoded into it */
+	const V2D_CPU_MAP_S *pFbcMap;
+	const uint8_t *pPalette;
+	V2D_AREA_S rect;
+	V2D_AREA_S area;
+	V2D_ROTATE_ANGLE_E rt;
+	const V2D_CSC_MATRIX_S *pCsc;
+} V2D_CPU_LAYER_S;
+
+typedef struct SPACEMIT_V2D_CPU_TASK_S
+{
+	const V2D_PARAM_S *pParam;
+	V2D_CPU_LAYER_S astLayer[V2D_INPUT_LAYER_NUM];
+	V2D_CPU_LAYER_S stMask;
+	V2D_CPU_LAYER_S stDst;
+	V2D_PIXEL_S stBgColor;
+	/* plain unscaled layer0 copies go through the row kernels of V2dCscConvert or V2dRotateConvert */
+	int rowPath;
+	V2D_IMAGE_S stSrcImage;
+	V2D_IMAGE_S stDstImage;
+} V2D_CPU_TASK_S;
+
+static const uint8_t gBayer4x4[4][4] = {
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
+
+static const uint8_t gBayer2x2[2][2] = {
+	{ 0, 2 },
+	{ 3, 1 },
+};
+
+/* bytes per pixel of the first plane */
+int V2dCpuBpp(V2D_COLOR_FORMAT_E format)
+{
+	switch (format)
+	{
+		case V2D_COLOR_FORMAT_RGBX8888:
+		case V2D_COLOR_FORMAT_RGBA8888:
+		case V2D_COLOR_FORMAT_ARGB8888:
+		case V2D_COLOR_FORMAT_BGRX8888:
+		case V2D_COLOR_FORMAT_BGRA8888:
+		case V2D_COLOR_FORMAT_ABGR8888:
+			return 4;
+		case V2D_COLOR_FORMAT_RGB888:
+		case V2D_COLOR_FORMAT_BGR888:
+		case V2D_COLOR_FORMAT_RGBA5658:
+		case V2D_COLOR_FORMAT_ARGB8565:
+		case V2D_COLOR_FORMAT_BGRA5658:
+		case V2D_COLOR_FORMAT_ABGR8565:
+			return 3;
+		case V2D_COLOR_FORMAT_RGB565:
+		case V2D_COLOR_FORMAT_BGR565:
+			return 2;
+		default:
+			return 1;
+	}
+}
+
+int V2dCpuIsPalette(V2D_COLOR_FORMAT_E format)
+{
+	return (format >= V2D_COLOR_FORMAT_L8_RGBA8888 && format <= V2D_COLOR_FORMAT_L8_RGB565) ||
+	       (format >= V2D_COLOR_FORMAT_L8_BGRA8888 && format <= V2D_COLOR_FORMAT_L8_BGR565);
+}
+
+/* format of the palette entries of an L8 format */
+static V2D_COLOR_FORMAT_E V2dCpuPaletteFormat(V2D_COLOR_FORMAT_E format)
+{
+	switch (format)
+	{
+		case V2D_COLOR_FORMAT_L8_RGBA8888: return V2D_COLOR_FORMAT_RGBA8888;
+		case V2D_COLOR_FORMAT_L8_RGB888:   return V2D_COLOR_FORMAT_RGB888;
+		case V2D_COLOR_FORMAT_L8_RGB565:   return V2D_COLOR_FORMAT_RGB565;
+		case V2D_COLOR_FORMAT_L8_BGRA8888: return V2D_COLOR_FORMAT_BGRA8888;
+		case V2D_COLOR_FORMAT_L8_BGR888:   return V2D_COLOR_FORMAT_BGR888;
+		default:                           return V2D_COLOR_FORMAT_BGR565;
+	}
+}
+
+static void V2dCpuUnpack565(const uint8_t *p, int bgr, V2D_PIXEL_S *px)
+{
+	uint32_t v = p[0] | (p[1] << 8);
+	uint8_t hi = (v >> 11) & 0x1f, mid = (v >> 5) & 0x3f, lo = v & 0x1f;
+
+	px->c[bgr ? 2 : 0] = (hi << 3) | (hi >> 2);
+	px->c[1] = (mid << 2) | (mid >> 4);
+	px->c[bgr ? 0 : 2] = (lo << 3) | (lo >> 2);
+}
+
+void V2dCpuUnpack(const uint8_t *p, V2D_COLOR_FORMAT_E format, V2D_PIXEL_S *px)
+{
+	px->c[3] = 0xff;
+	switch (format)
+	{
+		case V2D_COLOR_FORMAT_RGB888:
+		case V2D_COLOR_FORMAT_RGBX8888:
+			px->c[0] = p[0]; px->c[1] = p[1]; px->c[2] = p[2];
+			break;
+		case V2D_COLOR_FORMAT_RGBA8888:
+			px->c[0] = p[0]; px->c[1] = p[1]; px->c[2] = p[2]; px->c[3] = p[3];
+			break;
+		case V2D_COLOR_FORMAT_ARGB8888:
+			px->c[3] = p[0]; px->c[0] = p[1]; px->c[1] = p[2]; px->c[2] = p[3];
+			break;
+		case V2D_COLOR_FORMAT_BGR888:
+		case V2D_COLOR_FORMAT_BGRX8888:
+			px->c[2] = p[0]; px->c[1] = p[1]; px->c[0] = p[2];
+			break;
+		case V2D_COLOR_FORMAT_BGRA8888:
+			px->c[2] = p[0]; px->c[1] = p[1]; px->c[0] = p[2]; px->c[3] = p[3];
+			break;
+		case V2D_COLOR_FORMAT_ABGR8888:
+			px->c[3] = p[0]; px->c[2] = p[1]; px->c[1] = p[2]; px->c[0] = p[3];
+			break;
+		case V2D_COLOR_FORMAT_RGB565:
+		case V2D_COLOR_FORMAT_BGR565:
+			V2dCpuUnpack565(p, format == V2D_COLOR_FORMAT_BGR565, px);
+			break;
+		case V2D_COLOR_FORMAT_RGBA5658:
+		case V2D_COLOR_FORMAT_BGRA5658:
+			V2dCpuUnpack565(p, format == V2D_COLOR_FORMAT_BGRA5658, px);
+			px->c[3] = p[2];
+			break;
+		case V2D_COLOR_FORMAT_ARGB8565:
+		case V2D_COLOR_FORMAT_ABGR8565:
+			V2dCpuUnpack565(p + 1, format == V2D_COLOR_FORMAT_ABGR8565, px);
+			px->c[3] = p[0];
+			break;
+		case V2D_COLOR_FORMAT_A8:
+			px->c[0] = px->c[1] = px->c[2] = 0;
+			px->c[3] = p[0];
+			break;
+		case V2D_COLOR_FORMAT_NV21:
+			px->c[0] = p[0]; px->c[1] = p[2]; px->c[2] = p[1];
+			break;
+		default:
+			/* Y8 and NV12 as a plain Y,U,V triple, used for fill colours */
+			px->c[0] = p[0]; px->c[1] = p[1]; px->c[2] = p[2];
+			break;
+	}
+}
+
+static void V2dCpuPack565(uint8_t *p, int bgr, const V2D_PIXEL_S *px)
+{
+	uint32_t v = ((px->c[bgr ? 2 : 0] >> 3) << 11) | ((px->c[1] >> 2) << 5) | (px->c[bgr ? 0 : 2] >> 3);
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+}
+
+void V2dCpuPack(uint8_t *p, V2D_COLOR_FORMAT_E format, const V2D_PIXEL_S *px)
+{
+	switch (format)
+	{
+		case V2D_COLOR_FORMAT_RGB888:
+			p[0] = px->c[0]; p[1] = px->c[1]; p[2] = px->c[2];
+			break;
+		case V2D_COLOR_FORMAT_RGBX8888:
+		case V2D_COLOR_FORMAT_RGBA8888:
+			p[0] = px->c[0]; p[1] = px->c[1]; p[2] = px->c[2]; p[3] = px->c[3];
+			break;
+		case V2D_COLOR_FORMAT_ARGB8888:
+			p[0] = px->c[3]; p[1] = px->c[0]; p[2] = px->c[1]; p[3] = px->c[2];
+			break;
+		case V2D_COLOR_FORMAT_BGR888:
+			p[0] = px->c[2]; p[1] = px->c[1]; p[2] = px->c[0];
+			break;
+		case V2D_COLOR_FORMAT_BGRX8888:
+		case V2D_COLOR_FORMAT_BGRA8888:
+			p[0] = px->c[2]; p[1] = px->c[1]; p[2] = px->c[0]; p[3] = px->c[3];
+			break;
+		case V2D_COLOR_FORMAT_ABGR8888:
+			p[0] = px->c[3]; p[1] = px->c[2]; p[2] = px->c[1]; p[3] = px->c[0];
+			break;
+		case V2D_COLOR_FORMAT_RGB565:
+		case V2D_COLOR_FORMAT_BGR565:
+			V2dCpuPack565(p, format == V2D_COLOR_FORMAT_BGR565, px);
+			break;
+		case V2D_COLOR_FORMAT_RGBA5658:
+		case V2D_COLOR_FORMAT_BGRA5658:
+			V2dCpuPack565(p, format == V2D_COLOR_FORMAT_BGRA5658, px);
+			p[2] = px->c[3];
+			break;
+		case V2D_COLOR_FORMAT_ARGB8565:
+		case V2D_COLOR_FORMAT_ABGR8565:
+			p[0] = px->c[3];
+			V2dCpuPack565(p + 1, format == V2D_COLOR_FORMAT_ABGR8565, px);
+			break;
+		case V2D_COLOR_FORMAT_A8:
+			p[0] = px->c[3];
+			break;
+		default:
+			p[0] = px->c[0];
+			break;
+	}
+}
+
+static void V2dCpuFillColor(const V2D_FILLCOLOR_S *pstColor, V2D_PIXEL_S *px)
+{
+	uint8_t au8Bytes[4];
+
+	au8Bytes[0] = pstColor->colorvalue & 0xff;
+	au8Bytes[1] = (pstColor->colorvalue >> 8) & 0xff;
+	au8Bytes[2] = (pstColor->colorvalue >> 16) & 0xff;
+	au8Bytes[3] = (pstColor->colorvalue >> 24) & 0xff;
+	V2dCpuUnpack(au8Bytes, pstColor->format, px);
+}
+
+static void V2dCpuCacheDrop(V2D_CPU_MAP_CACHE_S *pCache, V2D_CPU_CACHED_S *pEntry)
+{
+	munmap(pEntry->pAddr, pEntry->size);
+	pCache->bytes -= pEntry->size;
+	pEntry->pAddr = NULL;
+}
+
+/* unmaps the idle entries whose fd was closed or now refers to another buffer */
+static void V2dCpuCacheSweep(V2D_CPU_MAP_CACHE_S *pCache)
+{
+	V2D_CPU_CACHED_S *pEntry;
+	struct stat st;
+	int i;
+
+	pthread_mutex_lock(&pCache->lock);
+	for (i=0; i<CPU_MAP_CACHE; i++)
+	{
+		pEntry = &pCache->astEntry[i];
+		if (pEntry->pAddr && !pEntry->users &&
+		    (fstat(pEntry->fd, &st) || pEntry->dev != st.st_dev || pEntry->ino != st.st_ino))
+			V2dCpuCacheDrop(pCache, pEntry);
+	}
+	pthread_mutex_unlock(&pCache->lock);
+}
+
+/* evicts idle entries other than pKeep, least recently used first, until the cache fits its budget */
+static void V2dCpuCacheShrink(V2D_CPU_MAP_CACHE_S *pCache, const V2D_CPU_CACHED_S *pKeep)
+{
+	V2D_CPU_CACHED_S *pEntry, *pVictim;
+	int i;
+
+	while (pCache->bytes > CPU_MAP_CACHE_BYTES)
+	{
+		pVictim = NULL;
+		for (i=0; i<CPU_MAP_CACHE; i++)
+		{
+			pEntry = &pCache->astEntry[i];
+			if (pEntry != pKeep && pEntry->pAddr && !pEntry->users && (!pVictim || pEntry->lastUse < pVictim->lastUse))
+				pVictim = pEntry;
+		}
+		if (!pVictim)
+			break;
+		V2dCpuCacheDrop(pCache, pVictim);
+	}
+}
+
+/* a cached mapping of the buffer behind fd, NULL when every slot is in use */
+static V2D_CPU_CACHED_S *V2dCpuCacheGet(V2D_CPU_MAP_CACHE_S *pCache, int fd, size_t size)
+{
+	V2D_CPU_CACHED_S *pEntry, *pVictim = NULL;
+	struct stat st;
+	void *pAddr;
+	int i;
+
+	if (fstat(fd, &st))
+		return NULL;
+	pthread_mutex_lock(&pCache->lock);
+	for (i=0; i<CPU_MAP_CACHE; i++)
+	{
+		pEntry = &pCache->astEntry[i];
+		if (pEntry->pAddr && pEntry->dev == st.st_dev && pEntry->ino == st.st_ino)
+		{
+			if (size <= pEntry->size)
+			{
+				pEntry->fd = fd;
+				pEntry->users++;
+				pEntry->lastUse = ++pCache->clock;
+				pthread_mutex_unlock(&pCache->lock);
+				return pEntry;
+			}
+			/* the buffer grew, e.g. a memfd, map it anew once nobody works on the old size */
+			if (pEntry->users)
+			{
+				pthread_mutex_unlock(&pCache->lock);
+				return NULL;
+			}
+			V2dCpuCacheDrop(pCache, pEntry);
+		}
+		if (!pEntry->users && (!pVictim || (pVictim->pAddr && (!pEntry->pAddr || pEntry->lastUse < pVictim->lastUse))))
+			pVictim = pEntry;
+	}
+	if (!pVictim)
+	{
+		pthread_mutex_unlock(&pCache->lock);
+		return NULL;
+	}
+	if (pVictim->pAddr)
+		V2dCpuCacheDrop(pCache, pVictim);
+	pAddr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (pAddr == MAP_FAILED)
+	{
+		pthread_mutex_unlock(&pCache->lock);
+		return NULL;
+	}
+	pVictim->dev = st.st_dev;
+	pVictim->ino = st.st_ino;
+	pVictim->fd = fd;
+	pVictim->pAddr = (uint8_t *)pAddr;
+	pVictim->size = size;
+	pVictim->users = 1;
+	pVictim->lastUse = ++pCache->clock;
+	pCache->bytes += size;
+	V2dCpuCacheShrink(pCache, pVictim);
+	pthread_mutex_unlock(&pCache->lock);
+	return pVictim;
+}
+
+static void V2dCpuCachePut(V2D_CPU_MAP_CACHE_S *pCache, V2D_CPU_CACHED_S *pEntry)
+{
+	pthread_mutex_lock(&pCache->lock);
+	pEntry->users--;
+	/* entries in use when the cache went over its budget */
+	V2dCpuCacheShrink(pCache, NULL);
+	pthread_mutex_unlock(&pCache->lock);
+}
+
+static void V2dCpuCacheFlush(V2D_CPU_MAP_CACHE_S *pCache)
+{
+	int i;
+
+	for (i=0; i<CPU_MAP_CACHE; i++)
+	{
+		if (pCache->astEntry[i].pAddr)
+			V2dCpuCacheDrop(pCache, &pCache->astEntry[i]);
+	}
+}
+
+static V2D_CPU_MAP_S *V2dCpuMap(V2D_CPU_MAPS_S *pMaps, int fd)
+{
+	struct dma_buf_sync stSync;
+	V2D_CPU_MAP_S *pMap;
+	off_t size;
+	int i;
+
+	for (i=0; i<pMaps->count; i++)
+	{
+		if (pMaps->astMap[i].fd == fd)
+			return &pMaps->astMap[i];
+	}
+	if (pMaps->count == CPU_MAP_MAX)
+		return NULL;
+	size = lseek(fd, 0, SEEK_END);
+	if (size <= 0)
+		return NULL;
+	pMap = &pMaps->astMap[pMaps->count];
+	pMap->pCached = V2dCpuCacheGet(pMaps->pCache, fd, size);
+	if (pMap->pCached)
+	{
+		pMap->pAddr = pMap->pCached->pAddr;
+	}
+	else
+	{
+		/* every cached mapping is in use by concurrent submits */
+		pMap->pAddr = (uint8_t *)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+		if (pMap->pAddr == MAP_FAILED)
+			return NULL;
+	}
+	pMap->fd = fd;
+	pMap->size = size;
+	pMaps->count++;
+	/* not a dma-buf when this fails, e.g. a memfd standing in for one */
+	stSync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_RW;
+	ioctl(fd, DMA_BUF_IOCTL_SYNC, &stSync);
+	return pMap;
+}
+
+static void V2dCpuUnmapAll(V2D_CPU_MAPS_S *pMaps)
+{
+	struct dma_buf_sync stSync;
+	V2D_CPU_MAP_S *pMap;
+	int i;
+
+	for (i=0; i<pMaps->count; i++)
+	{
+		pMap = &pMaps->astMap[i];
+		stSync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_RW;
+		ioctl(pMap->fd, DMA_BUF_IOCTL_SYNC, &stSync);
+		if (pMap->pCached)
+			V2dCpuCachePut(pMaps->pCache, pMap->pCached);
+		else
+			munmap(pMap->pAddr, pMap->size);
+	}
+	pMaps->count = 0;
+}
+
+static int V2dCpuSetupSurface(V2D_CPU_LAYER_S *pLayer, const V2D_SURFACE_S *pSurface, const V2D_AREA_S *pRect,
+                              V2D_CPU_MAPS_S *pMaps)
+{
+	V2D_CPU_MAP_S *pMap;
+	size_t need;
+
+	pLayer->pSurface = pSurface;
+	pLayer->rect = *pRect;
+	if (pSurface->format >= V2D_COLOR_FORMAT_BUTT || !pRect->w || !pRect->h ||
+	    pRect->x + pRect->w > pSurface->w || pRect->y + pRect->h > pSurface->h)
+	{
+		printf("v2d cpu backend got a bad surface, %ux%u format %d rect %u,%u %ux%u\n", pSurface->w, pSurface->h,
+		       pSurface->format, pRect->x, pRect->y, pRect->w, pRect->h);
+		return FAILURE;
+	}
+	pMap = V2dCpuMap(pMaps, pSurface->fd);
+	if (!pMap)
+	{
+		printf("v2d cpu backend failed to map fd %d\n", pSurface->fd);
+		return FAILURE;
+	}
+	need = (size_t)pSurface->stride * (pSurface->h - 1) + (size_t)pSurface->w * V2dCpuBpp(pSurface->format);
+	if (pSurface->format == V2D_COLOR_FORMAT_NV12 || pSurface->format == V2D_COLOR_FORMAT_NV21)
+	{
+		if ((size_t)pSurface->offset + (size_t)pSurface->stride * ((pSurface->h + 1) / 2) > need)
+			need = (size_t)pSurface->offset + (size_t)pSurface->stride * ((pSurface->h + 1) / 2);
+	}
+	if (need > pMap->size)
+	{
+		printf("v2d cpu backend surface of %zu bytes exceeds its buffer of %zu\n", need, pMap->size);
+		return FAILURE;
+	}
+	pLayer->pBase = pMap->pAddr;
+	pLayer->pChroma = pMap->pAddr + pSurface->offset;
+	pLayer->stride = pSurface->stride;
+	pLayer->active = 1;
+	return SUCCESS;
+}
+
+/*
+ * Fbc surfaces are worked on as a copy in process memory. Layers are decoded
+ * into it up front, only where their rect reads, destinations start zeroed
+ * and are encoded by V2dCpuEncodeBatch.
+ */
+static int V2dCpuSetupFbc(V2D_CPU_LAYER_S *pLayer, const V2D_SURFACE_S *pSurface, const V2D_AREA_S *pRect, int write,
+                          V2D_CPU_MAPS_S *pMaps)
+{
+	V2D_CPU_MAP_S *pMap;
+	V2D_IMAGE_S stImage;
+	size_t plane;
+	int nv = (pSurface->format == V2D_COLOR_FORMAT_NV12);
+
+	pLayer->pSurface = pSurface;
+	pLayer->rect = *pRect;
+	if (pSurface->format != V2dFbcFormat(write ? pSurface->fbcEncInfo.enFbcencFmt : pSurface->fbcDecInfo.enFbcdecFmt) ||
+	    !pRect->w || !pRect->h || pRect->x + pRect->w > pSurface->w || pRect->y + pRect->h > pSurface->h)
+	{
+		printf("v2d cpu backend got a bad fbc surface, %ux%u format %d rect %u,%u %ux%u\n", pSurface->w, pSurface->h,
+		       pSurface->format, pRect->x, pRect->y, pRect->w, pRect->h);
+		return FAILURE;
+	}
+	pMap = V2dCpuMap(pMaps, pSurface->fbcDecInfo.fd);
+	if (!pMap)
+	{
+		printf("v2d cpu backend failed to map fd %d\n", pSurface->fbcDecInfo.fd);
+		return FAILURE;
+	}
+	stImage.stride = ((pSurface->w + 1) & ~1) * V2dCpuBpp(pSurface->format);
+	plane = (size_t)stImage.stride * ((pSurface->h + 1) & ~1);
+	pLayer->pFbc = (uint8_t *)calloc(1, nv ? plane + plane / 2 : plane);
+	if (!pLayer->pFbc)
+	{
+		printf("Failed to malloc v2d cpu fbc surface\n");
+		return FAILURE;
+	}
+	stImage.pData = pLayer->pFbc;
+	stImage.pUv = nv ? pLayer->pFbc + plane : NULL;
+	stImage.w = pSurface->w;
+	stImage.h = pSurface->h;
+	stImage.format = pSurface->format;
+	if (write && V2dFbcEncodeSize(&pSurface->fbcEncInfo, pSurface->w, pSurface->h) > pMap->size)
+	{
+		printf("v2d cpu backend fbc surface of %zu bytes exceeds its buffer of %zu\n",
+		       V2dFbcEncodeSize(&pSurface->fbcEncInfo, pSurface->w, pSurface->h), pMap->size);
+		return FAILURE;
+	}
+	if (!write && V2dFbcDecodeRect(&pSurface->fbcDecInfo, pMap->pAddr, pMap->size, &stImage, pRect))
+		return FAILURE;
+	pLayer->pFbcMap = write ? pMap : NULL;
+	pLayer->pBase = stImage.pData;
+	pLayer->pChroma = stImage.pUv;
+	pLayer->stride = stImage.stride;
+	pLayer->active = 1;
+	return SUCCESS;
+}
+
+static int V2dCpuSetupLayer(V2D_CPU_LAYER_S *pLayer, const V2D_SURFACE_S *pSurface, const V2D_AREA_S *pRect,
+                            const V2D_AREA_S *pArea, const V2D_AREA_S *pDstRect, V2D_ROTATE_ANGLE_E rt,
+                            V2D_CSC_MODE_E csc, const V2D_PALETTE_S *pPalette, V2D_CPU_MAPS_S *pMaps)
+{
+	memset(pLayer, 0, sizeof(V2D_CPU_LAYER_S));
+	pLayer->area = (pArea->w && pArea->h) ? *pArea : *pDstRect;
+	pLayer->rt = rt;
+	pLayer->pCsc = V2dCscMatrix(csc);
+	if (pSurface->solidcolor.enable)
+	{
+		pLayer->active = 1;
+		pLayer->solid = 1;
+		V2dCpuFillColor(&pSurface->solidcolor.fillcolor, &pLayer->stSolid);
+		if (pLayer->pCsc)
+			V2dCscPixel(pLayer->pCsc, &pLayer->stSolid);
+		return SUCCESS;
+	}
+	if (!pSurface->w || !pSurface->h)
+		return SUCCESS;
+	if (V2dCpuIsPalette(pSurface->format))
+		pLayer->pPalette = pPalette->palVal;
+	if (pSurface->fbc_enable)
+		return V2dCpuSetupFbc(pLayer, pSurface, pRect, 0, pMaps);
+	return V2dCpuSetupSurface(pLayer, pSurface, pRect, pMaps);
+}
+
+static void V2dCpuFetch(const V2D_CPU_LAYER_S *pLayer, int x, int y, V2D_PIXEL_S *px)
+{
+	const V2D_SURFACE_S *pSurface = pLayer->pSurface;
+	const uint8_t *p = pLayer->pBase + (size_t)y * pLayer->stride + (size_t)x * V2dCpuBpp(pSurface->format);
+	const uint8_t *pUv;
+	V2D_COLOR_FORMAT_E format = pSurface->format;
+
+	switch (format)
+	{
+		case V2D_COLOR_FORMAT_NV12:
+		case V2D_COLOR_FORMAT_NV21:
+			pUv = pLayer->pChroma + (size_t)(y >> 1) * pLayer->stride + (x & ~1);
+			px->c[0] = p[0];
+			px->c[1] = pUv[format == V2D_COLOR_FORMAT_NV21];
+			px->c[2] = pUv[format == V2D_COLOR_FORMAT_NV12];
+			px->c[3] = 0xff;
+			break;
+		case V2D_COLOR_FORMAT_Y8:
+			px->c[0] = p[0];
+			px->c[1] = px->c[2] = 0x80;
+			px->c[3] = 0xff;
+			break;
+		default:
+			if (V2dCpuIsPalette(format))
+			{
+				format = V2dCpuPaletteFormat(format);
+				p = pLayer->pPalette + p[0] * V2dCpuBpp(format);
+			}
+			V2dCpuUnpack(p, format, px);
+			break;
+	}
+}
+
+/* samples a layer at a destination pixel, 0 when the layer does not cover it */
+static int V2dCpuSample(const V2D_CPU_LAYER_S *pLayer, int x, int y, V2D_PIXEL_S *px)
+{
+	const V2D_AREA_S *pRect = &pLayer->rect;
+	const V2D_AREA_S *pArea = &pLayer->area;
+	uint32_t u, v, ow, oh, ru, rv, sx, sy;
+
+	if (!pLayer->active || x < pArea->x || y < pArea->y)
+		return 0;
+	u = x - pArea->x;
+	v = y - pArea->y;
+	if (u >= pArea->w || v >= pArea->h)
+		return 0;
+	if (pLayer->solid)
+	{
+		*px = pLayer->stSolid;
+		return 1;
+	}
+	ow = pRect->w;
+	oh = pRect->h;
+	if (pLayer->rt == V2D_ROT_90 || pLayer->rt == V2D_ROT_270)
+	{
+		ow = pRect->h;
+		oh = pRect->w;
+	}
+	ru = u * ow / pArea->w;
+	rv = v * oh / pArea->h;
+	switch (pLayer->rt)
+	{
+		case V2D_ROT_90:     sx = rv;                sy = pRect->h - 1 - ru; break;
+		case V2D_ROT_180:    sx = pRect->w - 1 - ru; sy = pRect->h - 1 - rv; break;
+		case V2D_ROT_270:    sx = pRect->w - 1 - rv; sy = ru;                break;
+		case V2D_ROT_MIRROR: sx = pRect->w - 1 - ru; sy = rv;                break;
+		case V2D_ROT_FLIP:   sx = ru;                sy = pRect->h - 1 - rv; break;
+		default:             sx = ru;                sy = rv;                break;
+	}
+	V2dCpuFetch(pLayer, pRect->x + sx, pRect->y + sy, px);
+	if (pLayer->pCsc)
+		V2dCscPixel(pLayer->pCsc, px);
+	return 1;
+}
+
+static uint8_t V2dCpuMul(uint32_t a, uint32_t b)
+{
+	return (uint8_t)((a * b + 127) / 255);
+}
+
+static uint32_t V2dCpuFactor(V2D_BLEND_MODE_E mode, uint8_t sa, uint8_t da)
+{
+	switch (mode)
+	{
+		case V2D_BLEND_ONE:                 return 255;
+		case V2D_BLEND_SRC_ALPHA:           return sa;
+		case V2D_BLEND_ONE_MINUS_SRC_ALPHA: return 255 - sa;
+		case V2D_BLEND_DST_ALPHA:           return da;
+		case V2D_BLEND_ONE_MINUS_DST_ALPHA: return 255 - da;
+		default:                            return 0;
+	}
+}
+
+static uint8_t V2dCpuRop2(V2D_ROP2_MODE_E code, uint8_t p, uint8_t d)
+{
+	switch (code)
+	{
+		case V2D_ROP2_BLACK:       return 0;
+		case V2D_ROP2_NOTMERGEPEN: return ~(p | d);
+		case V2D_ROP2_MASKNOTPEN:  return ~p & d;
+		case V2D_ROP2_NOTCOPYPEN:  return ~p;
+		case V2D_ROP2_MASKPENNOT:  return p & ~d;
+		case V2D_ROP2_NOT:         return ~d;
+		case V2D_ROP2_XORPEN:      return p ^ d;
+		case V2D_ROP2_NOTMASKPEN:  return ~(p & d);
+		case V2D_ROP2_MASKPEN:     return p & d;
+		case V2D_ROP2_NOTXORPEN:   return ~(p ^ d);
+		case V2D_ROP2_MERGENOTPEN: return ~p | d;
+		case V2D_ROP2_COPYPEN:     return p;
+		case V2D_ROP2_MERGEPENNOT: return p | ~d;
+		case V2D_ROP2_MERGEPEN:    return p | d;
+		case V2D_ROP2_WHITE:       return 0xff;
+		default:                   return d;
+	}
+}
+
+/* combines src into dst in place with the configuration of one blend layer */
+static void V2dCpuBlend(const V2D_BLEND_CONF_S *pConf, const V2D_BLEND_LAYER_CONF_S *pLayerConf,
+                        const V2D_PIXEL_S *pSrc, uint8_t mask, V2D_PIXEL_S *pDst)
+{
+	const V2D_BLEND_FACTOR_S *pFactor = &pLayerConf->stBlendFactor;
+	uint32_t fs, fd;
+	uint8_t sa, da = pDst->c[3];
+	int i;
+
+	if (pConf->blend_cmd == V2D_BLENDCMD_ROP2)
+	{
+		for (i=0; i<3; i++)
+			pDst->c[i] = V2dCpuRop2(pLayerConf->stRop2Code.colorRop2Code, pSrc->c[i], pDst->c[i]);
+		pDst->c[3] = V2dCpuRop2(pLayerConf->stRop2Code.alphaRop2Code, pSrc->c[3], pDst->c[3]);
+		return;
+	}
+	switch (pLayerConf->blend_alpha_source)
+	{
+		case V2D_BLENDALPHA_SOURCE_GOLBAL: sa = pLayerConf->global_alpha; break;
+		case V2D_BLENDALPHA_SOURCE_MASK:   sa = mask;                     break;
+		default:                           sa = pSrc->c[3];               break;
+	}
+	if (pLayerConf->blend_pre_alpha_func == V2D_BLEND_PRE_ALPHA_FUNC_GLOBAL_MULTI_SOURCE)
+		sa = V2dCpuMul(sa, pLayerConf->global_alpha);
+	else if (pLayerConf->blend_pre_alpha_func == V2D_BLEND_PRE_ALPHA_FUNC_MASK_MULTI_SOURCE)
+		sa = V2dCpuMul(sa, mask);
+	if (pConf->mask_cmd == V2D_MASKCMD_AS_VALUE)
+		sa = V2dCpuMul(sa, mask);
+
+	fs = V2dCpuFactor(pFactor->srcColorFactor, sa, da);
+	fd = V2dCpuFactor(pFactor->dstColorFactor, sa, da);
+	for (i=0; i<3; i++)
+	{
+		uint32_t v = (pSrc->c[i] * fs + pDst->c[i] * fd + 127) / 255;
+		pDst->c[i] = (uint8_t)(v > 255 ? 255 : v);
+	}
+	fs = V2dCpuFactor(pFactor->srcAlphaFactor, sa, da);
+	fd = V2dCpuFactor(pFactor->dstAlphaFactor, sa, da);
+	{
+		uint32_t v = (sa * fs + da * fd + 127) / 255;
+		pDst->c[3] = (uint8_t)(v > 255 ? 255 : v);
+	}
+}
+
+static int V2dCpuDitherBits(V2D_COLOR_FORMAT_E format, int channel)
+{
+	switch (format)
+	{
+		case V2D_COLOR_FORMAT_RGB565:
+		case V2D_COLOR_FORMAT_BGR565:
+		case V2D_COLOR_FORMAT_RGBA5658:
+		case V2D_COLOR_FORMAT_ARGB8565:
+		case V2D_COLOR_FORMAT_BGRA5658:
+		case V2D_COLOR_FORMAT_ABGR8565:
+			return (channel == 1) ? 2 : 3;
+		default:
+			return 0;
+	}
+}
+
+/* ordered dither ahead of truncating to 5/6 bit channels */
+static void V2dCpuDither(V2D_DITHER_E dither, V2D_COLOR_FORMAT_E format, int x, int y, V2D_PIXEL_S *px)
+{
+	uint32_t threshold, v;
+	int i, bits;
+
+	if (dither == V2D_DITHER_4X4)
+		threshold = gBayer4x4[y & 3][x & 3] * 16;
+	else if (dither == V2D_DITHER_8X8)
+		threshold = (gBayer4x4[y & 3][x & 3] * 4 + gBayer2x2[(y >> 2) & 1][(x >> 2) & 1]) * 4;
+	else
+		return;
+	for (i=0; i<3; i++)
+	{
+		bits = V2dCpuDitherBits(format, i);
+		if (!bits)
+			continue;
+		/* threshold is in 1/256 of the quantisation step */
+		v = px->c[i] + ((threshold << bits) >> 8);
+		px->c[i] = (uint8_t)(v > 255 ? 255 : v);
+	}
+}
+
+static void V2dCpuStore(const V2D_CPU_LAYER_S *pDst, V2D_DITHER_E dither, int x, int y, V2D_PIXEL_S *px)
+{
+	const V2D_SURFACE_S *pSurface = pDst->pSurface;
+	uint8_t *p = pDst->pBase + (size_t)y * pDst->stride + (size_t)x * V2dCpuBpp(pSurface->format);
+	uint8_t *pUv;
+
+	V2dCpuDither(dither, pSurface->format, x, y, px);
+	switch (pSurface->format)
+	{
+		case V2D_COLOR_FORMAT_NV12:
+		case V2D_COLOR_FORMAT_NV21:
+			p[0] = px->c[0];
+			/* the top left pixel of each 2x2 block carries the chroma */
+			if (!(x & 1) && !(y & 1))
+			{
+				pUv = pDst->pChroma + (size_t)(y >> 1) * pDst->stride + x;
+				pUv[pSurface->format == V2D_COLOR_FORMAT_NV21] = px->c[1];
+				pUv[pSurface->format == V2D_COLOR_FORMAT_NV12] = px->c[2];
+			}
+			break;
+		default:
+			V2dCpuPack(p, pSurface->format, px);
+			break;
+	}
+}
+
+static void V2dCpuImage(const V2D_CPU_LAYER_S *pLayer, V2D_IMAGE_S *pImage)
+{
+	pImage->pData = pLayer->pBase;
+	pImage->pUv = pLayer->pChroma;
+	pImage->stride = pLayer->stride;
+	pImage->w = pLayer->pSurface->w;
+	pImage->h = pLayer->pSurface->h;
+	pImage->format = pLayer->pSurface->format;
+}
+
+static void V2dCpuRowPath(V2D_CPU_TASK_S *pstCpuTask)
+{
+	const V2D_PARAM_S *pParam = pstCpuTask->pParam;
+	const V2D_CPU_LAYER_S *pLayer = &pstCpuTask->astLayer[0];
+	int i, dither = 0;
+
+	for (i=0; i<3 && pParam->dither != V2D_NO_DITHER; i++)
+		dither |= V2dCpuDitherBits(pParam->dst.format, i);
+	if (pParam->blendconf.bgcolor.enable || pstCpuTask->astLayer[1].active || !pLayer->active || pLayer->solid ||
+	    pLayer->pPalette || dither || memcmp(&pLayer->area, &pParam->dst_rect, sizeof(V2D_AREA_S)))
+		return;
+	if (pLayer->rt == V2D_ROT_90 || pLayer->rt == V2D_ROT_270)
+	{
+		if (pLayer->rect.w != pLayer->area.h || pLayer->rect.h != pLayer->area.w)
+			return;
+	}
+	else if (pLayer->rect.w != pLayer->area.w || pLayer->rect.h != pLayer->area.h)
+	{
+		return;
+	}
+	/* rotation moves raw pixels, so only between equal formats that unpack and pack losslessly */
+	if (pLayer->rt != V2D_ROT_0 &&
+	    (pLayer->pCsc || pLayer->pSurface->format != pParam->dst.format || pLayer->pSurface->fd == pParam->dst.fd ||
+	     pParam->dst.format == V2D_COLOR_FORMAT_RGBX8888 || pParam->dst.format == V2D_COLOR_FORMAT_BGRX8888))
+		return;
+	V2dCpuImage(pLayer, &pstCpuTask->stSrcImage);
+	V2dCpuImage(&pstCpuTask->stDst, &pstCpuTask->stDstImage);
+	pstCpuTask->rowPath = 1;
+}
+
+static int V2dCpuPrepareTask(const V2D_SUBMIT_TASK_S *pstTask, V2D_CPU_TASK_S *pstCpuTask, V2D_CPU_MAPS_S *pMaps)
+{
+	const V2D_PARAM_S *pParam = &pstTask->param;
+	const V2D_BLEND_CONF_S *pConf = &pParam->blendconf;
+	V2D_AREA_S stNone;
+
+	memset(pstCpuTask, 0, sizeof(V2D_CPU_TASK_S));
+	memset(&stNone, 0, sizeof(stNone));
+	pstCpuTask->pParam = pParam;
+	if (V2dCpuIsPalette(pParam->dst.format) || pParam->dst.solidcolor.enable)
+	{
+		printf("v2d cpu backend cannot write to format %d\n", pParam->dst.format);
+		return FAILURE;
+	}
+	if (pParam->dst.fbc_enable)
+	{
+		if (V2dCpuSetupFbc(&pstCpuTask->stDst, &pParam->dst, &pParam->dst_rect, 1, pMaps))
+			return FAILURE;
+	}
+	else if (V2dCpuSetupSurface(&pstCpuTask->stDst, &pParam->dst, &pParam->dst_rect, pMaps))
+	{
+		return FAILURE;
+	}
+	if (V2dCpuSetupLayer(&pstCpuTask->astLayer[0], &pParam->layer0, &pParam->l0_rect, &pConf->blendlayer[0].blend_area,
+	                     &pParam->dst_rect, pParam->l0_rt, pParam->l0_csc, &pParam->palette, pMaps))
+		return FAILURE;
+	if (V2dCpuSetupLayer(&pstCpuTask->astLayer[1], &pParam->layer1, &pParam->l1_rect, &pConf->blendlayer[1].blend_area,
+	                     &pParam->dst_rect, pParam->l1_rt, pParam->l1_csc, &pParam->palette, pMaps))
+		return FAILURE;
+	if (pConf->mask_cmd != V2D_MASKCMD_DISABLE || pConf->blendlayer[1].blend_alpha_source == V2D_BLENDALPHA_SOURCE_MASK ||
+	    pConf->blendlayer[1].blend_pre_alpha_func == V2D_BLEND_PRE_ALPHA_FUNC_MASK_MULTI_SOURCE)
+	{
+		if (V2dCpuSetupLayer(&pstCpuTask->stMask, &pParam->mask, &pParam->mask_rect, &pConf->blend_mask_area,
+		                     &pParam->dst_rect, V2D_ROT_0, V2D_CSC_MODE_BUTT, &pParam->palette, pMaps))
+			return FAILURE;
+	}
+	if (pConf->bgcolor.enable)
+		V2dCpuFillColor(&pConf->bgcolor.fillcolor, &pstCpuTask->stBgColor);
+	V2dCpuRowPath(pstCpuTask);
+	return SUCCESS;
+}
+
+/*
+ * Row path of V2dCpuRenderRect. region spans whole rows of dst_rect, which
+ * for a rotation is a band of rows or columns of the source rect. The row
+ * kernels need a little scratch memory, so they may fail where the pixel
+ * loop does not.
+ */
+static int V2dCpuRenderRows(const V2D_CPU_TASK_S *pstCpuTask, const V2D_AREA_S *pRegion)
+{
+	const V2D_CPU_LAYER_S *pLayer = &pstCpuTask->astLayer[0];
+	uint32_t v0 = pRegion->y - pLayer->area.y, sx = pLayer->rect.x, sy = pLayer->rect.y, w, h;
+
+	switch (pLayer->rt)
+	{
+		case V2D_ROT_0:
+			return V2dCscConvert(&pstCpuTask->stSrcImage, pRegion->x - pLayer->area.x + sx, sy + v0,
+			                     &pstCpuTask->stDstImage, pRegion->x, pRegion->y, pRegion->w, pRegion->h, pLayer->pCsc);
+		case V2D_ROT_90:
+		case V2D_ROT_270:
+			sx += (pLayer->rt == V2D_ROT_90) ? v0 : pLayer->rect.w - v0 - pRegion->h;
+			w = pRegion->h;
+			h = pLayer->rect.h;
+			break;
+		default:
+			sy += (pLayer->rt == V2D_ROT_MIRROR) ? v0 : pLayer->rect.h - v0 - pRegion->h;
+			w = pLayer->rect.w;
+			h = pRegion->h;
+			break;
+	}
+	return V2dRotateConvert(&pstCpuTask->stSrcImage, sx, sy, w, h, &pstCpuTask->stDstImage, pRegion->x, pRegion->y,
+	                        pLayer->rt);
+}
+
+/* renders the part of a prepared task that falls into region, which lies within dst_rect */
+static void V2dCpuRenderRect(const V2D_CPU_TASK_S *pstCpuTask, const V2D_AREA_S *pRegion)
+{
+	const V2D_PARAM_S *pParam = pstCpuTask->pParam;
+	const V2D_BLEND_CONF_S *pConf = &pParam->blendconf;
+	V2D_PIXEL_S stOut, stLayer, stMask;
+	uint8_t mask;
+	int x, y, covered;
+
+	if (pstCpuTask->rowPath && V2dCpuRenderRows(pstCpuTask, pRegion) == SUCCESS)
+		return;
+	for (y=pRegion->y; y<pRegion->y + pRegion->h; y++)
+	{
+		for (x=pRegion->x; x<pRegion->x + pRegion->w; x++)
+		{
+			covered = 0;
+			if (pConf->bgcolor.enable)
+			{
+				stOut = pstCpuTask->stBgColor;
+				covered = 1;
+			}
+			if (V2dCpuSample(&pstCpuTask->astLayer[0], x, y, &stLayer))
+			{
+				if (covered)
+					V2dCpuBlend(pConf, &pConf->blendlayer[0], &stLayer, 0xff, &stOut);
+				else
+					stOut = stLayer;
+				covered = 1;
+			}
+			if (V2dCpuSample(&pstCpuTask->astLayer[1], x, y, &stLayer))
+			{
+				mask = 0xff;
+				if (V2dCpuSample(&pstCpuTask->stMask, x, y, &stMask))
+					mask = stMask.c[3];
+				if (pConf->mask_cmd != V2D_MASKCMD_NORMAL || mask)
+				{
+					if (!covered)
+						memset(&stOut, 0, sizeof(stOut));
+					V2dCpuBlend(pConf, &pConf->blendlayer[1], &stLayer, mask, &stOut);
+					covered = 1;
+				}
+			}
+			if (covered)
+				V2dCpuStore(&pstCpuTask->stDst, pParam->dither, x, y, &stOut);
+		}
+	}
+}
+
+/*
+ * Tasks run in batches on a pool of worker threads. A batch is a run of
+ * consecutive tasks of which none writes memory another one reads or writes,
+ * so their tiles may run in any order. Every task's dst_rect is cut into
+ * stripes of about CPU_TILE_BYTES of destination, each worker owns a range of
+ * the stripes of a batch and steals from the ranges of the others once its own
+ * is drained. A task that reads what it writes is run as a single stripe.
+ */
+typedef struct SPACEMIT_V2D_CPU_RANGE_S
+{
+	int fd;
+	int write;
+	size_t start;
+	size_t end;
+} V2D_CPU_RANGE_S;
+
+typedef struct SPACEMIT_V2D_CPU_TILE_S
+{
+	uint32_t task;
+	V2D_AREA_S region;
+} V2D_CPU_TILE_S;
+
+typedef struct SPACEMIT_V2D_CPU_QUEUE_S
+{
+	uint32_t next;
+	uint32_t end;
+	uint8_t au8Pad[56]; /* one queue per cache line */
+} V2D_CPU_QUEUE_S;
+
+typedef struct SPACEMIT_V2D_CPU_BATCH_S
+{
+	V2D_CPU_TASK_S astTask[CPU_BATCH_MAX];
+	V2D_CPU_RANGE_S astRange[CPU_BATCH_MAX * CPU_TASK_RANGES];
+	uint32_t taskCount;
+	uint32_t rangeCount;
+	V2D_CPU_TILE_S *pTiles;
+	uint32_t tileCount;
+	uint32_t tileCapacity;
+	struct SPACEMIT_V2D_CPU_BATCH_S *pNext;
+} V2D_CPU_BATCH_S;
+
+typedef struct SPACEMIT_V2D_CPU_S
+{
+	int threads;
+	pthread_t *pTids;
+	pthread_mutex_t runLock; /* one batch on the pool at a time */
+	pthread_mutex_t lock;
+	pthread_cond_t startCond;
+	pthread_cond_t doneCond;
+	uint32_t generation;
+	int busy;
+	int quit;
+	V2D_CPU_BATCH_S *pBatch;
+	V2D_CPU_QUEUE_S *pQueues;
+	/* batches of finished submits under lock, one per concurrent submitter, and their mappings */
+	V2D_CPU_BATCH_S *pFreeBatch;
+	V2D_CPU_MAP_CACHE_S stMapCache;
+} V2D_CPU_S;
+
+static void V2dCpuSpan(const V2D_SURFACE_S *pSurface, const V2D_AREA_S *pRect, V2D_CPU_RANGE_S *pRange, int write)
+{
+	int bpp = V2dCpuBpp(pSurface->format);
+
+	pRange->fd = pSurface->fd;
+	pRange->write = write;
+	pRange->start = (size_t)pRect->y * pSurface->stride + (size_t)pRect->x * bpp;
+	pRange->end = (size_t)(pRect->y + pRect->h - 1) * pSurface->stride + (size_t)(pRect->x + pRect->w) * bpp;
+}
+
+/* memory a task reads and writes, conservatively as byte spans of its rects */
+static uint32_t V2dCpuTaskRanges(const V2D_PARAM_S *pParam, V2D_CPU_RANGE_S *pRange)
+{
+	const V2D_SURFACE_S *apSurface[CPU_TASK_MAPS] = {&pParam->dst, &pParam->layer0, &pParam->layer1, &pParam->mask};
+	const V2D_AREA_S *apRect[CPU_TASK_MAPS] = {&pParam->dst_rect, &pParam->l0_rect, &pParam->l1_rect, &pParam->mask_rect};
+	V2D_AREA_S stChroma;
+	uint32_t i, n = 0;
+
+	for (i=0; i<CPU_TASK_MAPS; i++)
+	{
+		if (apSurface[i]->solidcolor.enable || !apSurface[i]->w || !apSurface[i]->h || !apRect[i]->w || !apRect[i]->h)
+			continue;
+		if (apSurface[i]->fbc_enable)
+		{
+			/* superblock payloads may sit anywhere in the buffer */
+			pRange[n].fd = apSurface[i]->fbcDecInfo.fd;
+			pRange[n].write = (i == 0);
+			pRange[n].start = 0;
+			pRange[n].end = (size_t)-1;
+			n++;
+			continue;
+		}
+		V2dCpuSpan(apSurface[i], apRect[i], &pRange[n++], i == 0);
+		if (apSurface[i]->format == V2D_COLOR_FORMAT_NV12 || apSurface[i]->format == V2D_COLOR_FORMAT_NV21)
+		{
+			stChroma.x = apRect[i]->x & ~1;
+			stChroma.y = apRect[i]->y >> 1;
+			stChroma.w = apRect[i]->w + (apRect[i]->x & 1) + 1;
+			stChroma.h = (apRect[i]->h + (apRect[i]->y & 1) + 1) >> 1;
+			V2dCpuSpan(apSurface[i], &stChroma, &pRange[n], i == 0);
+			pRange[n].start += apSurface[i]->offset;
+			pRange[n].end += apSurface[i]->offset;
+			n++;
+		}
+	}
+	return n;
+}
+
+static int V2dCpuConflict(const V2D_CPU_RANGE_S *pA, uint32_t countA, const V2D_CPU_RANGE_S *pB, uint32_t countB)
+{
+	uint32_t i, j;
+
+	for (i=0; i<countA; i++)
+	{
+		for (j=0; j<countB; j++)
+		{
+			if (pA[i].fd == pB[j].fd && (pA[i].write || pB[j].write) &&
+			    pA[i].start < pB[j].end && pB[j].start < pA[i].end)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/* a task writing memory it also reads, e.g. an in-place rotation, cannot be split */
+static int V2dCpuSelfConflict(const V2D_CPU_RANGE_S *pRange, uint32_t count)
+{
+	uint32_t i, j;
+
+	for (i=0; i<count; i++)
+	{
+		for (j=0; j<count; j++)
+		{
+			if (pRange[i].write && !pRange[j].write && pRange[i].fd == pRange[j].fd &&
+			    pRange[i].start < pRange[j].end && pRange[j].start < pRange[i].end)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+static int V2dCpuAddTiles(V2D_CPU_BATCH_S *pBatch, uint32_t task, int whole)
+{
+	const V2D_PARAM_S *pParam = pBatch->astTask[task].pParam;
+	const V2D_AREA_S *pRect = &pParam->dst_rect;
+	V2D_CPU_TILE_S *pTiles;
+	uint32_t rows, y, n;
+
+	rows = CPU_TILE_BYTES / ((uint32_t)pRect->w * V2dCpuBpp(pParam->dst.format));
+	/* even stripes keep each 2x2 chroma block of NV12 inside one stripe */
+	rows = (rows < 2) ? 2 : (rows & ~1u);
+	if (whole || rows >= pRect->h)
+		rows = pRect->h;
+	n = (pRect->h + rows - 1) / rows;
+	if (pBatch->tileCount + n > pBatch->tileCapacity)
+	{
+		pTiles = (V2D_CPU_TILE_S *)realloc(pBatch->pTiles, (pBatch->tileCount + n) * 2 * sizeof(V2D_CPU_TILE_S));
+		if (!pTiles)
+			return FAILURE;
+		pBatch->pTiles = pTiles;
+		pBatch->tileCapacity = (pBatch->tileCount + n) * 2;
+	}
+	for (y=0; y<pRect->h; y+=rows)
+	{
+		pTiles = &pBatch->pTiles[pBatch->tileCount++];
+		pTiles->task = task;
+		pTiles->region.x = pRect->x;
+		pTiles->region.y = pRect->y + y;
+		pTiles->region.w = pRect->w;
+		pTiles->region.h = (pRect->h - y < rows) ? pRect->h - y : rows;
+	}
+	return SUCCESS;
+}
+
+static void V2dCpuRunTiles(V2D_CPU_S *pCpu, int worker)
+{
+	V2D_CPU_BATCH_S *pBatch = pCpu->pBatch;
+	V2D_CPU_QUEUE_S *pQueue;
+	V2D_CPU_TILE_S *pTile;
+	uint32_t t;
+	int i;
+
+	for (i=0; i<pCpu->threads; i++)
+	{
+		pQueue = &pCpu->pQueues[(worker + i) % pCpu->threads];
+		while ((t = __atomic_fetch_add(&pQueue->next, 1, __ATOMIC_RELAXED)) < pQueue->end)
+		{
+			pTile = &pBatch->pTiles[t];
+			V2dCpuRenderRect(&pBatch->astTask[pTile->task], &pTile->region);
+		}
+	}
+}
+
+static void *V2dCpuWorker(void *arg)
+{
+	V2D_CPU_S *pCpu = (V2D_CPU_S *)((void **)arg)[0];
+	int worker = (int)(long)((void **)arg)[1];
+	uint32_t generation = 0;
+
+	free(arg);
+	for (;;)
+	{
+		pthread_mutex_lock(&pCpu->lock);
+		while (!pCpu->quit && pCpu->generation == generation)
+			pthread_cond_wait(&pCpu->startCond, &pCpu->lock);
+		if (pCpu->quit)
+		{
+			pthread_mutex_unlock(&pCpu->lock);
+			break;
+		}
+		generation = pCpu->generation;
+		pthread_mutex_unlock(&pCpu->lock);
+
+		V2dCpuRunTiles(pCpu, worker);
+
+		pthread_mutex_lock(&pCpu->lock);
+		if (--pCpu->busy == 0)
+			pthread_cond_signal(&pCpu->doneCond);
+		pthread_mutex_unlock(&pCpu->lock);
+	}
+	return NULL;
+}
+
+static void V2dCpuRunBatch(V2D_CPU_S *pCpu, V2D_CPU_BATCH_S *pBatch)
+{
+	V2D_CPU_QUEUE_S stQueue;
+	V2D_CPU_S stInline;
+	uint32_t i, per;
+
+	/* the pool is busy with another submitter's batch, or there is no pool */
+	if (pCpu->threads <= 1 || pBatch->tileCount <= 1 || pthread_mutex_trylock(&pCpu->runLock))
+	{
+		stQueue.next = 0;
+		stQueue.end = pBatch->tileCount;
+		stInline.threads = 1;
+		stInline.pBatch = pBatch;
+		stInline.pQueues = &stQueue;
+		V2dCpuRunTiles(&stInline, 0);
+		return;
+	}
+	per = (pBatch->tileCount + pCpu->threads - 1) / pCpu->threads;
+	for (i=0; i<(uint32_t)pCpu->threads; i++)
+	{
+		pCpu->pQueues[i].next = (i * per < pBatch->tileCount) ? i * per : pBatch->tileCount;
+		pCpu->pQueues[i].end = ((i + 1) * per < pBatch->tileCount) ? (i + 1) * per : pBatch->tileCount;
+	}
+	pCpu->pBatch = pBatch;
+	pthread_mutex_lock(&pCpu->lock);
+	pCpu->busy = pCpu->threads - 1;
+	pCpu->generation++;
+	pthread_cond_broadcast(&pCpu->startCond);
+	pthread_mutex_unlock(&pCpu->lock);
+
+	/* the submitting thread works as worker 0 */
+	V2dCpuRunTiles(pCpu, 0);
+
+	pthread_mutex_lock(&pCpu->lock);
+	while (pCpu->busy)
+		pthread_cond_wait(&pCpu->doneCond, &pCpu->lock);
+	pthread_mutex_unlock(&pCpu->lock);
+	pCpu->pBatch = NULL;
+	pthread_mutex_unlock(&pCpu->runLock);
+}
+
+/* fbc destinations of a batch that ran, before anything after it reads them */
+static void V2dCpuEncodeBatch(V2D_CPU_BATCH_S *pBatch)
+{
+	const V2D_CPU_LAYER_S *pDst;
+	V2D_IMAGE_S stImage;
+	uint32_t i;
+
+	for (i=0; i<pBatch->taskCount; i++)
+	{
+		pDst = &pBatch->astTask[i].stDst;
+		if (!pDst->pFbcMap)
+			continue;
+		V2dCpuImage(pDst, &stImage);
+		V2dFbcEncodeRect(&pDst->pSurface->fbcEncInfo, pDst->pFbcMap->pAddr, pDst->pFbcMap->size, &stImage, &pDst->rect,
+		                 NULL);
+	}
+}
+
+static void V2dCpuReleaseTask(V2D_CPU_TASK_S *pstCpuTask)
+{
+	int i;
+
+	for (i=0; i<V2D_INPUT_LAYER_NUM; i++)
+		free(pstCpuTask->astLayer[i].pFbc);
+	free(pstCpuTask->stMask.pFbc);
+	free(pstCpuTask->stDst.pFbc);
+}
+
+static void V2dCpuReleaseBatch(V2D_CPU_BATCH_S *pBatch)
+{
+	uint32_t i;
+
+	for (i=0; i<pBatch->taskCount; i++)
+		V2dCpuReleaseTask(&pBatch->astTask[i]);
+}
+
+static V2D_CPU_BATCH_S *V2dCpuGetBatch(V2D_CPU_S *pCpu)
+{
+	V2D_CPU_BATCH_S *pBatch;
+
+	pthread_mutex_lock(&pCpu->lock);
+	pBatch = pCpu->pFreeBatch;
+	if (pBatch)
+		pCpu->pFreeBatch = pBatch->pNext;
+	pthread_mutex_unlock(&pCpu->lock);
+	if (!pBatch)
+		pBatch = (V2D_CPU_BATCH_S *)calloc(1, sizeof(V2D_CPU_BATCH_S));
+	return pBatch;
+}
+
+/* the batch keeps its tile array for the next submit */
+static void V2dCpuPutBatch(V2D_CPU_S *pCpu, V2D_CPU_BATCH_S *pBatch)
+{
+	pBatch->taskCount = pBatch->rangeCount = pBatch->tileCount = 0;
+	pthread_mutex_lock(&pCpu->lock);
+	pBatch->pNext = pCpu->pFreeBatch;
+	pCpu->pFreeBatch = pBatch;
+	pthread_mutex_unlock(&pCpu->lock);
+}
+
+static void V2dCpuClose(void *pPriv)
+{
+	V2D_CPU_S *pCpu = (V2D_CPU_S *)pPriv;
+	V2D_CPU_BATCH_S *pBatch;
+	int i;
+
+	pthread_mutex_lock(&pCpu->lock);
+	pCpu->quit = 1;
+	pthread_cond_broadcast(&pCpu->startCond);
+	pthread_mutex_unlock(&pCpu->lock);
+	for (i=1; i<pCpu->threads; i++)
+		pthread_join(pCpu->pTids[i], NULL);
+	while ((pBatch = pCpu->pFreeBatch))
+	{
+		pCpu->pFreeBatch = pBatch->pNext;
+		free(pBatch->pTiles);
+		free(pBatch);
+	}
+	V2dCpuCacheFlush(&pCpu->stMapCache);
+	pthread_mutex_destroy(&pCpu->stMapCache.lock);
+	pthread_mutex_destroy(&pCpu->runLock);
+	pthread_mutex_destroy(&pCpu->lock);
+	pthread_cond_destroy(&pCpu->startCond);
+	pthread_cond_destroy(&pCpu->doneCond);
+	free(pCpu->pTids);
+	free(pCpu->pQueues);
+	free(pCpu);
+}
+
+static int32_t V2dCpuOpen(void **ppPriv)
+{
+	V2D_CPU_S *pCpu;
+	const char *pThreads = getenv(CPU_THREADS_ENV);
+	void **ppArg;
+	int i;
+
+	pCpu = (V2D_CPU_S *)calloc(1, sizeof(V2D_CPU_S));
+	if (!pCpu)
+		return FAILURE;
+	pCpu->threads = (pThreads && atoi(pThreads) > 0) ? atoi(pThreads) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (pCpu->threads < 1)
+		pCpu->threads = 1;
+	if (pCpu->threads > CPU_THREADS_MAX)
+		pCpu->threads = CPU_THREADS_MAX;
+	pCpu->pTids = (pthread_t *)calloc(pCpu->threads, sizeof(pthread_t));
+	pCpu->pQueues = (V2D_CPU_QUEUE_S *)calloc(pCpu->threads, sizeof(V2D_CPU_QUEUE_S));
+	pthread_mutex_init(&pCpu->runLock, NULL);
+	pthread_mutex_init(&pCpu->lock, NULL);
+	pthread_mutex_init(&pCpu->stMapCache.lock, NULL);
+	pthread_cond_init(&pCpu->startCond, NULL);
+	pthread_cond_init(&pCpu->doneCond, NULL);
+	if (!pCpu->pTids || !pCpu->pQueues)
+	{
+		pCpu->threads = 1;
+		V2dCpuClose(pCpu);
+		return FAILURE;
+	}
+	for (i=1; i<pCpu->threads; i++)
+	{
+		ppArg = (void **)malloc(2 * sizeof(void *));
+		if (ppArg)
+		{
+			ppArg[0] = pCpu;
+			ppArg[1] = (void *)(long)i;
+		}
+		if (!ppArg || pthread_create(&pCpu->pTids[i], NULL, V2dCpuWorker, ppArg))
+		{
+			printf("Failed to create v2d cpu worker, running on %d threads\n", i);
+			free(ppArg);
+			pCpu->threads = i;
+			break;
+		}
+	}
+	*ppPriv = pCpu;
+	return SUCCESS;
+}
+
+static int32_t V2dCpuSubmit(void *pPriv, V2D_TASK_S *pstTasks, uint32_t count)
+{
+	V2D_CPU_S *pCpu = (V2D_CPU_S *)pPriv;
+	V2D_CPU_MAPS_S stMaps;
+	V2D_CPU_RANGE_S astRange[CPU_TASK_RANGES];
+	V2D_CPU_BATCH_S *pBatch;
+	V2D_SUBMIT_TASK_S *pstTask;
+	int failed = 0;
+	uint32_t i, n;
+
+	pBatch = V2dCpuGetBatch(pCpu);
+	if (!pBatch)
+		return 0;
+	stMaps.pCache = &pCpu->stMapCache;
+	stMaps.count = 0;
+	V2dCpuCacheSweep(stMaps.pCache);
+	for (i=0; i<count && !failed; i++)
+	{
+		pstTask = &pstTasks[i].stV2dTask;
+		pstTask->completeFencefd = -1;
+		n = V2dCpuTaskRanges(&pstTask->param, astRange);
+		/* the task has to see everything the batch writes, and must not write what it reads */
+		if (pBatch->taskCount == CPU_BATCH_MAX || stMaps.count > CPU_MAP_MAX - CPU_TASK_MAPS ||
+		    V2dCpuConflict(astRange, n, pBatch->astRange, pBatch->rangeCount))
+		{
+			V2dCpuRunBatch(pCpu, pBatch);
+			V2dCpuEncodeBatch(pBatch);
+			V2dCpuReleaseBatch(pBatch);
+			pBatch->taskCount = pBatch->rangeCount = pBatch->tileCount = 0;
+			if (stMaps.count > CPU_MAP_MAX - CPU_TASK_MAPS)
+				V2dCpuUnmapAll(&stMaps);
+		}
+		if (pstTask->acquireFencefd >= 0 && V2dWaitFence(pstTask->acquireFencefd, CPU_FENCE_TIMEOUT))
+		{
+			printf("v2d cpu backend timed out on an acquire fence\n");
+			failed = 1;
+			break;
+		}
+		if (V2dCpuPrepareTask(pstTask, &pBatch->astTask[pBatch->taskCount], &stMaps))
+		{
+			V2dCpuReleaseTask(&pBatch->astTask[pBatch->taskCount]);
+			failed = 1;
+			break;
+		}
+		if (V2dCpuAddTiles(pBatch, pBatch->taskCount, V2dCpuSelfConflict(astRange, n)))
+		{
+			printf("Failed to malloc v2d cpu tiles\n");
+			V2dCpuReleaseTask(&pBatch->astTask[pBatch->taskCount]);
+			failed = 1;
+			break;
+		}
+		memcpy(&pBatch->astRange[pBatch->rangeCount], astRange, n * sizeof(V2D_CPU_RANGE_S));
+		pBatch->rangeCount += n;
+		pBatch->taskCount++;
+	}
+	/* whatever was prepared before a failure still runs, the accepted count covers it */
+	V2dCpuRunBatch(pCpu, pBatch);
+	V2dCpuEncodeBatch(pBatch);
+	V2dCpuReleaseBatch(pBatch);
+	V2dCpuUnmapAll(&stMaps);
+	V2dCpuPutBatch(pCpu, pBatch);
+	return (int32_t)i;
+}
+
+const V2D_BACKEND_S gV2dCpuBackend = {
+	"cpu",
+	V2dCpuOpen,
+	V2dCpuClose,
+	V2dCpuSubmit,
+	1,
+	1,
+};
@@ -0,0 +1,95 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#ifndef __V2D_CPU_H__
+#define __V2D_CPU_H__
+#include <stddef.h>
+#include "v2d_type.h"
+
+/*
+ * Working pixel of the cpu backend, c[0..2] hold R,G,B or Y,U,V depending on
+ * the colour space the layer is in, c[3] is the alpha.
+ */
+typedef struct SPACEMIT_V2D_PIXEL_S
+{
+	uint8_t c[4];
+} V2D_PIXEL_S;
+
+/*
+ * A conversion is out = (m * in + bias + 2048) >> 12 per channel, the
+ * bias folds in the input and output offsets of the narrow range spaces.
+ */
+typedef struct SPACEMIT_V2D_CSC_MATRIX_S
+{
+	int32_t m[3][3];
+	int32_t bias[3];
+} V2D_CSC_MATRIX_S;
+
+const V2D_CSC_MATRIX_S *V2dCscMatrix(V2D_CSC_MODE_E enMode);
+void V2dCscPixel(const V2D_CSC_MATRIX_S *pMatrix, V2D_PIXEL_S *pstPixel);
+
+/*
+ * Kernel flavour of the host image paths: the per pixel reference or the
+ * portable C kernels. V2D_CPU_ISA=scalar|generic is read once, generic by
+ * default.
+ */
+typedef enum SPACEMIT_V2D_CPU_ISA_E
+{
+	CPU_ISA_SCALAR = 0,
+	CPU_ISA_GENERIC,
+} V2D_CPU_ISA_E;
+
+V2D_CPU_ISA_E V2dCpuIsa(void);
+
+/*
+ * Converts a w x h window at (sx,sy) of pSrc into (dx,dy) of pDst, pMatrix
+ * may be NULL for a plain format conversion.
+ */
+int V2dCscConvert(const V2D_IMAGE_S *pSrc, uint32_t sx, uint32_t sy, const V2D_IMAGE_S *pDst, uint32_t dx, uint32_t dy,
+                  uint32_t w, uint32_t h, const V2D_CSC_MATRIX_S *pMatrix);
+
+/*
+ * Matrix stage of the row pipeline, converts w planar pixels in place. The
+ * arithmetic is the one of V2dCscPixel, every implementation is bit exact.
+ */
+typedef void (*V2D_CSC_ROW_FN)(const V2D_CSC_MATRIX_S *pMatrix, uint8_t *pC0, uint8_t *pC1, uint8_t *pC2, uint32_t w);
+
+/*
+ * Rotates the w x h window at (sx,sy) of pSrc into (dx,dy) of pDst, both of
+ * the same format and not overlapping. Pixels move like in V2dCpuSample. The
+ * chroma plane of NV12/NV21 needs even window coordinates and sizes.
+ */
+int V2dRotateConvert(const V2D_IMAGE_S *pSrc, uint32_t sx, uint32_t sy, uint32_t w, uint32_t h,
+                     const V2D_IMAGE_S *pDst, uint32_t dx, uint32_t dy, V2D_ROTATE_ANGLE_E rt);
+
+/* linear format an FBC format decodes to, V2D_COLOR_FORMAT_BUTT for none */
+V2D_COLOR_FORMAT_E V2dFbcFormat(FBC_DECODER_FORMAT_E enFmt);
+
+/*
+ * Decodes the part of pRect inside the bbox of the FBC surface in pBuf, a
+ * header followed by its payload, into the same pixels of pstDst. pstDst has
+ * the size of the FBC picture and the format it decodes to.
+ */
+int V2dFbcDecodeRect(const FBC_DECODER_S *pstFbc, const uint8_t *pBuf, size_t size, const V2D_IMAGE_S *pstDst,
+                     const V2D_AREA_S *pRect);
+
+/* bytes of an FBC surface of w x h, its header and a raw sized payload slot per superblock */
+size_t V2dFbcEncodeSize(const FBC_ENCODER_S *pstFbc, uint32_t w, uint32_t h);
+
+/*
+ * Encodes every superblock of pstSrc that pRect touches inside the bbox into
+ * the FBC surface in pBuf, pUsed returns the header and payload bytes written,
+ * what the block reads back.
+ */
+int V2dFbcEncodeRect(const FBC_ENCODER_S *pstFbc, uint8_t *pBuf, size_t size, const V2D_IMAGE_S *pstSrc,
+                     const V2D_AREA_S *pRect, size_t *pUsed);
+
+int V2dCpuBpp(V2D_COLOR_FORMAT_E format);
+int V2dCpuIsPalette(V2D_COLOR_FORMAT_E format);
+void V2dCpuUnpack(const uint8_t *p, V2D_COLOR_FORMAT_E format, V2D_PIXEL_S *px);
+void V2dCpuPack(uint8_t *p, V2D_COLOR_FORMAT_E format, const V2D_PIXEL_S *px);
+
+#endif
@@ -0,0 +1,554 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pthread.h"
+#include "v2d_cpu.h"
+
+#define CSC_SHIFT 12
+#define CSC_ONE   (1 << CSC_SHIFT)
+/* fraction bits the block keeps of a coefficient, it keeps none of the bias */
+#define CSC_BLOCK_COEF_BITS 10
+#define CPU_ISA_ENV "V2D_CPU_ISA"
+
+typedef enum SPACEMIT_V2D_CSC_SPACE_E
+{
+	CSC_SPACE_RGB = 0,
+	CSC_SPACE_BT601WIDE,
+	CSC_SPACE_BT601NARROW,
+	CSC_SPACE_BT709WIDE,
+	CSC_SPACE_BT709NARROW,
+} V2D_CSC_SPACE_E;
+
+/* source and destination space of every V2D_CSC_MODE_E below RGB_2_GREY */
+static const uint8_t gCscSpaces[V2D_CSC_MODE_RGB_2_GREY][2] = {
+	{ CSC_SPACE_RGB,         CSC_SPACE_BT601WIDE   },
+	{ CSC_SPACE_BT601WIDE,   CSC_SPACE_RGB         },
+	{ CSC_SPACE_RGB,         CSC_SPACE_BT601NARROW },
+	{ CSC_SPACE_BT601NARROW, CSC_SPACE_RGB         },
+	{ CSC_SPACE_RGB,         CSC_SPACE_BT709WIDE   },
+	{ CSC_SPACE_BT709WIDE,   CSC_SPACE_RGB         },
+	{ CSC_SPACE_RGB,         CSC_SPACE_BT709NARROW },
+	{ CSC_SPACE_BT709NARROW, CSC_SPACE_RGB         },
+	{ CSC_SPACE_BT601WIDE,   CSC_SPACE_BT709WIDE   },
+	{ CSC_SPACE_BT601WIDE,   CSC_SPACE_BT709NARROW },
+	{ CSC_SPACE_BT601WIDE,   CSC_SPACE_BT601NARROW },
+	{ CSC_SPACE_BT601NARROW, CSC_SPACE_BT709WIDE   },
+	{ CSC_SPACE_BT601NARROW, CSC_SPACE_BT709NARROW },
+	{ CSC_SPACE_BT601NARROW, CSC_SPACE_BT601WIDE   },
+	{ CSC_SPACE_BT709WIDE,   CSC_SPACE_BT601WIDE   },
+	{ CSC_SPACE_BT709WIDE,   CSC_SPACE_BT601NARROW },
+	{ CSC_SPACE_BT709WIDE,   CSC_SPACE_BT709NARROW },
+	{ CSC_SPACE_BT709NARROW, CSC_SPACE_BT601WIDE   },
+	{ CSC_SPACE_BT709NARROW, CSC_SPACE_BT601NARROW },
+	{ CSC_SPACE_BT709NARROW, CSC_SPACE_BT709WIDE   },
+};
+
+static pthread_once_t gCscOnce = PTHREAD_ONCE_INIT;
+static V2D_CSC_MATRIX_S gCscMatrix[V2D_CSC_MODE_BUTT];
+
+/* RGB to Y'CbCr of a space, out = m * (r,g,b) + off */
+static void V2dCscFromRgb(V2D_CSC_SPACE_E enSpace, double m[3][3], double off[3])
+{
+	double kr, kb, kg, ys = 1.0, cs = 1.0;
+	int i, j;
+
+	memset(m, 0, 9 * sizeof(double));
+	memset(off, 0, 3 * sizeof(double));
+	if (enSpace == CSC_SPACE_RGB)
+	{
+		for (i=0; i<3; i++)
+			m[i][i] = 1.0;
+		return;
+	}
+	kr = (enSpace <= CSC_SPACE_BT601NARROW) ? 0.299 : 0.2126;
+	kb = (enSpace <= CSC_SPACE_BT601NARROW) ? 0.114 : 0.0722;
+	kg = 1.0 - kr - kb;
+	if (enSpace == CSC_SPACE_BT601NARROW || enSpace == CSC_SPACE_BT709NARROW)
+	{
+		ys = 219.0 / 255.0;
+		cs = 224.0 / 255.0;
+		off[0] = 16.0;
+	}
+	off[1] = off[2] = 128.0;
+	m[0][0] = kr;
+	m[0][1] = kg;
+	m[0][2] = kb;
+	m[1][0] = -kr / (2.0 * (1.0 - kb));
+	m[1][1] = -kg / (2.0 * (1.0 - kb));
+	m[1][2] = 0.5;
+	m[2][0] = 0.5;
+	m[2][1] = -kg / (2.0 * (1.0 - kr));
+	m[2][2] = -kb / (2.0 * (1.0 - kr));
+	for (j=0; j<3; j++)
+	{
+		m[0][j] *= ys;
+		m[1][j] *= cs;
+		m[2][j] *= cs;
+	}
+}
+
+static void V2dCscInvert(double m[3][3], double inv[3][3])
+{
+	double det;
+	int i, j;
+
+	inv[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	inv[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+	inv[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+	inv[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	inv[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+	inv[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+	inv[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	inv[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+	inv[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+	det = m[0][0] * inv[0][0] + m[0][1] * inv[1][0] + m[0][2] * inv[2][0];
+	for (i=0; i<3; i++)
+		for (j=0; j<3; j++)
+			inv[i][j] /= det;
+}
+
+/* v rounded to the nearest multiple of 2^-bits, in CSC_SHIFT fixed point */
+static int32_t V2dCscFixed(double v, int bits)
+{
+	return (int32_t)(v * (1 << bits) + (v < 0 ? -0.5 : 0.5)) * (1 << (CSC_SHIFT - bits));
+}
+
+/*
+ * out = to * from^-1 * (in - inOff) + outOff, folded into one matrix and bias.
+ * The block rounds the coefficients to CSC_BLOCK_COEF_BITS fraction bits and
+ * the bias to whole output levels, then rounds the sum to nearest. That is the
+ * fit of BT601 narrow to RGB, bit exact to the blend case in res/: the
+ * mirrored 320_240_yuv_s0 stream against adv_320_240_rgb888.raw. The other
+ * modes are built the same way.
+ */
+static void V2dCscBuild(V2D_CSC_SPACE_E enFrom, V2D_CSC_SPACE_E enTo, V2D_CSC_MATRIX_S *pMatrix)
+{
+	double from[3][3], fromInv[3][3], to[3][3], m[3][3];
+	double inOff[3], outOff[3], bias;
+	int i, j, k;
+
+	V2dCscFromRgb(enFrom, from, inOff);
+	V2dCscInvert(from, fromInv);
+	V2dCscFromRgb(enTo, to, outOff);
+	for (i=0; i<3; i++)
+	{
+		bias = outOff[i];
+		for (j=0; j<3; j++)
+		{
+			m[i][j] = 0.0;
+			for (k=0; k<3; k++)
+				m[i][j] += to[i][k] * fromInv[k][j];
+			bias -= m[i][j] * inOff[j];
+			pMatrix->m[i][j] = V2dCscFixed(m[i][j], CSC_BLOCK_COEF_BITS);
+		}
+		pMatrix->bias[i] = V2dCscFixed(bias, 0);
+	}
+}
+
+static void V2dCscInit(void)
+{
+	double from[3][3], off[3];
+	int i, j;
+
+	for (i=0; i<V2D_CSC_MODE_RGB_2_GREY; i++)
+		V2dCscBuild((V2D_CSC_SPACE_E)gCscSpaces[i][0], (V2D_CSC_SPACE_E)gCscSpaces[i][1], &gCscMatrix[i]);
+	/* grey is the full range BT601 luma replicated into all three channels */
+	V2dCscFromRgb(CSC_SPACE_BT601WIDE, from, off);
+	for (i=0; i<3; i++)
+		for (j=0; j<3; j++)
+			gCscMatrix[V2D_CSC_MODE_RGB_2_GREY].m[i][j] = V2dCscFixed(from[0][j], CSC_BLOCK_COEF_BITS);
+	V2dCscBuild(CSC_SPACE_RGB, CSC_SPACE_RGB, &gCscMatrix[V2D_CSC_MODE_RGB_2_RGB]);
+}
+
+/* NULL when the mode leaves the pixels untouched */
+const V2D_CSC_MATRIX_S *V2dCscMatrix(V2D_CSC_MODE_E enMode)
+{
+	if (enMode >= V2D_CSC_MODE_RGB_2_RGB)
+		return NULL;
+	pthread_once(&gCscOnce, V2dCscInit);
+	return &gCscMatrix[enMode];
+}
+
+void V2dCscPixel(const V2D_CSC_MATRIX_S *pMatrix, V2D_PIXEL_S *pstPixel)
+{
+	int32_t in[3], v;
+	int i;
+
+	for (i=0; i<3; i++)
+		in[i] = pstPixel->c[i];
+	for (i=0; i<3; i++)
+	{
+		v = pMatrix->m[i][0] * in[0] + pMatrix->m[i][1] * in[1] + pMatrix->m[i][2] * in[2];
+		v = (v + pMatrix->bias[i] + (CSC_ONE >> 1)) >> CSC_SHIFT;
+		pstPixel->c[i] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+	}
+}
+
+/*
+ * Host side conversion. The scalar path converts pixel by pixel and is the
+ * reference, the row pipeline unpacks a row into planar channels, runs the
+ * matrix over them and packs the result. Both place the chroma of NV12/NV21
+ * output on the top left pixel of each 2x2 block, like the cpu backend.
+ */
+static pthread_once_t gCpuIsaOnce = PTHREAD_ONCE_INIT;
+static V2D_CPU_ISA_E gCpuEnvIsa = CPU_ISA_GENERIC;
+static int gCpuIsaOverride = -1; /* V2D_SetCpuIsa, -1 for the V2D_CPU_ISA choice */
+
+/* -1 for an unknown name */
+static int V2dCpuIsaPick(const char *pIsa)
+{
+	if (!strcmp(pIsa, "scalar"))
+		return CPU_ISA_SCALAR;
+	if (!strcmp(pIsa, "generic"))
+		return CPU_ISA_GENERIC;
+	return -1;
+}
+
+static void V2dCpuIsaInit(void)
+{
+	const char *pIsa = getenv(CPU_ISA_ENV);
+	int isa;
+
+	if (!pIsa || !pIsa[0])
+		return;
+	isa = V2dCpuIsaPick(pIsa);
+	if (isa < 0)
+		printf("%s=%s is not available, using generic\n", CPU_ISA_ENV, pIsa);
+	else
+		gCpuEnvIsa = (V2D_CPU_ISA_E)isa;
+}
+
+V2D_CPU_ISA_E V2dCpuIsa(void)
+{
+	int isa;
+
+	pthread_once(&gCpuIsaOnce, V2dCpuIsaInit);
+	isa = __atomic_load_n(&gCpuIsaOverride, __ATOMIC_RELAXED);
+	return (isa >= 0) ? (V2D_CPU_ISA_E)isa : gCpuEnvIsa;
+}
+
+int32_t V2D_SetCpuIsa(const char *pIsa)
+{
+	int isa = -1;
+
+	if (pIsa)
+	{
+		isa = V2dCpuIsaPick(pIsa);
+		if (isa < 0)
+			return FAILURE;
+	}
+	__atomic_store_n(&gCpuIsaOverride, isa, __ATOMIC_RELAXED);
+	return SUCCESS;
+}
+
+static int V2dCscIsNv(V2D_COLOR_FORMAT_E format)
+{
+	return format == V2D_COLOR_FORMAT_NV12 || format == V2D_COLOR_FORMAT_NV21;
+}
+
+static void V2dCscFetch(const V2D_IMAGE_S *pImage, uint32_t x, uint32_t y, V2D_PIXEL_S *px)
+{
+	const uint8_t *p = (const uint8_t *)pImage->pData + (size_t)y * pImage->stride + (size_t)x * V2dCpuBpp(pImage->format);
+	const uint8_t *pUv;
+
+	if (V2dCscIsNv(pImage->format))
+	{
+		pUv = (const uint8_t *)pImage->pUv + (size_t)(y >> 1) * pImage->stride + (x & ~1);
+		px->c[0] = p[0];
+		px->c[1] = pUv[pImage->format == V2D_COLOR_FORMAT_NV21];
+		px->c[2] = pUv[pImage->format == V2D_COLOR_FORMAT_NV12];
+		px->c[3] = 0xff;
+	}
+	else if (pImage->format == V2D_COLOR_FORMAT_Y8)
+	{
+		px->c[0] = p[0];
+		px->c[1] = px->c[2] = 0x80;
+		px->c[3] = 0xff;
+	}
+	else
+	{
+		V2dCpuUnpack(p, pImage->format, px);
+	}
+}
+
+static void V2dCscStore(const V2D_IMAGE_S *pImage, uint32_t x, uint32_t y, const V2D_PIXEL_S *px)
+{
+	uint8_t *p = (uint8_t *)pImage->pData + (size_t)y * pImage->stride + (size_t)x * V2dCpuBpp(pImage->format);
+	uint8_t *pUv;
+
+	if (V2dCscIsNv(pImage->format))
+	{
+		p[0] = px->c[0];
+		if (!(x & 1) && !(y & 1))
+		{
+			pUv = (uint8_t *)pImage->pUv + (size_t)(y >> 1) * pImage->stride + x;
+			pUv[pImage->format == V2D_COLOR_FORMAT_NV21] = px->c[1];
+			pUv[pImage->format == V2D_COLOR_FORMAT_NV12] = px->c[2];
+		}
+	}
+	else
+	{
+		V2dCpuPack(p, pImage->format, px);
+	}
+}
+
+static void V2dCscUnpackRow(const V2D_IMAGE_S *pImage, uint32_t x, uint32_t y, uint32_t w, uint8_t *apRow[4])
+{
+	const uint8_t *p = (const uint8_t *)pImage->pData + (size_t)y * pImage->stride + (size_t)x * V2dCpuBpp(pImage->format);
+	const uint8_t *pUv;
+	V2D_PIXEL_S stPixel;
+	uint32_t i, v;
+	int u;
+
+	switch (pImage->format)
+	{
+		case V2D_COLOR_FORMAT_NV12:
+		case V2D_COLOR_FORMAT_NV21:
+			u = pImage->format == V2D_COLOR_FORMAT_NV21;
+			pUv = (const uint8_t *)pImage->pUv + (size_t)(y >> 1) * pImage->stride;
+			memcpy(apRow[0], p, w);
+			for (i=0; i<w; i++)
+			{
+				apRow[1][i] = pUv[((x + i) & ~1) + u];
+				apRow[2][i] = pUv[((x + i) & ~1) + !u];
+			}
+			memset(apRow[3], 0xff, w);
+			break;
+		case V2D_COLOR_FORMAT_Y8:
+			memcpy(apRow[0], p, w);
+			memset(apRow[1], 0x80, w);
+			memset(apRow[2], 0x80, w);
+			memset(apRow[3], 0xff, w);
+			break;
+		case V2D_COLOR_FORMAT_RGB888:
+			for (i=0; i<w; i++, p+=3)
+			{
+				apRow[0][i] = p[0];
+				apRow[1][i] = p[1];
+				apRow[2][i] = p[2];
+			}
+			memset(apRow[3], 0xff, w);
+			break;
+		case V2D_COLOR_FORMAT_RGBA8888:
+			for (i=0; i<w; i++, p+=4)
+			{
+				apRow[0][i] = p[0];
+				apRow[1][i] = p[1];
+				apRow[2][i] = p[2];
+				apRow[3][i] = p[3];
+			}
+			break;
+		case V2D_COLOR_FORMAT_RGB565:
+			for (i=0; i<w; i++, p+=2)
+			{
+				v = p[0] | (p[1] << 8);
+				apRow[0][i] = ((v >> 8) & 0xf8) | (v >> 13);
+				apRow[1][i] = ((v >> 3) & 0xfc) | ((v >> 9) & 0x03);
+				apRow[2][i] = ((v << 3) & 0xf8) | ((v >> 2) & 0x07);
+			}
+			memset(apRow[3], 0xff, w);
+			break;
+		default:
+			for (i=0; i<w; i++)
+			{
+				V2dCpuUnpack(p + (size_t)i * V2dCpuBpp(pImage->format), pImage->format, &stPixel);
+				apRow[0][i] = stPixel.c[0];
+				apRow[1][i] = stPixel.c[1];
+				apRow[2][i] = stPixel.c[2];
+				apRow[3][i] = stPixel.c[3];
+			}
+			break;
+	}
+}
+
+static void V2dCscPackRow(const V2D_IMAGE_S *pImage, uint32_t x, uint32_t y, uint32_t w, uint8_t *apRow[4])
+{
+	uint8_t *p = (uint8_t *)pImage->pData + (size_t)y * pImage->stride + (size_t)x * V2dCpuBpp(pImage->format);
+	uint8_t *pUv;
+	V2D_PIXEL_S stPixel;
+	uint32_t i, v;
+	int u;
+
+	switch (pImage->format)
+	{
+		case V2D_COLOR_FORMAT_NV12:
+		case V2D_COLOR_FORMAT_NV21:
+			memcpy(p, apRow[0], w);
+			if (y & 1)
+				break;
+			u = pImage->format == V2D_COLOR_FORMAT_NV21;
+			pUv = (uint8_t *)pImage->pUv + (size_t)(y >> 1) * pImage->stride;
+			for (i=(x & 1); i<w; i+=2)
+			{
+				pUv[x + i + u] = apRow[1][i];
+				pUv[x + i + !u] = apRow[2][i];
+			}
+			break;
+		case V2D_COLOR_FORMAT_Y8:
+			memcpy(p, apRow[0], w);
+			break;
+		case V2D_COLOR_FORMAT_RGB888:
+			for (i=0; i<w; i++, p+=3)
+			{
+				p[0] = apRow[0][i];
+				p[1] = apRow[1][i];
+				p[2] = apRow[2][i];
+			}
+			break;
+		case V2D_COLOR_FORMAT_RGBA8888:
+			for (i=0; i<w; i++, p+=4)
+			{
+				p[0] = apRow[0][i];
+				p[1] = apRow[1][i];
+				p[2] = apRow[2][i];
+				p[3] = apRow[3][i];
+			}
+			break;
+		case V2D_COLOR_FORMAT_RGB565:
+			for (i=0; i<w; i++, p+=2)
+			{
+				v = ((apRow[0][i] >> 3) << 11) | ((apRow[1][i] >> 2) << 5) | (apRow[2][i] >> 3);
+				p[0] = v & 0xff;
+				p[1] = v >> 8;
+			}
+			break;
+		default:
+			for (i=0; i<w; i++)
+			{
+				stPixel.c[0] = apRow[0][i];
+				stPixel.c[1] = apRow[1][i];
+				stPixel.c[2] = apRow[2][i];
+				stPixel.c[3] = apRow[3][i];
+				V2dCpuPack(p + (size_t)i * V2dCpuBpp(pImage->format), pImage->format, &stPixel);
+			}
+			break;
+	}
+}
+
+/* written for the vectoriser: the matrix in locals, the rows not aliasing and the clamps branch free */
+static void V2dCscRowGeneric(const V2D_CSC_MATRIX_S *pMatrix, uint8_t *restrict pC0, uint8_t *restrict pC1,
+                             uint8_t *restrict pC2, uint32_t w)
+{
+	const int32_t m00 = pMatrix->m[0][0], m01 = pMatrix->m[0][1], m02 = pMatrix->m[0][2];
+	const int32_t m10 = pMatrix->m[1][0], m11 = pMatrix->m[1][1], m12 = pMatrix->m[1][2];
+	const int32_t m20 = pMatrix->m[2][0], m21 = pMatrix->m[2][1], m22 = pMatrix->m[2][2];
+	const int32_t b0 = pMatrix->bias[0] + (CSC_ONE >> 1);
+	const int32_t b1 = pMatrix->bias[1] + (CSC_ONE >> 1);
+	const int32_t b2 = pMatrix->bias[2] + (CSC_ONE >> 1);
+	int32_t in0, in1, in2, v0, v1, v2;
+	uint32_t i;
+
+	for (i=0; i<w; i++)
+	{
+		in0 = pC0[i];
+		in1 = pC1[i];
+		in2 = pC2[i];
+		v0 = (m00 * in0 + m01 * in1 + m02 * in2 + b0) >> CSC_SHIFT;
+		v1 = (m10 * in0 + m11 * in1 + m12 * in2 + b1) >> CSC_SHIFT;
+		v2 = (m20 * in0 + m21 * in1 + m22 * in2 + b2) >> CSC_SHIFT;
+		v0 = v0 < 0 ? 0 : v0;
+		v1 = v1 < 0 ? 0 : v1;
+		v2 = v2 < 0 ? 0 : v2;
+		pC0[i] = (uint8_t)(v0 > 255 ? 255 : v0);
+		pC1[i] = (uint8_t)(v1 > 255 ? 255 : v1);
+		pC2[i] = (uint8_t)(v2 > 255 ? 255 : v2);
+	}
+}
+
+/* planar rows of the row pipeline, kept per thread and grown to the widest window seen */
+typedef struct SPACEMIT_V2D_CSC_ROWS_S
+{
+	size_t size;
+	uint8_t au8Data[];
+} V2D_CSC_ROWS_S;
+
+static pthread_once_t gCscRowsOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gCscRowsKey;
+
+static void V2dCscRowsInit(void)
+{
+	pthread_key_create(&gCscRowsKey, free);
+}
+
+static uint8_t *V2dCscRows(size_t size)
+{
+	V2D_CSC_ROWS_S *pRows;
+
+	pthread_once(&gCscRowsOnce, V2dCscRowsInit);
+	pRows = (V2D_CSC_ROWS_S *)pthread_getspecific(gCscRowsKey);
+	if (pRows && pRows->size >= size)
+		return pRows->au8Data;
+	free(pRows);
+	pRows = (V2D_CSC_ROWS_S *)malloc(sizeof(V2D_CSC_ROWS_S) + size);
+	if (pRows)
+		pRows->size = size;
+	pthread_setspecific(gCscRowsKey, pRows);
+	return pRows ? pRows->au8Data : NULL;
+}
+
+int V2dCscConvert(const V2D_IMAGE_S *pSrc, uint32_t sx, uint32_t sy, const V2D_IMAGE_S *pDst, uint32_t dx, uint32_t dy,
+                  uint32_t w, uint32_t h, const V2D_CSC_MATRIX_S *pMatrix)
+{
+	V2D_CSC_ROW_FN pfnRow = V2dCscRowGeneric;
+	V2D_PIXEL_S stPixel;
+	uint8_t *pRows, *apRow[4];
+	uint32_t x, y;
+	int i;
+
+	switch (V2dCpuIsa())
+	{
+		case CPU_ISA_SCALAR:
+			for (y=0; y<h; y++)
+			{
+				for (x=0; x<w; x++)
+				{
+					V2dCscFetch(pSrc, sx + x, sy + y, &stPixel);
+					if (pMatrix)
+						V2dCscPixel(pMatrix, &stPixel);
+					V2dCscStore(pDst, dx + x, dy + y, &stPixel);
+				}
+			}
+			return SUCCESS;
+		default:
+			break;
+	}
+
+	pRows = V2dCscRows(4 * (size_t)w);
+	if (!pRows)
+		return FAILURE;
+	for (i=0; i<4; i++)
+		apRow[i] = pRows + (size_t)i * w;
+	for (y=0; y<h; y++)
+	{
+		V2dCscUnpackRow(pSrc, sx, sy + y, w, apRow);
+		if (pMatrix)
+			pfnRow(pMatrix, apRow[0], apRow[1], apRow[2], w);
+		V2dCscPackRow(pDst, dx, dy + y, w, apRow);
+	}
+	return SUCCESS;
+}
+
+int32_t V2D_CscImage(V2D_IMAGE_S *pstSrc, V2D_IMAGE_S *pstDst, V2D_CSC_MODE_E enMode)
+{
+	if (!pstSrc || !pstDst || !pstSrc->pData || !pstDst->pData || enMode > V2D_CSC_MODE_BUTT)
+		return FAILURE;
+	if (pstSrc->format >= V2D_COLOR_FORMAT_BUTT || pstDst->format >= V2D_COLOR_FORMAT_BUTT ||
+	    V2dCpuIsPalette(pstSrc->format) || V2dCpuIsPalette(pstDst->format) ||
+	    (V2dCscIsNv(pstSrc->format) && !pstSrc->pUv) || (V2dCscIsNv(pstDst->format) && !pstDst->pUv))
+	{
+		printf("V2D_CscImage cannot convert format %d to %d\n", pstSrc->format, pstDst->format);
+		return FAILURE;
+	}
+	if (pstSrc->w != pstDst->w || pstSrc->h != pstDst->h)
+	{
+		printf("V2D_CscImage needs equal sizes, %ux%u vs %ux%u\n", pstSrc->w, pstSrc->h, pstDst->w, pstDst->h);
+		return FAILURE;
+	}
+	return V2dCscConvert(pstSrc, 0, 0, pstDst, 0, 0, pstSrc->w, pstSrc->h, V2dCscMatrix(enMode));
+}
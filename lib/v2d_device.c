@@ -0,0 +1,76 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include "v2d_backend.h"
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define DEV_NAME "/dev/v2d_dev"
+#define DEV_NAME_ENV "V2D_DEV_NAME"
+#define MAX_IOV_PER_WRITE 64
+
+static const char *V2dDevName(void)
+{
+	/* allow pointing the library at a stand-in node, e.g. for benchmarks */
+	const char *pName = getenv(DEV_NAME_ENV);
+	return (pName && pName[0]) ? pName : DEV_NAME;
+}
+
+static int32_t V2dDeviceOpen(void **ppPriv)
+{
+	int fd = open(V2dDevName(), O_RDWR|O_CLOEXEC|O_NONBLOCK);
+	if (fd < 0)
+	{
+		printf("Failed to open device file %s\n", V2dDevName());
+		return FAILURE;
+	}
+	*ppPriv = (void *)(long)fd;
+	return SUCCESS;
+}
+
+static void V2dDeviceClose(void *pPriv)
+{
+	close((int)(long)pPriv);
+}
+
+/* the driver consumes one V2D_TASK_S per iovec segment and fills in its completeFencefd */
+static int32_t V2dDeviceSubmit(void *pPriv, V2D_TASK_S *pstTasks, uint32_t count)
+{
+	struct iovec astIov[MAX_IOV_PER_WRITE];
+	uint32_t i, n, submitted = 0;
+	ssize_t len;
+
+	while (submitted < count)
+	{
+		n = count - submitted;
+		if (n > MAX_IOV_PER_WRITE)
+			n = MAX_IOV_PER_WRITE;
+		for (i=0; i<n; i++)
+		{
+			astIov[i].iov_base = &pstTasks[submitted + i];
+			astIov[i].iov_len  = sizeof(V2D_TASK_S);
+		}
+		len = writev((int)(long)pPriv, astIov, n);
+		if (len <= 0)
+			break;
+		submitted += (uint32_t)(len / sizeof(V2D_TASK_S));
+		if ((uint32_t)(len / sizeof(V2D_TASK_S)) != n)
+			break;
+	}
+	return (int32_t)submitted;
+}
+
+const V2D_BACKEND_S gV2dDeviceBackend = {
+	"device",
+	V2dDeviceOpen,
+	V2dDeviceClose,
+	V2dDeviceSubmit,
+	16,
+	0, /* widening is not verified on the hardware yet, V2D_DST_WIDEN=1 turns it on */
+};
@@ -0,0 +1,780 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "v2d_cpu.h"
+
+/*
+ * Host side decoder and encoder of the FBC surfaces the V2D reads and writes.
+ *
+ * The picture is cut into 16x16 superblocks, each with a 16 byte header
+ * entry: the byte offset of its payload from the start of the header, then
+ * the sizes of its sub-blocks. RGB superblocks have 16 sub-blocks of 4x4
+ * pixels, a 32 bit offset and 6 bit sizes. NV12 superblocks have a 24 bit
+ * offset and 20 sub-blocks of 5 bit sizes, one group per 8x8 quadrant: two
+ * 4x4 luma blocks, the 4x4 chroma block of the quadrant, two luma blocks.
+ * A size of 1 is a raw sub-block in memory order. Split payloads keep the
+ * second half of the sub-blocks at half the raw superblock size.
+ *
+ * A compressed sub-block holds per channel a 4 bit width code c, 15 for a
+ * constant channel, the 2 bit width codes of its 2x2 quadrants and the 8 bit
+ * minimum of the channel. The quadrant minimums above it follow with c bits
+ * each, then the quadrants with c+1, c, c-1 or c-2 bits per pixel on top of
+ * their minimum. A group of four values of one bit is stored as is, wider
+ * groups name the index of their zero and interleave the other three by bit
+ * plane. All fields are little endian, LSB first.
+ *
+ * Every superblock owns a slot of its raw size in the payload, so a surface
+ * takes as much memory as a linear one and compression only saves the bytes
+ * the block reads.
+ */
+
+#define FBC_SB              16
+#define FBC_ENTRY_BYTES     16
+#define FBC_SUB_MAX         20
+#define FBC_CH_MAX          4
+#define FBC_RAW             1
+#define FBC_CONST           15
+/* largest compressed sub-block, four channels of eight bit quadrants */
+#define FBC_BLOCK_MAX       128
+
+typedef struct SPACEMIT_V2D_FBC_LAYOUT_S
+{
+	uint32_t bpp;           /* bytes per pixel of the decoded first plane */
+	uint32_t channels;      /* channels of a luma or rgb sub-block */
+	uint32_t subCount;
+	uint32_t offsetBits;
+	uint32_t sizeShift;
+	uint32_t sizeBits;
+	uint32_t sbBytes;       /* raw payload of a superblock */
+	V2D_COLOR_FORMAT_E format;
+} V2D_FBC_LAYOUT_S;
+
+typedef struct SPACEMIT_V2D_FBC_BITS_S
+{
+	const uint8_t *p;
+	uint32_t bits;
+	uint32_t pos;
+	int bad;
+} V2D_FBC_BITS_S;
+
+typedef struct SPACEMIT_V2D_FBC_PUT_S
+{
+	uint8_t *p;             /* zeroed before the first put */
+	uint32_t pos;
+} V2D_FBC_PUT_S;
+
+static const V2D_FBC_LAYOUT_S gFbcLayout[FBC_DECODER_FORMAT_BUTT] = {
+	[FBC_DECODER_FORMAT_NV12]     = { 1, 1, 20, 24, 28, 5, 384,  V2D_COLOR_FORMAT_NV12 },
+	[FBC_DECODER_FORMAT_RGB888]   = { 3, 3, 16, 32, 32, 6, 768,  V2D_COLOR_FORMAT_RGB888 },
+	[FBC_DECODER_FORMAT_ARGB8888] = { 4, 4, 16, 32, 32, 6, 1024, V2D_COLOR_FORMAT_ARGB8888 },
+	[FBC_DECODER_FORMAT_RGB565]   = { 2, 3, 16, 32, 32, 6, 512,  V2D_COLOR_FORMAT_RGB565 },
+};
+
+/* position of the rgb sub-blocks in 4x4 units, quadrant by quadrant */
+static const uint8_t gFbcOrder[16][2] = {
+	{ 1, 1 }, { 0, 1 }, { 0, 0 }, { 1, 0 },
+	{ 2, 0 }, { 3, 0 }, { 3, 1 }, { 2, 1 },
+	{ 2, 2 }, { 3, 2 }, { 3, 3 }, { 2, 3 },
+	{ 1, 3 }, { 0, 3 }, { 0, 2 }, { 1, 2 },
+};
+
+static const V2D_FBC_LAYOUT_S *V2dFbcLayout(FBC_DECODER_FORMAT_E enFmt)
+{
+	return (enFmt < FBC_DECODER_FORMAT_BUTT) ? &gFbcLayout[enFmt] : NULL;
+}
+
+V2D_COLOR_FORMAT_E V2dFbcFormat(FBC_DECODER_FORMAT_E enFmt)
+{
+	return (enFmt < FBC_DECODER_FORMAT_BUTT) ? gFbcLayout[enFmt].format : V2D_COLOR_FORMAT_BUTT;
+}
+
+/*
+ * Maps sub-block i of a superblock to its 4x4 block (x,y) in luma or rgb
+ * units, returns 1 for the chroma block of an NV12 quadrant, whose (x,y) is
+ * then in 4x4 chroma units.
+ */
+static int V2dFbcSubBlock(const V2D_FBC_LAYOUT_S *pLayout, uint32_t i, uint32_t *pX, uint32_t *pY)
+{
+	uint32_t group, k;
+
+	if (pLayout->subCount == 16)
+	{
+		*pX = gFbcOrder[i][0];
+		*pY = gFbcOrder[i][1];
+		return 0;
+	}
+	group = i / 5;
+	k = i % 5;
+	if (k == 2)
+	{
+		*pX = gFbcOrder[4 * group + 2][0] >> 1;
+		*pY = gFbcOrder[4 * group + 2][1] >> 1;
+		return 1;
+	}
+	k = 4 * group + ((k < 2) ? k : k - 1);
+	*pX = gFbcOrder[k][0];
+	*pY = gFbcOrder[k][1];
+	return 0;
+}
+
+/* header entry of superblock (sx,sy), the decoder modes differ in the order the superblocks are stored */
+static uint32_t V2dFbcEntry(FBC_DECODER_MODE_E enMode, uint32_t sbw, uint32_t sx, uint32_t sy)
+{
+	switch (enMode)
+	{
+		case FBC_DECODER_MODE_H264_32x16:
+			return sy * ((sbw + 1) & ~1u) + sx;
+		case FBC_DECODER_MODE_H265_32x32:
+			return ((sy >> 1) * ((sbw + 1) >> 1) + (sx >> 1)) * 4 + (sy & 1) * 2 + (sx & 1);
+		default:
+			return sy * sbw + sx;
+	}
+}
+
+static uint32_t V2dFbcEntryCount(FBC_DECODER_MODE_E enMode, uint32_t w, uint32_t h)
+{
+	uint32_t sbw = (w + FBC_SB - 1) / FBC_SB, sbh = (h + FBC_SB - 1) / FBC_SB;
+
+	switch (enMode)
+	{
+		case FBC_DECODER_MODE_H264_32x16:
+			return ((sbw + 1) & ~1u) * sbh;
+		case FBC_DECODER_MODE_H265_32x32:
+			return ((sbw + 1) & ~1u) * ((sbh + 1) & ~1u);
+		default:
+			return sbw * sbh;
+	}
+}
+
+/* raw bytes of sub-block i */
+static uint32_t V2dFbcRawBytes(const V2D_FBC_LAYOUT_S *pLayout, uint32_t i)
+{
+	uint32_t x, y;
+
+	if (V2dFbcSubBlock(pLayout, i, &x, &y))
+		return 32;
+	return 16 * pLayout->bpp;
+}
+
+/* payload offset and sub-block sizes of a header entry */
+static uint32_t V2dFbcParseEntry(const V2D_FBC_LAYOUT_S *pLayout, const uint8_t *pEntry, uint32_t *pSizes)
+{
+	uint64_t lo = 0, hi = 0;
+	uint32_t i, bit;
+
+	for (i=0; i<8; i++)
+	{
+		lo |= (uint64_t)pEntry[i] << (8 * i);
+		hi |= (uint64_t)pEntry[8 + i] << (8 * i);
+	}
+	for (i=0; i<pLayout->subCount; i++)
+	{
+		bit = pLayout->sizeShift + i * pLayout->sizeBits;
+		if (bit >= 64)
+			pSizes[i] = hi >> (bit - 64);
+		else if (bit + pLayout->sizeBits <= 64)
+			pSizes[i] = lo >> bit;
+		else
+			pSizes[i] = (lo >> bit) | (hi << (64 - bit));
+		pSizes[i] &= (1u << pLayout->sizeBits) - 1;
+	}
+	return (uint32_t)(lo & ((pLayout->offsetBits == 32) ? 0xffffffffull : ((1ull << pLayout->offsetBits) - 1)));
+}
+
+static uint32_t V2dFbcGet(V2D_FBC_BITS_S *pBits, uint32_t n)
+{
+	uint64_t v = 0;
+	uint32_t i, first, last;
+
+	if (!n)
+		return 0;
+	if (pBits->pos + n > pBits->bits)
+	{
+		pBits->bad = 1;
+		return 0;
+	}
+	first = pBits->pos >> 3;
+	last = (pBits->pos + n + 7) >> 3;
+	for (i=first; i<last; i++)
+		v |= (uint64_t)pBits->p[i] << (8 * (i - first));
+	v >>= pBits->pos & 7;
+	pBits->pos += n;
+	return (uint32_t)(v & ((1ull << n) - 1));
+}
+
+/* four values of w bits, see the layout above */
+static void V2dFbcGroup(V2D_FBC_BITS_S *pBits, int w, uint8_t *pV)
+{
+	uint32_t planes, v[3] = { 0, 0, 0 };
+	int idx, k, b, j;
+
+	if (w <= 0 || w > 8)
+	{
+		memset(pV, 0, 4);
+		pBits->bad |= (w != 0);
+		return;
+	}
+	if (w == 1)
+	{
+		planes = V2dFbcGet(pBits, 4);
+		for (k=0; k<4; k++)
+			pV[k] = (planes >> k) & 1;
+		return;
+	}
+	idx = V2dFbcGet(pBits, 2);
+	planes = V2dFbcGet(pBits, 3 * w);
+	for (b=0; b<w; b++)
+	{
+		for (k=0; k<3; k++)
+			v[k] |= ((planes >> (3 * b + k)) & 1) << b;
+	}
+	for (k=0, j=0; k<4; k++)
+		pV[k] = (k == idx) ? 0 : v[j++];
+}
+
+/* decodes a compressed sub-block of n channels into pOut[pixel * n + channel], pixels in raster order */
+static int V2dFbcDecodeBlock(const uint8_t *p, uint32_t size, uint32_t n, uint8_t *pOut)
+{
+	V2D_FBC_BITS_S stBits = { p, size * 8, 0, 0 };
+	uint8_t au8Code[FBC_CH_MAX], au8Quad[FBC_CH_MAX][4], au8Base[FBC_CH_MAX];
+	uint8_t au8Min[FBC_CH_MAX][4], au8Leaf[FBC_CH_MAX][4][4];
+	uint32_t ch, k, q, x, y;
+
+	if (n > FBC_CH_MAX)
+		return FAILURE;
+	for (ch=0; ch<n; ch++)
+		au8Code[ch] = V2dFbcGet(&stBits, 4);
+	for (ch=0; ch<n; ch++)
+	{
+		q = (au8Code[ch] != FBC_CONST) ? V2dFbcGet(&stBits, 8) : 0;
+		for (k=0; k<4; k++)
+			au8Quad[ch][k] = (q >> (2 * k)) & 3;
+	}
+	for (ch=0; ch<n; ch++)
+		au8Base[ch] = V2dFbcGet(&stBits, 8);
+	for (ch=0; ch<n; ch++)
+	{
+		if (au8Code[ch] != FBC_CONST)
+			V2dFbcGroup(&stBits, au8Code[ch], au8Min[ch]);
+		else
+			memset(au8Min[ch], 0, 4);
+	}
+	for (k=0; k<4; k++)
+	{
+		for (ch=0; ch<n; ch++)
+		{
+			if (au8Code[ch] != FBC_CONST)
+				V2dFbcGroup(&stBits, au8Code[ch] + 1 - ((1 - au8Quad[ch][k]) & 3), au8Leaf[ch][k]);
+			else
+				memset(au8Leaf[ch][k], 0, 4);
+		}
+	}
+	if (stBits.bad)
+		return FAILURE;
+	for (y=0; y<4; y++)
+	{
+		for (x=0; x<4; x++)
+		{
+			k = (y >> 1) * 2 + (x >> 1);
+			q = (y & 1) * 2 + (x & 1);
+			for (ch=0; ch<n; ch++)
+				pOut[(y * 4 + x) * n + ch] = au8Base[ch] + au8Min[ch][k] + au8Leaf[ch][k][q];
+		}
+	}
+	return SUCCESS;
+}
+
+/* 4x4 block of channel values to pixels of the format */
+static void V2dFbcStoreBlock(const V2D_FBC_LAYOUT_S *pLayout, const uint8_t *pIn, int raw, uint8_t *pDst, uint32_t stride)
+{
+	uint32_t x, y, v;
+	const uint8_t *pPx;
+
+	for (y=0; y<4; y++)
+	{
+		if (raw || pLayout->format != V2D_COLOR_FORMAT_RGB565)
+		{
+			memcpy(pDst + y * stride, pIn + y * 4 * pLayout->bpp, 4 * pLayout->bpp);
+			continue;
+		}
+		for (x=0; x<4; x++)
+		{
+			pPx = pIn + (y * 4 + x) * 3;
+			v = ((pPx[0] & 0x1f) << 11) | ((pPx[1] & 0x3f) << 5) | (pPx[2] & 0x1f);
+			pDst[y * stride + 2 * x] = v & 0xff;
+			pDst[y * stride + 2 * x + 1] = v >> 8;
+		}
+	}
+}
+
+/*
+ * Decodes the superblock of entry pEntry into the 16x16 scratch planes, luma
+ * or rgb with a stride of 16 pixels and for NV12 the 8x8 chroma plane.
+ * planes selects the luma (1) and chroma (2) blocks of NV12.
+ */
+static int V2dFbcDecodeSuperblock(const V2D_FBC_LAYOUT_S *pLayout, const uint8_t *pBuf, size_t size, const uint8_t *pEntry,
+                                  int split, int planes, uint8_t *pSb, uint8_t *pSbUv)
+{
+	uint32_t au32Size[FBC_SUB_MAX];
+	uint8_t au8Block[16 * FBC_CH_MAX];
+	uint32_t i, k, offset, bytes, x, y, chroma;
+	size_t pos;
+
+	offset = V2dFbcParseEntry(pLayout, pEntry, au32Size);
+	pos = offset;
+	for (i=0; i<pLayout->subCount; i++)
+	{
+		if (split && i == pLayout->subCount / 2)
+			pos = (size_t)offset + pLayout->sbBytes / 2;
+		chroma = V2dFbcSubBlock(pLayout, i, &x, &y);
+		bytes = (au32Size[i] == FBC_RAW) ? V2dFbcRawBytes(pLayout, i) : au32Size[i];
+		if (!au32Size[i] || pos + bytes > size)
+		{
+			printf("v2d fbc sub-block %u of %u bytes at %zu is not supported or past the %zu byte buffer\n", i,
+			       au32Size[i], pos, size);
+			return FAILURE;
+		}
+		if (!(planes & (chroma ? 2 : 1)))
+		{
+			pos += bytes;
+			continue;
+		}
+		if (chroma)
+		{
+			if (au32Size[i] == FBC_RAW)
+				memcpy(au8Block, pBuf + pos, 32);
+			else if (V2dFbcDecodeBlock(pBuf + pos, bytes, 2, au8Block))
+				return FAILURE;
+			for (k=0; k<4; k++)
+				memcpy(pSbUv + ((y * 4 + k) * 8 + x * 4) * 2, au8Block + k * 8, 8);
+		}
+		else
+		{
+			if (au32Size[i] != FBC_RAW && V2dFbcDecodeBlock(pBuf + pos, bytes, pLayout->channels, au8Block))
+				return FAILURE;
+			V2dFbcStoreBlock(pLayout, (au32Size[i] == FBC_RAW) ? pBuf + pos : au8Block, au32Size[i] == FBC_RAW,
+			                 pSb + (y * 4 * FBC_SB + x * 4) * pLayout->bpp, FBC_SB * pLayout->bpp);
+		}
+		pos += bytes;
+	}
+	return SUCCESS;
+}
+
+/* pRect clipped to the inclusive bbox and the picture as x0,y0,x1,y1 with x1,y1 exclusive, 0 when nothing is left */
+static int V2dFbcClip(const V2D_AREA_S *pRect, uint32_t left, uint32_t top, uint32_t right, uint32_t bottom,
+                      const V2D_IMAGE_S *pstImage, uint32_t *pClip)
+{
+	pClip[0] = (pRect->x > left) ? pRect->x : left;
+	pClip[1] = (pRect->y > top) ? pRect->y : top;
+	pClip[2] = (pRect->x + pRect->w < right + 1u) ? pRect->x + pRect->w : right + 1u;
+	pClip[3] = (pRect->y + pRect->h < bottom + 1u) ? pRect->y + pRect->h : bottom + 1u;
+	pClip[2] = (pClip[2] < pstImage->w) ? pClip[2] : pstImage->w;
+	pClip[3] = (pClip[3] < pstImage->h) ? pClip[3] : pstImage->h;
+	return pClip[0] < pClip[2] && pClip[1] < pClip[3];
+}
+
+int V2dFbcDecodeRect(const FBC_DECODER_S *pstFbc, const uint8_t *pBuf, size_t size, const V2D_IMAGE_S *pstDst,
+                     const V2D_AREA_S *pRect)
+{
+	const V2D_FBC_LAYOUT_S *pLayout = V2dFbcLayout(pstFbc->enFbcdecFmt);
+	uint8_t au8Sb[FBC_SB * FBC_SB * FBC_CH_MAX], au8SbUv[FBC_SB * FBC_SB / 2];
+	uint32_t au32Clip[4], x0, y0, x1, y1, sbw, sx, sy, bx, by, cx0, cx1, cy0, cy1, y, bpp, entry;
+	int planes = 3;
+
+	if (!pLayout || pstFbc->enFbcdecMode >= FBC_DECODER_MODE_BUTT || pstDst->format != pLayout->format)
+	{
+		printf("v2d fbc cannot decode format %d in mode %d into format %d\n", pstFbc->enFbcdecFmt,
+		       pstFbc->enFbcdecMode, pstDst->format);
+		return FAILURE;
+	}
+	if (pstFbc->enFbcdecMode == FBC_DECODER_MODE_LDC_Y || pstFbc->enFbcdecMode == FBC_DECODER_MODE_LDC_UV)
+	{
+		if (pLayout->subCount != FBC_SUB_MAX)
+		{
+			printf("v2d fbc ldc modes only apply to NV12\n");
+			return FAILURE;
+		}
+		planes = (pstFbc->enFbcdecMode == FBC_DECODER_MODE_LDC_Y) ? 1 : 2;
+	}
+	if (pstFbc->is_split && pLayout->subCount == FBC_SUB_MAX)
+	{
+		printf("v2d fbc split payloads only apply to rgb formats\n");
+		return FAILURE;
+	}
+	if ((size_t)V2dFbcEntryCount(pstFbc->enFbcdecMode, pstDst->w, pstDst->h) * FBC_ENTRY_BYTES > size)
+	{
+		printf("v2d fbc header of %ux%u exceeds the %zu byte buffer\n", pstDst->w, pstDst->h, size);
+		return FAILURE;
+	}
+	if (!V2dFbcClip(pRect, pstFbc->bboxLeft, pstFbc->bboxTop, pstFbc->bboxRight, pstFbc->bboxBottom, pstDst, au32Clip))
+		return SUCCESS;
+	x0 = au32Clip[0];
+	y0 = au32Clip[1];
+	x1 = au32Clip[2];
+	y1 = au32Clip[3];
+	bpp = pLayout->bpp;
+	sbw = (pstDst->w + FBC_SB - 1) / FBC_SB;
+	/* one superblock at a time, so memory use does not grow with the picture */
+	for (sy=y0 / FBC_SB; sy*FBC_SB<y1; sy++)
+	{
+		for (sx=x0 / FBC_SB; sx*FBC_SB<x1; sx++)
+		{
+			entry = V2dFbcEntry(pstFbc->enFbcdecMode, sbw, sx, sy);
+			if (V2dFbcDecodeSuperblock(pLayout, pBuf, size, pBuf + (size_t)entry * FBC_ENTRY_BYTES, pstFbc->is_split,
+			                           planes, au8Sb, au8SbUv))
+				return FAILURE;
+			bx = sx * FBC_SB;
+			by = sy * FBC_SB;
+			cx0 = (x0 > bx) ? x0 - bx : 0;
+			cy0 = (y0 > by) ? y0 - by : 0;
+			cx1 = (x1 < bx + FBC_SB) ? x1 - bx : FBC_SB;
+			cy1 = (y1 < by + FBC_SB) ? y1 - by : FBC_SB;
+			for (y=cy0; y<cy1 && (planes & 1); y++)
+				memcpy((uint8_t *)pstDst->pData + (size_t)(by + y) * pstDst->stride + (size_t)(bx + cx0) * bpp,
+				       au8Sb + (y * FBC_SB + cx0) * bpp, (cx1 - cx0) * bpp);
+			if (pLayout->subCount != FBC_SUB_MAX || !(planes & 2))
+				continue;
+			/* chroma of every 2x2 block the rect touches */
+			cx0 &= ~1u;
+			cy0 &= ~1u;
+			for (y=cy0; y<cy1; y+=2)
+				memcpy((uint8_t *)pstDst->pUv + (size_t)((by + y) >> 1) * pstDst->stride + bx + cx0,
+				       au8SbUv + (y >> 1) * FBC_SB + cx0, ((cx1 + 1) & ~1u) - cx0);
+		}
+	}
+	return SUCCESS;
+}
+
+int32_t V2D_FbcDecode(FBC_DECODER_S *pstFbc, const void *pBuf, size_t size, V2D_IMAGE_S *pstDst)
+{
+	V2D_AREA_S stAll;
+
+	if (!pstFbc || !pBuf || !pstDst || !pstDst->pData)
+		return FAILURE;
+	if (pstFbc->enFbcdecFmt == FBC_DECODER_FORMAT_NV12 && !pstDst->pUv)
+	{
+		printf("V2D_FbcDecode needs a chroma plane for NV12\n");
+		return FAILURE;
+	}
+	stAll.x = 0;
+	stAll.y = 0;
+	stAll.w = pstDst->w;
+	stAll.h = pstDst->h;
+	return V2dFbcDecodeRect(pstFbc, (const uint8_t *)pBuf, size, pstDst, &stAll);
+}
+
+/* encoder, the inverse of the decoder above */
+
+static void V2dFbcPut(V2D_FBC_PUT_S *pPut, uint32_t v, uint32_t n)
+{
+	uint64_t bits = ((uint64_t)v & ((1ull << n) - 1)) << (pPut->pos & 7);
+	uint8_t *p = pPut->p + (pPut->pos >> 3);
+
+	for (; bits; bits >>= 8)
+		*p++ |= (uint8_t)bits;
+	pPut->pos += n;
+}
+
+static uint32_t V2dFbcWidth(uint32_t v)
+{
+	return v ? 32 - __builtin_clz(v) : 0;
+}
+
+/* four values of w bits, one of which is zero */
+static void V2dFbcPutGroup(V2D_FBC_PUT_S *pPut, uint32_t w, const uint8_t *pV)
+{
+	uint32_t planes = 0, idx, k, b, j;
+
+	if (!w)
+		return;
+	if (w == 1)
+	{
+		for (k=0; k<4; k++)
+			planes |= (uint32_t)pV[k] << k;
+		V2dFbcPut(pPut, planes, 4);
+		return;
+	}
+	for (idx=0; idx<3 && pV[idx]; idx++)
+		;
+	for (k=0, j=0; k<4; k++)
+	{
+		if (k == idx)
+			continue;
+		for (b=0; b<w; b++)
+			planes |= ((uint32_t)(pV[k] >> b) & 1) << (3 * b + j);
+		j++;
+	}
+	V2dFbcPut(pPut, idx, 2);
+	V2dFbcPut(pPut, planes, 3 * w);
+}
+
+/*
+ * Compresses a sub-block of n channels from pIn[pixel * n + channel], pixels in
+ * raster order, into pOut and returns its bytes. The width code of a channel
+ * is the smallest one that holds its quadrant minimums and, one bit up, its
+ * widest quadrant, every quadrant then takes the narrowest width it fits.
+ */
+static uint32_t V2dFbcEncodeBlock(const uint8_t *pIn, uint32_t n, uint8_t *pOut)
+{
+	V2D_FBC_PUT_S stPut = { pOut, 0 };
+	uint8_t au8Code[FBC_CH_MAX], au8Width[FBC_CH_MAX][4], au8Base[FBC_CH_MAX];
+	uint8_t au8Min[FBC_CH_MAX][4], au8Leaf[FBC_CH_MAX][4][4];
+	uint32_t ch, k, j, v, top, widest, w, q;
+
+	memset(pOut, 0, FBC_BLOCK_MAX);
+	for (ch=0; ch<n; ch++)
+	{
+		au8Base[ch] = 255;
+		top = widest = 0;
+		for (k=0; k<4; k++)
+		{
+			au8Min[ch][k] = 255;
+			for (j=0; j<4; j++)
+			{
+				v = pIn[(((k >> 1) * 2 + (j >> 1)) * 4 + (k & 1) * 2 + (j & 1)) * n + ch];
+				au8Leaf[ch][k][j] = v;
+				au8Min[ch][k] = (v < au8Min[ch][k]) ? v : au8Min[ch][k];
+			}
+			au8Base[ch] = (au8Min[ch][k] < au8Base[ch]) ? au8Min[ch][k] : au8Base[ch];
+			for (j=0, v=0; j<4; j++)
+			{
+				au8Leaf[ch][k][j] -= au8Min[ch][k];
+				v |= au8Leaf[ch][k][j];
+			}
+			au8Width[ch][k] = V2dFbcWidth(v);
+			widest = (au8Width[ch][k] > widest) ? au8Width[ch][k] : widest;
+		}
+		for (k=0; k<4; k++)
+		{
+			au8Min[ch][k] -= au8Base[ch];
+			top |= au8Min[ch][k];
+		}
+		if (!top && !widest)
+		{
+			au8Code[ch] = FBC_CONST;
+			continue;
+		}
+		au8Code[ch] = V2dFbcWidth(top);
+		if (widest > au8Code[ch] + 1u)
+			au8Code[ch] = widest - 1;
+		/* quadrants are c-2 to c+1 bits wide, never below zero */
+		for (k=0; k<4; k++)
+		{
+			w = (au8Code[ch] > 2) ? au8Code[ch] - 2u : 0;
+			au8Width[ch][k] = (au8Width[ch][k] > w) ? au8Width[ch][k] : w;
+		}
+	}
+	for (ch=0; ch<n; ch++)
+		V2dFbcPut(&stPut, au8Code[ch], 4);
+	for (ch=0; ch<n; ch++)
+	{
+		if (au8Code[ch] == FBC_CONST)
+			continue;
+		for (k=0, q=0; k<4; k++)
+			q |= ((au8Width[ch][k] + 4u - au8Code[ch]) & 3) << (2 * k);
+		V2dFbcPut(&stPut, q, 8);
+	}
+	for (ch=0; ch<n; ch++)
+		V2dFbcPut(&stPut, au8Base[ch], 8);
+	for (ch=0; ch<n; ch++)
+	{
+		if (au8Code[ch] != FBC_CONST)
+			V2dFbcPutGroup(&stPut, au8Code[ch], au8Min[ch]);
+	}
+	for (k=0; k<4; k++)
+	{
+		for (ch=0; ch<n; ch++)
+		{
+			if (au8Code[ch] != FBC_CONST)
+				V2dFbcPutGroup(&stPut, au8Width[ch][k], au8Leaf[ch][k]);
+		}
+	}
+	return (stPut.pos + 7) >> 3;
+}
+
+/* 4x4 block of pixels at pSrc as raw sub-block bytes and as channel values, the inverse of V2dFbcStoreBlock */
+static void V2dFbcLoadBlock(const V2D_FBC_LAYOUT_S *pLayout, const uint8_t *pSrc, uint32_t stride, uint8_t *pRaw,
+                            uint8_t *pChannels)
+{
+	uint32_t y, i, v;
+
+	for (y=0; y<4; y++)
+		memcpy(pRaw + y * 4 * pLayout->bpp, pSrc + y * stride, 4 * pLayout->bpp);
+	if (pLayout->format != V2D_COLOR_FORMAT_RGB565)
+	{
+		memcpy(pChannels, pRaw, 16 * pLayout->bpp);
+		return;
+	}
+	for (i=0; i<16; i++)
+	{
+		v = pRaw[2 * i] | (pRaw[2 * i + 1] << 8);
+		pChannels[3 * i] = v >> 11;
+		pChannels[3 * i + 1] = (v >> 5) & 0x3f;
+		pChannels[3 * i + 2] = v & 0x1f;
+	}
+}
+
+/*
+ * Encodes the 16x16 scratch planes of a superblock into its payload slot,
+ * fills in the sizes of its sub-blocks and returns the payload bytes used.
+ */
+static uint32_t V2dFbcEncodeSuperblock(const V2D_FBC_LAYOUT_S *pLayout, const uint8_t *pSb, const uint8_t *pSbUv, int split,
+                                       uint8_t *pSlot, uint32_t *pSizes)
+{
+	uint8_t au8Raw[16 * FBC_CH_MAX], au8Channels[16 * FBC_CH_MAX], au8Out[FBC_BLOCK_MAX];
+	uint32_t i, k, x, y, n, raw, bytes, pos = 0, used = 0;
+
+	for (i=0; i<pLayout->subCount; i++)
+	{
+		if (split && i == pLayout->subCount / 2)
+			pos = pLayout->sbBytes / 2;
+		if (V2dFbcSubBlock(pLayout, i, &x, &y))
+		{
+			for (k=0; k<4; k++)
+				memcpy(au8Raw + k * 8, pSbUv + ((y * 4 + k) * 8 + x * 4) * 2, 8);
+			memcpy(au8Channels, au8Raw, 32);
+			n = 2;
+		}
+		else
+		{
+			V2dFbcLoadBlock(pLayout, pSb + (y * 4 * FBC_SB + x * 4) * pLayout->bpp, FBC_SB * pLayout->bpp, au8Raw,
+			                au8Channels);
+			n = pLayout->channels;
+		}
+		raw = V2dFbcRawBytes(pLayout, i);
+		bytes = V2dFbcEncodeBlock(au8Channels, n, au8Out);
+		/* a compressed sub-block has to beat the raw one and fit the size field */
+		if (bytes >= raw || bytes >= (1u << pLayout->sizeBits))
+		{
+			memcpy(pSlot + pos, au8Raw, raw);
+			pSizes[i] = FBC_RAW;
+			bytes = raw;
+		}
+		else
+		{
+			memcpy(pSlot + pos, au8Out, bytes);
+			pSizes[i] = bytes;
+		}
+		pos += bytes;
+		used += bytes;
+	}
+	return used;
+}
+
+static void V2dFbcPutEntry(const V2D_FBC_LAYOUT_S *pLayout, uint8_t *pEntry, uint32_t offset, const uint32_t *pSizes)
+{
+	V2D_FBC_PUT_S stPut = { pEntry, 0 };
+	uint32_t i;
+
+	memset(pEntry, 0, FBC_ENTRY_BYTES);
+	V2dFbcPut(&stPut, offset, pLayout->offsetBits);
+	stPut.pos = pLayout->sizeShift;
+	for (i=0; i<pLayout->subCount; i++)
+		V2dFbcPut(&stPut, pSizes[i], pLayout->sizeBits);
+}
+
+/* offset of the payload from the header, right behind the header unless the encoder sets one */
+static size_t V2dFbcPayload(const FBC_ENCODER_S *pstFbc, uint32_t w, uint32_t h)
+{
+	size_t header = (size_t)V2dFbcEntryCount(FBC_DECODER_MODE_SCAN_LINE, w, h) * FBC_ENTRY_BYTES;
+
+	return ((size_t)pstFbc->offset > header) ? (size_t)pstFbc->offset : header;
+}
+
+size_t V2dFbcEncodeSize(const FBC_ENCODER_S *pstFbc, uint32_t w, uint32_t h)
+{
+	const V2D_FBC_LAYOUT_S *pLayout = V2dFbcLayout(pstFbc->enFbcencFmt);
+
+	if (!pLayout)
+		return 0;
+	return V2dFbcPayload(pstFbc, w, h) + (size_t)V2dFbcEntryCount(FBC_DECODER_MODE_SCAN_LINE, w, h) * pLayout->sbBytes;
+}
+
+int V2dFbcEncodeRect(const FBC_ENCODER_S *pstFbc, uint8_t *pBuf, size_t size, const V2D_IMAGE_S *pstSrc,
+                     const V2D_AREA_S *pRect, size_t *pUsed)
+{
+	const V2D_FBC_LAYOUT_S *pLayout = V2dFbcLayout(pstFbc->enFbcencFmt);
+	uint8_t au8Sb[FBC_SB * FBC_SB * FBC_CH_MAX], au8SbUv[FBC_SB * FBC_SB / 2];
+	uint32_t au32Size[FBC_SUB_MAX], au32Clip[4], sbw, sx, sy, bx, by, cols, rows, y, entry;
+	size_t payload, slot, used = 0;
+
+	if (pUsed)
+		*pUsed = 0;
+	if (!pLayout || pstSrc->format != pLayout->format)
+	{
+		printf("v2d fbc cannot encode format %d from format %d\n", pstFbc->enFbcencFmt, pstSrc->format);
+		return FAILURE;
+	}
+	if (pstFbc->is_split && pLayout->subCount == FBC_SUB_MAX)
+	{
+		printf("v2d fbc split payloads only apply to rgb formats\n");
+		return FAILURE;
+	}
+	if (V2dFbcEncodeSize(pstFbc, pstSrc->w, pstSrc->h) > size)
+	{
+		printf("v2d fbc surface of %ux%u needs %zu bytes, the buffer has %zu\n", pstSrc->w, pstSrc->h,
+		       V2dFbcEncodeSize(pstFbc, pstSrc->w, pstSrc->h), size);
+		return FAILURE;
+	}
+	if (!V2dFbcClip(pRect, pstFbc->bboxLeft, pstFbc->bboxTop, pstFbc->bboxRight, pstFbc->bboxBottom, pstSrc, au32Clip))
+		return SUCCESS;
+	payload = V2dFbcPayload(pstFbc, pstSrc->w, pstSrc->h);
+	sbw = (pstSrc->w + FBC_SB - 1) / FBC_SB;
+	/* every superblock the rect touches is encoded whole, the part outside the picture as zeros */
+	for (sy=au32Clip[1] / FBC_SB; sy*FBC_SB<au32Clip[3]; sy++)
+	{
+		for (sx=au32Clip[0] / FBC_SB; sx*FBC_SB<au32Clip[2]; sx++)
+		{
+			bx = sx * FBC_SB;
+			by = sy * FBC_SB;
+			cols = (pstSrc->w - bx < FBC_SB) ? pstSrc->w - bx : FBC_SB;
+			rows = (pstSrc->h - by < FBC_SB) ? pstSrc->h - by : FBC_SB;
+			memset(au8Sb, 0, sizeof(au8Sb));
+			memset(au8SbUv, 0, sizeof(au8SbUv));
+			for (y=0; y<rows; y++)
+				memcpy(au8Sb + y * FBC_SB * pLayout->bpp,
+				       (const uint8_t *)pstSrc->pData + (size_t)(by + y) * pstSrc->stride + (size_t)bx * pLayout->bpp,
+				       cols * pLayout->bpp);
+			for (y=0; pLayout->subCount == FBC_SUB_MAX && y<(rows + 1) / 2; y++)
+				memcpy(au8SbUv + y * FBC_SB, (const uint8_t *)pstSrc->pUv + (size_t)((by >> 1) + y) * pstSrc->stride + bx,
+				       (cols + 1) & ~1u);
+			entry = V2dFbcEntry(FBC_DECODER_MODE_SCAN_LINE, sbw, sx, sy);
+			slot = payload + (size_t)entry * pLayout->sbBytes;
+			used += FBC_ENTRY_BYTES + V2dFbcEncodeSuperblock(pLayout, au8Sb, au8SbUv, pstFbc->is_split, pBuf + slot,
+			                                                 au32Size);
+			V2dFbcPutEntry(pLayout, pBuf + (size_t)entry * FBC_ENTRY_BYTES, (uint32_t)slot, au32Size);
+		}
+	}
+	if (pUsed)
+		*pUsed = used;
+	return SUCCESS;
+}
+
+size_t V2D_FbcBufferSize(FBC_ENCODER_S *pstFbc, uint16_t w, uint16_t h)
+{
+	return pstFbc ? V2dFbcEncodeSize(pstFbc, w, h) : 0;
+}
+
+int32_t V2D_FbcEncode(FBC_ENCODER_S *pstFbc, V2D_IMAGE_S *pstSrc, void *pBuf, size_t size, size_t *pUsed)
+{
+	V2D_AREA_S stAll;
+
+	if (!pstFbc || !pstSrc || !pstSrc->pData || !pBuf)
+		return FAILURE;
+	if (pstFbc->enFbcencFmt == FBC_DECODER_FORMAT_NV12 && !pstSrc->pUv)
+	{
+		printf("V2D_FbcEncode needs a chroma plane for NV12\n");
+		return FAILURE;
+	}
+	stAll.x = 0;
+	stAll.y = 0;
+	stAll.w = pstSrc->w;
+	stAll.h = pstSrc->h;
+	return V2dFbcEncodeRect(pstFbc, (uint8_t *)pBuf, size, pstSrc, &stAll, pUsed);
+}
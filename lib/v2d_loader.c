@@ -0,0 +1,244 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "v2d_api.h"
+
+/*
+ * Image and sequence files loaded straight into buffer mappings. Regular
+ * files are mapped whole and a frame is a single memcpy from the page cache,
+ * anything that cannot be mapped is read with pread in large chunks right
+ * into the destination. Reading a frame prefetches the next one, the kernel
+ * reads ahead and on the mmap path a helper thread, given a second cpu,
+ * faults in its pages, so the copy of a sequence frame neither waits on the
+ * disk nor takes faults.
+ */
+#define LOADER_ENV "V2D_LOADER"
+#define LOADER_READ_CHUNK (4 << 20)
+
+typedef struct SPACEMIT_V2D_LOADER_S
+{
+	int fd;
+	uint8_t *pMap; /* the whole file, NULL on the read path */
+	size_t fileSize;
+	size_t frameSize;
+	uint32_t frames;
+	/* frame the prefetch thread faults in next, -1 when idle */
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int64_t want;
+	int quit;
+	int threadRunning;
+} V2D_LOADER_S;
+
+static void *V2dLoaderThread(void *arg)
+{
+	V2D_LOADER_S *pLoader = (V2D_LOADER_S *)arg;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	volatile uint8_t *pFrame;
+	size_t off;
+	int64_t frame;
+
+	pthread_mutex_lock(&pLoader->lock);
+	for (;;)
+	{
+		while (pLoader->want < 0 && !pLoader->quit)
+			pthread_cond_wait(&pLoader->cond, &pLoader->lock);
+		if (pLoader->quit)
+			break;
+		frame = pLoader->want;
+		pLoader->want = -1;
+		pthread_mutex_unlock(&pLoader->lock);
+
+		pFrame = pLoader->pMap + frame * pLoader->frameSize;
+		for (off=0; off<pLoader->frameSize; off+=page)
+			(void)pFrame[off];
+
+		pthread_mutex_lock(&pLoader->lock);
+	}
+	pthread_mutex_unlock(&pLoader->lock);
+	return NULL;
+}
+
+static void V2dLoaderPrefetch(V2D_LOADER_S *pLoader, uint32_t frame)
+{
+	size_t off = frame * pLoader->frameSize;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t start = off & ~(page - 1);
+
+	if (!pLoader->pMap)
+	{
+		posix_fadvise(pLoader->fd, off, pLoader->frameSize, POSIX_FADV_WILLNEED);
+		return;
+	}
+	madvise(pLoader->pMap + start, off + pLoader->frameSize - start, MADV_WILLNEED);
+	if (!pLoader->threadRunning)
+		return;
+	pthread_mutex_lock(&pLoader->lock);
+	pLoader->want = frame;
+	pthread_cond_signal(&pLoader->cond);
+	pthread_mutex_unlock(&pLoader->lock);
+}
+
+static int V2dLoaderUseMmap(void)
+{
+	const char *pPath = getenv(LOADER_ENV);
+	if (!pPath || !pPath[0] || !strcmp(pPath, "mmap"))
+		return 1;
+	if (strcmp(pPath, "read"))
+		printf("Unknown %s=%s, using mmap\n", LOADER_ENV, pPath);
+	return strcmp(pPath, "read") != 0;
+}
+
+int32_t V2D_LoaderOpen(const char *pFileName, size_t frameSize, V2D_LOADER_HANDLE *phLoader)
+{
+	V2D_LOADER_S *pLoader;
+	struct stat st;
+	void *pMap;
+
+	if (!pFileName || !phLoader)
+		return FAILURE;
+	pLoader = (V2D_LOADER_S *)calloc(1, sizeof(V2D_LOADER_S));
+	if (!pLoader)
+	{
+		printf("Failed to malloc v2d loader\n");
+		return FAILURE;
+	}
+	pLoader->want = -1;
+	pthread_mutex_init(&pLoader->lock, NULL);
+	pthread_cond_init(&pLoader->cond, NULL);
+	pLoader->fd = open(pFileName, O_RDONLY | O_CLOEXEC);
+	if (pLoader->fd < 0 || fstat(pLoader->fd, &st))
+	{
+		printf("Failed to open %s: %s\n", pFileName, strerror(errno));
+		V2D_LoaderClose((V2D_LOADER_HANDLE)pLoader);
+		return FAILURE;
+	}
+	pLoader->fileSize = (size_t)st.st_size;
+	pLoader->frameSize = frameSize ? frameSize : pLoader->fileSize;
+	if (!pLoader->frameSize || pLoader->fileSize < pLoader->frameSize)
+	{
+		printf("%s has %zu bytes, less than a frame of %zu\n", pFileName, pLoader->fileSize, pLoader->frameSize);
+		V2D_LoaderClose((V2D_LOADER_HANDLE)pLoader);
+		return FAILURE;
+	}
+	pLoader->frames = (uint32_t)(pLoader->fileSize / pLoader->frameSize);
+
+	if (S_ISREG(st.st_mode) && V2dLoaderUseMmap())
+	{
+		pMap = mmap(NULL, pLoader->fileSize, PROT_READ, MAP_SHARED, pLoader->fd, 0);
+		if (pMap != MAP_FAILED)
+		{
+			pLoader->pMap = (uint8_t *)pMap;
+			madvise(pMap, pLoader->fileSize, MADV_SEQUENTIAL);
+			/* a single frame has nothing to prefetch ahead of it, one cpu no time to do it */
+			if (pLoader->frames > 1 && sysconf(_SC_NPROCESSORS_ONLN) > 1 && !pthread_create(&pLoader->tid, NULL, V2dLoaderThread, pLoader))
+				pLoader->threadRunning = 1;
+		}
+	}
+	V2dLoaderPrefetch(pLoader, 0);
+	*phLoader = (V2D_LOADER_HANDLE)pLoader;
+	return SUCCESS;
+}
+
+int32_t V2D_LoaderFrames(V2D_LOADER_HANDLE hLoader, uint32_t *pFrames)
+{
+	if (hLoader == 0 || !pFrames)
+		return FAILURE;
+	*pFrames = ((V2D_LOADER_S *)hLoader)->frames;
+	return SUCCESS;
+}
+
+int32_t V2D_LoaderRead(V2D_LOADER_HANDLE hLoader, uint32_t frame, void *pDst, size_t size)
+{
+	V2D_LOADER_S *pLoader = (V2D_LOADER_S *)hLoader;
+	uint8_t *pOut = (uint8_t *)pDst;
+	size_t off, done = 0, chunk;
+	ssize_t len;
+
+	if (hLoader == 0 || !pDst)
+		return FAILURE;
+	if (frame >= pLoader->frames || size < pLoader->frameSize)
+	{
+		printf("Loader read of frame %u/%u into %zu bytes, frames have %zu\n", frame, pLoader->frames, size, pLoader->frameSize);
+		return FAILURE;
+	}
+	off = frame * pLoader->frameSize;
+	if (pLoader->pMap)
+	{
+		memcpy(pOut, pLoader->pMap + off, pLoader->frameSize);
+	}
+	else
+	{
+		while (done < pLoader->frameSize)
+		{
+			chunk = pLoader->frameSize - done;
+			if (chunk > LOADER_READ_CHUNK)
+				chunk = LOADER_READ_CHUNK;
+			len = pread(pLoader->fd, pOut + done, chunk, off + done);
+			if (len < 0 && errno == EINTR)
+				continue;
+			if (len <= 0)
+			{
+				printf("Loader read of frame %u failed: %s\n", frame, len ? strerror(errno) : "end of file");
+				return FAILURE;
+			}
+			done += (size_t)len;
+		}
+	}
+	if (pLoader->frames > 1)
+		V2dLoaderPrefetch(pLoader, (frame + 1) % pLoader->frames);
+	return SUCCESS;
+}
+
+int32_t V2D_LoaderClose(V2D_LOADER_HANDLE hLoader)
+{
+	V2D_LOADER_S *pLoader = (V2D_LOADER_S *)hLoader;
+
+	if (hLoader == 0)
+		return FAILURE;
+	if (pLoader->threadRunning)
+	{
+		pthread_mutex_lock(&pLoader->lock);
+		pLoader->quit = 1;
+		pthread_cond_signal(&pLoader->cond);
+		pthread_mutex_unlock(&pLoader->lock);
+		pthread_join(pLoader->tid, NULL);
+	}
+	if (pLoader->pMap)
+		munmap(pLoader->pMap, pLoader->fileSize);
+	if (pLoader->fd >= 0)
+		close(pLoader->fd);
+	pthread_mutex_destroy(&pLoader->lock);
+	pthread_cond_destroy(&pLoader->cond);
+	free(pLoader);
+	return SUCCESS;
+}
+
+int32_t V2D_LoadFile(const char *pFileName, void *pDst, size_t size, size_t *pLoaded)
+{
+	V2D_LOADER_HANDLE hLoader;
+	V2D_LOADER_S *pLoader;
+	int32_t ret;
+
+	if (V2D_LoaderOpen(pFileName, 0, &hLoader))
+		return FAILURE;
+	pLoader = (V2D_LOADER_S *)hLoader;
+	ret = V2D_LoaderRead(hLoader, 0, pDst, size);
+	if (ret == SUCCESS && pLoaded)
+		*pLoaded = pLoader->frameSize;
+	V2D_LoaderClose(hLoader);
+	return ret;
+}
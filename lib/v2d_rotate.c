@@ -0,0 +1,386 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "v2d_cpu.h"
+
+#define ROT_BLOCK 8
+/* a tile of source and one of destination fit the L1 cache together */
+#define ROT_TILE(bpp) (((bpp) > 2) ? 32 : 64)
+
+/*
+ * Host rotation of one plane. dst(u,v) is the source pixel at
+ * pOrigin + u * stepU + v * stepV, which encodes every V2D_ROTATE_ANGLE_E.
+ * The angles that keep rows in rows copy row by row, ROT_90 and ROT_270
+ * walk the destination in tiles so that the column reads of the source
+ * stay in the cache, with 8x8 block kernels inside each tile.
+ */
+typedef struct SPACEMIT_V2D_ROT_WALK_S
+{
+	const uint8_t *pOrigin;
+	ptrdiff_t stepU;
+	ptrdiff_t stepV;
+	uint32_t w;
+	uint32_t h;
+} V2D_ROT_WALK_S;
+
+typedef struct SPACEMIT_V2D_ROT_PIX3_S
+{
+	uint8_t b[3];
+} V2D_ROT_PIX3_S;
+
+typedef void (*V2D_ROT_BLOCK_FN)(const uint8_t *pS, ptrdiff_t stepU, uint8_t *pD, uint32_t dstStride);
+
+static int V2dRotateIsNv(V2D_COLOR_FORMAT_E format)
+{
+	return format == V2D_COLOR_FORMAT_NV12 || format == V2D_COLOR_FORMAT_NV21;
+}
+
+static int V2dRotateSwapsAxes(V2D_ROTATE_ANGLE_E rt)
+{
+	return rt == V2D_ROT_90 || rt == V2D_ROT_270;
+}
+
+static void V2dRotateWalk(const uint8_t *pSrc, uint32_t stride, uint32_t w, uint32_t h, uint32_t bpp,
+                          V2D_ROTATE_ANGLE_E rt, V2D_ROT_WALK_S *pWalk)
+{
+	ptrdiff_t right = (ptrdiff_t)(w - 1) * bpp, bottom = (ptrdiff_t)(h - 1) * stride;
+
+	pWalk->w = w;
+	pWalk->h = h;
+	switch (rt)
+	{
+		case V2D_ROT_90:
+			pWalk->pOrigin = pSrc + bottom; pWalk->stepU = -(ptrdiff_t)stride; pWalk->stepV = bpp;
+			pWalk->w = h; pWalk->h = w;
+			break;
+		case V2D_ROT_180:
+			pWalk->pOrigin = pSrc + bottom + right; pWalk->stepU = -(ptrdiff_t)bpp; pWalk->stepV = -(ptrdiff_t)stride;
+			break;
+		case V2D_ROT_270:
+			pWalk->pOrigin = pSrc + right; pWalk->stepU = stride; pWalk->stepV = -(ptrdiff_t)bpp;
+			pWalk->w = h; pWalk->h = w;
+			break;
+		case V2D_ROT_MIRROR:
+			pWalk->pOrigin = pSrc + right; pWalk->stepU = -(ptrdiff_t)bpp; pWalk->stepV = stride;
+			break;
+		case V2D_ROT_FLIP:
+			pWalk->pOrigin = pSrc + bottom; pWalk->stepU = bpp; pWalk->stepV = -(ptrdiff_t)stride;
+			break;
+		default:
+			pWalk->pOrigin = pSrc; pWalk->stepU = bpp; pWalk->stepV = stride;
+			break;
+	}
+}
+
+/* the per pixel reference, also the edge handling of the tiled path */
+static void V2dRotateNaive(const V2D_ROT_WALK_S *pWalk, uint8_t *pDst, uint32_t dstStride,
+                           uint32_t u0, uint32_t v0, uint32_t w, uint32_t h, uint32_t bpp)
+{
+	const uint8_t *pS;
+	uint8_t *pD;
+	uint32_t u, v;
+
+	for (v=v0; v<v0 + h; v++)
+	{
+		pS = pWalk->pOrigin + (ptrdiff_t)u0 * pWalk->stepU + (ptrdiff_t)v * pWalk->stepV;
+		pD = pDst + (size_t)v * dstStride + (size_t)u0 * bpp;
+		for (u=0; u<w; u++, pS += pWalk->stepU, pD += bpp)
+			memcpy(pD, pS, bpp);
+	}
+}
+
+/*
+ * 8x8 block kernels: eight contiguous source runs, forward or backward
+ * along the source row, are loaded, transposed in registers and stored as
+ * eight destination rows. The fixed trip counts and directions let the
+ * compiler unroll them into wide loads and shuffles.
+ */
+#define ROT_BLOCK_KERNEL(name, T, reverse)                                                       \
+static void name(const uint8_t *pS, ptrdiff_t stepU, uint8_t *pD, uint32_t dstStride)             \
+{                                                                                                \
+	T a[ROT_BLOCK][ROT_BLOCK], run[ROT_BLOCK];                                                   \
+	int u, v;                                                                                    \
+                                                                                                 \
+	if (reverse)                                                                                 \
+		pS -= (ROT_BLOCK - 1) * sizeof(T);                                                       \
+	for (u=0; u<ROT_BLOCK; u++)                                                                  \
+	{                                                                                            \
+		memcpy(run, pS + u * stepU, sizeof(run));                                                \
+		for (v=0; v<ROT_BLOCK; v++)                                                              \
+			a[v][u] = run[(reverse) ? ROT_BLOCK - 1 - v : v];                                    \
+	}                                                                                            \
+	for (v=0; v<ROT_BLOCK; v++)                                                                  \
+		memcpy(pD + (size_t)v * dstStride, a[v], sizeof(a[v]));                                  \
+}
+
+ROT_BLOCK_KERNEL(V2dRotateBlock8, uint8_t, 0)
+ROT_BLOCK_KERNEL(V2dRotateBlock16, uint16_t, 0)
+ROT_BLOCK_KERNEL(V2dRotateBlock24, V2D_ROT_PIX3_S, 0)
+ROT_BLOCK_KERNEL(V2dRotateBlock32, uint32_t, 0)
+ROT_BLOCK_KERNEL(V2dRotateBlock8R, uint8_t, 1)
+ROT_BLOCK_KERNEL(V2dRotateBlock16R, uint16_t, 1)
+ROT_BLOCK_KERNEL(V2dRotateBlock24R, V2D_ROT_PIX3_S, 1)
+ROT_BLOCK_KERNEL(V2dRotateBlock32R, uint32_t, 1)
+
+static V2D_ROT_BLOCK_FN V2dRotateBlockFn(uint32_t bpp, int reverse)
+{
+	switch (bpp)
+	{
+		case 1:  return reverse ? V2dRotateBlock8R : V2dRotateBlock8;
+		case 2:  return reverse ? V2dRotateBlock16R : V2dRotateBlock16;
+		case 3:  return reverse ? V2dRotateBlock24R : V2dRotateBlock24;
+		default: return reverse ? V2dRotateBlock32R : V2dRotateBlock32;
+	}
+}
+
+/* the w x h part of the destination at (u0,v0), small enough to stay in the cache */
+static void V2dRotateTile(const V2D_ROT_WALK_S *pWalk, uint8_t *pDst, uint32_t dstStride,
+                          uint32_t u0, uint32_t v0, uint32_t w, uint32_t h, uint32_t bpp)
+{
+	V2D_ROT_BLOCK_FN pfnBlock = V2dRotateBlockFn(bpp, pWalk->stepV < 0);
+	uint32_t u, v, bw = w & ~(ROT_BLOCK - 1), bh = h & ~(ROT_BLOCK - 1);
+
+	for (v=v0; v<v0 + bh; v+=ROT_BLOCK)
+		for (u=u0; u<u0 + bw; u+=ROT_BLOCK)
+			pfnBlock(pWalk->pOrigin + (ptrdiff_t)u * pWalk->stepU + (ptrdiff_t)v * pWalk->stepV, pWalk->stepU,
+			         pDst + (size_t)v * dstStride + (size_t)u * bpp, dstStride);
+	if (bw < w)
+		V2dRotateNaive(pWalk, pDst, dstStride, u0 + bw, v0, w - bw, bh, bpp);
+	if (bh < h)
+		V2dRotateNaive(pWalk, pDst, dstStride, u0, v0 + bh, w, h - bh, bpp);
+}
+
+static void V2dRotateTiled(const V2D_ROT_WALK_S *pWalk, uint8_t *pDst, uint32_t dstStride, uint32_t bpp)
+{
+	uint32_t tile = ROT_TILE(bpp), u, v;
+
+	for (v=0; v<pWalk->h; v+=tile)
+		for (u=0; u<pWalk->w; u+=tile)
+			V2dRotateTile(pWalk, pDst, dstStride, u, v, (pWalk->w - u < tile) ? pWalk->w - u : tile,
+			              (pWalk->h - v < tile) ? pWalk->h - v : tile, bpp);
+}
+
+/*
+ * Reverses a run of ROT_RUN 3 byte pixels that ends at pS into pD. The fixed
+ * size lets the compiler turn it into a few wide loads, byte shuffles and
+ * stores instead of a 3 byte copy per pixel.
+ */
+#define ROT_RUN 16
+static void V2dRotateRun24R(const uint8_t *pS, uint8_t *pD)
+{
+	uint8_t run[ROT_RUN * 3], out[ROT_RUN * 3];
+	int i;
+
+	memcpy(run, pS - (ROT_RUN - 1) * 3, sizeof(run));
+	for (i=0; i<ROT_RUN; i++)
+	{
+		out[i * 3]     = run[(ROT_RUN - 1 - i) * 3];
+		out[i * 3 + 1] = run[(ROT_RUN - 1 - i) * 3 + 1];
+		out[i * 3 + 2] = run[(ROT_RUN - 1 - i) * 3 + 2];
+	}
+	memcpy(pD, out, sizeof(out));
+}
+
+/* one row of an angle that keeps rows, pSrc is the first pixel to read */
+static void V2dRotateRow(const uint8_t *pSrc, uint8_t *pDst, uint32_t w, uint32_t bpp, int reverse)
+{
+	uint16_t v16;
+	uint32_t v32, i;
+
+	if (!reverse)
+	{
+		memcpy(pDst, pSrc, (size_t)w * bpp);
+		return;
+	}
+	switch (bpp)
+	{
+		case 1:
+			for (i=0; i<w; i++)
+				pDst[i] = *(pSrc - i);
+			break;
+		case 2:
+			for (i=0; i<w; i++)
+			{
+				memcpy(&v16, pSrc - (size_t)i * 2, 2);
+				memcpy(pDst + (size_t)i * 2, &v16, 2);
+			}
+			break;
+		case 3:
+			for (i=0; i + ROT_RUN <= w; i+=ROT_RUN)
+				V2dRotateRun24R(pSrc - (size_t)i * 3, pDst + (size_t)i * 3);
+			for (; i<w; i++)
+				memcpy(pDst + (size_t)i * 3, pSrc - (size_t)i * 3, 3);
+			break;
+		case 4:
+			for (i=0; i<w; i++)
+			{
+				memcpy(&v32, pSrc - (size_t)i * 4, 4);
+				memcpy(pDst + (size_t)i * 4, &v32, 4);
+			}
+			break;
+		default:
+			for (i=0; i<w; i++)
+				memcpy(pDst + (size_t)i * bpp, pSrc - (size_t)i * bpp, bpp);
+			break;
+	}
+}
+
+static void V2dRotatePlane(const uint8_t *pSrc, uint32_t srcStride, uint8_t *pDst, uint32_t dstStride,
+                           uint32_t w, uint32_t h, uint32_t bpp, V2D_ROTATE_ANGLE_E rt, V2D_CPU_ISA_E isa)
+{
+	V2D_ROT_WALK_S stWalk;
+	uint32_t v;
+
+	if (!w || !h)
+		return;
+	V2dRotateWalk(pSrc, srcStride, w, h, bpp, rt, &stWalk);
+	if (isa == CPU_ISA_SCALAR)
+		V2dRotateNaive(&stWalk, pDst, dstStride, 0, 0, stWalk.w, stWalk.h, bpp);
+	else if (V2dRotateSwapsAxes(rt))
+		V2dRotateTiled(&stWalk, pDst, dstStride, bpp);
+	else
+		for (v=0; v<stWalk.h; v++)
+			V2dRotateRow(stWalk.pOrigin + (ptrdiff_t)v * stWalk.stepV, pDst + (size_t)v * dstStride, stWalk.w, bpp,
+			             stWalk.stepU < 0);
+}
+
+/*
+ * In place, the angles that keep rows swap row pairs through two row
+ * buffers. A square plane is turned by a tiled transpose, swapping each
+ * tile with its mirror tile through a scratch tile, and a row pass:
+ * ROT_90 is a transpose and MIRROR, ROT_270 a transpose and FLIP.
+ */
+static int V2dRotateRowsInPlace(uint8_t *pPlane, uint32_t stride, uint32_t w, uint32_t h, uint32_t bpp,
+                                V2D_ROTATE_ANGLE_E rt)
+{
+	size_t rowBytes = (size_t)w * bpp;
+	int reverse = (rt == V2D_ROT_180 || rt == V2D_ROT_MIRROR);
+	uint8_t *pTmp, *pRow, *pPair;
+	uint32_t v, r;
+
+	if (rt == V2D_ROT_0 || !w || !h)
+		return SUCCESS;
+	pTmp = (uint8_t *)malloc(2 * rowBytes);
+	if (!pTmp)
+		return FAILURE;
+	for (v=0; v<h; v++)
+	{
+		r = (rt == V2D_ROT_MIRROR) ? v : h - 1 - v;
+		if (r < v)
+			break;
+		pRow = pPlane + (size_t)v * stride;
+		pPair = pPlane + (size_t)r * stride;
+		memcpy(pTmp, pRow, rowBytes);
+		memcpy(pTmp + rowBytes, pPair, rowBytes);
+		V2dRotateRow(pTmp + rowBytes + (reverse ? rowBytes - bpp : 0), pRow, w, bpp, reverse);
+		if (r != v)
+			V2dRotateRow(pTmp + (reverse ? rowBytes - bpp : 0), pPair, w, bpp, reverse);
+	}
+	free(pTmp);
+	return SUCCESS;
+}
+
+static int V2dRotateTransposeInPlace(uint8_t *pPlane, uint32_t stride, uint32_t n, uint32_t bpp)
+{
+	uint32_t tile = ROT_TILE(bpp), tu, tv, tw, th, y;
+	V2D_ROT_WALK_S stPlane, stScratch;
+	uint8_t *pScratch;
+
+	pScratch = (uint8_t *)malloc((size_t)tile * tile * bpp);
+	if (!pScratch)
+		return FAILURE;
+	stPlane.pOrigin = pPlane;
+	stPlane.stepU = stride;
+	stPlane.stepV = bpp;
+	for (tv=0; tv<n; tv+=tile)
+	{
+		for (tu=0; tu<=tv; tu+=tile)
+		{
+			/* the tile at x tu, y tv is saved, then refilled from its mirror tile, which gets the saved copy */
+			tw = (n - tu < tile) ? n - tu : tile;
+			th = (n - tv < tile) ? n - tv : tile;
+			for (y=0; y<th; y++)
+				memcpy(pScratch + (size_t)y * tw * bpp, pPlane + (size_t)(tv + y) * stride + (size_t)tu * bpp, (size_t)tw * bpp);
+			if (tu != tv)
+				V2dRotateTile(&stPlane, pPlane, stride, tu, tv, tw, th, bpp);
+			stScratch.pOrigin = pScratch;
+			stScratch.stepU = (ptrdiff_t)tw * bpp;
+			stScratch.stepV = bpp;
+			V2dRotateTile(&stScratch, pPlane + (size_t)tu * stride + (size_t)tv * bpp, stride, 0, 0, th, tw, bpp);
+		}
+	}
+	free(pScratch);
+	return SUCCESS;
+}
+
+static int V2dRotatePlaneInPlace(uint8_t *pPlane, uint32_t stride, uint32_t w, uint32_t h, uint32_t bpp,
+                                 V2D_ROTATE_ANGLE_E rt)
+{
+	if (!V2dRotateSwapsAxes(rt))
+		return V2dRotateRowsInPlace(pPlane, stride, w, h, bpp, rt);
+	if (V2dRotateTransposeInPlace(pPlane, stride, w, bpp))
+		return FAILURE;
+	return V2dRotateRowsInPlace(pPlane, stride, w, h, bpp, (rt == V2D_ROT_90) ? V2D_ROT_MIRROR : V2D_ROT_FLIP);
+}
+
+int V2dRotateConvert(const V2D_IMAGE_S *pSrc, uint32_t sx, uint32_t sy, uint32_t w, uint32_t h,
+                     const V2D_IMAGE_S *pDst, uint32_t dx, uint32_t dy, V2D_ROTATE_ANGLE_E rt)
+{
+	V2D_CPU_ISA_E isa = V2dCpuIsa();
+	uint32_t bpp = V2dCpuBpp(pSrc->format);
+
+	if (V2dRotateIsNv(pSrc->format) && ((sx | sy | dx | dy) & 1))
+		return FAILURE;
+	V2dRotatePlane((const uint8_t *)pSrc->pData + (size_t)sy * pSrc->stride + (size_t)sx * bpp, pSrc->stride,
+	               (uint8_t *)pDst->pData + (size_t)dy * pDst->stride + (size_t)dx * bpp, pDst->stride, w, h, bpp, rt, isa);
+	if (V2dRotateIsNv(pSrc->format))
+		V2dRotatePlane((const uint8_t *)pSrc->pUv + (size_t)(sy >> 1) * pSrc->stride + sx, pSrc->stride,
+		               (uint8_t *)pDst->pUv + (size_t)(dy >> 1) * pDst->stride + dx, pDst->stride,
+		               (w + 1) >> 1, (h + 1) >> 1, 2, rt, isa);
+	return SUCCESS;
+}
+
+int32_t V2D_RotateImage(V2D_IMAGE_S *pstSrc, V2D_IMAGE_S *pstDst, V2D_ROTATE_ANGLE_E enRotate)
+{
+	uint32_t w, h;
+	int nv;
+
+	if (!pstSrc || !pstDst || !pstSrc->pData || !pstDst->pData || enRotate > V2D_ROT_FLIP ||
+	    pstSrc->format >= V2D_COLOR_FORMAT_BUTT)
+		return FAILURE;
+	nv = V2dRotateIsNv(pstSrc->format);
+	if (pstSrc->format != pstDst->format || (nv && (!pstSrc->pUv || !pstDst->pUv)))
+	{
+		printf("V2D_RotateImage cannot rotate format %d into %d\n", pstSrc->format, pstDst->format);
+		return FAILURE;
+	}
+	w = V2dRotateSwapsAxes(enRotate) ? pstSrc->h : pstSrc->w;
+	h = V2dRotateSwapsAxes(enRotate) ? pstSrc->w : pstSrc->h;
+	if (pstDst->w != w || pstDst->h != h)
+	{
+		printf("V2D_RotateImage needs a %ux%u destination, got %ux%u\n", w, h, pstDst->w, pstDst->h);
+		return FAILURE;
+	}
+	if (pstSrc->pData != pstDst->pData)
+		return V2dRotateConvert(pstSrc, 0, 0, pstSrc->w, pstSrc->h, pstDst, 0, 0, enRotate);
+
+	if (pstSrc->stride != pstDst->stride || (nv && pstSrc->pUv != pstDst->pUv) ||
+	    (V2dRotateSwapsAxes(enRotate) && pstSrc->w != pstSrc->h))
+	{
+		printf("V2D_RotateImage can only turn square images with the same layout in place\n");
+		return FAILURE;
+	}
+	if (V2dRotatePlaneInPlace((uint8_t *)pstSrc->pData, pstSrc->stride, pstSrc->w, pstSrc->h, V2dCpuBpp(pstSrc->format),
+	                          enRotate))
+		return FAILURE;
+	if (nv)
+		return V2dRotatePlaneInPlace((uint8_t *)pstSrc->pUv, pstSrc->stride, (pstSrc->w + 1) >> 1, (pstSrc->h + 1) >> 1,
+		                             2, enRotate);
+	return SUCCESS;
+}
@@ -0,0 +1,375 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+/*
+ * Opt-in trace of the job lifecycle in the Chrome trace event format, which
+ * chrome://tracing and ui.perfetto.dev both load. V2D_TRACE=file turns it on
+ * for the whole run and writes the file at exit, V2D_TraceEnable and
+ * V2D_TraceDump do the same under program control.
+ *
+ * The thread ending a job gets a job span from V2D_BeginJob to the return of
+ * V2D_EndJob*, with the submission and the fence wait nested in it. Tasks go
+ * to a separate v2d track and end when their completion fence signals, the
+ * time the kernel stamped on the fence, or when the backend accepted them if
+ * they came back without a fence. The fences a thread holds are checked when
+ * it ends its next job, when it exits and by every dump.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "pthread.h"
+#include "v2d_backend.h"
+#include "v2d_trace.h"
+#include "v2d_api.h"
+
+#define TRACE_ENV "V2D_TRACE"
+/* records kept per thread, the oldest ones are overwritten */
+#define TRACE_RING_SIZE 4096
+/* task fences a thread holds on to until they signal */
+#define TRACE_PENDING_MAX 256
+/* track of the task spans */
+#define TRACE_DEVICE_TID 0
+
+typedef struct SPACEMIT_V2D_TRACE_REC_S
+{
+	uint64_t startNs;
+	uint64_t endNs;
+	uint64_t job;
+	uint32_t arg;
+	uint8_t kind;
+	V2D_TRACE_TASK_S stTask;
+} V2D_TRACE_REC_S;
+
+typedef struct SPACEMIT_V2D_TRACE_PENDING_S
+{
+	int fence;
+	V2D_TRACE_REC_S stRec;
+} V2D_TRACE_PENDING_S;
+
+/*
+ * Every thread appends to a ring of its own without locking. head counts the
+ * records ever written and is published after the record, the dump copies a
+ * ring from another thread and drops what the owner may have overwritten in
+ * the meantime. Rings stay listed after their thread exits so its records
+ * still make it into the dump. The pending fences are shared with the dump
+ * under pendingLock, the dump writes the tasks it resolves straight out.
+ */
+typedef struct SPACEMIT_V2D_TRACE_RING_S
+{
+	int tid;
+	uint32_t head;
+	uint32_t dumped;            /* records before it were written out, dump side only */
+	pthread_mutex_t pendingLock;
+	uint32_t pendingFirst;
+	uint32_t pendingCount;
+	uint64_t lastJob;           /* last task resolved, tasks of a job run one after another */
+	uint64_t lastEndNs;
+	struct SPACEMIT_V2D_TRACE_RING_S *pNext;
+	V2D_TRACE_PENDING_S astPending[TRACE_PENDING_MAX];
+	V2D_TRACE_REC_S astRec[TRACE_RING_SIZE];
+} V2D_TRACE_RING_S;
+
+int gV2dTraceOn = 0;
+static pthread_once_t gTraceOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gTraceKey;
+static pthread_mutex_t gTraceLock = PTHREAD_MUTEX_INITIALIZER;
+static V2D_TRACE_RING_S *gTraceRings = NULL;
+static uint64_t gTraceJobId = 0;
+static char gTraceFile[256];
+
+static const char *gTraceTaskName[] = { "fill", "blit", "blend" };
+static const char *gTraceFormatName[V2D_COLOR_FORMAT_BUTT + 1] =
+{
+	"RGB888", "RGBX8888", "RGBA8888", "ARGB8888", "RGB565", "NV12", "RGBA5658", "ARGB8565",
+	"A8", "Y8", "L8_RGBA8888", "L8_RGB888", "L8_RGB565", "BGR888", "BGRX8888", "BGRA8888",
+	"ABGR8888", "BGR565", "NV21", "BGRA5658", "ABGR8565", "L8_BGRA8888", "L8_BGR888", "L8_BGR565",
+	"none",
+};
+
+static void V2dTraceExit(void)
+{
+	V2D_TraceDump(gTraceFile);
+}
+
+static void V2dTraceResolveRing(V2D_TRACE_RING_S *pRing, FILE *pFile, int pid);
+
+/* the ring stays listed, the tasks that finished go into it before the thread is gone */
+static void V2dTraceThreadExit(void *pData)
+{
+	V2dTraceResolveRing((V2D_TRACE_RING_S *)pData, NULL, 0);
+}
+
+static void V2dTraceEnvInit(void)
+{
+	const char *pName = getenv(TRACE_ENV);
+
+	pthread_key_create(&gTraceKey, V2dTraceThreadExit);
+	if (!pName || !pName[0])
+		return;
+	strncpy(gTraceFile, pName, sizeof(gTraceFile) - 1);
+	__atomic_store_n(&gV2dTraceOn, 1, __ATOMIC_RELAXED);
+	atexit(V2dTraceExit);
+}
+
+void V2dTraceInit(void)
+{
+	pthread_once(&gTraceOnce, V2dTraceEnvInit);
+}
+
+uint64_t V2dTraceNow(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t V2dTraceJobId(void)
+{
+	return __atomic_add_fetch(&gTraceJobId, 1, __ATOMIC_RELAXED);
+}
+
+static V2D_TRACE_RING_S *V2dTraceRing(void)
+{
+	V2D_TRACE_RING_S *pRing;
+
+	V2dTraceInit();
+	pRing = (V2D_TRACE_RING_S *)pthread_getspecific(gTraceKey);
+	if (pRing)
+		return pRing;
+	pRing = (V2D_TRACE_RING_S *)calloc(1, sizeof(V2D_TRACE_RING_S));
+	if (!pRing)
+	{
+		printf("Failed to malloc v2d trace ring\n");
+		return NULL;
+	}
+	pRing->tid = (int)syscall(SYS_gettid);
+	pthread_mutex_init(&pRing->pendingLock, NULL);
+	pthread_mutex_lock(&gTraceLock);
+	pRing->pNext = gTraceRings;
+	gTraceRings = pRing;
+	pthread_mutex_unlock(&gTraceLock);
+	pthread_setspecific(gTraceKey, pRing);
+	return pRing;
+}
+
+static void V2dTracePut(V2D_TRACE_RING_S *pRing, const V2D_TRACE_REC_S *pRec)
+{
+	pRing->astRec[pRing->head & (TRACE_RING_SIZE - 1)] = *pRec;
+	__atomic_store_n(&pRing->head, pRing->head + 1, __ATOMIC_RELEASE);
+}
+
+void V2dTraceSpan(V2D_TRACE_KIND_E enKind, uint64_t job, uint32_t arg, uint64_t startNs, uint64_t endNs)
+{
+	V2D_TRACE_RING_S *pRing = V2dTraceRing();
+	V2D_TRACE_REC_S stRec;
+
+	if (!pRing)
+		return;
+	memset(&stRec, 0, sizeof(stRec));
+	stRec.startNs = startNs;
+	stRec.endNs = endNs;
+	stRec.job = job;
+	stRec.arg = arg;
+	stRec.kind = enKind;
+	V2dTracePut(pRing, &stRec);
+}
+
+void V2dTraceTask(uint64_t job, uint32_t idx, const V2D_TRACE_TASK_S *pstTask, int fence, uint64_t startNs, uint64_t endNs)
+{
+	V2D_TRACE_RING_S *pRing = V2dTraceRing();
+	V2D_TRACE_PENDING_S *pPending;
+	V2D_TRACE_REC_S stRec;
+
+	if (!pRing)
+	{
+		if (fence >= 0)
+			close(fence);
+		return;
+	}
+	stRec.startNs = startNs;
+	stRec.endNs = endNs;
+	stRec.job = job;
+	stRec.arg = idx;
+	stRec.kind = TRACE_TASK;
+	stRec.stTask = *pstTask;
+	if (fence < 0)
+	{
+		V2dTracePut(pRing, &stRec);
+		return;
+	}
+	pthread_mutex_lock(&pRing->pendingLock);
+	/* nobody resolved the oldest fence for a long time, its task goes without a span */
+	if (pRing->pendingCount == TRACE_PENDING_MAX)
+	{
+		close(pRing->astPending[pRing->pendingFirst].fence);
+		pRing->pendingFirst = (pRing->pendingFirst + 1) % TRACE_PENDING_MAX;
+		pRing->pendingCount--;
+	}
+	pPending = &pRing->astPending[(pRing->pendingFirst + pRing->pendingCount) % TRACE_PENDING_MAX];
+	pPending->fence = fence;
+	pPending->stRec = stRec;
+	pRing->pendingCount++;
+	pthread_mutex_unlock(&pRing->pendingLock);
+}
+
+static void V2dTraceWrite(FILE *pFile, int pid, int tid, const V2D_TRACE_REC_S *pRec);
+
+/*
+ * The pending tasks of pRing whose fences have signaled, into the ring on its
+ * own thread, or written to pFile by a dump on any other.
+ */
+static void V2dTraceResolveRing(V2D_TRACE_RING_S *pRing, FILE *pFile, int pid)
+{
+	V2D_TRACE_PENDING_S *pPending;
+	uint64_t ns;
+	int ret;
+
+	pthread_mutex_lock(&pRing->pendingLock);
+	/* the device completes tasks in order, the first pending one signals first */
+	while (pRing->pendingCount)
+	{
+		pPending = &pRing->astPending[pRing->pendingFirst];
+		ret = V2dFenceSignaled(pPending->fence, &ns);
+		if (ret == 0)
+			break;
+		if (ret > 0)
+		{
+			pPending->stRec.endNs = ns;
+			if (pPending->stRec.job == pRing->lastJob && pRing->lastEndNs > pPending->stRec.startNs)
+				pPending->stRec.startNs = pRing->lastEndNs;
+			if (pPending->stRec.startNs > ns)
+				pPending->stRec.startNs = ns;
+			pRing->lastJob = pPending->stRec.job;
+			pRing->lastEndNs = ns;
+			if (pFile)
+				V2dTraceWrite(pFile, pid, pRing->tid, &pPending->stRec);
+			else
+				V2dTracePut(pRing, &pPending->stRec);
+		}
+		close(pPending->fence);
+		pRing->pendingFirst = (pRing->pendingFirst + 1) % TRACE_PENDING_MAX;
+		pRing->pendingCount--;
+	}
+	pthread_mutex_unlock(&pRing->pendingLock);
+}
+
+void V2dTraceResolve(void)
+{
+	V2D_TRACE_RING_S *pRing;
+
+	V2dTraceInit();
+	pRing = (V2D_TRACE_RING_S *)pthread_getspecific(gTraceKey);
+	if (pRing)
+		V2dTraceResolveRing(pRing, NULL, 0);
+}
+
+static void V2dTraceWrite(FILE *pFile, int pid, int tid, const V2D_TRACE_REC_S *pRec)
+{
+	static const char *apName[] = { "job", "submit", "wait" };
+	const V2D_TRACE_TASK_S *pstTask = &pRec->stTask;
+
+	if (pRec->kind == TRACE_TASK)
+	{
+		fprintf(pFile, ",\n{\"name\":\"%s\",\"cat\":\"v2d\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+				"\"args\":{\"job\":%" PRIu64 ",\"task\":%u,\"src\":\"%s\",\"dst\":\"%s\",\"w\":%u,\"h\":%u}}",
+				gTraceTaskName[pstTask->type], pRec->startNs / 1000.0, (pRec->endNs - pRec->startNs) / 1000.0,
+				pid, TRACE_DEVICE_TID, pRec->job, pRec->arg,
+				gTraceFormatName[pstTask->srcFormat < V2D_COLOR_FORMAT_BUTT ? pstTask->srcFormat : V2D_COLOR_FORMAT_BUTT],
+				gTraceFormatName[pstTask->dstFormat < V2D_COLOR_FORMAT_BUTT ? pstTask->dstFormat : V2D_COLOR_FORMAT_BUTT],
+				pstTask->w, pstTask->h);
+	}
+	else
+	{
+		fprintf(pFile, ",\n{\"name\":\"%s\",\"cat\":\"v2d\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+				"\"args\":{\"job\":%" PRIu64 ",\"tasks\":%u}}",
+				apName[pRec->kind], pRec->startNs / 1000.0, (pRec->endNs - pRec->startNs) / 1000.0,
+				pid, tid, pRec->job, pRec->arg);
+	}
+}
+
+/* writes the records no earlier dump wrote, returns how many were lost to ring wraps */
+static uint32_t V2dTraceWriteRing(FILE *pFile, int pid, V2D_TRACE_RING_S *pRing, V2D_TRACE_REC_S *pCopy)
+{
+	uint32_t head, first, valid, i, lost = 0;
+
+	head = __atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE);
+	first = pRing->dumped;
+	if (head - first > TRACE_RING_SIZE)
+	{
+		lost = head - first - TRACE_RING_SIZE;
+		first = head - TRACE_RING_SIZE;
+	}
+	for (i=first; i!=head; i++)
+		pCopy[i - first] = pRing->astRec[i & (TRACE_RING_SIZE - 1)];
+	/* the owner may have been overwriting the oldest slots while they were copied */
+	valid = __atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE) - TRACE_RING_SIZE + 1;
+	for (i=first; i!=head; i++)
+	{
+		if ((int32_t)(i - valid) < 0)
+		{
+			lost++;
+			continue;
+		}
+		V2dTraceWrite(pFile, pid, pRing->tid, &pCopy[i - first]);
+	}
+	pRing->dumped = head;
+	return lost;
+}
+
+int32_t V2D_TraceEnable(int32_t enable)
+{
+	V2dTraceInit();
+	__atomic_store_n(&gV2dTraceOn, enable ? 1 : 0, __ATOMIC_RELAXED);
+	return SUCCESS;
+}
+
+int32_t V2D_TraceDump(const char *pFileName)
+{
+	V2D_TRACE_RING_S *pRing;
+	V2D_TRACE_REC_S *pCopy;
+	FILE *pFile;
+	int pid = (int)getpid();
+	uint32_t lost = 0;
+
+	if (!pFileName || !pFileName[0])
+		return FAILURE;
+	pCopy = (V2D_TRACE_REC_S *)malloc(TRACE_RING_SIZE * sizeof(V2D_TRACE_REC_S));
+	pFile = fopen(pFileName, "w");
+	if (!pCopy || !pFile)
+	{
+		printf("Failed to write v2d trace %s\n", pFileName);
+		free(pCopy);
+		if (pFile)
+			fclose(pFile);
+		return FAILURE;
+	}
+	fprintf(pFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(pFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"v2d\"}}",
+			pid, TRACE_DEVICE_TID);
+	pthread_mutex_lock(&gTraceLock);
+	for (pRing=gTraceRings; pRing; pRing=pRing->pNext)
+	{
+		lost += V2dTraceWriteRing(pFile, pid, pRing, pCopy);
+		/* tasks that finished after their thread last looked, or exited */
+		V2dTraceResolveRing(pRing, pFile, pid);
+	}
+	pthread_mutex_unlock(&gTraceLock);
+	fprintf(pFile, "\n]}\n");
+	free(pCopy);
+	if (fclose(pFile))
+	{
+		printf("Failed to write v2d trace %s\n", pFileName);
+		return FAILURE;
+	}
+	if (lost)
+		printf("v2d trace lost %u records to full rings\n", lost);
+	return SUCCESS;
+}
@@ -0,0 +1,63 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#ifndef __V2D_TRACE_H__
+#define __V2D_TRACE_H__
+#include "v2d_type.h"
+
+/* spans of the job lifecycle, job, submit and wait on the thread ending the job, tasks on the v2d track */
+typedef enum SPACEMIT_V2D_TRACE_KIND_E
+{
+	TRACE_JOB = 0,
+	TRACE_SUBMIT,
+	TRACE_WAIT,
+	TRACE_TASK,
+} V2D_TRACE_KIND_E;
+
+typedef enum SPACEMIT_V2D_TRACE_TASK_E
+{
+	TRACE_TASK_FILL = 0,
+	TRACE_TASK_BLIT,
+	TRACE_TASK_BLEND,
+} V2D_TRACE_TASK_E;
+
+/* what a task span shows besides its times, formats are V2D_COLOR_FORMAT_BUTT when absent */
+typedef struct SPACEMIT_V2D_TRACE_TASK_S
+{
+	uint8_t type;
+	uint8_t srcFormat;
+	uint8_t dstFormat;
+	uint16_t w;
+	uint16_t h;
+} V2D_TRACE_TASK_S;
+
+extern int gV2dTraceOn;
+
+/* checks V2D_TRACE once, tracing costs a single load while it is off */
+void V2dTraceInit(void);
+static inline int V2dTracing(void)
+{
+	return __atomic_load_n(&gV2dTraceOn, __ATOMIC_RELAXED);
+}
+
+uint64_t V2dTraceNow(void);
+uint64_t V2dTraceJobId(void);
+
+/* a span on the calling thread, arg is the task count of a job or submit */
+void V2dTraceSpan(V2D_TRACE_KIND_E enKind, uint64_t job, uint32_t arg, uint64_t startNs, uint64_t endNs);
+
+/*
+ * A task handed to the backend at startNs. Without a fence it completed by
+ * endNs, otherwise the trace takes over the fence and the span ends when it
+ * signals, as seen by a later V2dTraceResolve on the same thread, the exit
+ * of the thread or a dump.
+ */
+void V2dTraceTask(uint64_t job, uint32_t idx, const V2D_TRACE_TASK_S *pstTask, int fence, uint64_t startNs, uint64_t endNs);
+
+/* records the tasks of this thread whose fences have signaled by now, never blocks */
+void V2dTraceResolve(void);
+
+#endif
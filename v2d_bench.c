@@ -0,0 +1,537 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "v2d_api.h"
+#include "v2d_type.h"
+#include "dmabufheap/BufferAllocatorWrapper.h"
+
+/*
+ * Latency and throughput sweep of the v2d job path. Every op runs over a
+ * list of formats, surface sizes and tasks per job, the tasks of a job cut
+ * the destination into stripes so each job moves one full surface.
+ *
+ * Per job it times the submit, from the end of the job build to the return
+ * of V2D_EndJobAsync, and the completion, from the end of the build to the
+ * signal of the job fence. On the cpu backend the work is done inside the
+ * submit, so both are the same. The stand-in device of --node accepts every
+ * task and never hands back a fence, which measures the library alone.
+ *
+ * With --rects random the tasks draw rects of random position and size
+ * instead, mostly off the dst alignment of the device, and the share of
+ * pixels the library had to draw on the host is reported next to the rates.
+ * --align sets that alignment, to see the split on the cpu backend too. It
+ * keeps the device rules and does not widen tasks unless V2D_DST_WIDEN=1.
+ */
+
+#define BENCH_MAX_SIZES     8
+#define BENCH_MAX_TASKS     8
+#define BENCH_MAX_ITERS     1000
+#define BENCH_TIME_NS       2000000000LL /* per config, at least one job runs */
+#define BENCH_FENCE_TIMEOUT 3000
+
+#define ALIGN_UP(size, shift) (((size+shift-1)/shift)*shift)
+#define PAGESIZE (4096)
+
+typedef enum {
+	BENCH_OP_FILL,
+	BENCH_OP_BLIT,
+	BENCH_OP_BLEND,
+	BENCH_OP_CSC,
+	BENCH_OP_ROTATE,
+	BENCH_OP_BUTT,
+} BENCH_OP_E;
+
+typedef struct {
+	BENCH_OP_E op;
+	V2D_COLOR_FORMAT_E srcFormat;
+	V2D_COLOR_FORMAT_E dstFormat;
+	V2D_CSC_MODE_E csc;
+} BENCH_CASE_S;
+
+typedef struct {
+	int fd;
+	void *pAddr;
+	unsigned int size;
+} BENCH_BUF_S;
+
+static const char *gOpName[BENCH_OP_BUTT] = {"fill", "blit", "blend", "csc", "rotate"};
+
+static const BENCH_CASE_S gCases[] = {
+	{BENCH_OP_FILL,   V2D_COLOR_FORMAT_BUTT,     V2D_COLOR_FORMAT_RGB888,   V2D_CSC_MODE_BUTT},
+	{BENCH_OP_FILL,   V2D_COLOR_FORMAT_BUTT,     V2D_COLOR_FORMAT_RGBA8888, V2D_CSC_MODE_BUTT},
+	{BENCH_OP_FILL,   V2D_COLOR_FORMAT_BUTT,     V2D_COLOR_FORMAT_RGB565,   V2D_CSC_MODE_BUTT},
+	{BENCH_OP_FILL,   V2D_COLOR_FORMAT_BUTT,     V2D_COLOR_FORMAT_NV12,     V2D_CSC_MODE_BUTT},
+	{BENCH_OP_BLIT,   V2D_COLOR_FORMAT_RGB888,   V2D_COLOR_FORMAT_RGB888,   V2D_CSC_MODE_BUTT},
+	{BENCH_OP_BLIT,   V2D_COLOR_FORMAT_RGBA8888, V2D_COLOR_FORMAT_RGBA8888, V2D_CSC_MODE_BUTT},
+	{BENCH_OP_BLIT,   V2D_COLOR_FORMAT_RGB565,   V2D_COLOR_FORMAT_RGB565,   V2D_CSC_MODE_BUTT},
+	{BENCH_OP_BLIT,   V2D_COLOR_FORMAT_NV12,     V2D_COLOR_FORMAT_NV12,     V2D_CSC_MODE_BUTT},
+	{BENCH_OP_BLEND,  V2D_COLOR_FORMAT_RGB888,   V2D_COLOR_FORMAT_RGB888,   V2D_CSC_MODE_BUTT},
+	{BENCH_OP_BLEND,  V2D_COLOR_FORMAT_RGBA8888, V2D_COLOR_FORMAT_RGBA8888, V2D_CSC_MODE_BUTT},
+	{BENCH_OP_BLEND,  V2D_COLOR_FORMAT_RGB565,   V2D_COLOR_FORMAT_RGB565,   V2D_CSC_MODE_BUTT},
+	{BENCH_OP_BLEND,  V2D_COLOR_FORMAT_NV12,     V2D_COLOR_FORMAT_RGBA8888, V2D_CSC_MODE_BT601NARROW_2_RGB},
+	{BENCH_OP_CSC,    V2D_COLOR_FORMAT_NV12,     V2D_COLOR_FORMAT_RGB888,   V2D_CSC_MODE_BT601NARROW_2_RGB},
+	{BENCH_OP_CSC,    V2D_COLOR_FORMAT_NV12,     V2D_COLOR_FORMAT_RGBA8888, V2D_CSC_MODE_BT601NARROW_2_RGB},
+	{BENCH_OP_CSC,    V2D_COLOR_FORMAT_NV12,     V2D_COLOR_FORMAT_RGB565,   V2D_CSC_MODE_BT709WIDE_2_RGB},
+	{BENCH_OP_CSC,    V2D_COLOR_FORMAT_RGB888,   V2D_COLOR_FORMAT_NV12,     V2D_CSC_MODE_RGB_2_BT601NARROW},
+	{BENCH_OP_ROTATE, V2D_COLOR_FORMAT_RGB888,   V2D_COLOR_FORMAT_RGB888,   V2D_CSC_MODE_BUTT},
+	{BENCH_OP_ROTATE, V2D_COLOR_FORMAT_RGBA8888, V2D_COLOR_FORMAT_RGBA8888, V2D_CSC_MODE_BUTT},
+	{BENCH_OP_ROTATE, V2D_COLOR_FORMAT_RGB565,   V2D_COLOR_FORMAT_RGB565,   V2D_CSC_MODE_BUTT},
+	{BENCH_OP_ROTATE, V2D_COLOR_FORMAT_NV12,     V2D_COLOR_FORMAT_NV12,     V2D_CSC_MODE_BUTT},
+};
+
+static BufferAllocator *bufferAllocator = NULL;
+
+static long long nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static const char *v2d_bench_format(V2D_COLOR_FORMAT_E format)
+{
+	switch (format) {
+	case V2D_COLOR_FORMAT_RGB888:
+		return "RGB888";
+	case V2D_COLOR_FORMAT_RGBA8888:
+		return "RGBA8888";
+	case V2D_COLOR_FORMAT_RGB565:
+		return "RGB565";
+	case V2D_COLOR_FORMAT_NV12:
+		return "NV12";
+	default:
+		return "none";
+	}
+}
+
+//bytes per pixel, chroma included
+static double v2d_bench_bpp(V2D_COLOR_FORMAT_E format)
+{
+	switch (format) {
+	case V2D_COLOR_FORMAT_RGBA8888:
+		return 4.0;
+	case V2D_COLOR_FORMAT_RGB888:
+		return 3.0;
+	case V2D_COLOR_FORMAT_RGB565:
+		return 2.0;
+	case V2D_COLOR_FORMAT_NV12:
+		return 1.5;
+	default:
+		return 0.0;
+	}
+}
+
+//buffers come from the dma heap, or from a memfd where there is none
+static int v2d_bench_alloc(BENCH_BUF_S *pBuf, unsigned int size)
+{
+	pBuf->size = ALIGN_UP(size, PAGESIZE);
+	pBuf->fd = DmabufHeapAllocSystem(bufferAllocator, true, pBuf->size, 0, 0);
+	if (pBuf->fd < 0) {
+		pBuf->fd = syscall(__NR_memfd_create, "v2d_bench", 0);
+		if (pBuf->fd >= 0 && ftruncate(pBuf->fd, pBuf->size)) {
+			close(pBuf->fd);
+			pBuf->fd = -1;
+		}
+	}
+	if (pBuf->fd < 0) {
+		return -1;
+	}
+	pBuf->pAddr = mmap(NULL, pBuf->size, PROT_READ | PROT_WRITE, MAP_SHARED, pBuf->fd, 0);
+	if (pBuf->pAddr == MAP_FAILED) {
+		close(pBuf->fd);
+		pBuf->fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+static void v2d_bench_free(BENCH_BUF_S *pBuf)
+{
+	if (pBuf->fd >= 0) {
+		munmap(pBuf->pAddr, pBuf->size);
+		close(pBuf->fd);
+	}
+}
+
+static void v2d_bench_surface(V2D_SURFACE_S *pSurface, BENCH_BUF_S *pBuf, unsigned int w, unsigned int h,
+                              V2D_COLOR_FORMAT_E format)
+{
+	memset(pSurface, 0, sizeof(V2D_SURFACE_S));
+	pSurface->fd     = pBuf->fd;
+	pSurface->w      = w;
+	pSurface->h      = h;
+	pSurface->format = format;
+	if (format == V2D_COLOR_FORMAT_NV12) {
+		pSurface->stride = ALIGN_UP(w, 2);
+		pSurface->offset = pSurface->stride * ALIGN_UP(h, 2);
+	} else {
+		pSurface->stride = w * (int)v2d_bench_bpp(format);
+	}
+}
+
+static int v2d_bench_wait(int fence)
+{
+	struct pollfd fds;
+	int ret;
+
+	if (fence < 0) {
+		return 0;
+	}
+	fds.fd = fence;
+	fds.events = POLLIN;
+	do {
+		ret = poll(&fds, 1, BENCH_FENCE_TIMEOUT);
+	} while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+	close(fence);
+	return (ret > 0 && !(fds.revents & (POLLERR | POLLNVAL))) ? 0 : -1;
+}
+
+static int v2d_bench_cmp(const void *pA, const void *pB)
+{
+	long long a = *(const long long *)pA, b = *(const long long *)pB;
+	return (a > b) - (a < b);
+}
+
+//percentile of sorted samples, in us
+static double v2d_bench_pct(const long long *pNs, int n, int pct)
+{
+	int i = (n * pct + 99) / 100 - 1;
+	return pNs[i < 0 ? 0 : i] / 1000.0;
+}
+
+/*
+ * Adds the rect of the destination as one task. For a 90 degree turn the
+ * rows of the destination read the columns of the source.
+ */
+static int v2d_bench_task(V2D_HANDLE hHandle, const BENCH_CASE_S *pCase, V2D_SURFACE_S *pSrc, V2D_SURFACE_S *pOverlay,
+                          V2D_SURFACE_S *pDst, const V2D_AREA_S *pDstRect)
+{
+	V2D_AREA_S stDstRect, stSrcRect;
+	V2D_FILLCOLOR_S stFillColor;
+	V2D_BLEND_CONF_S stBlendConf;
+
+	stDstRect = *pDstRect;
+	stSrcRect = stDstRect;
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	stBlendConf.blendlayer[0].blend_area = stDstRect;
+	switch (pCase->op) {
+	case BENCH_OP_FILL:
+		stFillColor.format     = V2D_COLOR_FORMAT_RGBA8888;
+		stFillColor.colorvalue = 0xff336699;
+		return V2D_AddFillTask(hHandle, pDst, &stDstRect, &stFillColor);
+	case BENCH_OP_BLIT:
+	case BENCH_OP_CSC:
+		return V2D_AddBitblitTask(hHandle, pDst, &stDstRect, pSrc, &stSrcRect, pCase->csc);
+	case BENCH_OP_BLEND:
+		stBlendConf.blendlayer[1].blend_area = stDstRect;
+		stBlendConf.blendlayer[1].stBlendFactor.srcColorFactor = V2D_BLEND_SRC_ALPHA;
+		stBlendConf.blendlayer[1].stBlendFactor.dstColorFactor = V2D_BLEND_ONE_MINUS_SRC_ALPHA;
+		stBlendConf.blendlayer[1].stBlendFactor.srcAlphaFactor = V2D_BLEND_ONE;
+		stBlendConf.blendlayer[1].stBlendFactor.dstAlphaFactor = V2D_BLEND_ONE_MINUS_SRC_ALPHA;
+		return V2D_AddBlendTask(hHandle, pSrc, &stSrcRect, pOverlay, &stDstRect, NULL, NULL, pDst, &stDstRect, &stBlendConf,
+								V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, pCase->csc, NULL, V2D_NO_DITHER);
+	case BENCH_OP_ROTATE:
+		stSrcRect.x = stDstRect.y;
+		stSrcRect.y = stDstRect.x;
+		stSrcRect.w = stDstRect.h;
+		stSrcRect.h = stDstRect.w;
+		return V2D_AddBlendTask(hHandle, pSrc, &stSrcRect, NULL, NULL, NULL, NULL, pDst, &stDstRect, &stBlendConf,
+								V2D_ROT_0, V2D_ROT_90, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+	default:
+		return -1;
+	}
+}
+
+//a random rect of 1/8 to 1/2 of each side, even so the 2x2 chroma blocks of NV12 are not split
+static void v2d_bench_random_rect(unsigned int *pSeed, unsigned int w, unsigned int h, V2D_AREA_S *pRect)
+{
+	pRect->w = ALIGN_UP(w / 8 + rand_r(pSeed) % (w / 2 - w / 8 + 1), 2);
+	pRect->h = ALIGN_UP(h / 8 + rand_r(pSeed) % (h / 2 - h / 8 + 1), 2);
+	pRect->x = (rand_r(pSeed) % (w - pRect->w + 1)) & ~1;
+	pRect->y = (rand_r(pSeed) % (h - pRect->h + 1)) & ~1;
+}
+
+static int v2d_bench_run(V2D_CONTEXT_HANDLE hContext, const BENCH_CASE_S *pCase, BENCH_BUF_S *pBufs, unsigned int w,
+                         unsigned int h, int tasks, int random, int iters, FILE *pJson, int *pFirst)
+{
+	V2D_SURFACE_S stSrc, stOverlay, stDst;
+	V2D_STATS_S stBefore, stAfter;
+	V2D_HANDLE hHandle;
+	V2D_AREA_S stRect;
+	long long *pSubmit, *pComplete, start, built, queued, total = 0;
+	unsigned int dw = w, dh = h, step, seed = 1;
+	double bytes, mpix, gbs, pixels = 0, host = -1;
+	int ret = 0, i, t, n, fence, stats;
+
+	if (pCase->op == BENCH_OP_ROTATE) {
+		dw = h;
+		dh = w;
+	}
+	v2d_bench_surface(&stSrc, &pBufs[0], w, h, pCase->srcFormat);
+	v2d_bench_surface(&stOverlay, &pBufs[1], w, h, V2D_COLOR_FORMAT_RGBA8888);
+	v2d_bench_surface(&stDst, &pBufs[2], dw, dh, pCase->dstFormat);
+	//stripes stay even so the 2x2 chroma blocks of NV12 are not split
+	step = ALIGN_UP((dh + tasks - 1) / tasks, 2);
+	if (!random) {
+		tasks = (dh + step - 1) / step;
+	}
+	stats = V2D_GetStats(hContext, &stBefore) == SUCCESS;
+	pSubmit = calloc(iters, sizeof(long long));
+	pComplete = calloc(iters, sizeof(long long));
+	if (!pSubmit || !pComplete) {
+		free(pSubmit);
+		free(pComplete);
+		return -1;
+	}
+	//the first job warms up the backend and the page tables
+	for (i=-1, n=0; i<iters && !ret; i++) {
+		start = nowNs();
+		ret = V2D_BeginContextJob(hContext, &hHandle);
+		for (t=0; t<tasks && !ret; t++) {
+			if (random) {
+				v2d_bench_random_rect(&seed, dw, dh, &stRect);
+			} else {
+				stRect.x = 0;
+				stRect.y = t * step;
+				stRect.w = dw;
+				stRect.h = (stRect.y + step < dh) ? step : dh - stRect.y;
+			}
+			if (i >= 0) {
+				pixels += (double)stRect.w * stRect.h;
+			}
+			ret = v2d_bench_task(hHandle, pCase, &stSrc, &stOverlay, &stDst, &stRect);
+		}
+		built = nowNs();
+		fence = -1;
+		ret |= V2D_EndJobAsync(hHandle, &fence);
+		queued = nowNs();
+		ret |= v2d_bench_wait(fence);
+		if (i < 0) {
+			continue;
+		}
+		pSubmit[n] = queued - built;
+		pComplete[n] = nowNs() - built;
+		total += nowNs() - start;
+		n++;
+		if (total > BENCH_TIME_NS) {
+			break;
+		}
+	}
+	if (ret || !n) {
+		printf("%-6s %-8s -> %-8s %4ux%-4u tasks %2d failed\n", gOpName[pCase->op], v2d_bench_format(pCase->srcFormat),
+			   v2d_bench_format(pCase->dstFormat), w, h, tasks);
+		free(pSubmit);
+		free(pComplete);
+		return -1;
+	}
+	qsort(pSubmit, n, sizeof(long long), v2d_bench_cmp);
+	qsort(pComplete, n, sizeof(long long), v2d_bench_cmp);
+	//share of the destination pixels the library drew on the host around unaligned rects
+	if (stats && V2D_GetStats(hContext, &stAfter) == SUCCESS) {
+		host = 100.0 * (stAfter.fixupPixels - stBefore.fixupPixels) / pixels;
+	}
+	//bytes the block moves per job: the destination written, the sources read and blended destinations read back
+	pixels /= n;
+	bytes = pixels * v2d_bench_bpp(pCase->dstFormat);
+	if (pCase->op != BENCH_OP_FILL) {
+		bytes += pixels * v2d_bench_bpp(pCase->srcFormat);
+	}
+	if (pCase->op == BENCH_OP_BLEND) {
+		bytes += pixels * v2d_bench_bpp(V2D_COLOR_FORMAT_RGBA8888);
+	}
+	mpix = pixels / v2d_bench_pct(pComplete, n, 50);
+	gbs = bytes / 1000.0 / v2d_bench_pct(pComplete, n, 50);
+	printf("%-6s %-8s -> %-8s %4ux%-4u tasks %2d  submit p50 %8.1f p99 %8.1f us  complete p50 %8.1f p99 %8.1f us  %8.1f MPix/s %6.2f GB/s",
+		   gOpName[pCase->op], v2d_bench_format(pCase->srcFormat), v2d_bench_format(pCase->dstFormat), w, h, tasks,
+		   v2d_bench_pct(pSubmit, n, 50), v2d_bench_pct(pSubmit, n, 99), v2d_bench_pct(pComplete, n, 50),
+		   v2d_bench_pct(pComplete, n, 99), mpix, gbs);
+	if (random && host >= 0) {
+		printf("  host %5.2f%%", host);
+	}
+	printf("\n");
+	if (pJson) {
+		fprintf(pJson, "%s\n    {\"op\": \"%s\", \"src\": \"%s\", \"dst\": \"%s\", \"width\": %u, \"height\": %u, "
+				"\"tasks\": %d, \"rects\": \"%s\", \"jobs\": %d, \"submit_us_p50\": %.2f, \"submit_us_p99\": %.2f, "
+				"\"complete_us_p50\": %.2f, \"complete_us_p99\": %.2f, \"mpix_s\": %.2f, \"gb_s\": %.3f, "
+				"\"host_pct\": %.3f}",
+				*pFirst ? "" : ",", gOpName[pCase->op], v2d_bench_format(pCase->srcFormat),
+				v2d_bench_format(pCase->dstFormat), w, h, tasks, random ? "random" : "stripes", n,
+				v2d_bench_pct(pSubmit, n, 50), v2d_bench_pct(pSubmit, n, 99), v2d_bench_pct(pComplete, n, 50),
+				v2d_bench_pct(pComplete, n, 99), mpix, gbs, host);
+		*pFirst = 0;
+	}
+	free(pSubmit);
+	free(pComplete);
+	return 0;
+}
+
+static void v2d_bench_usage(void)
+{
+	printf("spacemit v2d bench:\n");
+	printf("--backend device|cpu|auto     backend to run on, default auto \n");
+	printf("--node path                   stand-in device node such as /dev/null, implies device \n");
+	printf("--rate 204M|307M|491M         set the v2d clock first \n");
+	printf("--ops fill,blit,blend,csc,rotate  ops to run, default all \n");
+	printf("--sizes WxH,...               surface sizes, default 320x240,1280x720,1920x1080,3840x2160 \n");
+	printf("--tasks n,...                 tasks per job, default 1,4,16 \n");
+	printf("--iters n                     jobs per config, default 20 \n");
+	printf("--rects stripes|random        stripes covering the surface or random rects, default stripes \n");
+	printf("--align n                     dst alignment to split unaligned rects for, default the backend's \n");
+	printf("--json file                   also write the results as json \n");
+}
+
+int main(int argc, char **argv)
+{
+	static const char *apRate[][2] = {{"204M", "204800000"}, {"307M", "307200000"}, {"491M", "491520000"}};
+	const char *pOps = NULL, *pSizes = "320x240,1280x720,1920x1080,3840x2160", *pTasks = "1,4,16";
+	const char *pJsonName = NULL, *pRate = NULL, *pBackendName = "auto";
+	unsigned int aW[BENCH_MAX_SIZES], aH[BENCH_MAX_SIZES], maxPix = 0;
+	int aTasks[BENCH_MAX_TASKS], sizeCount = 0, taskCount = 0, iters = 20, first = 1, ret = 0, failed = 0, random = 0;
+	V2D_BACKEND_E enBackend = V2D_BACKEND_AUTO;
+	V2D_CONTEXT_HANDLE hContext;
+	BENCH_BUF_S astBuf[3];
+	FILE *pJson = NULL;
+	const char *p;
+	char *pEnd;
+	int i, j, s, t, fd;
+
+	for (i=1; i<argc; i++) {
+		if (i + 1 < argc && strcmp(argv[i], "--backend") == 0) {
+			pBackendName = argv[++i];
+		} else if (i + 1 < argc && strcmp(argv[i], "--node") == 0) {
+			setenv("V2D_DEV_NAME", argv[++i], 1);
+			pBackendName = "device";
+		} else if (i + 1 < argc && strcmp(argv[i], "--rate") == 0) {
+			pRate = argv[++i];
+		} else if (i + 1 < argc && strcmp(argv[i], "--ops") == 0) {
+			pOps = argv[++i];
+		} else if (i + 1 < argc && strcmp(argv[i], "--sizes") == 0) {
+			pSizes = argv[++i];
+		} else if (i + 1 < argc && strcmp(argv[i], "--tasks") == 0) {
+			pTasks = argv[++i];
+		} else if (i + 1 < argc && strcmp(argv[i], "--iters") == 0) {
+			iters = atoi(argv[++i]);
+		} else if (i + 1 < argc && strcmp(argv[i], "--json") == 0) {
+			pJsonName = argv[++i];
+		} else if (i + 1 < argc && strcmp(argv[i], "--rects") == 0) {
+			random = strcmp(argv[++i], "random") == 0;
+		} else if (i + 1 < argc && strcmp(argv[i], "--align") == 0) {
+			setenv("V2D_DST_ALIGN", argv[++i], 1);
+			setenv("V2D_DST_WIDEN", "0", 0);
+		} else {
+			v2d_bench_usage();
+			return (strcmp(argv[i], "--help") == 0) ? 0 : -1;
+		}
+	}
+	if (strcmp(pBackendName, "device") == 0) {
+		enBackend = V2D_BACKEND_DEVICE;
+	} else if (strcmp(pBackendName, "cpu") == 0) {
+		enBackend = V2D_BACKEND_CPU;
+	} else if (strcmp(pBackendName, "auto") != 0) {
+		v2d_bench_usage();
+		return -1;
+	}
+	for (p=pSizes; *p && sizeCount<BENCH_MAX_SIZES; p=(*pEnd == ',') ? pEnd + 1 : pEnd) {
+		aW[sizeCount] = strtoul(p, &pEnd, 10);
+		if (*pEnd != 'x') {
+			break;
+		}
+		aH[sizeCount] = strtoul(pEnd + 1, &pEnd, 10);
+		if (aW[sizeCount] && aH[sizeCount] && aW[sizeCount] <= 4096 && aH[sizeCount] <= 4096) {
+			maxPix = (aW[sizeCount] * aH[sizeCount] > maxPix) ? aW[sizeCount] * aH[sizeCount] : maxPix;
+			sizeCount++;
+		}
+	}
+	for (p=pTasks; *p && taskCount<BENCH_MAX_TASKS; p=(*pEnd == ',') ? pEnd + 1 : pEnd) {
+		aTasks[taskCount] = strtol(p, &pEnd, 10);
+		if (pEnd == p) {
+			break;
+		}
+		if (aTasks[taskCount] > 0) {
+			taskCount++;
+		}
+	}
+	iters = (iters < 1) ? 1 : (iters > BENCH_MAX_ITERS) ? BENCH_MAX_ITERS : iters;
+	if (!sizeCount || !taskCount) {
+		v2d_bench_usage();
+		return -1;
+	}
+	for (i=0; pRate && i<3; i++) {
+		if (strcmp(pRate, apRate[i][0]) == 0) {
+			fd = open("/sys/bus/platform/devices/c0100000.v2d/clkrate", O_WRONLY);
+			if (fd < 0 || write(fd, apRate[i][1], strlen(apRate[i][1])) < 0) {
+				printf("failed to set the v2d clock to %s\n", pRate);
+			}
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+	}
+
+	bufferAllocator = CreateDmabufHeapBufferAllocator();
+	for (i=0; i<3; i++) {
+		astBuf[i].fd = -1;
+	}
+	for (i=0; i<3 && !ret; i++) {
+		ret = v2d_bench_alloc(&astBuf[i], ALIGN_UP(maxPix, PAGESIZE) * 4 + PAGESIZE);
+		if (!ret) {
+			memset(astBuf[i].pAddr, 0x5a + 0x31 * i, astBuf[i].size);
+		}
+	}
+	if (!ret) {
+		ret = V2D_OpenBackend(enBackend, &hContext);
+	}
+	if (ret) {
+		printf("v2d bench setup failed\n");
+		goto out;
+	}
+	if (pJsonName) {
+		pJson = fopen(pJsonName, "w");
+		if (!pJson) {
+			printf("failed to open %s\n", pJsonName);
+		} else {
+			fprintf(pJson, "{\n  \"backend\": \"%s\",\n  \"node\": \"%s\",\n  \"rate\": \"%s\",\n  \"align\": \"%s\",\n  \"results\": [",
+					pBackendName, getenv("V2D_DEV_NAME") ? getenv("V2D_DEV_NAME") : "", pRate ? pRate : "",
+					getenv("V2D_DST_ALIGN") ? getenv("V2D_DST_ALIGN") : "");
+		}
+	}
+	printf("v2d bench on the %s backend\n", pBackendName);
+	for (i=0; i<(int)(sizeof(gCases)/sizeof(gCases[0])); i++) {
+		if (pOps && !strstr(pOps, gOpName[gCases[i].op])) {
+			continue;
+		}
+		for (s=0; s<sizeCount; s++) {
+			for (t=0; t<taskCount; t++) {
+				j = v2d_bench_run(hContext, &gCases[i], astBuf, aW[s], aH[s], aTasks[t], random, iters, pJson, &first);
+				failed += (j != 0);
+			}
+		}
+	}
+	if (pJson) {
+		fprintf(pJson, "\n  ]\n}\n");
+		fclose(pJson);
+	}
+	V2D_Close(hContext);
+	ret = failed ? 1 : 0;
+out:
+	for (i=0; i<3; i++) {
+		v2d_bench_free(&astBuf[i]);
+	}
+	FreeDmabufHeapBufferAllocator(bufferAllocator);
+	printf("v2d bench %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
@@ -0,0 +1,155 @@
+/*
+* V2D test for Spacemit
+* Copyright (C) 2023 Spacemit Co., Ltd.
+*
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "v2d.hpp"
+
+/*
+ * Builds the same job through v2d::Job and through the V2D_Add*Task calls and
+ * compares the tasks the library expands them into. Each job goes to a device
+ * context whose node is a memfd, so the tasks land in the file instead of the
+ * driver and can be read back byte for byte.
+ */
+namespace {
+
+/* the driver ABI: one V2D_SUBMIT_TASK_S plus the list link per task */
+struct DriverTask {
+    V2D_SUBMIT_TASK_S task;
+    void* reserved;
+};
+constexpr size_t kTaskSize = sizeof(DriverTask);
+constexpr uint16_t kWidth = 128;
+constexpr uint16_t kHeight = 64;
+
+int NewBuffer(const char* name, size_t size) {
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd >= 0 && ftruncate(fd, size) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* a device context on a fresh capture file, the backend opens it on the first submission */
+bool OpenCapture(const char* name, V2D_CONTEXT_HANDLE* context, int* capture) {
+    char node[64];
+
+    *capture = memfd_create(name, MFD_CLOEXEC);
+    if (*capture < 0) return false;
+    snprintf(node, sizeof(node), "/proc/self/fd/%d", *capture);
+    setenv("V2D_DEV_NAME", node, 1);
+    return V2D_OpenBackend(V2D_BACKEND_DEVICE, context) == SUCCESS;
+}
+
+std::vector<uint8_t> ReadCapture(int capture) {
+    std::vector<uint8_t> tasks(lseek(capture, 0, SEEK_END));
+    if (pread(capture, tasks.data(), tasks.size(), 0) != (ssize_t)tasks.size()) tasks.clear();
+    close(capture);
+    return tasks;
+}
+
+V2D_SURFACE_S CSurface(int fd, uint16_t w, uint16_t h, uint16_t stride, V2D_COLOR_FORMAT_E format, int offset) {
+    V2D_SURFACE_S surface;
+    memset(&surface, 0, sizeof(surface));
+    surface.fd = fd;
+    surface.w = w;
+    surface.h = h;
+    surface.stride = stride;
+    surface.format = format;
+    surface.offset = offset;
+    return surface;
+}
+
+}  // namespace
+
+int main() {
+    using Rgba = v2d::Surface<V2D_COLOR_FORMAT_RGBA8888>;
+    using Nv12 = v2d::Surface<V2D_COLOR_FORMAT_NV12>;
+    V2D_CONTEXT_HANDLE context;
+    V2D_HANDLE handle;
+    int capture, ret = 0;
+
+    Rgba dst(NewBuffer("dst", kWidth * kHeight * 4), kWidth, kHeight);
+    Rgba fore(NewBuffer("fore", kWidth * kHeight * 4), kWidth, kHeight);
+    Nv12 video(NewBuffer("video", kWidth * kHeight * 3 / 2), kWidth, kHeight);
+    if (dst.fd() < 0 || fore.fd() < 0 || video.fd() < 0) {
+        printf("v2d cpp test buffer alloc failed\n");
+        return -1;
+    }
+    const V2D_AREA_S left = {0, 0, kWidth / 2, kHeight};
+    const V2D_AREA_S right = {kWidth / 2, 0, kWidth / 2, kHeight};
+    const V2D_AREA_S tile = {16, 16, 32, 32};
+    V2D_BLEND_CONF_S conf = {};
+    conf.blend_cmd = V2D_BLENDCMD_ALPHA;
+    conf.blendlayer[0].blend_area = tile;
+    conf.blendlayer[1].blend_area = tile;
+    conf.blendlayer[1].blend_alpha_source = V2D_BLENDALPHA_SOURCE_GOLBAL;
+    conf.blendlayer[1].global_alpha = 0x80;
+
+    /* through the wrapper */
+    if (!OpenCapture("v2d-cpp", &context, &capture)) {
+        printf("V2D_OpenBackend err\n");
+        return -1;
+    }
+    {
+        v2d::Job job = v2d::Job::Begin(context);
+        ret |= job.Fill(dst, dst.rect(), 0xff000000);
+        ret |= job.Convert<V2D_CSC_MODE_BT601WIDE_2_RGB>(dst, left, video, video.rect());
+        ret |= job.Blit(dst, right, fore, left);
+        ret |= job.Blend(dst, tile, dst, tile, fore, tile, conf);
+        ret |= job.End();
+    }
+    V2D_Close(context);
+    std::vector<uint8_t> cpp = ReadCapture(capture);
+
+    /* the same job through the C calls */
+    V2D_SURFACE_S stDst = CSurface(dst.fd(), kWidth, kHeight, kWidth * 4, V2D_COLOR_FORMAT_RGBA8888, 0);
+    V2D_SURFACE_S stFore = CSurface(fore.fd(), kWidth, kHeight, kWidth * 4, V2D_COLOR_FORMAT_RGBA8888, 0);
+    V2D_SURFACE_S stVideo = CSurface(video.fd(), kWidth, kHeight, kWidth, V2D_COLOR_FORMAT_NV12, kWidth * kHeight);
+    V2D_AREA_S stAll = {0, 0, kWidth, kHeight}, stLeft = left, stRight = right, stTile = tile;
+    V2D_FILLCOLOR_S stFillColor = {0xff000000, V2D_COLOR_FORMAT_RGBA8888};
+    V2D_BLEND_CONF_S stConvertConf = {};
+    stConvertConf.blendlayer[0].blend_area = left;
+    if (!OpenCapture("v2d-c", &context, &capture)) {
+        printf("V2D_OpenBackend err\n");
+        return -1;
+    }
+    ret |= V2D_BeginContextJob(context, &handle);
+    ret |= V2D_AddFillTask(handle, &stDst, &stAll, &stFillColor);
+    ret |= V2D_AddBlendTask(handle, &stVideo, &stAll, nullptr, nullptr, nullptr, nullptr, &stDst, &stLeft,
+                            &stConvertConf, V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BT601WIDE_2_RGB,
+                            nullptr, V2D_NO_DITHER);
+    ret |= V2D_AddBitblitTask(handle, &stDst, &stRight, &stFore, &stLeft, V2D_CSC_MODE_BUTT);
+    ret |= V2D_AddBlendTask(handle, &stDst, &stTile, &stFore, &stTile, nullptr, nullptr, &stDst, &stTile, &conf,
+                            V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, nullptr, V2D_NO_DITHER);
+    ret |= V2D_EndJob(handle);
+    V2D_Close(context);
+    std::vector<uint8_t> c = ReadCapture(capture);
+
+    printf("tasks: c++ %zu, c %zu\n", cpp.size() / kTaskSize, c.size() / kTaskSize);
+    if (ret || c.empty() || c.size() % kTaskSize) {
+        printf("v2d cpp test job failed\n");
+        ret = -1;
+    } else if (cpp != c) {
+        for (size_t i = 0; i < c.size() && i < cpp.size(); i += kTaskSize) {
+            if (memcmp(&c[i], &cpp[i], kTaskSize)) {
+                printf("task %zu differs\n", i / kTaskSize);
+                break;
+            }
+        }
+        ret = -1;
+    }
+    printf("v2d cpp test %s\n", ret ? "failed!" : "successful!");
+    return ret;
+}
@@ -20,6 +20,10 @@
 #include <sys/cdefs.h>
 #include <sys/sysinfo.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <linux/sync_file.h>
 #include "v2d_api.h"
 #include "v2d_type.h"
 #include "dmabufheap/BufferAllocatorWrapper.h"
@@ -39,9 +43,26 @@ struct v2d_alloc_dma_buf {
 };
 BufferAllocator* bufferAllocator = NULL;
 
+/* sw_sync timeline, stands in for an upstream producer such as a decoder */
+#define SW_SYNC_FILE "/sys/kernel/debug/sync/sw_sync"
+struct sw_sync_create_fence_data {
+	uint32_t value;
+	char name[32];
+	int32_t fence;
+};
+#define SW_SYNC_IOC_CREATE_FENCE _IOWR('W', 0, struct sw_sync_create_fence_data)
+#define SW_SYNC_IOC_INC          _IOW('W', 1, uint32_t)
+
 #define ALIGN_UP(size, shift) (((size+shift-1)/shift)*shift)
 #define PAGESIZE (4096)
 
+static long long nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 static int write_sysfile(const char *file, const char *str)
 {
         int fd;
@@ -56,24 +77,14 @@ static int write_sysfile(const char *file, const char *str)
         return 0;
 }
 
-int readFile(char *pFileName, void* pBuff)
+int readFile(char *pFileName, void* pBuff, size_t size)
 {
-	int ret = 0;
-	unsigned int filesize = 0;
-
-	FILE* pImageFile = fopen(pFileName, "rb");
-	if (!pImageFile)
+	if (V2D_LoadFile(pFileName, pBuff, size, NULL))
 	{
-		printf("Error in read %s,file not found\n", pFileName);
+		printf("Error in read %s\n", pFileName);
 		return -1;
 	}
-	fseek(pImageFile, 0, SEEK_END);
-	filesize = ftell(pImageFile);
-	fseek(pImageFile, 0, SEEK_SET);
-	size_t elementsRead = fread(pBuff, filesize, 1, pImageFile);
-	fclose(pImageFile);
-
-	return ret;
+	return 0;
 }
 
 int writeFile(char *pFileName, int size, void* pBuff)
@@ -105,6 +116,25 @@ void destroyAllocator()
 		bufferAllocator = NULL;
 	}
 }
+//a device context whose node is a memfd, the tasks it submits land in *pCapture
+static int v2d_capture_open(V2D_CONTEXT_HANDLE *phContext, int *pCapture)
+{
+	char node[64];
+	int ret;
+
+	*pCapture = syscall(__NR_memfd_create, "v2d-capture", 0);
+	if (*pCapture < 0) {
+		return -1;
+	}
+	snprintf(node, sizeof(node), "/proc/self/fd/%d", *pCapture);
+	setenv("V2D_DEV_NAME", node, 1);
+	ret = V2D_OpenBackend(V2D_BACKEND_DEVICE, phContext);
+	unsetenv("V2D_DEV_NAME");
+	if (ret) {
+		close(*pCapture);
+	}
+	return ret;
+}
 
 int v2d_adv(void)
 {
@@ -142,8 +172,8 @@ int v2d_adv(void)
 	if (pDst == MAP_FAILED) {
 		V2DLOGD(" v2d mmap dst failed\n");
 	}
-	ret = readFile(pFbcCase0Layer0H, pLayer0);	
-	ret = readFile(pFbcCase0Layer0B,  pLayer0+4800);
+	ret = readFile(pFbcCase0Layer0H, pLayer0, mapsize0);	
+	ret = readFile(pFbcCase0Layer0B,  pLayer0+4800, mapsize0-4800);
 	memset(pDst, 0,  ALIGN_UP(out.size, PAGESIZE));	
 	//config layer0
 	enBackRotate  = V2D_ROT_MIRROR;
@@ -222,10 +252,10 @@ int v2d_adv(void)
 		V2DLOGD("malloc fail\n");
 	}
 	if (stDst.fbc_enable) {
-		readFile(pFbcCase0Header, tmp);
-		readFile(pFbcCase0Body, tmp+4800);
+		readFile(pFbcCase0Header, tmp, out.size);
+		readFile(pFbcCase0Body, tmp+4800, out.size-4800);
 	} else {
-		readFile(pFbcCase0Raw, tmp);
+		readFile(pFbcCase0Raw, tmp, out.size);
 	}
 	real = (unsigned int *)tmp;
 	expect = (unsigned int *)pDst;
@@ -280,7 +310,7 @@ int v2d_SimpleCase(void)
 	if (pDst == MAP_FAILED) {
 		V2DLOGD(" v2d mmap dst failed\n");
 	}
-	ret = readFile(pRawData, pLayer0);
+	ret = readFile(pRawData, pLayer0, mapsize0);
 	memset(pDst, 0,  ALIGN_UP(out.size, PAGESIZE));	
 	//config layer0
 	enBackRotate  = V2D_ROT_0;
@@ -360,10 +390,10 @@ int v2d_SimpleCase(void)
 		V2DLOGD("malloc fail\n");
 	}
 	if (stDst.fbc_enable) {
-		readFile(pFbcCase0Header, tmp);
-		readFile(pFbcCase0Body, tmp+4800);
+		readFile(pFbcCase0Header, tmp, out.size);
+		readFile(pFbcCase0Body, tmp+4800, out.size-4800);
 	} else {
-		readFile(pRawData, tmp);
+		readFile(pRawData, tmp, out.size);
 	}
 	real = (unsigned int *)tmp;
 	expect = (unsigned int *)pDst;
@@ -564,6 +594,3006 @@ fini:
 	V2DLOGD("v2d blit test %s\n", ret ? "v2d blit test case failed!":"v2d blit test case successful!");
 	return ret;
 }
+//async end job test
+static void v2d_async_callback(int32_t result, void *pUserData)
+{
+	int *pDone = (int *)pUserData;
+	*pDone = result ? -1 : 1;
+}
+int v2d_async_test(void)
+{
+	int ret = 0;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stDst;
+	V2D_AREA_S stDstRect;
+	V2D_FILLCOLOR_S stFillColor;
+	struct v2d_alloc_dma_buf out;
+	struct pollfd stPoll;
+	void *pDst;
+	unsigned int mapsize;
+	bool cpu_access_need = true;
+	int fence = -1;
+	volatile int done = 0;
+	int i;
+
+	V2DLOGD("v2d async test start\n");
+	out.size   = 320*240*4;
+	mapsize   = ALIGN_UP(out.size, PAGESIZE);
+	createAllocator();
+	out.fd = DmabufHeapAllocSystem(bufferAllocator, cpu_access_need, mapsize, 0, 0);
+	pDst = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, out.fd, 0);
+	if (pDst == MAP_FAILED) {
+		V2DLOGD(" v2d mmap dst failed\n");
+	}
+	memset(pDst, 0x80,  mapsize);
+	stFillColor.format = V2D_COLOR_FORMAT_RGBA8888;
+	stFillColor.colorvalue  = 0xff0000ff;
+	memset(&stDst, 0, sizeof(V2D_SURFACE_S));
+	stDst.fbc_enable = 0;
+	stDst.fd         = out.fd;
+	stDst.offset     = 0x00;
+	stDst.w          = 320;
+	stDst.h          = 240;
+	stDst.stride     = 320*4;
+	stDst.format     = V2D_COLOR_FORMAT_RGBA8888;
+	stDstRect.x      = 0;
+	stDstRect.y      = 0;
+	stDstRect.w      = 320;
+	stDstRect.h      = 240;
+
+	//fence form
+	ret = V2D_BeginJob(&hHandle);
+	ret |= V2D_AddFillTask(hHandle, &stDst, &stDstRect, &stFillColor);
+	ret |= V2D_EndJobAsync(hHandle, &fence);
+	if (ret) {
+		V2DLOGD("V2D_EndJobAsync err\n");
+		goto fini;
+	}
+	if (fence >= 0) {
+		stPoll.fd = fence;
+		stPoll.events = POLLIN;
+		if (poll(&stPoll, 1, 3000) != 1) {
+			V2DLOGD("async fence timeout\n");
+			ret = 1;
+		}
+		close(fence);
+	}
+	//callback form
+	stFillColor.colorvalue  = 0xffff0000;
+	ret |= V2D_BeginJob(&hHandle);
+	ret |= V2D_AddFillTask(hHandle, &stDst, &stDstRect, &stFillColor);
+	ret |= V2D_EndJobCallback(hHandle, v2d_async_callback, (void *)&done);
+	for (i=0; i<300 && !done && !ret; i++) {
+		usleep(10000);
+	}
+	if (done != 1) {
+		V2DLOGD("async callback not fired\n");
+		ret = 1;
+	}
+fini:
+	munmap(pDst, mapsize);
+	destroyAllocator();
+	V2DLOGD("v2d async test %s\n", ret ? "v2d async test case failed!":"v2d async test case successful!");
+	return ret;
+}
+//acquire fence test
+int v2d_fence_test(void)
+{
+	int ret = 0;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stDst;
+	V2D_AREA_S stDstRect;
+	V2D_FILLCOLOR_S stFillColor;
+	struct v2d_alloc_dma_buf out;
+	struct sw_sync_create_fence_data stFence;
+	struct pollfd stPoll;
+	void *pDst;
+	unsigned int mapsize;
+	bool cpu_access_need = true;
+	int timeline, fence = -1;
+	uint32_t inc = 1;
+	unsigned int *real;
+
+	V2DLOGD("v2d fence test start\n");
+	timeline = open(SW_SYNC_FILE, O_RDWR|O_CLOEXEC);
+	if (timeline < 0) {
+		V2DLOGD("failed to open %s\n", SW_SYNC_FILE);
+		return -1;
+	}
+	memset(&stFence, 0, sizeof(stFence));
+	stFence.value = 1;
+	strcpy(stFence.name, "v2d_producer");
+	if (ioctl(timeline, SW_SYNC_IOC_CREATE_FENCE, &stFence) < 0) {
+		V2DLOGD("failed to create sw_sync fence\n");
+		close(timeline);
+		return -1;
+	}
+	out.size   = 320*240*4;
+	mapsize   = ALIGN_UP(out.size, PAGESIZE);
+	createAllocator();
+	out.fd = DmabufHeapAllocSystem(bufferAllocator, cpu_access_need, mapsize, 0, 0);
+	pDst = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, out.fd, 0);
+	if (pDst == MAP_FAILED) {
+		V2DLOGD(" v2d mmap dst failed\n");
+	}
+	memset(pDst, 0x80,  mapsize);
+	stFillColor.format = V2D_COLOR_FORMAT_RGBA8888;
+	stFillColor.colorvalue  = 0xffffffff;
+	memset(&stDst, 0, sizeof(V2D_SURFACE_S));
+	stDst.fbc_enable = 0;
+	stDst.fd         = out.fd;
+	stDst.offset     = 0x00;
+	stDst.w          = 320;
+	stDst.h          = 240;
+	stDst.stride     = 320*4;
+	stDst.format     = V2D_COLOR_FORMAT_RGBA8888;
+	stDstRect.x      = 0;
+	stDstRect.y      = 0;
+	stDstRect.w      = 320;
+	stDstRect.h      = 240;
+
+	ret = V2D_BeginJob(&hHandle);
+	ret |= V2D_AddFillTask(hHandle, &stDst, &stDstRect, &stFillColor);
+	ret |= V2D_AddAcquireFence(hHandle, stFence.fence);
+	ret |= V2D_EndJobAsync(hHandle, &fence);
+	if (ret || fence < 0) {
+		V2DLOGD("V2D_EndJobAsync err\n");
+		ret = 1;
+		goto fini;
+	}
+	//the job must not run before the producer signals
+	stPoll.fd = fence;
+	stPoll.events = POLLIN;
+	if (poll(&stPoll, 1, 100) != 0) {
+		V2DLOGD("job finished before its acquire fence\n");
+		ret = 1;
+	}
+	ioctl(timeline, SW_SYNC_IOC_INC, &inc);
+	if (poll(&stPoll, 1, 3000) != 1) {
+		V2DLOGD("job did not finish after its acquire fence\n");
+		ret = 1;
+	}
+	real = (unsigned int *)pDst;
+	if (*real != 0xffffffff) {
+		V2DLOGD("exp:0x%08x,real:0x%08x\n", 0xffffffff, *real);
+		ret = 1;
+	}
+fini:
+	if (fence >= 0) {
+		close(fence);
+	}
+	close(timeline);
+	munmap(pDst, mapsize);
+	destroyAllocator();
+	V2DLOGD("v2d fence test %s\n", ret ? "v2d fence test case failed!":"v2d fence test case successful!");
+	return ret;
+}
+//multi-thread submission stress test, runs against a stand-in device node
+struct v2d_stress_arg {
+	V2D_CONTEXT_HANDLE hContext;
+	int jobs;
+	int failures;
+	volatile int callbacks;
+};
+static void v2d_stress_callback(int32_t result, void *pUserData)
+{
+	struct v2d_stress_arg *pArg = (struct v2d_stress_arg *)pUserData;
+	if (result) {
+		__atomic_add_fetch(&pArg->failures, 1, __ATOMIC_RELAXED);
+	}
+	__atomic_add_fetch(&pArg->callbacks, 1, __ATOMIC_RELAXED);
+}
+static void *v2d_stress_thread(void *arg)
+{
+	struct v2d_stress_arg *pArg = (struct v2d_stress_arg *)arg;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stDst;
+	V2D_AREA_S stDstRect;
+	V2D_FILLCOLOR_S stFillColor;
+	unsigned int seed = (unsigned int)(uintptr_t)arg;
+	int i, j, tasks, fence, ret, queued = 0;
+
+	memset(&stDst, 0, sizeof(V2D_SURFACE_S));
+	stDst.w      = 320;
+	stDst.h      = 240;
+	stDst.stride = 320*4;
+	stDst.format = V2D_COLOR_FORMAT_RGBA8888;
+	stDstRect.x  = 0;
+	stDstRect.y  = 0;
+	stDstRect.w  = 16;
+	stDstRect.h  = 16;
+	stFillColor.format = V2D_COLOR_FORMAT_RGBA8888;
+	for (j=0; j<pArg->jobs; j++) {
+		if (pArg->hContext) {
+			ret = V2D_BeginContextJob(pArg->hContext, &hHandle);
+		} else {
+			ret = V2D_BeginJob(&hHandle);
+		}
+		tasks = 1 + rand_r(&seed) % 160;
+		for (i=0; i<tasks && !ret; i++) {
+			stFillColor.colorvalue = rand_r(&seed);
+			ret = V2D_AddFillTask(hHandle, &stDst, &stDstRect, &stFillColor);
+		}
+		switch (j % 3) {
+		case 0:
+			ret |= V2D_EndJob(hHandle);
+			break;
+		case 1:
+			ret |= V2D_EndJobAsync(hHandle, &fence);
+			if (fence >= 0) {
+				close(fence);
+			}
+			break;
+		default:
+			ret |= V2D_EndJobCallback(hHandle, v2d_stress_callback, pArg);
+			queued++;
+			break;
+		}
+		if (ret) {
+			__atomic_add_fetch(&pArg->failures, 1, __ATOMIC_RELAXED);
+		}
+	}
+	for (i=0; i<300 && pArg->callbacks < queued; i++) {
+		usleep(10000);
+	}
+	if (pArg->callbacks != queued) {
+		__atomic_add_fetch(&pArg->failures, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+static int v2d_stress_chunks(void);
+int v2d_stress_test(char *pNode, int threads, int jobs)
+{
+	int ret = 0;
+	int i;
+	pthread_t *pTid;
+	struct v2d_stress_arg *pArgs;
+	long long start;
+
+	V2DLOGD("v2d stress test start, node:%s threads:%d jobs:%d\n", pNode, threads, jobs);
+	if (v2d_stress_chunks()) {
+		V2DLOGD("v2d stress test v2d stress test case failed!\n");
+		return -1;
+	}
+	setenv("V2D_DEV_NAME", pNode, 1);
+	pTid = calloc(threads, sizeof(pthread_t));
+	pArgs = calloc(threads, sizeof(struct v2d_stress_arg));
+	if (!pTid || !pArgs) {
+		free(pTid);
+		free(pArgs);
+		return -1;
+	}
+	start = nowNs();
+	for (i=0; i<threads; i++) {
+		//odd threads get their own context, even ones race on the default one
+		if ((i & 1) && V2D_Open(&pArgs[i].hContext)) {
+			pArgs[i].failures++;
+		}
+		pArgs[i].jobs = jobs;
+		pthread_create(&pTid[i], NULL, v2d_stress_thread, &pArgs[i]);
+	}
+	for (i=0; i<threads; i++) {
+		pthread_join(pTid[i], NULL);
+		if (pArgs[i].hContext) {
+			V2D_Close(pArgs[i].hContext);
+		}
+		ret |= pArgs[i].failures;
+	}
+	V2DLOGD("%d jobs in %lld us\n", threads * jobs, (nowNs() - start) / 1000);
+	free(pTid);
+	free(pArgs);
+	V2DLOGD("v2d stress test %s\n", ret ? "v2d stress test case failed!":"v2d stress test case successful!");
+	return ret;
+}
+//cpu backend buffers come from the dma heap, or from a memfd where there is none
+static int v2d_cpu_buffer(unsigned int size, void **ppAddr)
+{
+	int fd;
+
+	createAllocator();
+	fd = DmabufHeapAllocSystem(bufferAllocator, true, size, 0, 0);
+	if (fd < 0) {
+		fd = syscall(__NR_memfd_create, "v2d", 0);
+		if (fd >= 0 && ftruncate(fd, size)) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	if (fd < 0) {
+		return -1;
+	}
+	*ppAddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (*ppAddr == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+//whether this process still maps the file with inode ino
+static int v2d_mapped(ino_t ino)
+{
+	char line[512];
+	unsigned long node;
+	int found = 0;
+	FILE *fp = fopen("/proc/self/maps", "r");
+
+	if (!fp) {
+		return 0;
+	}
+	while (!found && fgets(line, sizeof(line), fp)) {
+		found = sscanf(line, "%*s %*s %*s %*s %lu", &node) == 1 && node == (unsigned long)ino;
+	}
+	fclose(fp);
+	return found;
+}
+//adds the fills first..first+count of a job of five chunks, task i fills cell i % 150 of a 20x15 grid of 16x16 cells
+static int v2d_stress_fills(V2D_HANDLE hHandle, V2D_SURFACE_S *pDst, int first, int count)
+{
+	V2D_AREA_S stRect;
+	V2D_FILLCOLOR_S stFillColor;
+	int i, ret = 0;
+
+	stFillColor.format = V2D_COLOR_FORMAT_RGBA8888;
+	stRect.w = 16;
+	stRect.h = 16;
+	for (i=first; i<first + count && !ret; i++) {
+		stRect.x = (i % 150) % 20 * 16;
+		stRect.y = (i % 150) / 20 * 16;
+		stFillColor.colorvalue = 0xff000000u | i;
+		ret = V2D_AddFillTask(hHandle, pDst, &stRect, &stFillColor);
+	}
+	return ret;
+}
+//a 300 task job goes down like five hand split jobs of at most 64 tasks, and draws in task order across its chunks
+static int v2d_stress_chunks(void)
+{
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stDst;
+	unsigned int size = 320*240*4, streamSize;
+	unsigned char *pDst, *pWhole, *pSplit, *p;
+	int capture[2] = {-1, -1}, c, i, x, y, task, ret = 0;
+
+	memset(&stDst, 0, sizeof(V2D_SURFACE_S));
+	stDst.fd     = v2d_cpu_buffer(size, (void **)&pDst);
+	stDst.w      = 320;
+	stDst.h      = 240;
+	stDst.stride = 320*4;
+	stDst.format = V2D_COLOR_FORMAT_RGBA8888;
+	if (stDst.fd < 0) {
+		return -1;
+	}
+	for (c=0; c<2 && !ret; c++) {
+		if (v2d_capture_open(&hContext, &capture[c])) {
+			capture[c] = -1;
+			ret = -1;
+			break;
+		}
+		for (i=0; i<300 && !ret; i+=(c ? 64 : 300)) {
+			ret |= V2D_BeginContextJob(hContext, &hHandle);
+			ret |= v2d_stress_fills(hHandle, &stDst, i, c ? ((300 - i < 64) ? 300 - i : 64) : 300);
+			ret |= V2D_EndJob(hHandle);
+		}
+		V2D_Close(hContext);
+	}
+	streamSize = (capture[1] >= 0) ? lseek(capture[1], 0, SEEK_END) : 0;
+	pWhole = malloc(streamSize);
+	pSplit = malloc(streamSize);
+	if (!ret && (!streamSize || !pWhole || !pSplit || lseek(capture[0], 0, SEEK_END) != (off_t)streamSize ||
+				 pread(capture[0], pWhole, streamSize, 0) != (ssize_t)streamSize ||
+				 pread(capture[1], pSplit, streamSize, 0) != (ssize_t)streamSize || memcmp(pWhole, pSplit, streamSize))) {
+		V2DLOGD("a 300 task job does not write what five jobs of its chunks write\n");
+		ret = -1;
+	}
+	free(pWhole);
+	free(pSplit);
+	for (c=0; c<2; c++) {
+		if (capture[c] >= 0) {
+			close(capture[c]);
+		}
+	}
+
+	//the cpu backend runs the same job, the second fill of a cell lands in a later chunk than the first
+	memset(pDst, 0, size);
+	if (!ret) {
+		ret = V2D_OpenBackend(V2D_BACKEND_CPU, &hContext);
+		if (!ret) {
+			ret |= V2D_BeginContextJob(hContext, &hHandle);
+			ret |= v2d_stress_fills(hHandle, &stDst, 0, 300);
+			ret |= V2D_EndJob(hHandle);
+			V2D_Close(hContext);
+		}
+	}
+	for (y=0; y<240 && !ret; y++) {
+		for (x=0; x<320; x++) {
+			p = pDst + y*320*4 + x*4;
+			task = y / 16 * 20 + x / 16 + 150;
+			if ((task < 300) ? (p[0] != (task & 0xff) || p[1] != (task >> 8) || p[2] || p[3] != 0xff) :
+							   (p[0] || p[1] || p[2] || p[3])) {
+				V2DLOGD("300 task job mismatch at %d,%d\n", x, y);
+				ret = -1;
+				break;
+			}
+		}
+	}
+	munmap(pDst, size);
+	close(stDst.fd);
+	destroyAllocator();
+	return ret;
+}
+//counts the buffers a context reports, the user data is the fd it expects written
+struct v2d_access_arg {
+	int fd;
+	int written;
+	int others;
+};
+static void v2d_access_hook(const V2D_BUFFER_ACCESS_S *pstAccess, uint32_t count, void *pUserData)
+{
+	struct v2d_access_arg *pArg = (struct v2d_access_arg *)pUserData;
+	uint32_t i;
+
+	for (i=0; i<count; i++) {
+		if (pstAccess[i].fd == pArg->fd && pstAccess[i].write) {
+			pArg->written++;
+		} else {
+			pArg->others++;
+		}
+	}
+}
+//cpu reference backend test, runs without the v2d block
+int v2d_cpu_test(void)
+{
+	int ret = 0;
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stSrc, stTmp, stDst, stYuv, stYuvDst, stFbc, stRgb;
+	V2D_AREA_S stRect, stFillRect, stSrcRect, stDstRect, stYuvRect;
+	V2D_FILLCOLOR_S stFillColor;
+	V2D_BLEND_CONF_S stBlendConf;
+	unsigned int size = 320*240*4, yuvSize = ALIGN_UP(320*240*3/2, PAGESIZE), i;
+	unsigned char *pSrc, *pTmp, *pDst, *pYuv, *pYuvDst, *p;
+	int srcFd, tmpFd, dstFd, yuvFd, yuvDstFd;
+	int x, y, in, err, maxErr = 0;
+	struct stat st;
+	V2D_SURFACE_S stMask;
+	V2D_AREA_S stSmall = {0, 0, 64, 64};
+	V2D_CONTEXT_HANDLE hOther;
+	struct v2d_access_arg stAccess = {0, 0, 0}, stOther = {0, 0, 0};
+	//a 0x41 grey into RGB565 with either dither, 8 bit input has too few fraction bits for the 8x8 matrix to differ
+	static const unsigned short au16Dither[4][4] = {
+		{0x4208, 0x4208, 0x4208, 0x4208},
+		{0x4228, 0x4208, 0x4a29, 0x4208},
+		{0x4208, 0x4208, 0x4208, 0x4208},
+		{0x4a29, 0x4208, 0x4228, 0x4208},
+	};
+	//per layer0/layer1 byte: ROP2 colour XOR and alpha AND, the mask as value with layer1 alpha 0xcc * 0x80
+	static const unsigned char au8Layer0[4] = {0x3c, 0x5a, 0xff, 0xf0}, au8Layer1[4] = {0x0f, 0xf0, 0x33, 0xcc};
+	static const unsigned char au8Rop2[4] = {0x33, 0xaa, 0xcc, 0xc0}, au8MaskValue[4] = {0x2a, 0x96, 0xad, 0x66};
+	int d;
+
+	V2DLOGD("v2d cpu test start\n");
+	srcFd    = v2d_cpu_buffer(size, (void **)&pSrc);
+	tmpFd    = v2d_cpu_buffer(size, (void **)&pTmp);
+	dstFd    = v2d_cpu_buffer(size, (void **)&pDst);
+	yuvFd    = v2d_cpu_buffer(yuvSize, (void **)&pYuv);
+	yuvDstFd = v2d_cpu_buffer(yuvSize, (void **)&pYuvDst);
+	if (srcFd < 0 || tmpFd < 0 || dstFd < 0 || yuvFd < 0 || yuvDstFd < 0) {
+		V2DLOGD("v2d cpu test buffer alloc failed\n");
+		return -1;
+	}
+	ret = V2D_OpenBackend(V2D_BACKEND_CPU, &hContext);
+	if (ret) {
+		V2DLOGD("V2D_OpenBackend err\n");
+		return ret;
+	}
+	for (i=0; i<size; i++) {
+		pSrc[i] = (i * 7) ^ (i >> 9);
+	}
+	memset(pDst, 0x80, size);
+	memset(&stSrc, 0, sizeof(V2D_SURFACE_S));
+	stSrc.fd     = srcFd;
+	stSrc.w      = 320;
+	stSrc.h      = 240;
+	stSrc.stride = 320*4;
+	stSrc.format = V2D_COLOR_FORMAT_RGBA8888;
+	stTmp = stSrc;
+	stTmp.fd = tmpFd;
+	stDst = stSrc;
+	stDst.fd = dstFd;
+	stRect.x = 0;
+	stRect.y = 0;
+	stRect.w = 320;
+	stRect.h = 240;
+
+	//fill, then blit a window on top of it
+	stFillColor.format     = V2D_COLOR_FORMAT_RGBA8888;
+	stFillColor.colorvalue = 0x00ffcc66;
+	stFillRect.x = 32;
+	stFillRect.y = 32;
+	stFillRect.w = 210;
+	stFillRect.h = 180;
+	stSrcRect.x = 64;
+	stSrcRect.y = 48;
+	stSrcRect.w = 64;
+	stSrcRect.h = 64;
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= V2D_AddFillTask(hHandle, &stDst, &stFillRect, &stFillColor);
+	ret |= V2D_AddBitblitTask(hHandle, &stDst, &stSrcRect, &stSrc, &stSrcRect, V2D_CSC_MODE_BUTT);
+	ret |= V2D_EndJob(hHandle);
+	for (y=0; y<240 && !ret; y++) {
+		for (x=0; x<320; x++) {
+			p = pDst + y*320*4 + x*4;
+			in = x >= 32 && x < 242 && y >= 32 && y < 212;
+			if (x >= 64 && x < 128 && y >= 48 && y < 112) {
+				err = memcmp(p, pSrc + y*320*4 + x*4, 4);
+			} else if (in) {
+				err = p[0] != 0x66 || p[1] != 0xcc || p[2] != 0xff || p[3] != 0x00;
+			} else {
+				err = p[0] != 0x80 || p[1] != 0x80 || p[2] != 0x80 || p[3] != 0x80;
+			}
+			if (err) {
+				V2DLOGD("fill/blit mismatch at %d,%d\n", x, y);
+				ret = 1;
+				break;
+			}
+		}
+	}
+
+	//rotate a 64x32 window by 90 degrees into a 32x64 one
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	stSrcRect.x = 16;
+	stSrcRect.y = 16;
+	stSrcRect.w = 64;
+	stSrcRect.h = 32;
+	stDstRect.x = 0;
+	stDstRect.y = 0;
+	stDstRect.w = 32;
+	stDstRect.h = 64;
+	stBlendConf.blendlayer[0].blend_area = stDstRect;
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= V2D_AddBlendTask(hHandle, &stSrc, &stSrcRect, NULL, NULL, NULL, NULL, &stDst, &stDstRect, &stBlendConf,
+							V2D_ROT_0, V2D_ROT_90, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+	ret |= V2D_EndJob(hHandle);
+	for (y=0; y<64 && !ret; y++) {
+		for (x=0; x<32; x++) {
+			if (memcmp(pDst + y*320*4 + x*4, pSrc + (16 + 31 - x)*320*4 + (16 + y)*4, 4)) {
+				V2DLOGD("rotation mismatch at %d,%d\n", x, y);
+				ret = 1;
+				break;
+			}
+		}
+	}
+
+	//RGB -> BT601 narrow -> RGB, then blend the result over the source at half alpha
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	stBlendConf.blendlayer[0].blend_area = stRect;
+	stBlendConf.blendlayer[1].blend_area = stRect;
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= V2D_AddBlendTask(hHandle, &stSrc, &stRect, NULL, NULL, NULL, NULL, &stTmp, &stRect, &stBlendConf,
+							V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_RGB_2_BT601NARROW, NULL, V2D_NO_DITHER);
+	ret |= V2D_AddBlendTask(hHandle, &stTmp, &stRect, NULL, NULL, NULL, NULL, &stDst, &stRect, &stBlendConf,
+							V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BT601NARROW_2_RGB, NULL, V2D_NO_DITHER);
+	ret |= V2D_EndJob(hHandle);
+	for (i=0; i<size && !ret; i++) {
+		err = abs(pDst[i] - pSrc[i]);
+		maxErr = (i % 4 != 3 && err > maxErr) ? err : maxErr;
+	}
+	V2DLOGD("csc round trip max error %d\n", maxErr);
+	//narrow range keeps 219/224 levels of 256, so up to 2 steps are lost on the way back
+	if (maxErr > 2) {
+		ret = 1;
+	}
+	stBlendConf.blendlayer[1].blend_alpha_source = V2D_BLENDALPHA_SOURCE_GOLBAL;
+	stBlendConf.blendlayer[1].global_alpha = 0x80;
+	stBlendConf.blendlayer[1].stBlendFactor.srcColorFactor = V2D_BLEND_SRC_ALPHA;
+	stBlendConf.blendlayer[1].stBlendFactor.dstColorFactor = V2D_BLEND_ONE_MINUS_SRC_ALPHA;
+	memcpy(pTmp, pDst, size);
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= V2D_AddBlendTask(hHandle, &stSrc, &stRect, &stTmp, &stRect, NULL, NULL, &stDst, &stRect, &stBlendConf,
+							V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+	ret |= V2D_EndJob(hHandle);
+	for (i=0; i<size && !ret; i++) {
+		if (i % 4 != 3 && pDst[i] != (pTmp[i] * 0x80 + pSrc[i] * 0x7f + 127) / 255) {
+			V2DLOGD("blend mismatch at byte %u\n", i);
+			ret = 1;
+		}
+	}
+
+	//the golden NV12 frame has to come through a blit untouched
+	memset(&stYuv, 0, sizeof(V2D_SURFACE_S));
+	stYuv.fd     = yuvFd;
+	stYuv.offset = 320*240;
+	stYuv.w      = 320;
+	stYuv.h      = 240;
+	stYuv.stride = 320;
+	stYuv.format = V2D_COLOR_FORMAT_NV12;
+	stYuvDst = stYuv;
+	stYuvDst.fd = yuvDstFd;
+	stYuvRect = stRect;
+	if (!ret && readFile(pRawData, pYuv, yuvSize)) {
+		ret = 1;
+	}
+	if (!ret) {
+		ret |= V2D_BeginContextJob(hContext, &hHandle);
+		ret |= V2D_AddBitblitTask(hHandle, &stYuvDst, &stYuvRect, &stYuv, &stYuvRect, V2D_CSC_MODE_BUTT);
+		ret |= V2D_EndJob(hHandle);
+		if (!ret && memcmp(pYuv, pYuvDst, 320*240*3/2)) {
+			V2DLOGD("nv12 blit differs from %s\n", pRawData);
+			ret = 1;
+		}
+	}
+
+	//the blend case of --blend, fbc NV12 mirrored and converted to RGB888, against what the block wrote
+	memset(&stFbc, 0, sizeof(V2D_SURFACE_S));
+	stFbc.fbc_enable = 1;
+	stFbc.w          = 320;
+	stFbc.h          = 240;
+	stFbc.stride     = 320;
+	stFbc.format     = V2D_COLOR_FORMAT_NV12;
+	stFbc.fbcDecInfo.fd           = tmpFd;
+	stFbc.fbcDecInfo.bboxRight    = 319;
+	stFbc.fbcDecInfo.bboxBottom   = 239;
+	stFbc.fbcDecInfo.enFbcdecFmt  = FBC_DECODER_FORMAT_NV12;
+	stFbc.fbcDecInfo.enFbcdecMode = FBC_DECODER_MODE_SCAN_LINE;
+	stRgb = stDst;
+	stRgb.stride = 320*3;
+	stRgb.format = V2D_COLOR_FORMAT_RGB888;
+	memset(pTmp, 0, size);
+	if (!ret && (readFile(pFbcCase0Layer0H, pTmp, size) || readFile(pFbcCase0Layer0B, pTmp + 4800, size - 4800) ||
+	             readFile(pFbcCase0Raw, pSrc, 320*240*3))) {
+		ret = 1;
+	}
+	if (!ret) {
+		memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+		stBlendConf.blendlayer[0].blend_area = stRect;
+		memset(pDst, 0, size);
+		ret |= V2D_BeginContextJob(hContext, &hHandle);
+		ret |= V2D_AddBlendTask(hHandle, &stFbc, &stRect, NULL, NULL, NULL, NULL, &stRgb, &stRect, &stBlendConf,
+								V2D_ROT_0, V2D_ROT_MIRROR, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BT601NARROW_2_RGB, NULL, V2D_NO_DITHER);
+		ret |= V2D_EndJob(hHandle);
+		if (!ret && memcmp(pDst, pSrc, 320*240*3)) {
+			V2DLOGD("fbc nv12 blend differs from %s\n", pFbcCase0Raw);
+			ret = 1;
+		}
+	}
+
+	//ROP2 of two layers, then layer1 gated by a mask and scaled by it, on a 64x64 corner
+	for (i=0; i<size; i++) {
+		pSrc[i] = au8Layer0[i % 4];
+		pTmp[i] = au8Layer1[i % 4];
+	}
+	memset(&stMask, 0, sizeof(V2D_SURFACE_S));
+	stMask.fd     = yuvDstFd;
+	stMask.w      = 64;
+	stMask.h      = 64;
+	stMask.stride = 64*4;
+	stMask.format = V2D_COLOR_FORMAT_RGBA8888;
+	for (d=0; d<3 && !ret; d++) {
+		memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+		stBlendConf.blendlayer[0].blend_area = stSmall;
+		stBlendConf.blendlayer[1].blend_area = stSmall;
+		stBlendConf.blend_mask_area = stSmall;
+		if (d == 0) {
+			stBlendConf.blend_cmd = V2D_BLENDCMD_ROP2;
+			stBlendConf.blendlayer[1].stRop2Code.colorRop2Code = V2D_ROP2_XORPEN;
+			stBlendConf.blendlayer[1].stRop2Code.alphaRop2Code = V2D_ROP2_MASKPEN;
+		} else if (d == 1) {
+			//layer1 only where the mask alpha is not 0, the right half
+			stBlendConf.mask_cmd = V2D_MASKCMD_NORMAL;
+			stBlendConf.blendlayer[1].stBlendFactor.srcColorFactor = V2D_BLEND_ONE;
+			stBlendConf.blendlayer[1].stBlendFactor.srcAlphaFactor = V2D_BLEND_ONE;
+		} else {
+			stBlendConf.mask_cmd = V2D_MASKCMD_AS_VALUE;
+			stBlendConf.blendlayer[1].stBlendFactor.srcColorFactor = V2D_BLEND_SRC_ALPHA;
+			stBlendConf.blendlayer[1].stBlendFactor.dstColorFactor = V2D_BLEND_ONE_MINUS_SRC_ALPHA;
+			stBlendConf.blendlayer[1].stBlendFactor.srcAlphaFactor = V2D_BLEND_ONE;
+		}
+		for (y=0; y<64; y++) {
+			for (x=0; x<64; x++) {
+				memset(pYuvDst + (y*64 + x)*4, 0, 3);
+				pYuvDst[(y*64 + x)*4 + 3] = (d == 1) ? (x < 32 ? 0x00 : 0xff) : 0x80;
+			}
+		}
+		memset(pDst, 0, size);
+		ret |= V2D_BeginContextJob(hContext, &hHandle);
+		ret |= V2D_AddBlendTask(hHandle, &stSrc, &stSmall, &stTmp, &stSmall, d ? &stMask : NULL, d ? &stSmall : NULL,
+								&stDst, &stSmall, &stBlendConf, V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT,
+								NULL, V2D_NO_DITHER);
+		ret |= V2D_EndJob(hHandle);
+		for (y=0; y<240 && !ret; y++) {
+			for (x=0; x<320; x++) {
+				p = pDst + y*320*4 + x*4;
+				if (x >= 64 || y >= 64) {
+					err = p[0] || p[1] || p[2] || p[3];
+				} else if (d == 0) {
+					err = memcmp(p, au8Rop2, 4);
+				} else if (d == 1) {
+					err = memcmp(p, x < 32 ? au8Layer0 : au8Layer1, 4);
+				} else {
+					err = memcmp(p, au8MaskValue, 4);
+				}
+				if (err) {
+					V2DLOGD("%s mismatch at %d,%d\n", d ? "mask" : "rop2", x, y);
+					ret = 1;
+					break;
+				}
+			}
+		}
+	}
+
+	//ordered dither of a flat grey into RGB565
+	for (i=0; i<size; i+=4) {
+		pSrc[i] = pSrc[i + 1] = pSrc[i + 2] = 0x41;
+		pSrc[i + 3] = 0xff;
+	}
+	stRgb = stDst;
+	stRgb.stride = 320*2;
+	stRgb.format = V2D_COLOR_FORMAT_RGB565;
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	stBlendConf.blendlayer[0].blend_area = stRect;
+	for (d=V2D_DITHER_4X4; d<=V2D_DITHER_8X8 && !ret; d++) {
+		memset(pDst, 0, size);
+		ret |= V2D_BeginContextJob(hContext, &hHandle);
+		ret |= V2D_AddBlendTask(hHandle, &stSrc, &stRect, NULL, NULL, NULL, NULL, &stRgb, &stRect, &stBlendConf,
+								V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, (V2D_DITHER_E)d);
+		ret |= V2D_EndJob(hHandle);
+		for (y=0; y<240 && !ret; y++) {
+			for (x=0; x<320; x++) {
+				p = pDst + y*320*2 + x*2;
+				if ((p[0] | (p[1] << 8)) != au16Dither[y & 3][x & 3]) {
+					V2DLOGD("dither %d mismatch at %d,%d\n", d, x, y);
+					ret = 1;
+					break;
+				}
+			}
+		}
+	}
+
+	//the access hook belongs to one context, jobs of another do not reach it
+	stAccess.fd = dstFd;
+	stOther.fd = dstFd;
+	if (!ret) {
+		ret = V2D_OpenBackend(V2D_BACKEND_CPU, &hOther);
+		if (!ret) {
+			ret |= V2D_SetDeviceAccessHook(hContext, v2d_access_hook, &stAccess);
+			ret |= V2D_SetDeviceAccessHook(hOther, v2d_access_hook, &stOther);
+			ret |= V2D_SetDeviceAccessHook(hOther, NULL, NULL);
+			ret |= V2D_BeginContextJob(hOther, &hHandle);
+			ret |= V2D_AddFillTask(hHandle, &stDst, &stRect, &stFillColor);
+			ret |= V2D_EndJob(hHandle);
+			ret |= V2D_BeginContextJob(hContext, &hHandle);
+			ret |= V2D_AddFillTask(hHandle, &stDst, &stRect, &stFillColor);
+			ret |= V2D_EndJob(hHandle);
+			ret |= V2D_SetDeviceAccessHook(hContext, NULL, NULL);
+			V2D_Close(hOther);
+		}
+		if (ret || stAccess.written != 1 || stAccess.others || stOther.written || stOther.others) {
+			V2DLOGD("access hook saw %d/%d buffers, the other context %d/%d\n", stAccess.written, stAccess.others,
+					stOther.written, stOther.others);
+			ret = 1;
+		}
+	}
+
+	//the backend keeps the destination mapped, the next job has to let it go once its fd is closed
+	stTmp.fd = v2d_cpu_buffer(size, (void **)&p);
+	if (!ret && (stTmp.fd < 0 || fstat(stTmp.fd, &st))) {
+		ret = 1;
+	}
+	if (!ret) {
+		munmap(p, size);
+		ret |= V2D_BeginContextJob(hContext, &hHandle);
+		ret |= V2D_AddFillTask(hHandle, &stTmp, &stRect, &stFillColor);
+		ret |= V2D_EndJob(hHandle);
+		close(stTmp.fd);
+		ret |= V2D_BeginContextJob(hContext, &hHandle);
+		ret |= V2D_AddFillTask(hHandle, &stDst, &stRect, &stFillColor);
+		ret |= V2D_EndJob(hHandle);
+		if (!ret && v2d_mapped(st.st_ino)) {
+			V2DLOGD("cpu backend still maps a closed buffer\n");
+			ret = 1;
+		}
+	}
+
+	V2D_Close(hContext);
+	munmap(pSrc, size);
+	munmap(pTmp, size);
+	munmap(pDst, size);
+	munmap(pYuv, yuvSize);
+	munmap(pYuvDst, yuvSize);
+	close(srcFd);
+	close(tmpFd);
+	close(dstFd);
+	close(yuvFd);
+	close(yuvDstFd);
+	destroyAllocator();
+	V2DLOGD("v2d cpu test %s\n", ret ? "v2d cpu test case failed!":"v2d cpu test case successful!");
+	return ret;
+}
+//cpu backend scaling, a 1080p NV12 frame with an RGBA overlay blended into RGBA
+int v2d_bench_cpu(int maxThreads, int iters)
+{
+	int ret = 0;
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stYuv, stOverlay, stDst;
+	V2D_AREA_S stRect;
+	V2D_BLEND_CONF_S stBlendConf;
+	unsigned int w = 1920, h = 1080;
+	unsigned int yuvSize = ALIGN_UP(w*h*3/2, PAGESIZE), rgbSize = ALIGN_UP(w*h*4, PAGESIZE), n;
+	unsigned char *pYuv, *pOverlay, *pDst;
+	int yuvFd, overlayFd, dstFd, threads, i;
+	long long start, frameNs, baseNs = 0;
+	char acThreads[16];
+
+	V2DLOGD("v2d cpu bench start, %ux%u threads:1-%d iters:%d\n", w, h, maxThreads, iters);
+	yuvFd     = v2d_cpu_buffer(yuvSize, (void **)&pYuv);
+	overlayFd = v2d_cpu_buffer(rgbSize, (void **)&pOverlay);
+	dstFd     = v2d_cpu_buffer(rgbSize, (void **)&pDst);
+	if (yuvFd < 0 || overlayFd < 0 || dstFd < 0) {
+		V2DLOGD("v2d cpu bench buffer alloc failed\n");
+		return -1;
+	}
+	for (n=0; n<rgbSize; n++) {
+		pOverlay[n] = n * 13;
+	}
+	memset(pYuv, 0x60, yuvSize);
+	memset(&stYuv, 0, sizeof(V2D_SURFACE_S));
+	stYuv.fd     = yuvFd;
+	stYuv.offset = w*h;
+	stYuv.w      = w;
+	stYuv.h      = h;
+	stYuv.stride = w;
+	stYuv.format = V2D_COLOR_FORMAT_NV12;
+	stOverlay = stYuv;
+	stOverlay.fd     = overlayFd;
+	stOverlay.offset = 0;
+	stOverlay.stride = w*4;
+	stOverlay.format = V2D_COLOR_FORMAT_RGBA8888;
+	stDst = stOverlay;
+	stDst.fd = dstFd;
+	stRect.x = 0;
+	stRect.y = 0;
+	stRect.w = w;
+	stRect.h = h;
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	stBlendConf.blendlayer[0].blend_area = stRect;
+	stBlendConf.blendlayer[1].blend_area = stRect;
+	stBlendConf.blendlayer[1].stBlendFactor.srcColorFactor = V2D_BLEND_SRC_ALPHA;
+	stBlendConf.blendlayer[1].stBlendFactor.dstColorFactor = V2D_BLEND_ONE_MINUS_SRC_ALPHA;
+	stBlendConf.blendlayer[1].stBlendFactor.srcAlphaFactor = V2D_BLEND_ONE;
+	stBlendConf.blendlayer[1].stBlendFactor.dstAlphaFactor = V2D_BLEND_ONE_MINUS_SRC_ALPHA;
+
+	for (threads=1; threads<=maxThreads && !ret; threads++) {
+		snprintf(acThreads, sizeof(acThreads), "%d", threads);
+		setenv("V2D_CPU_THREADS", acThreads, 1);
+		ret = V2D_OpenBackend(V2D_BACKEND_CPU, &hContext);
+		//first frame warms up the pool and the page tables
+		for (i=-1; i<iters && !ret; i++) {
+			if (i == 0) {
+				start = nowNs();
+			}
+			ret |= V2D_BeginContextJob(hContext, &hHandle);
+			ret |= V2D_AddBlendTask(hHandle, &stYuv, &stRect, &stOverlay, &stRect, NULL, NULL, &stDst, &stRect, &stBlendConf,
+									V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BT601NARROW_2_RGB, NULL, V2D_NO_DITHER);
+			ret |= V2D_EndJob(hHandle);
+		}
+		frameNs = (nowNs() - start) / (iters > 0 ? iters : 1);
+		if (threads == 1) {
+			baseNs = frameNs;
+		}
+		V2DLOGD("threads %d: %lld us/frame, speedup %.2f\n", threads, frameNs / 1000, (double)baseNs / frameNs);
+		V2D_Close(hContext);
+	}
+	unsetenv("V2D_CPU_THREADS");
+	munmap(pYuv, yuvSize);
+	munmap(pOverlay, rgbSize);
+	munmap(pDst, rgbSize);
+	close(yuvFd);
+	close(overlayFd);
+	close(dstFd);
+	destroyAllocator();
+	V2DLOGD("v2d cpu bench %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//host colour conversion, dispatched kernels against the scalar reference
+static int v2d_bpp(V2D_COLOR_FORMAT_E format)
+{
+	switch (format) {
+	case V2D_COLOR_FORMAT_RGBA8888:
+		return 4;
+	case V2D_COLOR_FORMAT_RGB888:
+		return 3;
+	case V2D_COLOR_FORMAT_RGB565:
+		return 2;
+	default:
+		return 1;
+	}
+}
+static void v2d_image(V2D_IMAGE_S *pImage, void *pData, unsigned int w, unsigned int h, V2D_COLOR_FORMAT_E format)
+{
+	pImage->pData  = pData;
+	pImage->stride = ALIGN_UP(w, 2) * v2d_bpp(format);
+	pImage->pUv    = (char *)pData + pImage->stride * ALIGN_UP(h, 2);
+	pImage->w      = w;
+	pImage->h      = h;
+	pImage->format = format;
+}
+static double v2d_bench_csc_run(V2D_IMAGE_S *pSrc, V2D_IMAGE_S *pDst, V2D_CSC_MODE_E mode, int iters, const char *pIsa)
+{
+	long long start;
+	int i;
+
+	if (V2D_SetCpuIsa(pIsa)) {
+		return -1.0;
+	}
+	start = nowNs();
+	for (i=0; i<iters; i++) {
+		if (V2D_CscImage(pSrc, pDst, mode)) {
+			V2D_SetCpuIsa(NULL);
+			return -1.0;
+		}
+	}
+	V2D_SetCpuIsa(NULL);
+	return (double)pSrc->w * pSrc->h * iters * 1000.0 / (nowNs() - start);
+}
+//nv12 layer of the blend case decoded and mirrored like the block does it, the input of pFbcCase0Raw
+static int v2d_golden_nv12(V2D_IMAGE_S *pYuv, V2D_IMAGE_S *pMirror)
+{
+	size_t bufSize = 1 << 20;
+	unsigned char *pFbc;
+	FBC_DECODER_S stFbc;
+	int ret = 0;
+
+	pFbc = calloc(1, bufSize);
+	if (!pFbc) {
+		return -1;
+	}
+	memset(&stFbc, 0, sizeof(stFbc));
+	stFbc.bboxRight    = 319;
+	stFbc.bboxBottom   = 239;
+	stFbc.enFbcdecMode = FBC_DECODER_MODE_SCAN_LINE;
+	stFbc.enFbcdecFmt  = FBC_DECODER_FORMAT_NV12;
+	if (readFile(pFbcCase0Layer0H, pFbc, bufSize) || readFile(pFbcCase0Layer0B, pFbc + 4800, bufSize - 4800) ||
+	    V2D_FbcDecode(&stFbc, pFbc, bufSize, pYuv) || V2D_RotateImage(pYuv, pMirror, V2D_ROT_MIRROR)) {
+		ret = -1;
+	}
+	free(pFbc);
+	return ret;
+}
+//BT601 narrow to RGB888 of the blend case, bit exact against the block output on every kernel
+static int v2d_bench_csc_golden(const char **apKernel, int kernels)
+{
+	unsigned int size = 320 * 240 * 3, i;
+	unsigned char *pYuv, *pMirror, *pRaw, *pDst;
+	V2D_IMAGE_S stYuv, stMirror, stDst;
+	int ret = 0, k;
+
+	pYuv    = malloc(size);
+	pMirror = malloc(size);
+	pRaw    = malloc(size);
+	pDst    = malloc(size);
+	if (!pYuv || !pMirror || !pRaw || !pDst) {
+		V2DLOGD("malloc fail\n");
+		ret = -1;
+		goto out;
+	}
+	v2d_image(&stYuv, pYuv, 320, 240, V2D_COLOR_FORMAT_NV12);
+	v2d_image(&stMirror, pMirror, 320, 240, V2D_COLOR_FORMAT_NV12);
+	v2d_image(&stDst, pDst, 320, 240, V2D_COLOR_FORMAT_RGB888);
+	if (v2d_golden_nv12(&stYuv, &stMirror) || readFile(pFbcCase0Raw, pRaw, size)) {
+		V2DLOGD("no golden pair for the csc check\n");
+		ret = 1;
+		goto out;
+	}
+	for (k=-1; k<kernels && !ret; k++) {
+		memset(pDst, 0, size);
+		if (v2d_bench_csc_run(&stMirror, &stDst, V2D_CSC_MODE_BT601NARROW_2_RGB, 1, (k < 0) ? "scalar" : apKernel[k]) < 0) {
+			ret = 1;
+			break;
+		}
+		for (i=0; i<size && pDst[i] == pRaw[i]; i++);
+		if (i < size) {
+			V2DLOGD("bt601 narrow %s differs from %s at byte %u\n", (k < 0) ? "scalar" : apKernel[k], pFbcCase0Raw, i);
+			ret = 1;
+		}
+	}
+	if (!ret) {
+		V2DLOGD("bt601 narrow -> RGB888 bit exact against %s\n", pFbcCase0Raw);
+	}
+out:
+	free(pYuv);
+	free(pMirror);
+	free(pRaw);
+	free(pDst);
+	return ret;
+}
+int v2d_bench_csc(unsigned int w, unsigned int h, int iters)
+{
+	static const V2D_COLOR_FORMAT_E aYuv[] = {V2D_COLOR_FORMAT_NV12, V2D_COLOR_FORMAT_NV21};
+	static const V2D_COLOR_FORMAT_E aRgb[] = {V2D_COLOR_FORMAT_RGB888, V2D_COLOR_FORMAT_RGBA8888, V2D_COLOR_FORMAT_RGB565};
+	static const char *apName[V2D_COLOR_FORMAT_BUTT] = {
+		[V2D_COLOR_FORMAT_RGB888] = "RGB888", [V2D_COLOR_FORMAT_RGBA8888] = "RGBA8888",
+		[V2D_COLOR_FORMAT_RGB565] = "RGB565", [V2D_COLOR_FORMAT_NV12] = "NV12", [V2D_COLOR_FORMAT_NV21] = "NV21"};
+	int ret = 0;
+	V2D_IMAGE_S stSrc, stRef, stDst;
+	unsigned int size = ALIGN_UP(w, 2) * ALIGN_UP(h, 2) * 4, i;
+	unsigned char *pSrc, *pRef, *pDst;
+	int mode, s, d, k, yuvIn, yuvOut, srcNum, dstNum;
+	V2D_COLOR_FORMAT_E srcFormat, dstFormat;
+	double refRate, rate;
+	//every kernel besides the naive reference
+	const char *apKernel[] = {"generic"};
+	int kernels = sizeof(apKernel) / sizeof(apKernel[0]);
+
+	V2D_SetCpuIsa(NULL);
+	V2DLOGD("v2d csc bench start, %ux%u iters:%d\n", w, h, iters);
+	pSrc = malloc(size);
+	pRef = malloc(size);
+	pDst = malloc(size);
+	if (!pSrc || !pRef || !pDst) {
+		V2DLOGD("malloc fail\n");
+		return -1;
+	}
+	for (i=0; i<size; i++) {
+		pSrc[i] = (i * 2654435761u) >> 24;
+	}
+	for (mode=0; mode<V2D_CSC_MODE_BUTT && !ret; mode++) {
+		//RGB input for RGB_2_* modes, YUV input otherwise; output is YUV unless the mode ends in RGB or grey
+		yuvIn  = !(mode == 0 || mode == 2 || mode == 4 || mode == 6 || mode >= V2D_CSC_MODE_RGB_2_GREY);
+		yuvOut = !(mode == 1 || mode == 3 || mode == 5 || mode == 7 || mode >= V2D_CSC_MODE_RGB_2_GREY);
+		srcNum = yuvIn ? 2 : 3;
+		dstNum = yuvOut ? 2 : 3;
+		for (s=0; s<srcNum && !ret; s++) {
+			for (d=0; d<dstNum && !ret; d++) {
+				srcFormat = yuvIn ? aYuv[s] : aRgb[s];
+				dstFormat = yuvOut ? aYuv[d] : aRgb[d];
+				v2d_image(&stSrc, pSrc, w, h, srcFormat);
+				v2d_image(&stRef, pRef, w, h, dstFormat);
+				v2d_image(&stDst, pDst, w, h, dstFormat);
+				memset(pRef, 0, size);
+				refRate = v2d_bench_csc_run(&stSrc, &stRef, mode, 1, "scalar");
+				for (k=0; k<kernels && !ret; k++) {
+					memset(pDst, 0, size);
+					rate = v2d_bench_csc_run(&stSrc, &stDst, mode, iters, apKernel[k]);
+					if (refRate < 0 || rate < 0 || memcmp(pRef, pDst, size)) {
+						V2DLOGD("mode %d %s->%s %s differs from the scalar reference\n", mode, apName[srcFormat],
+								apName[dstFormat], apKernel[k]);
+						ret = 1;
+						break;
+					}
+					V2DLOGD("mode %2d %-8s -> %-8s scalar %7.1f MPix/s, %-7s %7.1f MPix/s\n", mode,
+							apName[srcFormat], apName[dstFormat], refRate, apKernel[k], rate);
+				}
+			}
+		}
+	}
+	if (!ret) {
+		ret = v2d_bench_csc_golden(apKernel, kernels);
+	}
+	free(pSrc);
+	free(pRef);
+	free(pDst);
+	V2DLOGD("v2d csc bench %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//host rotation, tiled kernels against the naive per pixel loop
+static int v2d_image_cmp(V2D_IMAGE_S *pA, V2D_IMAGE_S *pB)
+{
+	unsigned int y;
+
+	for (y=0; y<pA->h; y++) {
+		if (memcmp((char *)pA->pData + y * pA->stride, (char *)pB->pData + y * pB->stride, pA->w * v2d_bpp(pA->format))) {
+			return 1;
+		}
+	}
+	for (y=0; pA->format == V2D_COLOR_FORMAT_NV12 && y<(pA->h + 1u) / 2; y++) {
+		if (memcmp((char *)pA->pUv + y * pA->stride, (char *)pB->pUv + y * pB->stride, ALIGN_UP(pA->w, 2))) {
+			return 1;
+		}
+	}
+	return 0;
+}
+static double v2d_bench_rotate_run(V2D_IMAGE_S *pSrc, V2D_IMAGE_S *pDst, V2D_ROTATE_ANGLE_E rt, int iters, const char *pIsa)
+{
+	long long start;
+	int i;
+
+	if (V2D_SetCpuIsa(pIsa)) {
+		return -1.0;
+	}
+	start = nowNs();
+	for (i=0; i<iters; i++) {
+		if (V2D_RotateImage(pSrc, pDst, rt)) {
+			V2D_SetCpuIsa(NULL);
+			return -1.0;
+		}
+	}
+	V2D_SetCpuIsa(NULL);
+	return (double)pSrc->w * pSrc->h * iters * 1000.0 / (nowNs() - start);
+}
+int v2d_bench_rotate(unsigned int w, unsigned int h, int iters)
+{
+	static const V2D_COLOR_FORMAT_E aFormat[] = {V2D_COLOR_FORMAT_RGB888, V2D_COLOR_FORMAT_RGBA8888,
+		V2D_COLOR_FORMAT_RGB565, V2D_COLOR_FORMAT_NV12};
+	static const char *apFormat[] = {"RGB888", "RGBA8888", "RGB565", "NV12"};
+	static const char *apAngle[] = {"0", "90", "180", "270", "mirror", "flip"};
+	int ret = 0;
+	V2D_IMAGE_S stSrc, stRef, stDst, stInRef;
+	unsigned int size = ALIGN_UP(w, 2) * ALIGN_UP(h, 2) * 4, n = (w < h) ? w : h, i;
+	unsigned char *pSrc, *pRef, *pDst, *pInRef;
+	int f, rt, sw, k;
+	double naive, rate;
+	//every kernel besides the naive reference
+	const char *apKernel[] = {"generic"};
+	int kernels = sizeof(apKernel) / sizeof(apKernel[0]);
+
+	V2DLOGD("v2d rotate bench start, %ux%u iters:%d\n", w, h, iters);
+	V2D_SetCpuIsa(NULL);
+	pSrc = malloc(size);
+	pRef = malloc(size);
+	pDst = malloc(size);
+	pInRef = malloc(size);
+	if (!pSrc || !pRef || !pDst || !pInRef) {
+		V2DLOGD("malloc fail\n");
+		return -1;
+	}
+	for (i=0; i<size; i++) {
+		pSrc[i] = (i * 2654435761u) >> 24;
+	}
+	for (f=0; f<(int)(sizeof(aFormat)/sizeof(aFormat[0])) && !ret; f++) {
+		for (rt=V2D_ROT_90; rt<=V2D_ROT_FLIP && !ret; rt++) {
+			sw = (rt == V2D_ROT_90 || rt == V2D_ROT_270);
+			v2d_image(&stSrc, pSrc, w, h, aFormat[f]);
+			v2d_image(&stRef, pRef, sw ? h : w, sw ? w : h, aFormat[f]);
+			v2d_image(&stDst, pDst, sw ? h : w, sw ? w : h, aFormat[f]);
+			memset(pRef, 0, size);
+			naive = v2d_bench_rotate_run(&stSrc, &stRef, rt, iters, "scalar");
+			for (k=0; k<kernels && !ret; k++) {
+				v2d_image(&stSrc, pSrc, w, h, aFormat[f]);
+				v2d_image(&stDst, pDst, sw ? h : w, sw ? w : h, aFormat[f]);
+				memset(pDst, 0, size);
+				rate = v2d_bench_rotate_run(&stSrc, &stDst, rt, iters, apKernel[k]);
+				if (naive < 0 || rate < 0 || memcmp(pRef, pDst, size)) {
+					V2DLOGD("%s rotate %s %s differs from the naive loop\n", apFormat[f], apAngle[rt], apKernel[k]);
+					ret = 1;
+					break;
+				}
+				V2DLOGD("%-8s %-6s naive %7.1f MPix/s, %-7s %7.1f MPix/s, %.2fx\n", apFormat[f], apAngle[rt], naive,
+						apKernel[k], rate, rate / naive);
+
+				//the same turn in place on an n x n copy
+				v2d_image(&stSrc, pSrc, n, n, aFormat[f]);
+				v2d_image(&stInRef, pInRef, n, n, aFormat[f]);
+				v2d_image(&stDst, pDst, n, n, aFormat[f]);
+				memcpy(pDst, pSrc, size);
+				if (v2d_bench_rotate_run(&stSrc, &stInRef, rt, 1, "scalar") < 0 ||
+				    v2d_bench_rotate_run(&stDst, &stDst, rt, 1, apKernel[k]) < 0 || v2d_image_cmp(&stInRef, &stDst)) {
+					V2DLOGD("%s rotate %s %s in place differs from the naive loop\n", apFormat[f], apAngle[rt], apKernel[k]);
+					ret = 1;
+				}
+			}
+		}
+	}
+	free(pSrc);
+	free(pRef);
+	free(pDst);
+	free(pInRef);
+	V2DLOGD("v2d rotate bench %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//host fbc decoder against the res/ golden files
+static double v2d_bench_fbc_run(FBC_DECODER_S *pstFbc, unsigned char *pBuf, size_t size, V2D_IMAGE_S *pDst, int iters)
+{
+	long long start;
+	int i;
+
+	start = nowNs();
+	for (i=0; i<iters; i++) {
+		if (V2D_FbcDecode(pstFbc, pBuf, size, pDst)) {
+			return -1.0;
+		}
+	}
+	//MB/s of decoded picture, nv12 carries half a plane of chroma
+	return (double)pDst->stride * pDst->h * (pDst->format == V2D_COLOR_FORMAT_NV12 ? 1.5 : 1.0) * iters * 1000.0 / (nowNs() - start);
+}
+int v2d_bench_fbc(int iters)
+{
+	int ret = 0;
+	unsigned int bufSize = 1 << 20, size = 320 * 240 * 3, x, y, in, bad = 0;
+	unsigned char *pRgbFbc, *pYuvFbc, *pRaw, *pDst, *pYuv, *pMirror;
+	V2D_IMAGE_S stDst, stYuv, stMirror;
+	FBC_DECODER_S stFbc;
+	double rgbRate, yuvRate;
+
+	V2DLOGD("v2d fbc decode start, iters:%d\n", iters);
+	pRgbFbc = calloc(1, bufSize);
+	pYuvFbc = calloc(1, bufSize);
+	pRaw    = malloc(size);
+	pDst    = malloc(size);
+	pYuv    = malloc(size);
+	pMirror = malloc(size);
+	if (!pRgbFbc || !pYuvFbc || !pRaw || !pDst || !pYuv || !pMirror) {
+		V2DLOGD("malloc fail\n");
+		return -1;
+	}
+	if (readFile(pFbcCase0Header, pRgbFbc, bufSize) || readFile(pFbcCase0Body, pRgbFbc + 4800, bufSize - 4800) ||
+	    readFile(pFbcCase0Raw, pRaw, size) ||
+	    readFile(pFbcCase0Layer0H, pYuvFbc, bufSize) || readFile(pFbcCase0Layer0B, pYuvFbc + 4800, bufSize - 4800)) {
+		ret = -1;
+		goto out;
+	}
+
+	//split rgb888 stream, bit exact against the raw picture
+	memset(&stFbc, 0, sizeof(stFbc));
+	stFbc.bboxRight    = 319;
+	stFbc.bboxBottom   = 239;
+	stFbc.is_split     = 1;
+	stFbc.enFbcdecMode = FBC_DECODER_MODE_SCAN_LINE;
+	stFbc.enFbcdecFmt  = FBC_DECODER_FORMAT_RGB888;
+	v2d_image(&stDst, pDst, 320, 240, V2D_COLOR_FORMAT_RGB888);
+	memset(pDst, 0, size);
+	rgbRate = v2d_bench_fbc_run(&stFbc, pRgbFbc, bufSize, &stDst, iters);
+	if (rgbRate < 0 || memcmp(pDst, pRaw, size)) {
+		V2DLOGD("rgb888 fbc decode differs from %s\n", pFbcCase0Raw);
+		ret = 1;
+		goto out;
+	}
+
+	//only the bbox is written
+	stFbc.bboxLeft   = 37;
+	stFbc.bboxRight  = 137;
+	stFbc.bboxTop    = 21;
+	stFbc.bboxBottom = 97;
+	memset(pDst, 0, size);
+	if (v2d_bench_fbc_run(&stFbc, pRgbFbc, bufSize, &stDst, 1) < 0) {
+		ret = 1;
+		goto out;
+	}
+	for (y=0; y<240; y++) {
+		for (x=0; x<320 * 3; x++) {
+			in = (x / 3 >= 37 && x / 3 <= 137 && y >= 21 && y <= 97);
+			bad += (pDst[y * 960 + x] != (in ? pRaw[y * 960 + x] : 0));
+		}
+	}
+	if (bad) {
+		V2DLOGD("rgb888 fbc bbox decode has %u wrong bytes\n", bad);
+		ret = 1;
+		goto out;
+	}
+
+	//nv12 layer of the blend case, mirrored and converted like the block does it
+	memset(&stFbc, 0, sizeof(stFbc));
+	stFbc.bboxRight    = 319;
+	stFbc.bboxBottom   = 239;
+	stFbc.enFbcdecMode = FBC_DECODER_MODE_SCAN_LINE;
+	stFbc.enFbcdecFmt  = FBC_DECODER_FORMAT_NV12;
+	v2d_image(&stYuv, pYuv, 320, 240, V2D_COLOR_FORMAT_NV12);
+	v2d_image(&stMirror, pMirror, 320, 240, V2D_COLOR_FORMAT_NV12);
+	yuvRate = v2d_bench_fbc_run(&stFbc, pYuvFbc, bufSize, &stYuv, iters);
+	if (yuvRate < 0 || V2D_RotateImage(&stYuv, &stMirror, V2D_ROT_MIRROR) ||
+	    V2D_CscImage(&stMirror, &stDst, V2D_CSC_MODE_BT601NARROW_2_RGB)) {
+		ret = 1;
+		goto out;
+	}
+	for (x=0; x<size; x++) {
+		bad += (pDst[x] != pRaw[x]);
+	}
+	if (bad) {
+		V2DLOGD("nv12 fbc decode after csc differs from %s in %u bytes\n", pFbcCase0Raw, bad);
+		ret = 1;
+		goto out;
+	}
+	V2DLOGD("rgb888 split %7.1f MB/s, nv12 %7.1f MB/s, nv12 after csc bit exact against the raw\n",
+			rgbRate, yuvRate);
+out:
+	free(pRgbFbc);
+	free(pYuvFbc);
+	free(pRaw);
+	free(pDst);
+	free(pYuv);
+	free(pMirror);
+	V2DLOGD("v2d fbc decode %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//host fbc encoder against the res/ golden files, and round trip through fbcEncInfo on the cpu backend
+static double v2d_bench_fbc_encode_run(FBC_ENCODER_S *pstFbc, V2D_IMAGE_S *pSrc, unsigned char *pBuf, size_t size,
+                                       size_t *pUsed, int iters)
+{
+	long long start;
+	int i;
+
+	start = nowNs();
+	for (i=0; i<iters; i++) {
+		if (V2D_FbcEncode(pstFbc, pSrc, pBuf, size, pUsed)) {
+			return -1.0;
+		}
+	}
+	return (double)pSrc->stride * pSrc->h * (pSrc->format == V2D_COLOR_FORMAT_NV12 ? 1.5 : 1.0) * iters * 1000.0 / (nowNs() - start);
+}
+int v2d_bench_fbc_encode(int iters)
+{
+	int ret = 0;
+	unsigned int size = 320 * 240 * 3, fbcSize = 4800 + size;
+	unsigned char *pRgbFbc, *pYuvFbc, *pRaw, *pYuv, *pOut, *pIn, *pDst;
+	int inFd, outFd, dstFd;
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stRaw, stFbc, stDst;
+	V2D_AREA_S stRect;
+	V2D_BLEND_CONF_S stBlendConf;
+	V2D_IMAGE_S stRaw0, stYuv;
+	FBC_ENCODER_S stEnc;
+	FBC_DECODER_S stDec;
+	size_t rgbUsed, yuvUsed;
+	double rgbRate, yuvRate;
+
+	V2DLOGD("v2d fbc encode start, iters:%d\n", iters);
+	pRgbFbc = calloc(1, fbcSize);
+	pYuvFbc = calloc(1, fbcSize);
+	pRaw    = malloc(size);
+	pYuv    = malloc(size);
+	inFd  = v2d_cpu_buffer(ALIGN_UP(size, PAGESIZE), (void **)&pIn);
+	outFd = v2d_cpu_buffer(ALIGN_UP(fbcSize, PAGESIZE), (void **)&pOut);
+	dstFd = v2d_cpu_buffer(ALIGN_UP(size, PAGESIZE), (void **)&pDst);
+	if (!pRgbFbc || !pYuvFbc || !pRaw || !pYuv || inFd < 0 || outFd < 0 || dstFd < 0) {
+		V2DLOGD("v2d fbc encode buffer alloc failed\n");
+		return -1;
+	}
+	if (readFile(pFbcCase0Header, pRgbFbc, fbcSize) || readFile(pFbcCase0Body, pRgbFbc + 4800, fbcSize - 4800) ||
+	    readFile(pFbcCase0Raw, pRaw, size) ||
+	    readFile(pFbcCase0Layer0H, pYuvFbc, fbcSize) || readFile(pFbcCase0Layer0B, pYuvFbc + 4800, fbcSize - 4800)) {
+		ret = -1;
+		goto out;
+	}
+
+	//the raw picture encodes to the split rgb888 stream the block wrote for it
+	memset(&stEnc, 0, sizeof(stEnc));
+	stEnc.offset      = 320*240/16;
+	stEnc.bboxRight   = 319;
+	stEnc.bboxBottom  = 239;
+	stEnc.is_split    = 1;
+	stEnc.enFbcencFmt = FBC_DECODER_FORMAT_RGB888;
+	v2d_image(&stRaw0, pRaw, 320, 240, V2D_COLOR_FORMAT_RGB888);
+	memset(pOut, 0, fbcSize);
+	rgbRate = v2d_bench_fbc_encode_run(&stEnc, &stRaw0, pOut, fbcSize, &rgbUsed, iters);
+	if (rgbRate < 0 || memcmp(pOut, pRgbFbc, fbcSize)) {
+		V2DLOGD("rgb888 fbc encode differs from %s\n", pFbcCase0Header);
+		ret = 1;
+		goto out;
+	}
+
+	//and the nv12 stream encodes back to itself
+	memset(&stDec, 0, sizeof(stDec));
+	stDec.bboxRight    = 319;
+	stDec.bboxBottom   = 239;
+	stDec.enFbcdecMode = FBC_DECODER_MODE_SCAN_LINE;
+	stDec.enFbcdecFmt  = FBC_DECODER_FORMAT_NV12;
+	v2d_image(&stYuv, pYuv, 320, 240, V2D_COLOR_FORMAT_NV12);
+	stEnc.is_split    = 0;
+	stEnc.enFbcencFmt = FBC_DECODER_FORMAT_NV12;
+	memset(pOut, 0, fbcSize);
+	if (V2D_FbcDecode(&stDec, pYuvFbc, fbcSize, &stYuv)) {
+		ret = 1;
+		goto out;
+	}
+	yuvRate = v2d_bench_fbc_encode_run(&stEnc, &stYuv, pOut, 115200 + 4800, &yuvUsed, iters);
+	if (yuvRate < 0 || memcmp(pOut, pYuvFbc, 115200 + 4800)) {
+		V2DLOGD("nv12 fbc encode differs from %s\n", pFbcCase0Layer0H);
+		ret = 1;
+		goto out;
+	}
+	V2DLOGD("rgb888 split %7.1f MB/s ratio %.2f, nv12 %7.1f MB/s ratio %.2f\n", rgbRate, (double)size / rgbUsed,
+			yuvRate, 115200.0 / yuvUsed);
+
+	//cpu backend: blit the raw picture into an fbc surface, then that surface back out
+	memcpy(pIn, pRaw, size);
+	memset(pOut, 0, fbcSize);
+	memset(pDst, 0, size);
+	ret = V2D_OpenBackend(V2D_BACKEND_CPU, &hContext);
+	if (ret) {
+		V2DLOGD("V2D_OpenBackend err\n");
+		goto out;
+	}
+	memset(&stRaw, 0, sizeof(V2D_SURFACE_S));
+	stRaw.fd     = inFd;
+	stRaw.w      = 320;
+	stRaw.h      = 240;
+	stRaw.stride = 320*3;
+	stRaw.format = V2D_COLOR_FORMAT_RGB888;
+	stDst = stRaw;
+	stDst.fd = dstFd;
+	memset(&stFbc, 0, sizeof(V2D_SURFACE_S));
+	stFbc.fbc_enable = 1;
+	stFbc.w          = 320;
+	stFbc.h          = 240;
+	stFbc.format     = V2D_COLOR_FORMAT_RGB888;
+	stFbc.fbcEncInfo.fd          = outFd;
+	stFbc.fbcEncInfo.offset      = 320*240/16;
+	stFbc.fbcEncInfo.bboxRight   = 319;
+	stFbc.fbcEncInfo.bboxBottom  = 239;
+	stFbc.fbcEncInfo.enFbcencFmt = FBC_DECODER_FORMAT_RGB888;
+	stFbc.fbcEncInfo.is_split    = 1;
+	stRect.x = 0;
+	stRect.y = 0;
+	stRect.w = 320;
+	stRect.h = 240;
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	stBlendConf.blendlayer[0].blend_area = stRect;
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= V2D_AddBlendTask(hHandle, &stRaw, &stRect, NULL, NULL, NULL, NULL, &stFbc, &stRect, &stBlendConf,
+							V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+	ret |= V2D_EndJob(hHandle);
+	if (!ret && memcmp(pOut, pRgbFbc, fbcSize)) {
+		V2DLOGD("fbcEncInfo output differs from %s\n", pFbcCase0Header);
+		ret = 1;
+	}
+	//the encoder and decoder fields of the surface share a union
+	stFbc.fbcDecInfo.bboxLeft     = 0;
+	stFbc.fbcDecInfo.bboxRight    = 319;
+	stFbc.fbcDecInfo.bboxTop      = 0;
+	stFbc.fbcDecInfo.bboxBottom   = 239;
+	stFbc.fbcDecInfo.rgb_pack_en  = 0;
+	stFbc.fbcDecInfo.is_split     = 1;
+	stFbc.fbcDecInfo.enFbcdecMode = FBC_DECODER_MODE_SCAN_LINE;
+	stFbc.fbcDecInfo.enFbcdecFmt  = FBC_DECODER_FORMAT_RGB888;
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= V2D_AddBlendTask(hHandle, &stFbc, &stRect, NULL, NULL, NULL, NULL, &stDst, &stRect, &stBlendConf,
+							V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+	ret |= V2D_EndJob(hHandle);
+	if (!ret && memcmp(pDst, pRaw, size)) {
+		V2DLOGD("fbcDecInfo input differs from %s\n", pFbcCase0Raw);
+		ret = 1;
+	}
+	V2D_Close(hContext);
+out:
+	free(pRgbFbc);
+	free(pYuvFbc);
+	free(pRaw);
+	free(pYuv);
+	munmap(pIn, ALIGN_UP(size, PAGESIZE));
+	munmap(pOut, ALIGN_UP(fbcSize, PAGESIZE));
+	munmap(pDst, ALIGN_UP(size, PAGESIZE));
+	close(inFd);
+	close(outFd);
+	close(dstFd);
+	V2DLOGD("v2d fbc encode %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//submit overhead benchmark, runs against a stand-in device node such as /dev/null
+int v2d_bench_submit(char *pNode, int tasks, int jobs)
+{
+	int ret = 0;
+	int fd, i, j;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stDst;
+	V2D_AREA_S stDstRect;
+	V2D_FILLCOLOR_S stFillColor;
+	/* the driver ABI: one V2D_SUBMIT_TASK_S plus the list link per write */
+	size_t taskSize = sizeof(V2D_SUBMIT_TASK_S) + sizeof(void *);
+	void *pTask;
+	long long start, perTaskNs, perJobNs, perBuildNs;
+
+	V2DLOGD("v2d submit bench start, node:%s tasks:%d jobs:%d\n", pNode, tasks, jobs);
+	setenv("V2D_DEV_NAME", pNode, 1);
+	fd = open(pNode, O_RDWR|O_CLOEXEC|O_NONBLOCK);
+	pTask = calloc(1, taskSize);
+	if (fd < 0 || !pTask) {
+		V2DLOGD("failed to open %s\n", pNode);
+		free(pTask);
+		return -1;
+	}
+	memset(&stDst, 0, sizeof(V2D_SURFACE_S));
+	stDst.w      = 320;
+	stDst.h      = 240;
+	stDst.stride = 320*4;
+	stDst.format = V2D_COLOR_FORMAT_RGBA8888;
+	stDstRect.x  = 0;
+	stDstRect.y  = 0;
+	stDstRect.w  = 16;
+	stDstRect.h  = 16;
+	stFillColor.format     = V2D_COLOR_FORMAT_RGBA8888;
+	stFillColor.colorvalue = 0xff00ff00;
+
+	//before: one write() per task
+	start = nowNs();
+	for (j=0; j<jobs; j++) {
+		for (i=0; i<tasks; i++) {
+			if (write(fd, pTask, taskSize) != (ssize_t)taskSize) {
+				ret = -1;
+			}
+		}
+	}
+	perTaskNs = (nowNs() - start) / jobs;
+	close(fd);
+	free(pTask);
+
+	//job build cost alone, the tasks are dropped instead of submitted
+	start = nowNs();
+	ret = V2D_BeginJob(&hHandle);
+	for (j=0; j<jobs && !ret; j++) {
+		for (i=0; i<tasks && !ret; i++) {
+			stDstRect.x = (i & 7) * 16;
+			ret = V2D_AddFillTask(hHandle, &stDst, &stDstRect, &stFillColor);
+		}
+		ret |= V2D_ResetJob(hHandle);
+	}
+	ret |= V2D_EndJob(hHandle);
+	perBuildNs = (nowNs() - start) / jobs;
+
+	//after: whole job through the library
+	start = nowNs();
+	for (j=0; j<jobs && !ret; j++) {
+		ret = V2D_BeginJob(&hHandle);
+		for (i=0; i<tasks && !ret; i++) {
+			ret = V2D_AddFillTask(hHandle, &stDst, &stDstRect, &stFillColor);
+		}
+		ret |= V2D_EndJob(hHandle);
+	}
+	perJobNs = (nowNs() - start) / jobs;
+
+	V2DLOGD("driver task size: %u bytes\n", (unsigned int)taskSize);
+	V2DLOGD("per-task write: %lld ns/job, V2D job build: %lld ns/job, V2D job build+submit: %lld ns/job\n",
+			perTaskNs, perBuildNs, perJobNs);
+	V2DLOGD("v2d submit bench %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//per context statistics, checks the counters against a known load on a stand-in device node
+static void v2d_print_latency(const char *pName, V2D_LATENCY_S *pstLatency)
+{
+	int i;
+
+	V2DLOGD("%-9s count %lu avg %lu ns max %lu ns\n", pName, pstLatency->count,
+			pstLatency->count ? pstLatency->totalNs / pstLatency->count : 0, pstLatency->maxNs);
+	for (i=0; i<V2D_STATS_BUCKETS; i++) {
+		if (pstLatency->buckets[i]) {
+			V2DLOGD("          <%8lu us: %u\n", 2UL << i, pstLatency->buckets[i]);
+		}
+	}
+}
+static void v2d_stats_callback(int32_t result, void *pUserData)
+{
+	__atomic_add_fetch((int *)pUserData, result ? 1000000 : 1, __ATOMIC_RELAXED);
+}
+int v2d_stats_test(char *pNode, int tasks, int jobs)
+{
+	int ret = 0;
+	int i, j, fence, callbacks = 0, queued = 0, waited = 0;
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stDst;
+	V2D_AREA_S stDstRect;
+	V2D_FILLCOLOR_S stFillColor;
+	V2D_STATS_S stStats;
+	long long start, perJobNs;
+
+	V2DLOGD("v2d stats test start, node:%s tasks:%d jobs:%d\n", pNode, tasks, jobs);
+	setenv("V2D_DEV_NAME", pNode, 1);
+	ret = V2D_OpenBackend(V2D_BACKEND_DEVICE, &hContext);
+	if (ret) {
+		V2DLOGD("V2D_OpenBackend err\n");
+		return ret;
+	}
+	memset(&stDst, 0, sizeof(V2D_SURFACE_S));
+	stDst.w      = 320;
+	stDst.h      = 240;
+	stDst.stride = 320*4;
+	stDst.format = V2D_COLOR_FORMAT_RGBA8888;
+	stDstRect.x  = 0;
+	stDstRect.y  = 0;
+	stDstRect.w  = 16;
+	stDstRect.h  = 16;
+	stFillColor.format     = V2D_COLOR_FORMAT_RGBA8888;
+	stFillColor.colorvalue = 0xff00ff00;
+
+	start = nowNs();
+	for (j=0; j<jobs && !ret; j++) {
+		ret = V2D_BeginContextJob(hContext, &hHandle);
+		for (i=0; i<tasks && !ret; i++) {
+			stDstRect.x = (i & 7) * 16;
+			ret = V2D_AddFillTask(hHandle, &stDst, &stDstRect, &stFillColor);
+		}
+		switch (j % 3) {
+		case 0:
+			ret |= V2D_EndJob(hHandle);
+			waited++;
+			break;
+		case 1:
+			ret |= V2D_EndJobAsync(hHandle, &fence);
+			if (fence >= 0) {
+				close(fence);
+			}
+			break;
+		default:
+			ret |= V2D_EndJobCallback(hHandle, v2d_stats_callback, &callbacks);
+			queued++;
+			break;
+		}
+	}
+	perJobNs = (nowNs() - start) / jobs;
+	for (i=0; i<300 && __atomic_load_n(&callbacks, __ATOMIC_RELAXED) < queued; i++) {
+		usleep(10000);
+	}
+	V2DLOGD("%lld ns/job\n", perJobNs);
+	if (ret || callbacks != queued) {
+		V2DLOGD("jobs failed, %d of %d callbacks\n", callbacks, queued);
+		ret = -1;
+	}
+
+	if (V2D_GetStats(hContext, &stStats)) {
+		V2DLOGD("libv2d built without V2D_STATS\n");
+	} else if (!ret) {
+		V2DLOGD("jobs %lu tasks %lu bytes %lu timeouts %lu failures %lu\n", stStats.jobs, stStats.tasks,
+				stStats.bytes, stStats.timeouts, stStats.failures);
+		v2d_print_latency("build", &stStats.build);
+		v2d_print_latency("submit", &stStats.submit);
+		v2d_print_latency("complete", &stStats.complete);
+		if (stStats.jobs != (unsigned long)jobs || stStats.tasks != (unsigned long)jobs * tasks ||
+			stStats.bytes != (unsigned long)jobs * tasks * 16 * 16 * 4 ||
+			stStats.timeouts || stStats.failures || stStats.build.count != (unsigned long)jobs ||
+			stStats.submit.count != (unsigned long)jobs || stStats.complete.count > (unsigned long)(waited + queued)) {
+			V2DLOGD("counters do not match the load\n");
+			ret = -1;
+		}
+		V2D_ResetStats(hContext);
+		V2D_GetStats(hContext, &stStats);
+		if (stStats.jobs || stStats.build.count || stStats.complete.buckets[0]) {
+			V2DLOGD("counters survived V2D_ResetStats\n");
+			ret = -1;
+		}
+	}
+	V2D_Close(hContext);
+	V2DLOGD("v2d stats test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//job trace, records jobs of the cpu backend and checks the spans in the dump
+static int v2d_trace_count(const char *pFileName, const char *pName)
+{
+	char line[512], key[64];
+	int count = 0;
+	FILE *pFile = fopen(pFileName, "r");
+
+	if (!pFile) {
+		return -1;
+	}
+	snprintf(key, sizeof(key), "{\"name\":\"%s\",", pName);
+	while (fgets(line, sizeof(line), pFile)) {
+		if (strstr(line, key) && strstr(line, "\"ph\":\"X\"")) {
+			count++;
+		}
+	}
+	fclose(pFile);
+	return count;
+}
+static void v2d_trace_callback(int32_t result, void *pUserData)
+{
+	__atomic_store_n((int *)pUserData, result ? -1 : 1, __ATOMIC_RELEASE);
+}
+struct v2d_trace_arg {
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_SURFACE_S *pDst;
+	V2D_AREA_S *pRect;
+	V2D_FILLCOLOR_S *pColor;
+	int ret;
+};
+//a thread that ends a job and is gone before the dump
+static void *v2d_trace_thread(void *arg)
+{
+	struct v2d_trace_arg *pArg = (struct v2d_trace_arg *)arg;
+	V2D_HANDLE hHandle;
+
+	pArg->ret = V2D_BeginContextJob(pArg->hContext, &hHandle);
+	pArg->ret |= V2D_AddFillTask(hHandle, pArg->pDst, pArg->pRect, pArg->pColor);
+	pArg->ret |= V2D_EndJob(hHandle);
+	return NULL;
+}
+int v2d_trace_test(char *pFileName)
+{
+	int ret = 0;
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stSrc, stDst;
+	V2D_AREA_S stRect, stFillRect;
+	V2D_FILLCOLOR_S stFillColor;
+	V2D_BLEND_CONF_S stBlendConf;
+	unsigned int size = 320*240*4;
+	unsigned char *pSrc, *pDst;
+	int srcFd, dstFd, fence, i, done = 0;
+	struct v2d_trace_arg stArg;
+	pthread_t tid;
+
+	V2DLOGD("v2d trace test start, file:%s\n", pFileName);
+	srcFd = v2d_cpu_buffer(size, (void **)&pSrc);
+	dstFd = v2d_cpu_buffer(size, (void **)&pDst);
+	if (srcFd < 0 || dstFd < 0) {
+		V2DLOGD("v2d trace test buffer alloc failed\n");
+		return -1;
+	}
+	ret = V2D_OpenBackend(V2D_BACKEND_CPU, &hContext);
+	if (ret) {
+		V2DLOGD("V2D_OpenBackend err\n");
+		return ret;
+	}
+	memset(&stSrc, 0, sizeof(V2D_SURFACE_S));
+	stSrc.fd     = srcFd;
+	stSrc.w      = 320;
+	stSrc.h      = 240;
+	stSrc.stride = 320*4;
+	stSrc.format = V2D_COLOR_FORMAT_RGBA8888;
+	stDst = stSrc;
+	stDst.fd = dstFd;
+	stRect.x = 0;
+	stRect.y = 0;
+	stRect.w = 320;
+	stRect.h = 240;
+	stFillRect.x = 0;
+	stFillRect.y = 0;
+	stFillRect.w = 16;
+	stFillRect.h = 16;
+	stFillColor.format     = V2D_COLOR_FORMAT_RGBA8888;
+	stFillColor.colorvalue = 0xff00ff00;
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	stBlendConf.blendlayer[0].blend_area = stRect;
+
+	//a job from before tracing stays out of the trace
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= V2D_AddFillTask(hHandle, &stDst, &stFillRect, &stFillColor);
+	ret |= V2D_TraceEnable(1);
+	ret |= V2D_EndJob(hHandle);
+
+	//fill and blit waited on, a blend ended async, 70 fills in two chunks through a callback and a fill on another thread
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= V2D_AddFillTask(hHandle, &stDst, &stFillRect, &stFillColor);
+	ret |= V2D_AddBitblitTask(hHandle, &stDst, &stRect, &stSrc, &stRect, V2D_CSC_MODE_BUTT);
+	ret |= V2D_EndJob(hHandle);
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= V2D_AddBlendTask(hHandle, &stSrc, &stRect, NULL, NULL, NULL, NULL, &stDst, &stRect, &stBlendConf,
+							V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+	ret |= V2D_EndJobAsync(hHandle, &fence);
+	if (fence >= 0) {
+		close(fence);
+	}
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	for (i=0; i<70 && !ret; i++) {
+		stFillRect.x = (i % 20) * 16;
+		ret |= V2D_AddFillTask(hHandle, &stDst, &stFillRect, &stFillColor);
+	}
+	ret |= V2D_EndJobCallback(hHandle, v2d_trace_callback, &done);
+	for (i=0; i<300 && !__atomic_load_n(&done, __ATOMIC_ACQUIRE); i++) {
+		usleep(10000);
+	}
+	stArg.hContext = hContext;
+	stArg.pDst = &stDst;
+	stArg.pRect = &stFillRect;
+	stArg.pColor = &stFillColor;
+	stArg.ret = -1;
+	if (pthread_create(&tid, NULL, v2d_trace_thread, &stArg) == 0) {
+		pthread_join(tid, NULL);
+	}
+	ret |= stArg.ret;
+	ret |= V2D_TraceEnable(0);
+	ret |= V2D_TraceDump(pFileName);
+	if (ret || done != 1) {
+		V2DLOGD("traced jobs failed\n");
+		ret = -1;
+	} else if (v2d_trace_count(pFileName, "job") != 4 || v2d_trace_count(pFileName, "submit") != 4 ||
+			   v2d_trace_count(pFileName, "fill") != 72 || v2d_trace_count(pFileName, "blit") != 1 ||
+			   v2d_trace_count(pFileName, "blend") != 1) {
+		V2DLOGD("trace holds job:%d submit:%d fill:%d blit:%d blend:%d spans\n", v2d_trace_count(pFileName, "job"),
+				v2d_trace_count(pFileName, "submit"), v2d_trace_count(pFileName, "fill"),
+				v2d_trace_count(pFileName, "blit"), v2d_trace_count(pFileName, "blend"));
+		ret = -1;
+	}
+
+	V2D_Close(hContext);
+	munmap(pSrc, size);
+	munmap(pDst, size);
+	close(srcFd);
+	close(dstFd);
+	V2DLOGD("v2d trace test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//dmabuf pool, a frame loop of allocations that must not reach the heap once warmed up
+int v2d_pool_test(int frames)
+{
+	int ret = 0;
+	int i, j, fd[3];
+	size_t size[3] = {1920*1080*4, 1920*1080*3/2, 1280*720*4};
+	long long start, poolNs, heapNs;
+	DmabufPoolStats stStats;
+
+	V2DLOGD("v2d pool test start, frames:%d\n", frames);
+	createAllocator();
+	for (i=0; i<3 && !ret; i++) {
+		ret = DmabufHeapPoolReserve(bufferAllocator, "system", size[i], 2);
+	}
+	if (ret) {
+		V2DLOGD("pool reserve failed, no dma heap?\n");
+		return -1;
+	}
+
+	start = nowNs();
+	for (j=0; j<frames; j++) {
+		for (i=0; i<3; i++) {
+			fd[i] = DmabufHeapPoolAllocSystem(bufferAllocator, true, size[i]);
+			ret |= (fd[i] < 0);
+		}
+		for (i=0; i<3; i++) {
+			ret |= (fd[i] >= 0 && DmabufHeapPoolRelease(bufferAllocator, fd[i]));
+		}
+	}
+	poolNs = (nowNs() - start) / frames;
+	DmabufHeapPoolGetStats(bufferAllocator, &stStats);
+	V2DLOGD("pool: %lld ns/frame, hits %lu misses %lu releases %lu evictions %lu, free %lu buffers %zu bytes\n",
+			poolNs, stStats.hits, stStats.misses, stStats.releases, stStats.evictions,
+			stStats.free_buffers, stStats.free_bytes);
+	if (stStats.misses || stStats.hits != (unsigned long)frames * 3 || stStats.busy_buffers) {
+		V2DLOGD("steady state reached the heap\n");
+		ret = -1;
+	}
+
+	//the same loop straight on the heap
+	start = nowNs();
+	for (j=0; j<frames && !ret; j++) {
+		for (i=0; i<3; i++) {
+			fd[i] = DmabufHeapAllocSystem(bufferAllocator, true, size[i], 0, 0);
+		}
+		for (i=0; i<3; i++) {
+			if (fd[i] >= 0) {
+				close(fd[i]);
+			}
+		}
+	}
+	heapNs = (nowNs() - start) / frames;
+	V2DLOGD("heap: %lld ns/frame\n", heapNs);
+
+	DmabufHeapPoolTrim(bufferAllocator, 0);
+	DmabufHeapPoolGetStats(bufferAllocator, &stStats);
+	if (stStats.free_buffers) {
+		V2DLOGD("trim left %lu buffers\n", stStats.free_buffers);
+		ret = -1;
+	}
+	V2DLOGD("v2d pool test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//a dmabuf from the system heap, or a memfd where there is none
+static int v2d_map_buffer(size_t size)
+{
+	int fd;
+
+	fd = DmabufHeapAllocSystem(bufferAllocator, true, size, 0, 0);
+	if (fd < 0) {
+		fd = syscall(__NR_memfd_create, "v2d", 0);
+		if (fd >= 0 && ftruncate(fd, size)) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	return fd;
+}
+//cpu mapping cache, per frame mmap/munmap against cached lookups, and a reused fd number
+int v2d_map_test(int frames)
+{
+	int ret = 0;
+	int i, j, fd[3], fdNew;
+	size_t size[3] = {1920*1080*4, 1920*1080*3/2, 1280*720*4};
+	long long start, mmapNs, cacheNs;
+	uint8_t *pAddr[3], *pNew;
+	volatile uint8_t sum = 0;
+
+	V2DLOGD("v2d map test start, frames:%d\n", frames);
+	createAllocator();
+	for (i=0; i<3; i++) {
+		fd[i] = v2d_map_buffer(size[i]);
+		if (fd[i] < 0) {
+			V2DLOGD("buffer alloc failed\n");
+			return -1;
+		}
+	}
+
+	//what each frame costs when every access maps the buffer again
+	start = nowNs();
+	for (j=0; j<frames; j++) {
+		for (i=0; i<3; i++) {
+			pAddr[i] = mmap(NULL, size[i], PROT_READ | PROT_WRITE, MAP_SHARED, fd[i], 0);
+			if (pAddr[i] == MAP_FAILED) {
+				ret = -1;
+				continue;
+			}
+			sum += pAddr[i][j * 4096 % size[i]];
+			munmap(pAddr[i], size[i]);
+		}
+	}
+	mmapNs = (nowNs() - start) / frames;
+
+	for (i=0; i<3; i++) {
+		pAddr[i] = DmabufHeapMap(bufferAllocator, fd[i], size[i]);
+		ret |= !pAddr[i] || DmabufHeapUnmap(bufferAllocator, fd[i]);
+	}
+	start = nowNs();
+	for (j=0; j<frames && !ret; j++) {
+		for (i=0; i<3; i++) {
+			uint8_t *p = DmabufHeapMap(bufferAllocator, fd[i], size[i]);
+			if (p != pAddr[i]) {
+				V2DLOGD("frame %d buffer %d mapped again\n", j, i);
+				ret = -1;
+				break;
+			}
+			sum += p[j * 4096 % size[i]];
+			DmabufHeapUnmap(bufferAllocator, fd[i]);
+		}
+	}
+	cacheNs = (nowNs() - start) / frames;
+	V2DLOGD("mmap: %lld ns/frame, cached: %lld ns/frame\n", mmapNs, cacheNs);
+
+	//references are counted, a mapped buffer can not be forgotten
+	if (!ret) {
+		DmabufHeapMap(bufferAllocator, fd[0], size[0]);
+		if (DmabufHeapForgetMapping(bufferAllocator, fd[0]) != -EBUSY) {
+			V2DLOGD("forgot a mapped buffer\n");
+			ret = -1;
+		}
+		DmabufHeapUnmap(bufferAllocator, fd[0]);
+		if (DmabufHeapUnmap(bufferAllocator, fd[0]) != -EINVAL) {
+			V2DLOGD("unmapped an unmapped buffer\n");
+			ret = -1;
+		}
+	}
+
+	//the old mapping is still cached when its fd number comes back for another buffer
+	if (!ret) {
+		memset(pAddr[2], 0x5a, 4096);
+		close(fd[2]);
+		fdNew = v2d_map_buffer(size[2]);
+		pNew = DmabufHeapMap(bufferAllocator, fdNew, size[2]);
+		if (fdNew != fd[2] || !pNew || pNew[0] == 0x5a) {
+			V2DLOGD("fd %d reused as %d mapped the old buffer\n", fd[2], fdNew);
+			ret = -1;
+		}
+		if (pNew) {
+			DmabufHeapUnmap(bufferAllocator, fdNew);
+		}
+		fd[2] = fdNew;
+	}
+
+	for (i=0; i<3; i++) {
+		if (fd[i] >= 0) {
+			DmabufHeapForgetMapping(bufferAllocator, fd[i]);
+			close(fd[i]);
+		}
+	}
+	V2DLOGD("v2d map test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//one pass over a sequence file with the loader, MB/s
+static double v2d_load_pass(char *pFileName, size_t frameSize, uint8_t *pDst, size_t size, uint32_t *pSum)
+{
+	V2D_LOADER_HANDLE hLoader;
+	uint32_t frames, j, sum = 0;
+	long long start = nowNs();
+
+	if (V2D_LoaderOpen(pFileName, frameSize, &hLoader) || V2D_LoaderFrames(hLoader, &frames)) {
+		return 0;
+	}
+	for (j=0; j<frames; j++) {
+		if (V2D_LoaderRead(hLoader, j, pDst, size)) {
+			V2D_LoaderClose(hLoader);
+			return 0;
+		}
+		sum += pDst[0] + pDst[frameSize - 1];
+	}
+	V2D_LoaderClose(hLoader);
+	*pSum = sum;
+	return (double)frameSize * frames * 1000.0 / (nowNs() - start);
+}
+//sequence loading into a buffer mapping, stdio against the loader on its mmap and read paths
+int v2d_load_test(int frames)
+{
+	int ret = 0;
+	char *pFileName = "/tmp/v2d_load_test.yuv";
+	size_t frameSize = 1920*1080*3/2, size = ALIGN_UP(frameSize, PAGESIZE);
+	uint32_t sum, mmapSum = 0, readSum = 0, stdioSum = 0;
+	double stdioRate, mmapRate, readRate;
+	uint8_t *pDst;
+	long long start;
+	FILE *fp;
+	int fd, j;
+
+	V2DLOGD("v2d load test start, frames:%d\n", frames);
+	fd = v2d_cpu_buffer(size, (void **)&pDst);
+	fp = fopen(pFileName, "wb");
+	if (fd < 0 || !fp) {
+		V2DLOGD("v2d load test setup failed\n");
+		return -1;
+	}
+	for (j=0; j<frames; j++) {
+		memset(pDst, j + 1, frameSize);
+		pDst[frameSize - 1] = j;
+		ret |= (fwrite(pDst, frameSize, 1, fp) != 1);
+	}
+	fclose(fp);
+
+	//what readFile used to do per frame
+	start = nowNs();
+	fp = fopen(pFileName, "rb");
+	for (j=0; fp && j<frames; j++) {
+		ret |= (fread(pDst, frameSize, 1, fp) != 1);
+		stdioSum += pDst[0] + pDst[frameSize - 1];
+	}
+	if (fp) {
+		fclose(fp);
+	}
+	stdioRate = (double)frameSize * frames * 1000.0 / (nowNs() - start);
+
+	setenv("V2D_LOADER", "mmap", 1);
+	mmapRate = v2d_load_pass(pFileName, frameSize, pDst, size, &mmapSum);
+	setenv("V2D_LOADER", "read", 1);
+	readRate = v2d_load_pass(pFileName, frameSize, pDst, size, &readSum);
+	unsetenv("V2D_LOADER");
+	V2DLOGD("stdio: %.0f MB/s, mmap: %.0f MB/s, read: %.0f MB/s\n", stdioRate, mmapRate, readRate);
+	if (!mmapRate || !readRate || mmapSum != stdioSum || readSum != stdioSum) {
+		V2DLOGD("loaded frames differ\n");
+		ret = -1;
+	}
+
+	//a destination smaller than a frame is refused
+	if (!ret && v2d_load_pass(pFileName, frameSize, pDst, frameSize - 1, &sum) != 0) {
+		V2DLOGD("frame loaded into a short buffer\n");
+		ret = -1;
+	}
+	unlink(pFileName);
+	munmap(pDst, size);
+	close(fd);
+	V2DLOGD("v2d load test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//triple buffered streaming, load -> v2d -> write back over rings of buffers
+#define STREAM_SLOTS 3
+struct v2d_stream_queue {
+	int items[STREAM_SLOTS + 1];
+	int head;
+	int count;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+struct v2d_stream_buf {
+	int fd;
+	uint8_t *pAddr;
+	int fence;
+	int in;
+	long long submitNs;
+	long long endNs; //EndJobAsync returned, when a job without a fence was done
+};
+struct v2d_stream {
+	V2D_LOADER_HANDLE hLoader;
+	uint32_t frames;
+	int loops;
+	int outFd;
+	size_t inSize, outSize, inMap, outMap;
+	int sync;
+	struct v2d_stream_buf in[STREAM_SLOTS];
+	struct v2d_stream_buf out[STREAM_SLOTS];
+	struct v2d_stream_queue freeIn, loaded, freeOut, done;
+	//busy time of each stage, every counter is written by one thread
+	long long loadNs, loadSyncNs, submitNs, blockNs, writeNs, writeSyncNs;
+	int loadRet, writeRet;
+};
+static void v2d_stream_queue_init(struct v2d_stream_queue *pQueue)
+{
+	memset(pQueue, 0, sizeof(*pQueue));
+	pthread_mutex_init(&pQueue->lock, NULL);
+	pthread_cond_init(&pQueue->cond, NULL);
+}
+static void v2d_stream_push(struct v2d_stream_queue *pQueue, int item)
+{
+	pthread_mutex_lock(&pQueue->lock);
+	pQueue->items[(pQueue->head + pQueue->count++) % (STREAM_SLOTS + 1)] = item;
+	pthread_cond_signal(&pQueue->cond);
+	pthread_mutex_unlock(&pQueue->lock);
+}
+static int v2d_stream_pop(struct v2d_stream_queue *pQueue)
+{
+	int item;
+
+	pthread_mutex_lock(&pQueue->lock);
+	while (!pQueue->count) {
+		pthread_cond_wait(&pQueue->cond, &pQueue->lock);
+	}
+	item = pQueue->items[pQueue->head];
+	pQueue->head = (pQueue->head + 1) % (STREAM_SLOTS + 1);
+	pQueue->count--;
+	pthread_mutex_unlock(&pQueue->lock);
+	return item;
+}
+//load stage, frames into free input buffers, -1 ends the stream
+static void *v2d_stream_load(void *arg)
+{
+	struct v2d_stream *pStream = (struct v2d_stream *)arg;
+	struct v2d_stream_buf *pBuf;
+	long long start;
+	uint32_t j;
+	int slot;
+
+	for (j=0; j<pStream->frames * pStream->loops && !pStream->loadRet; j++) {
+		slot = v2d_stream_pop(&pStream->freeIn);
+		pBuf = &pStream->in[slot];
+		start = nowNs();
+		if (pStream->sync) {
+			pStream->loadRet |= DmabufHeapCpuSyncStart(bufferAllocator, pBuf->fd, kSyncWrite);
+		}
+		pStream->loadSyncNs += nowNs() - start;
+		start = nowNs();
+		pStream->loadRet |= V2D_LoaderRead(pStream->hLoader, j % pStream->frames, pBuf->pAddr, pStream->inMap);
+		pStream->loadNs += nowNs() - start;
+		start = nowNs();
+		if (pStream->sync) {
+			pStream->loadRet |= DmabufHeapCpuSyncEnd(bufferAllocator, pBuf->fd, kSyncWrite);
+		}
+		pStream->loadSyncNs += nowNs() - start;
+		v2d_stream_push(&pStream->loaded, slot);
+	}
+	v2d_stream_push(&pStream->loaded, -1);
+	return NULL;
+}
+//when a signaled fence signaled, as V2dFenceSignaled reads it, so a slow write back is not taken for block time
+static long long v2d_fence_signal_ns(int fence, long long fallbackNs)
+{
+	struct sync_file_info stInfo;
+	struct sync_fence_info stFence;
+
+	memset(&stInfo, 0, sizeof(stInfo));
+	memset(&stFence, 0, sizeof(stFence));
+	stInfo.num_fences = 1;
+	stInfo.sync_fence_info = (uint64_t)(uintptr_t)&stFence;
+	if (ioctl(fence, SYNC_IOC_FILE_INFO, &stInfo) < 0 || stInfo.status != 1 || !stFence.timestamp_ns) {
+		return fallbackNs;
+	}
+	return (long long)stFence.timestamp_ns;
+}
+//write back stage, waits for the job of each output buffer in submission order
+static void *v2d_stream_write(void *arg)
+{
+	struct v2d_stream *pStream = (struct v2d_stream *)arg;
+	struct v2d_stream_buf *pBuf;
+	struct pollfd stPoll;
+	long long start, signalNs, lastSignalNs = 0;
+	size_t done;
+	ssize_t len;
+	int slot;
+
+	while ((slot = v2d_stream_pop(&pStream->done)) >= 0) {
+		pBuf = &pStream->out[slot];
+		signalNs = pBuf->endNs;
+		if (pBuf->fence >= 0) {
+			stPoll.fd = pBuf->fence;
+			stPoll.events = POLLIN;
+			if (poll(&stPoll, 1, 3000) != 1) {
+				V2DLOGD("stream fence timeout\n");
+				pStream->writeRet = -1;
+			}
+			signalNs = v2d_fence_signal_ns(pBuf->fence, nowNs());
+			close(pBuf->fence);
+		}
+		//the block works through the jobs in order, busy from submission or the previous completion
+		pStream->blockNs += signalNs - (pBuf->submitNs > lastSignalNs ? pBuf->submitNs : lastSignalNs);
+		lastSignalNs = signalNs;
+		v2d_stream_push(&pStream->freeIn, pBuf->in);
+
+		start = nowNs();
+		if (pStream->sync) {
+			pStream->writeRet |= DmabufHeapCpuSyncStart(bufferAllocator, pBuf->fd, kSyncRead);
+		}
+		pStream->writeSyncNs += nowNs() - start;
+		start = nowNs();
+		for (done=0; done<pStream->outSize; done+=len) {
+			len = write(pStream->outFd, pBuf->pAddr + done, pStream->outSize - done);
+			if (len <= 0) {
+				V2DLOGD("stream write failed\n");
+				pStream->writeRet = -1;
+				break;
+			}
+		}
+		pStream->writeNs += nowNs() - start;
+		start = nowNs();
+		if (pStream->sync) {
+			pStream->writeRet |= DmabufHeapCpuSyncEnd(bufferAllocator, pBuf->fd, kSyncRead);
+		}
+		pStream->writeSyncNs += nowNs() - start;
+		v2d_stream_push(&pStream->freeOut, slot);
+	}
+	return NULL;
+}
+static void v2d_stream_surface(V2D_SURFACE_S *pstSurface, int fd, int w, int h, V2D_COLOR_FORMAT_E format)
+{
+	memset(pstSurface, 0, sizeof(V2D_SURFACE_S));
+	pstSurface->fd     = fd;
+	pstSurface->w      = w;
+	pstSurface->h      = h;
+	pstSurface->format = format;
+	if (format == V2D_COLOR_FORMAT_NV12) {
+		pstSurface->stride = w;
+		pstSurface->offset = w * h;
+	} else {
+		pstSurface->stride = w * 4;
+	}
+}
+//raw NV12 frames in, RGBA8888 out or the other way round, with the conversion on the v2d
+int v2d_stream_test(char *pInName, char *pOutName, int w, int h, char *pFormat, int loops)
+{
+	int ret = 0;
+	struct v2d_stream stStream;
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stSrc, stDst;
+	V2D_AREA_S stRect = {0, 0, w, h};
+	V2D_BLEND_CONF_S stBlendConf;
+	V2D_COLOR_FORMAT_E enIn, enOut;
+	V2D_CSC_MODE_E enCsc;
+	struct v2d_stream_buf *pOut;
+	pthread_t loadTid, writeTid;
+	long long start, wall;
+	double occupancy[6];
+	const char *apStage[6] = {"load io", "load sync", "submit", "v2d", "write io", "write sync"};
+	int i, in, slot, busiest = 0, frames = 0;
+
+	V2DLOGD("v2d stream test start, %s -> %s, %dx%d %s, loops:%d\n", pInName, pOutName, w, h, pFormat, loops);
+	memset(&stStream, 0, sizeof(stStream));
+	if (!strcmp(pFormat, "nv12")) {
+		enIn  = V2D_COLOR_FORMAT_NV12;
+		enOut = V2D_COLOR_FORMAT_RGBA8888;
+		enCsc = V2D_CSC_MODE_BT601NARROW_2_RGB;
+		stStream.inSize  = (size_t)w * h * 3 / 2;
+		stStream.outSize = (size_t)w * h * 4;
+	} else if (!strcmp(pFormat, "rgba")) {
+		enIn  = V2D_COLOR_FORMAT_RGBA8888;
+		enOut = V2D_COLOR_FORMAT_NV12;
+		enCsc = V2D_CSC_MODE_RGB_2_BT601NARROW;
+		stStream.inSize  = (size_t)w * h * 4;
+		stStream.outSize = (size_t)w * h * 3 / 2;
+	} else {
+		V2DLOGD("unknown format %s, nv12 or rgba\n", pFormat);
+		return -1;
+	}
+	stStream.loops = loops > 0 ? loops : 1;
+	stStream.inMap  = ALIGN_UP(stStream.inSize, PAGESIZE);
+	stStream.outMap = ALIGN_UP(stStream.outSize, PAGESIZE);
+	if (V2D_LoaderOpen(pInName, stStream.inSize, &stStream.hLoader) ||
+		V2D_LoaderFrames(stStream.hLoader, &stStream.frames)) {
+		return -1;
+	}
+	stStream.outFd = open(pOutName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (stStream.outFd < 0 || V2D_OpenBackend(V2D_BACKEND_AUTO, &hContext)) {
+		V2DLOGD("v2d stream test setup failed\n");
+		return -1;
+	}
+
+	//a blit leaves the colour space alone, the conversion is a blend of the background layer alone
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	stBlendConf.blendlayer[0].blend_area = stRect;
+
+	createAllocator();
+	v2d_stream_queue_init(&stStream.freeIn);
+	v2d_stream_queue_init(&stStream.loaded);
+	v2d_stream_queue_init(&stStream.freeOut);
+	v2d_stream_queue_init(&stStream.done);
+	for (i=0; i<STREAM_SLOTS; i++) {
+		stStream.in[i].fd = v2d_cpu_buffer(stStream.inMap, (void **)&stStream.in[i].pAddr);
+		stStream.out[i].fd = v2d_cpu_buffer(stStream.outMap, (void **)&stStream.out[i].pAddr);
+		if (stStream.in[i].fd < 0 || stStream.out[i].fd < 0) {
+			V2DLOGD("v2d stream buffer alloc failed\n");
+			return -1;
+		}
+		v2d_stream_push(&stStream.freeIn, i);
+		v2d_stream_push(&stStream.freeOut, i);
+	}
+	//memfd stand-ins for a missing dma heap take no cpu syncs
+	stStream.sync = !DmabufHeapCpuSyncStart(bufferAllocator, stStream.in[0].fd, kSyncRead) &&
+					!DmabufHeapCpuSyncEnd(bufferAllocator, stStream.in[0].fd, kSyncRead);
+
+	start = nowNs();
+	pthread_create(&loadTid, NULL, v2d_stream_load, &stStream);
+	pthread_create(&writeTid, NULL, v2d_stream_write, &stStream);
+	while ((in = v2d_stream_pop(&stStream.loaded)) >= 0) {
+		slot = v2d_stream_pop(&stStream.freeOut);
+		pOut = &stStream.out[slot];
+		pOut->in = in;
+		pOut->fence = -1;
+		pOut->submitNs = nowNs();
+		v2d_stream_surface(&stSrc, stStream.in[in].fd, w, h, enIn);
+		v2d_stream_surface(&stDst, pOut->fd, w, h, enOut);
+		ret |= V2D_BeginContextJob(hContext, &hHandle);
+		ret |= V2D_AddBlendTask(hHandle, &stSrc, &stRect, NULL, NULL, NULL, NULL, &stDst, &stRect, &stBlendConf,
+								V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, enCsc, NULL, V2D_NO_DITHER);
+		ret |= V2D_EndJobAsync(hHandle, &pOut->fence);
+		pOut->endNs = nowNs();
+		stStream.submitNs += pOut->endNs - pOut->submitNs;
+		v2d_stream_push(&stStream.done, slot);
+		frames++;
+	}
+	v2d_stream_push(&stStream.done, -1);
+	pthread_join(loadTid, NULL);
+	pthread_join(writeTid, NULL);
+	wall = nowNs() - start;
+	ret |= stStream.loadRet | stStream.writeRet;
+
+	occupancy[0] = stStream.loadNs;
+	occupancy[1] = stStream.loadSyncNs;
+	occupancy[2] = stStream.submitNs;
+	occupancy[3] = stStream.blockNs;
+	occupancy[4] = stStream.writeNs;
+	occupancy[5] = stStream.writeSyncNs;
+	V2DLOGD("%d frames in %lld us, %.1f fps\n", frames, wall / 1000, frames * 1e9 / wall);
+	for (i=0; i<6; i++) {
+		occupancy[i] = occupancy[i] * 100.0 / wall;
+		busiest = occupancy[i] > occupancy[busiest] ? i : busiest;
+		V2DLOGD("  %-10s %5.1f%%\n", apStage[i], occupancy[i]);
+	}
+	V2DLOGD("bottleneck: %s\n", apStage[busiest]);
+
+	for (i=0; i<STREAM_SLOTS; i++) {
+		munmap(stStream.in[i].pAddr, stStream.inMap);
+		munmap(stStream.out[i].pAddr, stStream.outMap);
+		close(stStream.in[i].fd);
+		close(stStream.out[i].fd);
+	}
+	close(stStream.outFd);
+	V2D_LoaderClose(stStream.hLoader);
+	V2D_Close(hContext);
+	V2DLOGD("v2d stream test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//hands the buffers of every job to the allocator, the two access structs share their layout
+static void v2d_sync_hook(const V2D_BUFFER_ACCESS_S *pstAccess, uint32_t count, void *pUserData)
+{
+	DmabufHeapSyncForDevice((BufferAllocator *)pUserData, (const DmabufDeviceAccess *)pstAccess, count);
+}
+//a frame with defensive syncs around every cpu access, cpu writes src, the job blits it to dst, cpu reads dst
+static int v2d_sync_frames(V2D_CONTEXT_HANDLE hContext, V2D_SURFACE_S *pstSrc, V2D_SURFACE_S *pstDst,
+						   uint8_t *pSrc, uint8_t *pDst, unsigned int size, int frames)
+{
+	int ret = 0;
+	V2D_HANDLE hHandle;
+	V2D_AREA_S stRect = {0, 0, pstSrc->w, pstSrc->h};
+	int j, k;
+
+	for (j=0; j<frames && !ret; j++) {
+		ret |= DmabufHeapCpuSyncStart(bufferAllocator, pstSrc->fd, kSyncWrite);
+		memset(pSrc, j, size);
+		ret |= DmabufHeapCpuSyncEnd(bufferAllocator, pstSrc->fd, kSyncWrite);
+		ret |= DmabufHeapCpuSyncStart(bufferAllocator, pstSrc->fd, kSyncRead);
+		ret |= (pSrc[size - 1] != (uint8_t)j);
+		ret |= DmabufHeapCpuSyncEnd(bufferAllocator, pstSrc->fd, kSyncRead);
+
+		ret |= V2D_BeginContextJob(hContext, &hHandle);
+		ret |= V2D_AddBitblitTask(hHandle, pstDst, &stRect, pstSrc, &stRect, V2D_CSC_MODE_BUTT);
+		ret |= V2D_EndJob(hHandle);
+
+		for (k=0; k<2; k++) {
+			ret |= DmabufHeapCpuSyncStart(bufferAllocator, pstDst->fd, kSyncRead);
+			ret |= (pDst[0] != (uint8_t)j || pDst[size - 1] != (uint8_t)j);
+			ret |= DmabufHeapCpuSyncEnd(bufferAllocator, pstDst->fd, kSyncRead);
+		}
+	}
+	return ret;
+}
+//sync ownership tracking, redundant syncs elided and cpu writes cleaned once when a job takes the buffer
+int v2d_sync_test(int frames)
+{
+	int ret = 0;
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_SURFACE_S stSrc, stDst;
+	DmabufSyncStats stBefore, stStats;
+	unsigned int size = 640*480*4;
+	uint8_t *pSrc, *pDst;
+	long long start, plainNs, trackedNs;
+	unsigned long issued;
+	int srcFd, dstFd;
+
+	V2DLOGD("v2d sync test start, frames:%d\n", frames);
+	createAllocator();
+	srcFd = DmabufHeapAllocSystem(bufferAllocator, true, size, 0, 0);
+	dstFd = DmabufHeapAllocSystem(bufferAllocator, true, size, 0, 0);
+	if (srcFd < 0 || dstFd < 0) {
+		V2DLOGD("buffer alloc failed, no dma heap?\n");
+		return -1;
+	}
+	pSrc = DmabufHeapMap(bufferAllocator, srcFd, size);
+	pDst = DmabufHeapMap(bufferAllocator, dstFd, size);
+	ret = V2D_OpenBackend(V2D_BACKEND_AUTO, &hContext);
+	if (ret || !pSrc || !pDst) {
+		V2DLOGD("v2d sync test setup failed\n");
+		return -1;
+	}
+	memset(&stSrc, 0, sizeof(V2D_SURFACE_S));
+	stSrc.fd     = srcFd;
+	stSrc.w      = 640;
+	stSrc.h      = 480;
+	stSrc.stride = 640*4;
+	stSrc.format = V2D_COLOR_FORMAT_RGBA8888;
+	stDst = stSrc;
+	stDst.fd = dstFd;
+
+	//every call an ioctl, 8 per frame
+	DmabufHeapSyncGetStats(bufferAllocator, &stBefore);
+	start = nowNs();
+	ret |= v2d_sync_frames(hContext, &stSrc, &stDst, pSrc, pDst, size, frames);
+	plainNs = (nowNs() - start) / frames;
+	DmabufHeapSyncGetStats(bufferAllocator, &stStats);
+	issued = stStats.issued - stBefore.issued;
+
+	//tracked, an invalidate of dst and a clean of src per frame and the first invalidate of src
+	DmabufHeapSetSyncTracking(bufferAllocator, true);
+	V2D_SetDeviceAccessHook(hContext, v2d_sync_hook, bufferAllocator);
+	stBefore = stStats;
+	start = nowNs();
+	ret |= v2d_sync_frames(hContext, &stSrc, &stDst, pSrc, pDst, size, frames);
+	trackedNs = (nowNs() - start) / frames;
+	DmabufHeapSyncGetStats(bufferAllocator, &stStats);
+	V2D_SetDeviceAccessHook(hContext, NULL, NULL);
+	DmabufHeapSetSyncTracking(bufferAllocator, false);
+
+	V2DLOGD("plain: %lld ns/frame %lu syncs, tracked: %lld ns/frame %lu syncs %lu elided %lu handoffs\n",
+			plainNs, issued, trackedNs, stStats.issued - stBefore.issued,
+			stStats.elided - stBefore.elided, stStats.handoffs - stBefore.handoffs);
+	if (!ret && (issued != 8ul * frames || stStats.issued - stBefore.issued != 2ul * frames + 1 ||
+			stStats.handoffs - stBefore.handoffs != 2ul * frames)) {
+		V2DLOGD("unexpected sync counts\n");
+		ret = -1;
+	}
+
+	V2D_Close(hContext);
+	DmabufHeapUnmap(bufferAllocator, srcFd);
+	DmabufHeapUnmap(bufferAllocator, dstFd);
+	DmabufHeapForgetMapping(bufferAllocator, srcFd);
+	DmabufHeapForgetMapping(bufferAllocator, dstFd);
+	close(srcFd);
+	close(dstFd);
+	V2DLOGD("v2d sync test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//startup warm-up, the first frame on the default context against the ones after it
+int v2d_warmup_test(int frames, int warm)
+{
+	int ret = 0;
+	V2D_HANDLE hHandle;
+	V2D_SURFACE_S stSrc, stDst;
+	V2D_AREA_S stRect;
+	V2D_FILLCOLOR_S stFillColor;
+	DmabufWarmupBuffer astBuffers[2] = {{NULL, 1920*1080*4, 2, 1}, {NULL, 1920*1080*3/2, 2, 0}};
+	DmabufWarmupReport stReport;
+	unsigned int size = 640*480*4;
+	unsigned char *pSrc, *pDst;
+	long long start, first, steady = 0;
+	uint64_t initNs = 0;
+	int srcFd, dstFd, j;
+
+	V2DLOGD("v2d warmup test start, frames:%d warm:%d\n", frames, warm);
+	if (frames < 2) {
+		frames = 2;
+	}
+	//the default context picks its backend from the environment, there is no device here
+	if (!getenv("V2D_BACKEND")) {
+		setenv("V2D_BACKEND", "cpu", 1);
+	}
+	srcFd = v2d_cpu_buffer(size, (void **)&pSrc);
+	dstFd = v2d_cpu_buffer(size, (void **)&pDst);
+	if (srcFd < 0 || dstFd < 0) {
+		V2DLOGD("v2d warmup test buffer alloc failed\n");
+		return -1;
+	}
+	if (warm) {
+		ret = DmabufHeapWarmup(bufferAllocator, astBuffers, 2, &stReport);
+		V2DLOGD("heaps: %lu in %llu ns, %lu buffers %zu bytes in %llu ns, faulted in %llu ns\n",
+				stReport.heaps, stReport.probe_ns, stReport.buffers, stReport.bytes,
+				stReport.alloc_ns, stReport.fault_ns);
+		if (ret && !stReport.heaps) {
+			V2DLOGD("no dma heap, buffers not warmed up\n");
+			ret = 0;
+		}
+		//without a heap the buffers are memfds, fault them in like Warmup does pool buffers
+		memset(pSrc, 0, size);
+		memset(pDst, 0, size);
+		ret |= V2D_Init(0, &initNs);
+		V2DLOGD("V2D_Init: %llu ns\n", (unsigned long long)initNs);
+		if (ret) {
+			V2DLOGD("warm-up failed\n");
+			return -1;
+		}
+	}
+
+	memset(&stSrc, 0, sizeof(V2D_SURFACE_S));
+	stSrc.fd     = srcFd;
+	stSrc.w      = 640;
+	stSrc.h      = 480;
+	stSrc.stride = 640*4;
+	stSrc.format = V2D_COLOR_FORMAT_RGBA8888;
+	stDst = stSrc;
+	stDst.fd = dstFd;
+	stRect.x = 0;
+	stRect.y = 0;
+	stRect.w = 640;
+	stRect.h = 480;
+	stFillColor.format     = V2D_COLOR_FORMAT_RGBA8888;
+	stFillColor.colorvalue = 0xff00ff00;
+
+	//a frame is a fill and a blit, steady state is the best of the frames after the first
+	first = 0;
+	for (j=0; j<frames && !ret; j++) {
+		start = nowNs();
+		ret |= V2D_BeginJob(&hHandle);
+		ret |= V2D_AddFillTask(hHandle, &stSrc, &stRect, &stFillColor);
+		ret |= V2D_AddBitblitTask(hHandle, &stDst, &stRect, &stSrc, &stRect, V2D_CSC_MODE_BUTT);
+		ret |= V2D_EndJob(hHandle);
+		start = nowNs() - start;
+		if (!j) {
+			first = start;
+		} else if (!steady || start < steady) {
+			steady = start;
+		}
+	}
+	V2DLOGD("first frame: %lld ns, steady state: %lld ns\n", first, steady);
+	if (!ret && warm && first > 4 * steady) {
+		V2DLOGD("first frame still pays for the startup\n");
+		ret = -1;
+	}
+	V2DLOGD("v2d warmup test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//job templates, a tiled frame rebuilt task by task against the recorded frame replayed with other buffers,
+//timed against a stand-in device node such as /dev/null so the task execution does not hide the library cost
+#define TEMPLATE_SIZE 128
+#define TEMPLATE_TILE 16
+#define TEMPLATE_TASKS ((TEMPLATE_SIZE / TEMPLATE_TILE) * (TEMPLATE_SIZE / TEMPLATE_TILE))
+static int v2d_template_frame(V2D_HANDLE hHandle, V2D_SURFACE_S *pstSrc, V2D_SURFACE_S *pstDst, V2D_BLEND_CONF_S *pstBlendConf)
+{
+	V2D_AREA_S stRect;
+	int ret = 0;
+	int x, y;
+
+	stRect.w = TEMPLATE_TILE;
+	stRect.h = TEMPLATE_TILE;
+	for (y=0; y<TEMPLATE_SIZE; y+=TEMPLATE_TILE) {
+		for (x=0; x<TEMPLATE_SIZE; x+=TEMPLATE_TILE) {
+			stRect.x = x;
+			stRect.y = y;
+			pstBlendConf->blendlayer[0].blend_area = stRect;
+			ret |= V2D_AddBlendTask(hHandle, pstSrc, &stRect, NULL, NULL, NULL, NULL, pstDst, &stRect, pstBlendConf,
+						V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+		}
+	}
+	return ret;
+}
+//recorded once against the first pair, replays swap the other pair in on odd frames
+static int v2d_template_record(V2D_CONTEXT_HANDLE hContext, V2D_SURFACE_S *pstSrc, V2D_SURFACE_S *pstDst,
+							   V2D_TEMPLATE_BIND_S *pstBind, V2D_TEMPLATE_HANDLE *phTemplate)
+{
+	V2D_HANDLE hHandle;
+	V2D_BLEND_CONF_S stBlendConf;
+	int ret = 0;
+
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	ret |= V2D_BeginContextJob(hContext, &hHandle);
+	ret |= v2d_template_frame(hHandle, &pstSrc[0], &pstDst[0], &stBlendConf);
+	ret |= V2D_RecordTemplate(hHandle, phTemplate);
+	pstBind[0].fd     = pstSrc[0].fd;
+	pstBind[0].newFd  = pstSrc[1].fd;
+	pstBind[0].offset = 0;
+	pstBind[1].fd     = pstDst[0].fd;
+	pstBind[1].newFd  = pstDst[1].fd;
+	pstBind[1].offset = 0;
+	return ret;
+}
+int v2d_template_test(char *pNode, int frames)
+{
+	int ret = 0;
+	V2D_CONTEXT_HANDLE hContext;
+	V2D_HANDLE hHandle;
+	V2D_TEMPLATE_HANDLE hTemplate;
+	V2D_TEMPLATE_BIND_S astBind[2];
+	V2D_SURFACE_S stSrc, astSrc[2], astDst[2];
+	V2D_BLEND_CONF_S stBlendConf;
+	unsigned int size = TEMPLATE_SIZE*TEMPLATE_SIZE*4;
+	unsigned char *apSrc[2], *apDst[2];
+	/* the driver ABI: one V2D_SUBMIT_TASK_S plus the list link per task */
+	size_t taskSize = sizeof(V2D_SUBMIT_TASK_S) + sizeof(void *);
+	struct iovec astIov[TEMPLATE_TASKS];
+	void *pTask;
+	long long start, writeNs, rebuildNs, replayNs;
+	struct pollfd stPoll;
+	int fd, fence = -1;
+	int i, j;
+
+	V2DLOGD("v2d template test start, node:%s frames:%d\n", pNode, frames);
+	if (frames < 1) {
+		frames = 1;
+	}
+	memset(&stSrc, 0, sizeof(V2D_SURFACE_S));
+	stSrc.w      = TEMPLATE_SIZE;
+	stSrc.h      = TEMPLATE_SIZE;
+	stSrc.stride = TEMPLATE_SIZE*4;
+	stSrc.format = V2D_COLOR_FORMAT_RGBA8888;
+	for (i=0; i<2; i++) {
+		astSrc[i] = stSrc;
+		astDst[i] = stSrc;
+		astSrc[i].fd = v2d_cpu_buffer(size, (void **)&apSrc[i]);
+		astDst[i].fd = v2d_cpu_buffer(size, (void **)&apDst[i]);
+		if (astSrc[i].fd < 0 || astDst[i].fd < 0) {
+			V2DLOGD("v2d template test buffer alloc failed\n");
+			return -1;
+		}
+		for (j=0; j<(int)size; j++) {
+			apSrc[i][j] = (unsigned char)(j * (i + 1) + i);
+		}
+	}
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+
+	//the floor: the frame's tasks handed to the node in one writev, nothing built
+	setenv("V2D_DEV_NAME", pNode, 1);
+	fd = open(pNode, O_RDWR|O_CLOEXEC|O_NONBLOCK);
+	pTask = calloc(1, taskSize);
+	if (fd < 0 || !pTask) {
+		V2DLOGD("failed to open %s\n", pNode);
+		free(pTask);
+		return -1;
+	}
+	for (i=0; i<TEMPLATE_TASKS; i++) {
+		astIov[i].iov_base = pTask;
+		astIov[i].iov_len  = taskSize;
+	}
+	start = nowNs();
+	for (j=0; j<frames; j++) {
+		if (writev(fd, astIov, TEMPLATE_TASKS) != (ssize_t)(taskSize * TEMPLATE_TASKS)) {
+			ret = -1;
+		}
+	}
+	writeNs = (nowNs() - start) / frames;
+	close(fd);
+	free(pTask);
+
+	ret |= V2D_OpenBackend(V2D_BACKEND_DEVICE, &hContext);
+	if (ret) {
+		V2DLOGD("V2D_OpenBackend err\n");
+		return ret;
+	}
+	//every frame through the V2D_AddBlendTask argument list
+	start = nowNs();
+	for (j=0; j<frames && !ret; j++) {
+		ret |= V2D_BeginContextJob(hContext, &hHandle);
+		ret |= v2d_template_frame(hHandle, &astSrc[j & 1], &astDst[j & 1], &stBlendConf);
+		ret |= V2D_EndJob(hHandle);
+	}
+	rebuildNs = (nowNs() - start) / frames;
+
+	ret |= v2d_template_record(hContext, astSrc, astDst, astBind, &hTemplate);
+	if (ret) {
+		V2DLOGD("v2d template record failed\n");
+		return -1;
+	}
+	start = nowNs();
+	for (j=0; j<frames && !ret; j++) {
+		ret |= V2D_ReplayTemplate(hContext, hTemplate, astBind, (j & 1) ? 2 : 0, -1, NULL);
+	}
+	replayNs = (nowNs() - start) / frames;
+	V2D_DestroyTemplate(hTemplate);
+	V2D_Close(hContext);
+	V2DLOGD("%d tasks per frame, writev: %lld ns/frame, rebuilt: %lld ns/frame, replayed: %lld ns/frame\n",
+			TEMPLATE_TASKS, writeNs, rebuildNs, replayNs);
+
+	//the replays after the first only patch buffers, both pairs still have to come out right on the cpu
+	ret |= V2D_OpenBackend(V2D_BACKEND_CPU, &hContext);
+	ret |= v2d_template_record(hContext, astSrc, astDst, astBind, &hTemplate);
+	if (ret) {
+		V2DLOGD("v2d template record failed\n");
+		return -1;
+	}
+	for (i=0; i<2 && !ret; i++) {
+		memset(apDst[0], 0, size);
+		memset(apDst[1], 0, size);
+		ret |= V2D_ReplayTemplate(hContext, hTemplate, astBind, i ? 2 : 0, -1, &fence);
+		if (fence >= 0) {
+			stPoll.fd = fence;
+			stPoll.events = POLLIN;
+			ret |= (poll(&stPoll, 1, 3000) != 1);
+			close(fence);
+		}
+		if (memcmp(apDst[i], apSrc[i], size) || apDst[!i][0] || memcmp(apDst[!i], apDst[!i] + 1, size - 1)) {
+			V2DLOGD("replay %d wrote the wrong buffers\n", i);
+			ret = -1;
+		}
+	}
+
+	V2D_DestroyTemplate(hTemplate);
+	V2D_Close(hContext);
+	for (i=0; i<2; i++) {
+		munmap(apSrc[i], size);
+		munmap(apDst[i], size);
+		close(astSrc[i].fd);
+		close(astDst[i].fd);
+	}
+	V2DLOGD("v2d template test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
+//unaligned destination rects, the device alignment emulated on the cpu against the plain cpu backend
+#define ALIGN_W 160
+#define ALIGN_H 120
+static void v2d_align_rect(unsigned int *pSeed, V2D_AREA_S *pRect, int even)
+{
+	pRect->x = rand_r(pSeed) % (ALIGN_W - 2);
+	pRect->y = rand_r(pSeed) % (ALIGN_H - 2);
+	pRect->w = 1 + rand_r(pSeed) % ((ALIGN_W - pRect->x < 64) ? ALIGN_W - pRect->x : 64);
+	pRect->h = 1 + rand_r(pSeed) % ((ALIGN_H - pRect->y < 64) ? ALIGN_H - pRect->y : 64);
+	if (even) {
+		pRect->x &= ~1;
+		pRect->y &= ~1;
+		pRect->w = (pRect->w + 1) & ~1;
+		pRect->h = (pRect->h + 1) & ~1;
+	}
+}
+//fills, blits and blends, some with a background colour or a layer reaching out of dst_rect
+static int v2d_align_job(V2D_CONTEXT_HANDLE hContext, unsigned int seed, V2D_SURFACE_S *pSrc, V2D_SURFACE_S *pOverlay,
+			V2D_SURFACE_S *pDst, V2D_SURFACE_S *pYuvSrc, V2D_SURFACE_S *pYuvDst)
+{
+	V2D_HANDLE hHandle;
+	V2D_AREA_S stRect, stSrcRect, stArea;
+	V2D_FILLCOLOR_S stFillColor;
+	V2D_BLEND_CONF_S stBlendConf;
+	int ret, t;
+
+	ret = V2D_BeginContextJob(hContext, &hHandle);
+	for (t=0; t<8 && !ret; t++) {
+		switch (rand_r(&seed) % 5) {
+		case 0:
+			v2d_align_rect(&seed, &stRect, 0);
+			stFillColor.format = V2D_COLOR_FORMAT_RGBA8888;
+			stFillColor.colorvalue = rand_r(&seed);
+			ret = V2D_AddFillTask(hHandle, pDst, &stRect, &stFillColor);
+			break;
+		case 1:
+			v2d_align_rect(&seed, &stRect, 0);
+			stSrcRect = stRect;
+			stSrcRect.x = rand_r(&seed) % (ALIGN_W - stRect.w + 1);
+			ret = V2D_AddBitblitTask(hHandle, pDst, &stRect, pSrc, &stSrcRect, V2D_CSC_MODE_BUTT);
+			break;
+		case 2:
+			v2d_align_rect(&seed, &stRect, 1);
+			stFillColor.format = V2D_COLOR_FORMAT_RGBA8888;
+			stFillColor.colorvalue = rand_r(&seed);
+			ret = V2D_AddFillTask(hHandle, pYuvDst, &stRect, &stFillColor);
+			ret |= V2D_AddBitblitTask(hHandle, pYuvDst, &stRect, pYuvSrc, &stRect, V2D_CSC_MODE_BUTT);
+			break;
+		default:
+			v2d_align_rect(&seed, &stRect, 0);
+			memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+			stBlendConf.bgcolor.enable = rand_r(&seed) & 1;
+			stBlendConf.bgcolor.fillcolor.format = V2D_COLOR_FORMAT_RGBA8888;
+			stBlendConf.bgcolor.fillcolor.colorvalue = 0x80402010;
+			stBlendConf.blendlayer[0].blend_area = stRect;
+			//the foreground starts up to 8 pixels above and left of dst_rect
+			stArea = stRect;
+			stArea.x -= (stRect.x < 8) ? stRect.x : rand_r(&seed) % 8;
+			stArea.y -= (stRect.y < 8) ? stRect.y : rand_r(&seed) % 8;
+			stArea.w += stRect.x - stArea.x;
+			stArea.h += stRect.y - stArea.y;
+			stSrcRect = stArea;
+			stSrcRect.x = 0;
+			stSrcRect.y = 0;
+			stBlendConf.blendlayer[1].blend_area = stArea;
+			stBlendConf.blendlayer[1].stBlendFactor.srcColorFactor = V2D_BLEND_SRC_ALPHA;
+			stBlendConf.blendlayer[1].stBlendFactor.dstColorFactor = V2D_BLEND_ONE_MINUS_SRC_ALPHA;
+			stBlendConf.blendlayer[1].stBlendFactor.srcAlphaFactor = V2D_BLEND_ONE;
+			stBlendConf.blendlayer[1].stBlendFactor.dstAlphaFactor = V2D_BLEND_ONE_MINUS_SRC_ALPHA;
+			ret = V2D_AddBlendTask(hHandle, pSrc, &stRect, pOverlay, &stSrcRect, NULL, NULL, pDst, &stRect, &stBlendConf,
+						V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+			break;
+		}
+	}
+	ret |= V2D_EndJob(hHandle);
+	return ret;
+}
+//the tasks a job left in the capture file, each a whole dst_rect from the aligned origin with the dst below its layer
+static int v2d_align_capture(int capture, V2D_SURFACE_S *pDst, V2D_AREA_S *pRect, int tasks)
+{
+	/* the driver ABI: one V2D_SUBMIT_TASK_S plus the list link per task */
+	struct { V2D_SUBMIT_TASK_S task; void *pReserved; } stTask;
+	size_t taskSize = sizeof(stTask);
+	off_t end = lseek(capture, 0, SEEK_END);
+	unsigned char *pTasks = malloc(taskSize * tasks);
+	V2D_PARAM_S *pParam;
+	int i, ret = 0;
+
+	if (!pTasks || end < (off_t)(taskSize * tasks) ||
+		pread(capture, pTasks, taskSize * tasks, end - taskSize * tasks) != (ssize_t)(taskSize * tasks)) {
+		free(pTasks);
+		return -1;
+	}
+	for (i=0; i<tasks; i++) {
+		pParam = &((V2D_SUBMIT_TASK_S *)(pTasks + i * taskSize))->param;
+		if ((pParam->dst_rect.x & 15) || (pParam->dst_rect.y & 15) ||
+			pParam->dst_rect.x + pParam->dst_rect.w != pRect->x + pRect->w ||
+			pParam->dst_rect.y + pParam->dst_rect.h != pRect->y + pRect->h ||
+			pParam->layer0.fd != pDst->fd || memcmp(&pParam->l0_rect, &pParam->dst_rect, sizeof(V2D_AREA_S)) ||
+			memcmp(&pParam->blendconf.blendlayer[1].blend_area, pRect, sizeof(V2D_AREA_S)) ||
+			pParam->blendconf.blendlayer[1].stBlendFactor.srcColorFactor != V2D_BLEND_ONE ||
+			pParam->blendconf.blendlayer[1].stBlendFactor.dstColorFactor != V2D_BLEND_ZERO) {
+			V2DLOGD("captured task %d is not folded onto the alignment\n", i);
+			ret = -1;
+		}
+	}
+	free(pTasks);
+	return ret;
+}
+int v2d_align_test(int jobs)
+{
+	int ret = 0;
+	V2D_CONTEXT_HANDLE ahContext[3], hDevice;
+	V2D_HANDLE hHandle;
+	V2D_TEMPLATE_HANDLE hTemplate;
+	V2D_SURFACE_S stSrc, stOverlay, stYuvSrc, astDst[3], astYuvDst[3];
+	V2D_AREA_S stRect;
+	V2D_FILLCOLOR_S stFillColor;
+	V2D_BLEND_CONF_S stBlendConf;
+	V2D_STATS_S stStats;
+	uint64_t fixups;
+	int capture, fence;
+	unsigned int size = ALIGN_W*ALIGN_H*4, yuvSize = ALIGN_W*ALIGN_H*3/2;
+	unsigned char *pSrc, *pOverlay, *pYuvSrc, *apDst[3], *apYuvDst[3];
+	int i, j;
+
+	V2DLOGD("v2d align test start, jobs:%d\n", jobs);
+	//the first context keeps the cpu rules, the second one takes the device alignment and may widen,
+	//the third one takes the device rules as they are, single layer tasks folded and the others split for the host
+	ret = V2D_OpenBackend(V2D_BACKEND_CPU, &ahContext[0]);
+	setenv("V2D_DST_ALIGN", "16", 1);
+	ret |= V2D_OpenBackend(V2D_BACKEND_CPU, &ahContext[1]);
+	setenv("V2D_DST_WIDEN", "0", 1);
+	ret |= V2D_OpenBackend(V2D_BACKEND_CPU, &ahContext[2]);
+	unsetenv("V2D_DST_WIDEN");
+	unsetenv("V2D_DST_ALIGN");
+	if (ret) {
+		V2DLOGD("V2D_OpenBackend err\n");
+		return ret;
+	}
+	memset(&stSrc, 0, sizeof(V2D_SURFACE_S));
+	stSrc.w      = ALIGN_W;
+	stSrc.h      = ALIGN_H;
+	stSrc.stride = ALIGN_W*4;
+	stSrc.format = V2D_COLOR_FORMAT_RGBA8888;
+	stOverlay = stSrc;
+	memset(&stYuvSrc, 0, sizeof(V2D_SURFACE_S));
+	stYuvSrc.w      = ALIGN_W;
+	stYuvSrc.h      = ALIGN_H;
+	stYuvSrc.stride = ALIGN_W;
+	stYuvSrc.offset = ALIGN_W*ALIGN_H;
+	stYuvSrc.format = V2D_COLOR_FORMAT_NV12;
+	stSrc.fd = v2d_cpu_buffer(size, (void **)&pSrc);
+	stOverlay.fd = v2d_cpu_buffer(size, (void **)&pOverlay);
+	stYuvSrc.fd = v2d_cpu_buffer(yuvSize, (void **)&pYuvSrc);
+	for (i=0; i<3; i++) {
+		astDst[i] = stSrc;
+		astYuvDst[i] = stYuvSrc;
+		astDst[i].fd = v2d_cpu_buffer(size, (void **)&apDst[i]);
+		astYuvDst[i].fd = v2d_cpu_buffer(yuvSize, (void **)&apYuvDst[i]);
+		if (stSrc.fd < 0 || stOverlay.fd < 0 || stYuvSrc.fd < 0 || astDst[i].fd < 0 || astYuvDst[i].fd < 0) {
+			V2DLOGD("v2d align test buffer alloc failed\n");
+			return -1;
+		}
+		memset(apDst[i], 0x33, size);
+		memset(apYuvDst[i], 0x66, yuvSize);
+	}
+	for (i=0; i<(int)size; i++) {
+		pSrc[i] = (unsigned char)(i * 13);
+		pOverlay[i] = (unsigned char)(i * 7 + (i >> 8));
+	}
+	for (i=0; i<(int)yuvSize; i++) {
+		pYuvSrc[i] = (unsigned char)(i * 5);
+	}
+	V2D_ResetStats(ahContext[1]);
+	V2D_ResetStats(ahContext[2]);
+
+	for (j=0; j<jobs && !ret; j++) {
+		for (i=0; i<3; i++) {
+			ret |= v2d_align_job(ahContext[i], 1000 + j, &stSrc, &stOverlay, &astDst[i], &stYuvSrc, &astYuvDst[i]);
+		}
+		for (i=1; i<3 && !ret; i++) {
+			if (memcmp(apDst[0], apDst[i], size) || memcmp(apYuvDst[0], apYuvDst[i], yuvSize)) {
+				V2DLOGD("job %d differs with the dst alignment%s\n", j, (i == 2) ? " and no widening" : "");
+				ret = -1;
+			}
+		}
+	}
+	for (i=1; i<3; i++) {
+		if (V2D_GetStats(ahContext[i], &stStats) != SUCCESS) {
+			continue;
+		}
+		V2DLOGD("%s: %lu tasks, %lu widened, %lu with host edges, %lu host pixels\n", (i == 2) ? "no widening" : "widening",
+				stStats.tasks, stStats.widened, stStats.fixups, stStats.fixupPixels);
+		if (!ret && jobs >= 20 && (!stStats.fixups || !stStats.widened)) {
+			V2DLOGD("the random jobs missed a path\n");
+			ret = -1;
+		}
+	}
+
+	//a template staged widened on one context must not be replayed as it is on a context that does not widen
+	memset(&stRect, 0, sizeof(stRect));
+	stRect.x = 3;
+	stRect.y = 5;
+	stRect.w = 40;
+	stRect.h = 40;
+	stFillColor.format = V2D_COLOR_FORMAT_RGBA8888;
+	stFillColor.colorvalue = 0x11223344;
+	memset(&stBlendConf, 0, sizeof(V2D_BLEND_CONF_S));
+	stBlendConf.blendlayer[0].blend_area = stRect;
+	stBlendConf.blendlayer[1].blend_area = stRect;
+	stBlendConf.blendlayer[1].stBlendFactor.srcColorFactor = V2D_BLEND_SRC_ALPHA;
+	stBlendConf.blendlayer[1].stBlendFactor.dstColorFactor = V2D_BLEND_ONE_MINUS_SRC_ALPHA;
+	if (!ret && V2D_GetStats(ahContext[2], &stStats) == SUCCESS) {
+		ret |= V2D_BeginContextJob(ahContext[0], &hHandle);
+		ret |= V2D_AddBlendTask(hHandle, &stSrc, &stRect, &stOverlay, &stRect, NULL, NULL, &astDst[0], &stRect,
+					&stBlendConf, V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+		ret |= V2D_RecordTemplate(hHandle, &hTemplate);
+		ret |= V2D_ReplayTemplate(ahContext[1], hTemplate, NULL, 0, -1, NULL);
+		fixups = stStats.fixups;
+		ret |= V2D_ReplayTemplate(ahContext[2], hTemplate, NULL, 0, -1, NULL);
+		ret |= V2D_GetStats(ahContext[2], &stStats);
+		if (!ret && stStats.fixups != fixups + 1) {
+			V2DLOGD("a replay without widening took the widened task of another context\n");
+			ret = -1;
+		}
+		V2D_DestroyTemplate(hTemplate);
+	}
+
+	//on the device a fill and a blit off the alignment go down whole, folded over a copy of the dst
+	if (!ret && v2d_capture_open(&hDevice, &capture) == 0) {
+		V2D_ResetStats(hDevice);
+		ret |= V2D_BeginContextJob(hDevice, &hHandle);
+		ret |= V2D_AddFillTask(hHandle, &astDst[1], &stRect, &stFillColor);
+		ret |= V2D_AddBitblitTask(hHandle, &astDst[1], &stRect, &stSrc, &stRect, V2D_CSC_MODE_BUTT);
+		ret |= V2D_EndJob(hHandle);
+		if (!ret && (v2d_align_capture(capture, &astDst[1], &stRect, 2) ||
+			V2D_GetStats(hDevice, &stStats) != SUCCESS || stStats.widened != 2 || stStats.fixups)) {
+			V2DLOGD("single layer tasks off the alignment did not go to the device whole\n");
+			ret = -1;
+		}
+
+		//without sw_sync the host edges of a job on the device are left to a caller that waits, never drawn in EndJobAsync
+		for (i=0; i<2; i++) {
+			ret |= V2D_BeginContextJob(hDevice, &hHandle);
+			ret |= V2D_AddBlendTask(hHandle, &stSrc, &stRect, &stOverlay, &stRect, NULL, NULL, &astDst[1], &stRect,
+						&stBlendConf, V2D_ROT_0, V2D_ROT_0, V2D_CSC_MODE_BUTT, V2D_CSC_MODE_BUTT, NULL, V2D_NO_DITHER);
+			if (i) {
+				ret |= V2D_EndJob(hHandle);
+				continue;
+			}
+			fence = -1;
+			if (V2D_EndJobAsync(hHandle, &fence) == SUCCESS) {
+				if (access(SW_SYNC_FILE, R_OK | W_OK) != 0) {
+					V2DLOGD("V2D_EndJobAsync left host edges to the submitting thread without sw_sync\n");
+					ret = -1;
+				}
+				if (fence >= 0) {
+					close(fence);
+				}
+			}
+		}
+		V2D_Close(hDevice);
+		close(capture);
+	}
+
+	for (i=0; i<3; i++) {
+		V2D_Close(ahContext[i]);
+		munmap(apDst[i], size);
+		munmap(apYuvDst[i], yuvSize);
+		close(astDst[i].fd);
+		close(astYuvDst[i].fd);
+	}
+	munmap(pSrc, size);
+	munmap(pOverlay, size);
+	munmap(pYuvSrc, yuvSize);
+	close(stSrc.fd);
+	close(stOverlay.fd);
+	close(stYuvSrc.fd);
+	V2DLOGD("v2d align test %s\n", ret ? "failed!":"successful!");
+	return ret;
+}
 int main(int argc, char** argv)
 {
 	int ret = 0;
@@ -576,6 +3606,27 @@ int main(int argc, char** argv)
 		printf("--blend              blend test case \n");
 		printf("--fill               fill test case \n");
 		printf("--blit               blit test cass \n");
+		printf("--async              async end job test case \n");
+		printf("--fence              acquire fence test case \n");
+		printf("--cpu                cpu reference backend test case \n");
+		printf("--stress node [threads] [jobs]      multi-thread submission test case \n");
+		printf("--bench-submit node [tasks] [jobs]  job submit overhead \n");
+		printf("--bench-cpu [threads] [iters]       cpu backend thread scaling \n");
+		printf("--bench-csc [w] [h] [iters]         host colour conversion throughput \n");
+		printf("--bench-rotate [w] [h] [iters]      host rotation, tiled against naive \n");
+		printf("--fbc-decode [iters]                host fbc decoder against the golden files \n");
+		printf("--fbc-encode [iters]                host fbc encoder and fbcEncInfo on the cpu backend \n");
+		printf("--stats node [tasks] [jobs]         job statistics against a known load \n");
+		printf("--trace file                        chrome trace of cpu backend jobs \n");
+		printf("--pool [frames]                     dmabuf pool against the heap \n");
+		printf("--map [frames]                      cpu mapping cache against mmap per frame \n");
+		printf("--warmup [frames] [warm]            first frame latency with and without warm-up \n");
+		printf("--sync [frames]                     dmabuf sync ownership tracking against plain syncs \n");
+		printf("--load [frames]                     sequence loading, stdio against the loader \n");
+		printf("--stream in out [w h nv12|rgba [loops]]  triple buffered load, convert, write back \n");
+		printf("--template node [frames]            job template replay against rebuilding every frame \n");
+		printf("--align [jobs]                      unaligned dst rects split for the device alignment \n");
+		printf("V2D_BACKEND=device|cpu|auto runs the cases on the given backend \n");
 		return -1;
 	}
 
@@ -594,6 +3645,47 @@ int main(int argc, char** argv)
 		ret = ret = v2d_fill_test();
 	} else if (strcmp(argv[1], "--blit") == 0) {
 		ret = v2d_blit_test();
+	} else if (strcmp(argv[1], "--async") == 0) {
+		ret = v2d_async_test();
+	} else if (strcmp(argv[1], "--fence") == 0) {
+		ret = v2d_fence_test();
+	} else if (strcmp(argv[1], "--cpu") == 0) {
+		ret = v2d_cpu_test();
+	} else if ((argc >= 3) && (strcmp(argv[1], "--stress") == 0)) {
+		ret = v2d_stress_test(argv[2], (argc > 3) ? atoi(argv[3]) : 8, (argc > 4) ? atoi(argv[4]) : 1000);
+	} else if ((argc >= 3) && (strcmp(argv[1], "--bench-submit") == 0)) {
+		ret = v2d_bench_submit(argv[2], (argc > 3) ? atoi(argv[3]) : 32, (argc > 4) ? atoi(argv[4]) : 1000);
+	} else if (strcmp(argv[1], "--bench-cpu") == 0) {
+		ret = v2d_bench_cpu((argc > 2) ? atoi(argv[2]) : 8, (argc > 3) ? atoi(argv[3]) : 10);
+	} else if (strcmp(argv[1], "--bench-csc") == 0) {
+		ret = v2d_bench_csc((argc > 2) ? atoi(argv[2]) : 1920, (argc > 3) ? atoi(argv[3]) : 1080, (argc > 4) ? atoi(argv[4]) : 5);
+	} else if (strcmp(argv[1], "--bench-rotate") == 0) {
+		ret = v2d_bench_rotate((argc > 2) ? atoi(argv[2]) : 3840, (argc > 3) ? atoi(argv[3]) : 2160, (argc > 4) ? atoi(argv[4]) : 3);
+	} else if (strcmp(argv[1], "--fbc-decode") == 0) {
+		ret = v2d_bench_fbc((argc > 2) ? atoi(argv[2]) : 100);
+	} else if (strcmp(argv[1], "--fbc-encode") == 0) {
+		ret = v2d_bench_fbc_encode((argc > 2) ? atoi(argv[2]) : 100);
+	} else if ((argc >= 3) && (strcmp(argv[1], "--stats") == 0)) {
+		ret = v2d_stats_test(argv[2], (argc > 3) ? atoi(argv[3]) : 100, (argc > 4) ? atoi(argv[4]) : 3000);
+	} else if ((argc >= 3) && (strcmp(argv[1], "--trace") == 0)) {
+		ret = v2d_trace_test(argv[2]);
+	} else if (strcmp(argv[1], "--pool") == 0) {
+		ret = v2d_pool_test((argc > 2) ? atoi(argv[2]) : 100);
+	} else if (strcmp(argv[1], "--map") == 0) {
+		ret = v2d_map_test((argc > 2) ? atoi(argv[2]) : 1000);
+	} else if (strcmp(argv[1], "--warmup") == 0) {
+		ret = v2d_warmup_test((argc > 2) ? atoi(argv[2]) : 20, (argc > 3) ? atoi(argv[3]) : 1);
+	} else if (strcmp(argv[1], "--sync") == 0) {
+		ret = v2d_sync_test((argc > 2) ? atoi(argv[2]) : 100);
+	} else if (strcmp(argv[1], "--load") == 0) {
+		ret = v2d_load_test((argc > 2) ? atoi(argv[2]) : 30);
+	} else if ((argc >= 4) && (strcmp(argv[1], "--stream") == 0)) {
+		ret = v2d_stream_test(argv[2], argv[3], (argc > 5) ? atoi(argv[4]) : 320, (argc > 5) ? atoi(argv[5]) : 240,
+							  (argc > 6) ? argv[6] : "nv12", (argc > 7) ? atoi(argv[7]) : 1);
+	} else if ((argc >= 3) && (strcmp(argv[1], "--template") == 0)) {
+		ret = v2d_template_test(argv[2], (argc > 3) ? atoi(argv[3]) : 1000);
+	} else if (strcmp(argv[1], "--align") == 0) {
+		ret = v2d_align_test((argc > 2) ? atoi(argv[2]) : 200);
 	} else if (strcmp(argv[1], "--help") == 0) {
 		printf("spacemit v2d test cases:\n");
 		printf("--rate 204M          default rate 204M \n");
@@ -602,6 +3694,27 @@ int main(int argc, char** argv)
 		printf("--blend              blend test case \n");
 		printf("--fill               fill test case \n");
 		printf("--blit               blit test cass \n");
+		printf("--async              async end job test case \n");
+		printf("--fence              acquire fence test case \n");
+		printf("--cpu                cpu reference backend test case \n");
+		printf("--stress node [threads] [jobs]      multi-thread submission test case \n");
+		printf("--bench-submit node [tasks] [jobs]  job submit overhead \n");
+		printf("--bench-cpu [threads] [iters]       cpu backend thread scaling \n");
+		printf("--bench-csc [w] [h] [iters]         host colour conversion throughput \n");
+		printf("--bench-rotate [w] [h] [iters]      host rotation, tiled against naive \n");
+		printf("--fbc-decode [iters]                host fbc decoder against the golden files \n");
+		printf("--fbc-encode [iters]                host fbc encoder and fbcEncInfo on the cpu backend \n");
+		printf("--stats node [tasks] [jobs]         job statistics against a known load \n");
+		printf("--trace file                        chrome trace of cpu backend jobs \n");
+		printf("--pool [frames]                     dmabuf pool against the heap \n");
+		printf("--map [frames]                      cpu mapping cache against mmap per frame \n");
+		printf("--warmup [frames] [warm]            first frame latency with and without warm-up \n");
+		printf("--sync [frames]                     dmabuf sync ownership tracking against plain syncs \n");
+		printf("--load [frames]                     sequence loading, stdio against the loader \n");
+		printf("--stream in out [w h nv12|rgba [loops]]  triple buffered load, convert, write back \n");
+		printf("--template node [frames]            job template replay against rebuilding every frame \n");
+		printf("--align [jobs]                      unaligned dst rects split for the device alignment \n");
+		printf("V2D_BACKEND=device|cpu|auto runs the cases on the given backend \n");
 	} else {
 		printf("spacemit v2d test case, intput error!\n");
 	}